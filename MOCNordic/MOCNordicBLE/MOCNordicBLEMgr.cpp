@@ -1,8 +1,13 @@
+#define MOCNORDIC_LOG_SUBSYS BLE
 #include <MOCNordic/MOCNordicBLEMgr.h>
 #include <MOCNordic/MOCNordicLogger.h>
 #include <bluetooth/services/hogp.h>
 #include <algorithm>
 #include <MOCNordic/MOCNordicHIDevice.h>
+#include <MOCNordic/MOCNordicTrace.h>
+#include <MOCNordic/MOCNordicScanMgr.h>
+#include <MOCNordic/MOCNordicRecorder.h>
+#include <zephyr/sys/byteorder.h>
 #include <set>
 
 
@@ -11,53 +16,71 @@ LOG_MODULE_REGISTER(MOCNordic, CONFIG_LOG_DEFAULT_LEVEL);
 
 namespace MOCNordic {
 
+namespace {
 
-uint8_t MOCNordicBLEMgr::read_report_map_cb(struct bt_conn *conn, uint8_t err, struct bt_gatt_read_params *params, const void *data, uint16_t length)
-{
-    DEBUG_PRINT("report map length: %d", length);
-    if (err) {
-        DEBUG_PRINT("Report Map read failed (err %d)", err);
-        return BT_GATT_ITER_STOP;
-    }
-    uint8_t index = bt_conn_index(conn);
-    
-    if (!length) {
-        
-        auto &unit = PeripheralSequence[index];
-        DEBUG_PRINT("get total Length: %d", unit.reportMapLength);
-        if(unit.getReportMapCallback) {
-            DEBUG_PRINT("registered callback, calling...");
-            unit.getReportMapCallback(unit.getReportMap().data(), unit.reportMapLength);
-        }
-
-        
-        DEBUG_PRINT("Report Map read complete");
-  
-        return BT_GATT_ITER_STOP;
-    }
+K_HEAP_DEFINE(reportMapHeap, CONFIG_MOCNORDIC_REPORT_MAP_POOL_SIZE);
+atomic_t mapBytesUsed;
+atomic_t mapPeakUsed;
+atomic_t mapAllocFailedCnt;
 
-    std::array<uint8_t, 247> rm_buffer;
-    memcpy(rm_buffer.data(), data, length);
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+K_THREAD_STACK_DEFINE(forwardStack, CONFIG_MOCNORDIC_FORWARD_THREAD_STACK_SIZE);
+struct k_thread forwardThreadData;
+#endif
 
-    auto &unit = PeripheralSequence[index];
-    unit.reportMapInsert(rm_buffer.data(), length);
-    DEBUG_PRINT("current Inserted length: %d", unit.reportMapLength);
+} /* namespace */
 
+uint8_t *ReportMapPool::alloc(size_t size)
+{
+    void *map = k_heap_alloc(&reportMapHeap, size, K_NO_WAIT);
+    if(!map) {
+        atomic_inc(&mapAllocFailedCnt);
+        DEBUG_PRINT("no report map buffer for %u bytes (CONFIG_MOCNORDIC_REPORT_MAP_POOL_SIZE %u, %u used)", static_cast<uint32_t>(size),
+            CONFIG_MOCNORDIC_REPORT_MAP_POOL_SIZE, static_cast<uint32_t>(atomic_get(&mapBytesUsed)));
+        return nullptr;
+    }
+    atomic_val_t used = atomic_add(&mapBytesUsed, size) + size;
+    atomic_val_t peak = atomic_get(&mapPeakUsed);
+    while(used > peak && !atomic_cas(&mapPeakUsed, peak, used)) {
+        peak = atomic_get(&mapPeakUsed);
+    }
+    return static_cast<uint8_t *>(map);
+}
 
-    return BT_GATT_ITER_CONTINUE;
+void ReportMapPool::free(uint8_t *map, size_t size)
+{
+    if(!map)
+        return;
+    k_heap_free(&reportMapHeap, map);
+    atomic_sub(&mapBytesUsed, size);
 }
 
+ReportMapPool::Stats ReportMapPool::stats()
+{
+    return Stats {
+        .capacity = CONFIG_MOCNORDIC_REPORT_MAP_POOL_SIZE,
+        .used = static_cast<uint32_t>(atomic_get(&mapBytesUsed)),
+        .peakUsed = static_cast<uint32_t>(atomic_get(&mapPeakUsed)),
+        .allocFailed = static_cast<uint32_t>(atomic_get(&mapAllocFailedCnt)),
+    };
+}
 
 /**
  * @note as https://github.com/zephyrproject-rtos/zephyr/issues/44579 says, subscription better be done after discovery!
- * 
+ * @note only collects handles and prepares the subscriptions, bringUp issues the requests once every HIDS instance is done
  */
 void MOCNordicBLEMgr::dm_discover_completed(struct bt_gatt_dm *dm, void *context)
 {
     auto conn = bt_gatt_dm_conn_get(dm);
-    uint8_t index = bt_conn_index(conn);
+    int slot = slotOf(conn);
+    if(slot < 0) {
+        bt_gatt_dm_data_release(dm);
+        return;
+    }
+    uint8_t index = slot;
 
     DEBUG_PRINT("Service discovery completed, sourceIndex: %d", index);
+    MOC_TRACE(DiscoveryComplete, index, 0);
     const struct bt_gatt_dm_attr *gatt_chrc;
 
     auto &unit = PeripheralSequence[index];
@@ -67,128 +90,319 @@ void MOCNordicBLEMgr::dm_discover_completed(struct bt_gatt_dm *dm, void *context
         const struct bt_gatt_chrc *chrc_val = bt_gatt_dm_attr_chrc_val(gatt_chrc);
         if(!chrc_val)
             break;
-        if (bt_uuid_cmp(chrc_val->uuid, BT_UUID_HIDS_REPORT_MAP) == 0) {
+        if (bt_uuid_cmp(chrc_val->uuid, BT_UUID_HIDS_REPORT_MAP) == 0 && !unit.reportMapHandle) {
             DEBUG_PRINT("found report map......");
-            /* static struct bt_gatt_read_params read_params = {
-                .func = read_report_map_cb,
-                .handle_count = 1,
-                .single = {
-                    .handle = chrc_val->value_handle,
-                    .offset = 0,
-                },
-
-            }; */
-        
-            unit.resetReportMap();
-            unit.reportMapReadParams.func = read_report_map_cb;
-            unit.reportMapReadParams.handle_count = 1;
-            unit.reportMapReadParams.single.handle = chrc_val->value_handle;
-            unit.reportMapReadParams.single.offset = 0;
-        
-
-            
-            /* int err = bt_gatt_read(bt_gatt_dm_conn_get(dm), &read_params);
-            if (err) {
-                DEBUG_PRINT("Report Map read failed (err %d)", err);
-            } */
-
+            unit.reportMapHandle = chrc_val->value_handle;
         }
 
         if (!(chrc_val->properties & (BT_GATT_CHRC_NOTIFY/*  | BT_GATT_CHRC_INDICATE */))) {
+            /* output or feature report, the report reference tells them apart */
+            if(bt_uuid_cmp(chrc_val->uuid, BT_UUID_HIDS_REPORT) == 0 && (chrc_val->properties & BT_GATT_CHRC_WRITE)) {
+                auto ref_desc = bt_gatt_dm_desc_by_uuid(dm, gatt_chrc, BT_UUID_HIDS_REPORT_REF);
+                if(ref_desc && unit.outputCnt < unit.outputs.size() && unit.refCnt < unit.refHandles.size()) {
+                    auto &output = unit.outputs[unit.outputCnt++];
+                    output.valueHandle = chrc_val->value_handle;
+                    output.refHandle = ref_desc->handle;
+                    output.reportId = -1;
+                    output.pending = false;
+                    output.writing = false;
+                    unit.refHandles[unit.refCnt++] = ref_desc->handle;
+                }
+            }
             continue;
         }
 
         
+        if(unit.curSubIndex >= unit.subscribeParams.size()) {
+            DEBUG_PRINT("more than %u notifying characteristics, the rest is not subscribed (CONFIG_MOCNORDIC_SUBSCRIPTIONS)",
+                static_cast<uint32_t>(unit.subscribeParams.size()));
+            break;
+        }
         auto gatt_desc = bt_gatt_dm_desc_by_uuid(dm, gatt_chrc, BT_UUID_HIDS_REPORT_REF);
-        if (gatt_desc) {
+        if (gatt_desc && unit.refCnt < unit.refHandles.size()) {
             DEBUG_PRINT("get hid handle: %02x", gatt_desc->handle);
-            bt_gatt_read_params *param = new bt_gatt_read_params;
-            param->func = [](struct bt_conn *conn, uint8_t err, struct bt_gatt_read_params *params, const void *data, uint16_t length){
-                if (err) {
-                    delete params;
-                    return (uint8_t)BT_GATT_ITER_STOP;
-                }
-                uint8_t index = bt_conn_index(conn);
-                if(length) {
-                    auto reportId = *(reinterpret_cast<const uint8_t *>(data));
-                    registerCharHandleReportIdMap(index, params->single.handle, reportId);
-                    DEBUG_PRINT("registered for reportId: %02x", reportId);
-                }
-                    
-
-                return (uint8_t)BT_GATT_ITER_CONTINUE;
-            };
-            param->handle_count = 1;
-            param->single.handle = gatt_desc->handle;
-
-            param->single.offset = 0;
             registerRefHandleCharHandleMap(index, gatt_desc->handle, chrc_val->value_handle);
-            bt_gatt_read(conn, param);
+            unit.refHandles[unit.refCnt++] = gatt_desc->handle;
         }
        
-        struct bt_gatt_subscribe_params *sub = &unit.subscribeParams[unit.curSubIndex].subscribeParams;
+        struct bt_gatt_subscribe_params *sub = &unit.subscribeParams[unit.curSubIndex].params;
         memset(sub, 0, sizeof(bt_gatt_subscribe_params));
         memset(&unit.subscribeParams[unit.curSubIndex].discoverParams, 0, sizeof(bt_gatt_discover_params));
-        /* auto subscription */
-        sub->ccc_handle = 0x0000;
-        sub->end_handle = 0xffff;
+
+        /* the CCC was discovered with the characteristic, only fall back to auto discovery without it */
+        auto ccc_desc = bt_gatt_dm_desc_by_uuid(dm, gatt_chrc, BT_UUID_GATT_CCC);
+        if(ccc_desc) {
+            sub->ccc_handle = ccc_desc->handle;
+        }
+        else {
+            sub->ccc_handle = 0x0000;
+            sub->end_handle = 0xffff;
+            sub->disc_params = &unit.subscribeParams[unit.curSubIndex].discoverParams;
+        }
+        unit.curSubIndex++;
 
         sub->value_handle = chrc_val->value_handle;
         sub->value = BT_GATT_CCC_NOTIFY;
         sub->notify = notifySubscribe;
-        
-        sub->disc_params = &unit.subscribeParams[unit.curSubIndex++].discoverParams;
 
         atomic_set_bit(sub->flags, BT_GATT_SUBSCRIBE_FLAG_VOLATILE);
-
-        if(bt_gatt_subscribe(unit.conn, sub)) {
-            DEBUG_PRINT("subscribe handle: %d failed.", sub->value_handle);
-
-        }
-        else {
-            DEBUG_PRINT("subscribed: %d", sub->value_handle);
-        }
-       
     }
+
     bt_gatt_dm_data_print(dm);
     bt_gatt_dm_data_release(dm);
     bt_gatt_dm_continue(dm, NULL);
 }
 
+void MOCNordicBLEMgr::linkMilestone(uint8_t index, int32_t &milestone)
+{
+    auto &unit = PeripheralSequence[index];
+    if(milestone >= 0)
+        return;
+    milestone = static_cast<int32_t>(k_uptime_get() - unit.linkTimeMs);
+
+    const auto &timing = unit.timing;
+    if(timing.upgradedMs < 0 || timing.discoveredMs < 0 || timing.refsMs < 0 || timing.subscribedMs < 0 || timing.reportMapMs < 0)
+        return;
+    DEBUG_PRINT("[TEST] link %d ready after %d ms on %u ATT bearers: upgraded %d ms, discovered %d ms, refs %d ms, subscribed %d ms, report map %d ms",
+        index, std::max({timing.discoveredMs, timing.refsMs, timing.subscribedMs, timing.reportMapMs}), unit.bearers,
+        timing.upgradedMs, timing.discoveredMs, timing.refsMs, timing.subscribedMs, timing.reportMapMs);
+}
+
 
 uint8_t MOCNordicBLEMgr::notifySubscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params, const void *data, uint16_t length)
 {   
-    DEBUG_PRINT("get notify from handle: %02x", params->value_handle);
+    DEBUG_TRACE(BLE, "get notify from handle: %02x", params->value_handle);
+
+    int slot = slotOf(conn);
+    if(slot < 0)
+        return BT_GATT_ITER_CONTINUE;
+    uint8_t index = slot;
+    MOC_TRACE(NotifyRx, index, params->value_handle);
 
-    uint8_t index = bt_conn_index(conn);
     auto &unit = PeripheralSequence[index];
-    if (length) {
+    uint32_t now = k_cycle_get_32();
+    if(unit.lastNotifyCyc)
+        MOCNordicScanMgr::recordEventGap(k_cyc_to_us_floor32(now - unit.lastNotifyCyc), unit.connIntervalUs);
+    unit.lastNotifyCyc = now;
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY)
+    /* first report of an idle link, back to the fastest parameters */
+    if(atomic_get(&unit.idle) && atomic_cas(&unit.idle, 1, 0)) {
+        if(unit.profile == LinkProfile::Idle) {
+            unit.wakeCyc = now | 0x01;
+            unit.slowReports = 0;
+        }
+        k_work_submit(&linkPolicyWork);
+    }
+    if(unit.wakeCyc)
+        ++unit.slowReports;
+#endif
+    /* a capture only holds notifications its layout records can replay */
+    if(atomic_test_bit(&unit.bringUpFlags, BringUpDone))
+        MOCNordicRecorder::notification(index, params->value_handle, data, length);
+    ++unit.notifyCnt;
+    if(dispatchNotification(index, params->value_handle, data, length))
+        atomic_inc(&unit.forwardFailCnt);
+    return BT_GATT_ITER_CONTINUE;
+}
+
+MOCNordicBLEMgr::LinkStats MOCNordicBLEMgr::linkStats(uint8_t index)
+{
+    if(index > PeripheralSequence.size() - 1)
+        return LinkStats {LinkState::Free, -1, 0, 0, 0, 0, 0, 0};
+    auto &unit = PeripheralSequence[index];
+    const auto &timing = unit.timing;
+    int32_t readyMs = -1;
+    if(timing.upgradedMs >= 0 && timing.discoveredMs >= 0 && timing.refsMs >= 0 && timing.subscribedMs >= 0 && timing.reportMapMs >= 0)
+        readyMs = std::max({timing.discoveredMs, timing.refsMs, timing.subscribedMs, timing.reportMapMs});
+    return LinkStats {
+        .state = linkState(index),
+        .readyMs = readyMs,
+        .connIntervalUs = unit.connIntervalUs,
+        .notifications = unit.notifyCnt,
+        .forwardFailed = static_cast<uint32_t>(atomic_get(&unit.forwardFailCnt)),
+        .outputWrites = unit.outputWrites,
+        .maxOutputUs = unit.maxOutputUs,
+        .bearers = unit.bearers,
+    };
+}
 
+int MOCNordicBLEMgr::dispatchNotification(uint8_t index, uint16_t valueHandle, const void *data, uint16_t length)
+{
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    return queueNotification(index, valueHandle, data, length);
+#else
+    return forwardNotification(index, valueHandle, data, length);
+#endif
+}
 
-        short response_len = length >= 247 ? (247 - 1) : length;
-        char response[247];
+int MOCNordicBLEMgr::forwardNotification(uint8_t index, uint16_t valueHandle, const void *data, uint16_t length)
+{
+    if(!length || !data)
+        return -EINVAL;
+
+    if(!isForwarding(index))
+        return -ENOENT;
+
+    /* report id and the largest notification the negotiated MTU allows */
+    uint8_t response[1 + Capacity::notifyPayload];
+    int reportId;
+    uint16_t response_len = buildReport(PeripheralSequence[index], valueHandle, data, length, response, reportId);
+    DEBUG_TRACE_HEX(BLE, "notification", data, length);
+    return forwardReport(index, reportId, response, response_len);
+}
 
-        if(unit.subscribed && unit.getNotifyCallback) {
-            /* hid report */
-            auto hidChar = unit.charHandleReportIdMap.find(params->value_handle);
-       
-            if(hidChar != unit.charHandleReportIdMap.end()) {
-                /* reportId */
-                response[0] = hidChar->second;
-                /* report is small, so just ignore the overflow situation... */
-                memcpy(&response[1], data, response_len);
-                ++length;
-            }
-            else {
-                memcpy(response, data, response_len);
-            }
-            DEBUG_PRINT_HEX("notification", data, length);
-            unit.getNotifyCallback((uint8_t *)response, length);
-        }
-            
-        //MOCNordic::MOCNordicHIDevice::writeToDevice(0, reinterpret_cast<uint8_t *>(response), length);
+uint16_t MOCNordicBLEMgr::buildReport(PeripheralUnit &unit, uint16_t valueHandle, const void *data, uint16_t length, uint8_t *report, int &reportId)
+{
+    uint16_t report_len = std::min<uint16_t>(length, Capacity::notifyPayload);
+
+    /* hid report */
+    reportId = unit.handleMap.findReportId(valueHandle);
+
+    if(reportId >= 0) {
+        report[0] = static_cast<uint8_t>(reportId);
+        memcpy(&report[1], data, report_len);
+        ++report_len;
     }
-    return BT_GATT_ITER_CONTINUE;
+    else {
+        memcpy(report, data, report_len);
+    }
+    return report_len;
+}
+
+int MOCNordicBLEMgr::forwardReport(uint8_t index, int reportId, uint8_t *report, uint32_t length)
+{
+    if(!isForwarding(index))
+        return -ENOENT;
+    /* the slot may leave Subscribed after the check, the pointer is read once and stays callable */
+    NotifyForwarder forwarder = PeripheralSequence[index].forwarder;
+    if(!forwarder)
+        return -ENOENT;
+    return forwarder(index, reportId, report, length);
+}
+
+void MOCNordicBLEMgr::priorityInit(uint8_t index)
+{
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    auto &unit = PeripheralSequence[index];
+    /* the stream saw every stored byte, a cut map gives the layout of what was kept */
+    if(!unit.priority.init(unit.mapStream.wakeLayout()))
+        DEBUG_PRINT("link %d has no key or button field, all its reports are bulk", index);
+#endif
+}
+
+void MOCNordicBLEMgr::forwardLanesStart()
+{
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    if(forwardStarted)
+        return;
+    forwardStarted = true;
+    forwardQueue.init(CONFIG_MOCNORDIC_FORWARD_URGENT_BURST);
+    k_tid_t tid = k_thread_create(&forwardThreadData, forwardStack, K_THREAD_STACK_SIZEOF(forwardStack), forwardThread,
+        NULL, NULL, NULL, K_PRIO_COOP(CONFIG_MOCNORDIC_FORWARD_THREAD_PRIO), 0, K_NO_WAIT);
+    /* named so the stack profiler can report it */
+    k_thread_name_set(tid, "MOCForward");
+#endif
+}
+
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+int MOCNordicBLEMgr::queueNotification(uint8_t index, uint16_t valueHandle, const void *data, uint16_t length)
+{
+    if(!length || !data)
+        return -EINVAL;
+
+    if(!isForwarding(index))
+        return -ENOENT;
+    auto queued = forwardQueue.alloc();
+    if(!queued)
+        return -ENOMEM;
+
+    auto &unit = PeripheralSequence[index];
+    int reportId;
+    queued->queuedCyc = k_cycle_get_32();
+    queued->index = index;
+    queued->length = buildReport(unit, valueHandle, data, length, queued->report.data(), reportId);
+    queued->reportId = static_cast<int16_t>(reportId);
+
+    ReportLane lane = unit.priority.classify(reportId, static_cast<const uint8_t *>(data), length);
+    /* the forwarding thread may count down meanwhile, that report is already out of the queue */
+    if(atomic_get(&unit.laneQueued[static_cast<uint8_t>(ReportLane::Bulk)])) {
+        if(lane == ReportLane::Urgent)
+            ++heldCnt;
+        lane = ReportLane::Bulk;
+    }
+    else if(atomic_get(&unit.laneQueued[static_cast<uint8_t>(ReportLane::Urgent)])) {
+        lane = ReportLane::Urgent;
+    }
+    uint8_t laneIndex = static_cast<uint8_t>(lane);
+    atomic_inc(&unit.laneQueued[laneIndex]);
+    ++laneStats[laneIndex].queued;
+    return forwardQueue.put(std::move(queued), laneIndex);
+}
+
+void MOCNordicBLEMgr::forwardThread(void *p1, void *p2, void *p3)
+{
+    while(1) {
+        size_t lane = 0;
+        auto queued = forwardQueue.get(K_FOREVER, &lane);
+        if(!queued)
+            continue;
+
+        auto &unit = PeripheralSequence[queued->index];
+        atomic_dec(&unit.laneQueued[lane]);
+        auto &stats = laneStats[lane];
+        uint32_t waitUs = k_cyc_to_us_floor32(k_cycle_get_32() - queued->queuedCyc);
+        ++stats.forwarded;
+        stats.sumWaitUs += waitUs;
+        stats.maxWaitUs = std::max(stats.maxWaitUs, waitUs);
+
+        DEBUG_TRACE_HEX(BLE, "notification", queued->report.data(), queued->length);
+        if(forwardReport(queued->index, queued->reportId, queued->report.data(), queued->length))
+            atomic_inc(&unit.forwardFailCnt);
+    }
+}
+
+MOCNordicBLEMgr::ForwardStats MOCNordicBLEMgr::forwardStats()
+{
+    auto queue = forwardQueue.stats();
+    return ForwardStats {
+        .lanes = laneStats,
+        .held = heldCnt,
+        .dropped = queue.allocFailed,
+        .starved = queue.starved,
+        .peakQueued = queue.peakUsed,
+    };
+}
+
+void MOCNordicBLEMgr::resetForwardStats()
+{
+    laneStats = {};
+    heldCnt = 0;
+    forwardQueue.resetStats();
+}
+#endif
+
+MOCNordicBLEMgr::NotifyForwarder MOCNordicBLEMgr::pickForwarder(uint8_t index)
+{
+    if(MOCNordicRouter::hasRoute(index))
+        return MOCNordicRouter::forward;
+    if(PeripheralSequence[index].getNotifyCallback)
+        return forwardToCallback;
+    /* the peripheral enumerated the interface of its own index, see interfacesOf() in main */
+    return forwardToOwnInterface;
+}
+
+int MOCNordicBLEMgr::forwardToOwnInterface(uint8_t index, int reportId, uint8_t *data, uint32_t length)
+{
+    return MOCNordicHIDevice::writeToDevice(index, data, length);
+}
+
+int MOCNordicBLEMgr::forwardToCallback(uint8_t index, int reportId, uint8_t *data, uint32_t length)
+{
+    auto &unit = PeripheralSequence[index];
+    if(!unit.getNotifyCallback)
+        return -ENOENT;
+    unit.getNotifyCallback(data, length);
+    return 0;
 }
 
 
@@ -196,7 +410,10 @@ uint8_t MOCNordicBLEMgr::notifySubscribe(struct bt_conn *conn, struct bt_gatt_su
 void MOCNordicBLEMgr::ServiceNotFound(struct bt_conn *conn, void *context) {
     /* discovery done. */
     DEBUG_PRINT("Discovery service all done.");
-    uint8_t index = bt_conn_index(conn);
+    int slot = slotOf(conn);
+    if(slot < 0)
+        return;
+    uint8_t index = slot;
 
     /* we update param until discovery done because timeout would effect discover speed */
     /* update param in the end, otherwise service discovery slow */
@@ -216,33 +433,510 @@ void MOCNordicBLEMgr::ServiceNotFound(struct bt_conn *conn, void *context) {
     
     DEBUG_PRINT("timeoutMs: %d", conn_param.timeout * 10); */
     
+    PeripheralSequence[index].discovered.set(0);
+}
+
+GattTask MOCNordicBLEMgr::bringUp(uint8_t index)
+{
     auto &unit = PeripheralSequence[index];
-    unit.subscribed = 1;
+    k_work_reschedule(&bringUpWorks[index].work, K_MSEC(CONFIG_MOCNORDIC_BRINGUP_TIMEOUT_MS));
+
+    MOC_TRACE(DiscoveryStart, index, 0);
+    unit.discovered.reset();
+    /* HIDS only, no other service is used */
+    int err = bt_gatt_dm_start(unit.conn, IS_ENABLED(CONFIG_MOCNORDIC_HIDS_DISCOVERY) ? BT_UUID_HIDS : NULL, &callbacks.dm_cb, NULL);
+    if(!err)
+        err = co_await unit.discovered;
+    if(err) {
+        DEBUG_PRINT("link %d discovery failed (err %d)", index, err);
+        k_work_cancel_delayable(&bringUpWorks[index].work);
+        co_return err;
+    }
 
-    int err = bt_gatt_read(unit.conn, &unit.reportMapReadParams);
-    if (err) {
-        DEBUG_PRINT("Report Map read failed (err %d)", err);
+    unit.forwarder = pickForwarder(index);
+    if(!transition(index, LinkState::Subscribed))
+        co_return -ECONNABORTED;
+    linkMilestone(index, unit.timing.discoveredMs);
+
+    /* one request at a time per ATT bearer: with EATT the three run in parallel, on one bearer queuing them keeps it busy;
+       the report map is the longest, it goes first */
+#if defined(CONFIG_MOCNORDIC_EATT)
+    unit.bearers = 1 + bt_eatt_count(unit.conn);
+#endif
+    auto [mapErr, refsErr, subscribeErr] = co_await whenAll(readReportMap(index), readReportRefs(index), subscribeAll(index));
+    k_work_cancel_delayable(&bringUpWorks[index].work);
+    if(!mapErr && !refsErr) {
+        atomic_set_bit(&unit.bringUpFlags, BringUpDone);
+        recordLayout(index);
     }
-    
-    unit.linkTimeMs = k_uptime_get() - unit.linkTimeMs;
-    double testTime = static_cast<double>(unit.linkTimeMs) / 1000.0;
-    DEBUG_PRINT("[TEST] total time: %.2fs", testTime);
-    
+    /* bring-up ran at full speed, a link that came up idle or while the host sleeps slows down now */
+    k_work_submit(&linkPolicyWork);
+    if(mapErr || refsErr || subscribeErr) {
+        DEBUG_PRINT("link %d bring-up incomplete: report map %d, refs %d, subscribe %d", index, mapErr, refsErr, subscribeErr);
+    }
+    co_return mapErr ? mapErr : (refsErr ? refsErr : subscribeErr);
+}
 
+GattTask MOCNordicBLEMgr::readReportMap(uint8_t index)
+{
+    auto &unit = PeripheralSequence[index];
+    if(!unit.reportMapHandle) {
+        DEBUG_PRINT("link %d has no report map", index);
+        co_return -ENOENT;
+    }
 
-    
+    unit.resetReportMap();
+    MOC_TRACE(ReportMapStart, index, 0);
+    GattResult result = co_await GattRead(unit.conn, unit.reportMapHandle, [] (void *context, const uint8_t *data, uint16_t length) {
+        auto &unit = *static_cast<PeripheralUnit *>(context);
+        /* parses the chunk while the next one is on air */
+        unit.reportMapInsert(data, length);
+        DEBUG_TRACE(BLE, "current Inserted length: %d", unit.reportMapLength);
+        /* a truncated map is still read to the end so the peripheral sees a normal long read */
+        return true;
+    }, &unit);
+    if(result.err) {
+        DEBUG_PRINT("Report Map read failed (err %d)", result.err);
+        co_return result.err;
+    }
+
+    bool parsed = unit.mapStream.finish();
+    priorityInit(index);
+    auto pool = ReportMapPool::stats();
+    DEBUG_PRINT("get total Length: %d in %u us, %s, pool %u/%u bytes", unit.reportMapLength, result.us,
+        parsed ? "parsed" : "malformed", pool.used, pool.capacity);
+    if(unit.reportMapTruncated) {
+        DEBUG_PRINT("report map %u bytes over CONFIG_MOCNORDIC_REPORT_MAP_SIZE or the pool, truncated", unit.reportMapTruncated);
+    }
+    MOC_TRACE(ReportMapDone, index, unit.reportMapLength);
+    linkMilestone(index, unit.timing.reportMapMs);
+    if(unit.getReportMapCallback) {
+        DEBUG_PRINT("registered callback, calling...");
+        unit.getReportMapCallback(unit.getReportMap(), unit.reportMapLength);
+    }
+    co_return 0;
+}
+
+GattTask MOCNordicBLEMgr::readReportRefs(uint8_t index)
+{
+    auto &unit = PeripheralSequence[index];
+    if(!unit.refCnt) {
+        linkMilestone(index, unit.timing.refsMs);
+        co_return 0;
+    }
+
+    /* report references are fixed 2 bytes, one read multiple returns all of them in order */
+    std::array<uint8_t, 2 * (Capacity::subscriptions + Capacity::outputReports)> refs;
+    GattResult result = {};
+    uint8_t covered = 0;
+    if(unit.refCnt > 1) {
+        GattBuffer buffer(refs.data(), refs.size());
+        result = co_await GattRead(unit.conn, unit.refHandles.data(), unit.refCnt, GattBuffer::sink, &buffer);
+        if(result.err < 0)
+            co_return result.err;
+        if(!result.err) {
+            covered = std::min<uint32_t>(unit.refCnt, buffer.length / 2);
+            for(uint8_t i = 0; i < covered; i++) {
+                registerReportRef(index, unit.refHandles[i], &refs[i * 2], 2);
+            }
+            /* the response is cut at ATT_MTU - 1 */
+            if(covered < unit.refCnt)
+                DEBUG_PRINT("read multiple returned %u of %d references, reading the rest one by one", covered, unit.refCnt);
+        }
+        else {
+            /* read multiple is optional for servers */
+            DEBUG_PRINT("read multiple failed (err %d), reading %d references one by one", result.err, unit.refCnt);
+        }
+    }
+    for(uint8_t i = covered; i < unit.refCnt; i++) {
+        GattBuffer single(refs.data(), 2);
+        result = co_await GattRead(unit.conn, unit.refHandles[i], GattBuffer::sink, &single);
+        if(result.err < 0)
+            break;
+        if(!result.err && single.length) {
+            registerReportRef(index, unit.refHandles[i], refs.data(), single.length);
+        }
+        else if(result.err) {
+            DEBUG_PRINT("report reference %d not read (err %d)", unit.refHandles[i], result.err);
+        }
+    }
+    if(result.err < 0)
+        co_return result.err;
+    linkMilestone(index, unit.timing.refsMs);
+    co_return 0;
+}
+
+void MOCNordicBLEMgr::registerReportRef(uint8_t index, uint16_t refHandle, const uint8_t *ref, uint32_t length)
+{
+    auto &unit = PeripheralSequence[index];
+    for(uint8_t i = 0; i < unit.outputCnt; i++) {
+        auto &output = unit.outputs[i];
+        if(output.refHandle != refHandle)
+            continue;
+        /* feature reports are writable as well, the dongle answers those itself */
+        if(length >= 2 && ref[1] == ReportRefOutput) {
+            output.reportId = ref[0];
+            DEBUG_PRINT("output report %02x at %d", ref[0], output.valueHandle);
+        }
+        return;
+    }
+    registerCharHandleReportIdMap(index, refHandle, ref[0]);
+    DEBUG_PRINT("registered for reportId: %02x", ref[0]);
+}
+
+GattTask MOCNordicBLEMgr::subscribeAll(uint8_t index)
+{
+    auto &unit = PeripheralSequence[index];
+    int ret = 0;
+    for(uint8_t i = 0; i < unit.curSubIndex; i++) {
+        auto &subscription = unit.subscribeParams[i];
+        GattResult result = co_await GattSubscribe(unit.conn, subscription);
+        if(result.err) {
+            DEBUG_PRINT("CCC write of %d failed (err %d)", subscription.params.value_handle, result.err);
+            ret = result.err;
+            /* the link is gone, nothing after this goes through either */
+            if(result.err < 0)
+                co_return ret;
+            continue;
+        }
+        DEBUG_PRINT("subscribed: %d in %u us", subscription.params.value_handle, result.us);
+        MOC_TRACE(Subscribe, index, subscription.params.value_handle);
+    }
+    linkMilestone(index, unit.timing.subscribedMs);
+    co_return ret;
 }
 
+int MOCNordicBLEMgr::writeOutputReport(uint8_t index, uint8_t reportId, const uint8_t *data, uint32_t length)
+{
+    if(!isForwarding(index))
+        return -ENOTCONN;
+    auto &unit = PeripheralSequence[index];
+    uint8_t output = 0;
+    while(output < unit.outputCnt && unit.outputs[output].reportId != reportId)
+        ++output;
+    if(output == unit.outputCnt)
+        return -ENOENT;
+    auto &report = unit.outputs[output];
+    if(length > report.data.size())
+        return -EMSGSIZE;
+
+    k_spinlock_key_t key = k_spin_lock(&outputLock);
+    memcpy(report.data.data(), data, length);
+    report.length = length;
+    if(!report.pending)
+        report.queuedCyc = k_cycle_get_32();
+    report.pending = true;
+    bool start = !report.writing;
+    report.writing = true;
+    k_spin_unlock(&outputLock, key);
+    if(!start)
+        return 0;
+
+    int err = writeOutput(index, output).detach();
+    if(err) {
+        key = k_spin_lock(&outputLock);
+        report.pending = false;
+        report.writing = false;
+        k_spin_unlock(&outputLock, key);
+        DEBUG_PRINT("link %d has no frame for output report %02x", index, reportId);
+    }
+    return err;
+}
+
+GattTask MOCNordicBLEMgr::writeOutput(uint8_t index, uint8_t output)
+{
+    auto &unit = PeripheralSequence[index];
+    auto &report = unit.outputs[output];
+    std::array<uint8_t, Capacity::usbReportSize> data;
+    int ret = 0;
+    while(true) {
+        k_spinlock_key_t key = k_spin_lock(&outputLock);
+        if(!report.pending || !isForwarding(index)) {
+            report.pending = false;
+            report.writing = false;
+            k_spin_unlock(&outputLock, key);
+            co_return ret;
+        }
+        uint16_t length = report.length;
+        uint32_t queuedCyc = report.queuedCyc;
+        memcpy(data.data(), report.data.data(), length);
+        report.pending = false;
+        k_spin_unlock(&outputLock, key);
+
+        /* write request rather than without response, the response is what the latency is measured to */
+        GattResult result = co_await GattWrite(unit.conn, report.valueHandle, data.data(), length);
+        if(result.err) {
+            DEBUG_PRINT("link %d output report %02x write failed (err %d)", index, report.reportId, result.err);
+            ret = result.err;
+            continue;
+        }
+        uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - queuedCyc);
+        ++unit.outputWrites;
+        unit.maxOutputUs = std::max(unit.maxOutputUs, us);
+        MOC_TRACE(OutputWrite, index, report.reportId);
+        DEBUG_TRACE(BLE, "link %d output report %02x on the peripheral %u us after the host sent it, write %u us",
+            index, report.reportId, us, result.us);
+    }
+}
+
+void MOCNordicBLEMgr::recordLayout(uint8_t index)
+{
+    auto &unit = PeripheralSequence[index];
+    MOCNordicRecorder::linkUp(index, unit.connIntervalUs);
+    MOCNordicRecorder::reportMap(index, unit.getReportMap(), unit.reportMapLength);
+    MOCNordicRecorder::reportIds(index, unit.handleMap);
+}
+
+void MOCNordicBLEMgr::recordLayouts()
+{
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+        if(isForwarding(i) && atomic_test_bit(&PeripheralSequence[i].bringUpFlags, BringUpDone))
+            recordLayout(i);
+    }
+}
+
+void MOCNordicBLEMgr::hostPowerChanged(bool suspended)
+{
+    atomic_set(&hostSuspended, suspended);
+    DEBUG_PRINT("host %s, %u links up", suspended ? "suspended" : "resumed", connectedCount());
+    /* usb stack context, the parameter updates go through the work queue */
+    k_work_submit(&linkPolicyWork);
+}
+
+void MOCNordicBLEMgr::linkPolicyApply(struct k_work *work)
+{
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+        /* links still in bring-up are handled when it ends */
+        if(isForwarding(i))
+            applyLinkPolicy(i);
+    }
+}
+
+void MOCNordicBLEMgr::activityCheck(struct k_work *work)
+{
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY)
+    uint32_t now = k_cycle_get_32();
+    bool quiet = false;
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+        auto &unit = PeripheralSequence[i];
+        if(!isForwarding(i) || atomic_get(&unit.idle))
+            continue;
+        /* a link without any report since it came up is quiet as well */
+        uint32_t last = unit.lastNotifyCyc;
+        if(last && k_cyc_to_ms_floor32(now - last) < CONFIG_MOCNORDIC_IDLE_MS)
+            continue;
+        atomic_set(&unit.idle, 1);
+        quiet = true;
+    }
+    if(quiet)
+        k_work_submit(&linkPolicyWork);
+    k_work_reschedule(&activityWork, K_MSEC(CONFIG_MOCNORDIC_IDLE_MS / 2));
+#endif
+}
+
+bool MOCNordicBLEMgr::usesSubrating(uint8_t index)
+{
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY) && defined(CONFIG_BT_SUBRATING)
+    return !PeripheralSequence[index].subrateRefused;
+#else
+    return false;
+#endif
+}
+
+const struct bt_le_conn_param &MOCNordicBLEMgr::connParamFor(uint8_t index, LinkProfile profile)
+{
+    switch(profile) {
+#if defined(CONFIG_MOCNORDIC_SUSPEND_LINK_POLICY)
+    case LinkProfile::Suspended:
+        return suspendConnParam;
+#endif
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY)
+    case LinkProfile::Idle:
+        return usesSubrating(index) ? activeConnParam : idleConnParam;
+#endif
+    default:
+        return activeConnParam;
+    }
+}
+
+void MOCNordicBLEMgr::applyLinkPolicy(uint8_t index)
+{
+    auto &unit = PeripheralSequence[index];
+    struct bt_conn *conn = unit.conn;
+    if(!conn)
+        return;
+
+    LinkProfile profile = LinkProfile::Active;
+#if defined(CONFIG_MOCNORDIC_SUSPEND_LINK_POLICY)
+    if(atomic_get(&hostSuspended))
+        profile = LinkProfile::Suspended;
+#endif
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY)
+    if(profile == LinkProfile::Active && atomic_get(&unit.idle))
+        profile = LinkProfile::Idle;
+#endif
+    if(profile == unit.profile)
+        return;
+
+    const struct bt_le_conn_param &from = connParamFor(index, unit.profile);
+    const struct bt_le_conn_param &to = connParamFor(index, profile);
+    if(&from != &to) {
+        int err = bt_conn_le_param_update(conn, &to);
+        /* -EALREADY: the link already runs with these parameters */
+        if(err && err != -EALREADY) {
+            DEBUG_PRINT("link %d parameter update failed (err %d)", index, err);
+            return;
+        }
+    }
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY) && defined(CONFIG_BT_SUBRATING)
+    if(usesSubrating(index) && (profile == LinkProfile::Idle || unit.profile == LinkProfile::Idle)) {
+        int err = bt_conn_le_subrate_request(conn, profile == LinkProfile::Idle ? &idleSubrate : &activeSubrate);
+        if(err && profile == LinkProfile::Idle) {
+            /* the longer interval next time round */
+            DEBUG_PRINT("link %d subrate request failed (err %d), idling on the interval", index, err);
+            unit.subrateRefused = true;
+            k_work_submit(&linkPolicyWork);
+            return;
+        }
+    }
+#endif
+    if(profile == LinkProfile::Idle)
+        ++unit.idleEntries;
+    unit.profile = profile;
+}
+
+void MOCNordicBLEMgr::wakeDone(uint8_t index)
+{
+    auto &unit = PeripheralSequence[index];
+    uint32_t wakeCyc = unit.wakeCyc;
+    if(!wakeCyc)
+        return;
+    unit.wakeCyc = 0;
+    uint32_t wakeUs = k_cyc_to_us_floor32(k_cycle_get_32() - wakeCyc);
+    unit.maxWakeUs = std::max(unit.maxWakeUs, wakeUs);
+    /* a bt callback, the counters are printed by printSequenceInfo() */
+    MOC_TRACE(LinkFast, index, wakeUs);
+    DEBUG_TRACE(BLE, "link %d fast again %u us after its first report", index, wakeUs);
+}
+
+void MOCNordicBLEMgr::bringUpTimeout(struct k_work *work)
+{
+    auto *linkWork = CONTAINER_OF(k_work_delayable_from_work(work), LinkWork, work);
+    auto &unit = PeripheralSequence[linkWork->index];
+    struct bt_conn *conn = unit.conn;
+    DEBUG_PRINT("link %d bring-up timed out in state %d, disconnecting", linkWork->index, static_cast<uint8_t>(linkState(linkWork->index)));
+    /* the stack fails every outstanding request, the bring-up task then returns on its own */
+    if(conn)
+        bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+}
+
+
+void MOCNordicBLEMgr::linkUpgradeStart(struct bt_conn *conn)
+{
+    int slot = slotOf(conn);
+    if(slot < 0)
+        return;
+    uint8_t index = slot;
+    auto &unit = PeripheralSequence[index];
+
+#if defined(CONFIG_MOCNORDIC_EATT)
+    /* not waited for: the bearers come up during discovery, which only needs the default one */
+    int eattErr = bt_eatt_connect(conn, CONFIG_BT_EATT_MAX);
+    if(eattErr)
+        DEBUG_PRINT("link %d enhanced ATT not requested (err %d), one bearer", index, eattErr);
+#endif
+
+#if defined(CONFIG_MOCNORDIC_LINK_UPGRADE)
+    struct bt_conn_info info;
+    if(bt_conn_get_info(conn, &info))
+        return;
+
+    atomic_set(&unit.upgradePending, BIT(UpgradeMtu) | BIT(UpgradeDataLen) | BIT(UpgradePhy));
+    k_work_reschedule(&upgradeWorks[index].work, K_MSEC(CONFIG_MOCNORDIC_LINK_UPGRADE_TIMEOUT_MS));
+
+    /* the request is queued before discovery, the response arrives long before any long read needs it */
+    unit.mtuParams.func = [](struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params) {
+        DEBUG_PRINT("MTU exchange %s (%u)", err == 0U ? "successful" : "failed", bt_gatt_get_mtu(conn));
+        int slot = slotOf(conn);
+        if(slot >= 0)
+            linkUpgradeDone(slot, UpgradeMtu);
+    };
+    if(bt_gatt_exchange_mtu(conn, &unit.mtuParams))
+        linkUpgradeDone(index, UpgradeMtu);
+
+    /* BT_LE_DATA_LEN_PARAM_MAX and BT_CONN_LE_PHY_PARAM_2M are compound literals, not usable in C++ */
+    static const struct bt_conn_le_data_len_param dataLenMax = {
+        .tx_max_len = BT_GAP_DATA_LEN_MAX,
+        .tx_max_time = BT_GAP_DATA_TIME_MAX,
+    };
+    static const struct bt_conn_le_phy_param phy2M = {
+        .options = BT_CONN_LE_PHY_OPT_NONE,
+        .pref_tx_phy = BT_GAP_LE_PHY_2M,
+        .pref_rx_phy = BT_GAP_LE_PHY_2M,
+    };
+
+    /* the controller only reports a change, skip what is already at max */
+    if(info.le.data_len && info.le.data_len->tx_max_len >= BT_GAP_DATA_LEN_MAX)
+        linkUpgradeDone(index, UpgradeDataLen);
+    else if(bt_conn_le_data_len_update(conn, &dataLenMax))
+        linkUpgradeDone(index, UpgradeDataLen);
+
+    if(info.le.phy && info.le.phy->tx_phy == BT_GAP_LE_PHY_2M && info.le.phy->rx_phy == BT_GAP_LE_PHY_2M)
+        linkUpgradeDone(index, UpgradePhy);
+    else if(bt_conn_le_phy_update(conn, &phy2M))
+        linkUpgradeDone(index, UpgradePhy);
+#else
+    atomic_clear(&unit.upgradePending);
+#endif
+}
+
+void MOCNordicBLEMgr::linkUpgradeDone(uint8_t index, LinkUpgrade step)
+{
+    auto &unit = PeripheralSequence[index];
+    atomic_clear_bit(&unit.upgradePending, step);
+    if(!atomic_get(&unit.upgradePending))
+        discoveryStart(index);
+}
+
+void MOCNordicBLEMgr::linkUpgradeTimeout(struct k_work *work)
+{
+    auto *linkWork = CONTAINER_OF(k_work_delayable_from_work(work), LinkWork, work);
+    auto &unit = PeripheralSequence[linkWork->index];
+    DEBUG_PRINT("link %d upgrade timed out, pending %lx", linkWork->index, atomic_get(&unit.upgradePending));
+    atomic_clear(&unit.upgradePending);
+    discoveryStart(linkWork->index);
+}
+
+void MOCNordicBLEMgr::discoveryStart(uint8_t index)
+{
+    auto &unit = PeripheralSequence[index];
+    if(linkState(index) != LinkState::Secured || !atomic_test_bit(&unit.bringUpFlags, BringUpPaired) || atomic_get(&unit.upgradePending))
+        return;
+    /* pairing, the upgrade callbacks and the timeout all end up here, only one wins */
+    if(!transition(index, LinkState::Discovering))
+        return;
+
+    k_work_cancel_delayable(&upgradeWorks[index].work);
+    linkMilestone(index, unit.timing.upgradedMs);
+    DEBUG_PRINT("link %d discovery starts, mtu %u", index, bt_gatt_get_mtu(unit.conn));
+
+    if(bringUp(index).detach()) {
+        DEBUG_PRINT("link %d has no bring-up frame, disconnecting", index);
+        bt_conn_disconnect(unit.conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+    }
+}
 
 void MOCNordicBLEMgr::BLEStackCallbacksInit()
 {
     callbacks.scan_cb.cb_data = {
         .filter_match = [](struct bt_scan_device_info *device_info, struct bt_scan_filter_match *filter_match, bool connectable) {
             DEBUG_PRINT_HEX("filterMatched", device_info->recv_info->addr->a.val, 6);
+            MOC_TRACE(ScanMatch, traceNoLink, sys_get_le16(device_info->recv_info->addr->a.val));
             int error = bt_scan_stop();
             if(error) {
                 DEBUG_PRINT("bt scan stop failed");
             }
+            MOCNordicScanMgr::connecting();
         },
         .filter_no_match = [] (struct bt_scan_device_info *device_info,bool connectable) {
 
@@ -313,9 +1007,14 @@ void MOCNordicBLEMgr::BLEStackCallbacksInit()
         auto macAddr = bt_conn_get_dst(conn);
         bt_addr_le_to_str(macAddr, addr_str, sizeof(addr_str));
         DEBUG_PRINT("Pairing completed: %s, bonded: %d", addr_str, bonded);
-        bt_gatt_dm_start(conn, NULL, &callbacks.dm_cb, NULL);
         /* bt_scan_filter_remove_all(); */
-        bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+        MOCNordicScanMgr::linkSettled();
+        int slot = slotOf(conn);
+        if(slot < 0)
+            return;
+        MOC_TRACE(PairingComplete, slot, bonded);
+        atomic_set_bit(&PeripheralSequence[slot].bringUpFlags, BringUpPaired);
+        discoveryStart(slot);
         
         
     };
@@ -324,7 +1023,7 @@ void MOCNordicBLEMgr::BLEStackCallbacksInit()
         DEBUG_PRINT("pairing_failed");
         /* bt_scan_filter_remove_all(); */
         /* should start connecting next device */
-        bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+        MOCNordicScanMgr::linkSettled();
 
         char addr_str[BT_ADDR_LE_STR_LEN];
 
@@ -338,7 +1037,9 @@ void MOCNordicBLEMgr::BLEStackCallbacksInit()
     callbacks.dm_cb.completed = dm_discover_completed;
     callbacks.dm_cb.error_found = [] (struct bt_conn *conn, int err, void *context) {
         DEBUG_PRINT("Discovery failed (err %d), %s", err, bt_hci_err_to_str(err));
-        
+        int slot = slotOf(conn);
+        if(slot >= 0)
+            PeripheralSequence[slot].discovered.set(err < 0 ? err : -EIO);
     };
 
     callbacks.dm_cb.service_not_found = ServiceNotFound;
@@ -347,12 +1048,25 @@ void MOCNordicBLEMgr::BLEStackCallbacksInit()
     callbacks.conn_cb.connected = [](struct bt_conn *conn, uint8_t err) {
         if (err) {
             DEBUG_PRINT("Connection failed, err 0x%02x %s", err, bt_hci_err_to_str(err));
+            MOC_TRACE(Connected, traceNoLink, err);
+            MOCNordicScanMgr::linkSettled();
             return;
         }
         char addr_str[BT_ADDR_LE_STR_LEN];
-        uint8_t index = bt_conn_index(conn);
+        int slot = claimSlot(conn);
+        if(slot < 0) {
+            DEBUG_PRINT("no slot for the new link");
+            bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+            MOCNordicScanMgr::linkSettled();
+            return;
+        }
+        uint8_t index = slot;
+        MOC_TRACE(Connected, index, 0);
         PeripheralSequence[index].linkTimeMs = k_uptime_get();
         PeripheralSequence[index].conn = /* bt_conn_ref( */conn/* ) */;
+        struct bt_conn_info info;
+        if(!bt_conn_get_info(conn, &info))
+            PeripheralSequence[index].connIntervalUs = info.le.interval * 1250;
         DEBUG_PRINT("current WorkCnt: %d", currentWorkCnt++);
 
         bt_addr_le_to_str(bt_conn_get_dst(conn), addr_str, sizeof(addr_str));
@@ -361,27 +1075,16 @@ void MOCNordicBLEMgr::BLEStackCallbacksInit()
         
         if (sec_err) {
             DEBUG_PRINT("Failed to set security level (err %d)", sec_err);
-            bt_conn_disconnect(PeripheralSequence[index].conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
-            PeripheralSequence[index].reset();
+            /* the slot is released in disconnected */
+            bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
             /* bt_scan_filter_remove_all(); */
-            bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+            MOCNordicScanMgr::linkSettled();
             /* bt_gatt_dm_start(conn, NULL, &callbacks.dm_cb, NULL);
             struct bt_le_scan_param scan_param = BT_LE_SCAN_PARAM_INIT(BT_LE_SCAN_TYPE_ACTIVE, BT_LE_SCAN_OPT_NONE, BT_GAP_SCAN_FAST_INTERVAL, BT_GAP_SCAN_FAST_WINDOW);
             bt_le_scan_start(&scan_param, NULL); */
         }
         else {
-            /* static struct bt_gatt_exchange_params mtu_exchange_params;
-            mtu_exchange_params.func = [] (struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params) {
-                DEBUG_PRINT("MTU exchange %u %s (%u)", bt_conn_index(conn), err == 0U ? "successful" : "failed", bt_gatt_get_mtu(conn));
-            };
-
-            bt_gatt_exchange_mtu(conn, &mtu_exchange_params); */
-
-            
-            
-
-            
-            
+            /* MTU, data length and PHY are requested once the link is encrypted, see linkUpgradeStart */
         }
         
         
@@ -391,24 +1094,92 @@ void MOCNordicBLEMgr::BLEStackCallbacksInit()
         DEBUG_PRINT("disconnected");
         char addr_str[BT_ADDR_LE_STR_LEN];
         auto macAddr = bt_conn_get_dst(conn);
-        uint8_t index = bt_conn_index(conn);
+        int slot = slotOf(conn);
+        MOC_TRACE(Disconnected, slot < 0 ? traceNoLink : slot, reason);
         bt_addr_le_to_str(macAddr, addr_str, sizeof(addr_str));
 
         DEBUG_PRINT("Disconnected from addr %s (reason %u) %s", addr_str,
             reason, bt_hci_err_to_str(reason));
         
-        disconnectTarget(index);
+	    while(0 != bt_unpair(BT_ID_DEFAULT, macAddr)) {
+            DEBUG_PRINT("unpair failed, try again...");
+        }
+        atomic_clear(&connSlots[bt_conn_index(conn)]);
+        if(slot >= 0) {
+            MOCNordicRecorder::linkDown(slot);
+            /* readers drop out on the state first, the link data is cleared afterwards */
+            transition(slot, LinkState::Targeted);
+            k_work_cancel_delayable(&upgradeWorks[slot].work);
+            k_work_cancel_delayable(&bringUpWorks[slot].work);
+            /* a bring-up still waiting for discovery returns, its GATT requests were already failed by the stack */
+            PeripheralSequence[slot].discovered.set(-ENOTCONN);
+            PeripheralSequence[slot].reset();
+        }
+        MOCNordicScanMgr::targetLost();
+    };
+
+    callbacks.conn_cb.le_param_updated = [](struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout) {
+        int slot = slotOf(conn);
+        DEBUG_PRINT("link %d parameters: interval %u us, latency %u, timeout %u ms", slot, interval * 1250, latency, timeout * 10);
+        if(slot < 0)
+            return;
+        PeripheralSequence[slot].connIntervalUs = interval * 1250;
+        if(interval == activeConnParam.interval_max && !latency)
+            wakeDone(slot);
+    };
+
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY) && defined(CONFIG_BT_SUBRATING)
+    callbacks.conn_cb.subrate_changed = [](struct bt_conn *conn, const struct bt_conn_le_subrate_changed *params) {
+        int slot = slotOf(conn);
+        DEBUG_PRINT("link %d subrate: status %u, factor %u, continuation %u", slot, params->status, params->factor, params->continuation_number);
+        if(slot < 0)
+            return;
+        auto &unit = PeripheralSequence[slot];
+        if(params->status) {
+            /* the peer doesn't support it, idle on the longer interval from now on */
+            unit.subrateRefused = true;
+            if(unit.profile == LinkProfile::Idle)
+                unit.profile = LinkProfile::Active;
+            k_work_submit(&linkPolicyWork);
+            return;
+        }
+        if(params->factor == 1)
+            wakeDone(slot);
+    };
+#endif
+
+#if defined(CONFIG_MOCNORDIC_LINK_UPGRADE)
+    callbacks.conn_cb.le_phy_updated = [](struct bt_conn *conn, struct bt_conn_le_phy_info *param) {
+        DEBUG_PRINT("phy updated, tx %u rx %u", param->tx_phy, param->rx_phy);
+        int slot = slotOf(conn);
+        if(slot >= 0)
+            linkUpgradeDone(slot, UpgradePhy);
     };
 
+    callbacks.conn_cb.le_data_len_updated = [](struct bt_conn *conn, struct bt_conn_le_data_len_info *info) {
+        DEBUG_PRINT("data length updated, tx %u rx %u", info->tx_max_len, info->rx_max_len);
+        int slot = slotOf(conn);
+        if(slot >= 0)
+            linkUpgradeDone(slot, UpgradeDataLen);
+    };
+#endif
+
     callbacks.conn_cb.security_changed = [](struct bt_conn *conn, bt_security_t level, enum bt_security_err err) {
         DEBUG_PRINT("security_changed");
+        int slot = slotOf(conn);
+        MOC_TRACE(SecurityChanged, slot < 0 ? traceNoLink : slot, level | (err << 8));
         char addr_str[BT_ADDR_LE_STR_LEN];
         bt_addr_le_to_str(bt_conn_get_dst(conn), addr_str, sizeof(addr_str));
         
 
         if (!err) {
             DEBUG_PRINT("Security changed: %s level %u", addr_str, level);
-
+            LinkState state = slot >= 0 ? linkState(slot) : LinkState::Free;
+            /* re-encryption of a link past pairing, bring-up already has what it needs */
+            if(state == LinkState::Secured || state == LinkState::Discovering || state == LinkState::Subscribed)
+                DEBUG_PRINT("link %d re-encrypted in state %u", slot, static_cast<uint8_t>(state));
+            else if(slot >= 0 && transition(slot, LinkState::Secured))
+                linkUpgradeStart(conn);
             
         } else {
             DEBUG_PRINT("Security failed: %s level %u err %d", addr_str, level, err);
@@ -423,12 +1194,7 @@ void MOCNordicBLEMgr::BLEStackCallbacksInit()
 int MOCNordicBLEMgr::BLEStackScanInit()
 {
     int err = 0;
-    struct bt_le_conn_param conn_param = {
-        .interval_min = 6, /* Minimum Connection Interval (interval_min * 1.25 ms) */
-        .interval_max = 6, /* Maximum Connection Interval (interval_max * 1.25 ms) */
-        .latency = 0,
-        .timeout = 50, /* Supervision Timeout (timeout * 10 ms) */
-    };
+    struct bt_le_conn_param conn_param = activeConnParam;
     struct bt_le_scan_param scan_param = {
 		.type = BT_LE_SCAN_TYPE_ACTIVE,
 		.options = BT_LE_SCAN_OPT_NONE,
@@ -453,7 +1219,9 @@ int MOCNordicBLEMgr::BLEStackScanInit()
         DEBUG_PRINT("scan filter added failed.");
         return err;
     }
-    return bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+    /* scanning starts with the first target */
+    MOCNordicScanMgr::init();
+    return 0;
 }
 
 int MOCNordicBLEMgr::BLEStackConnInit()
@@ -482,6 +1250,20 @@ int MOCNordicBLEMgr::BLEStackInit()
     int err = 0;
     
     subscribeWorkCtl.init();
+    forwardLanesStart();
+    for(uint8_t i = 0; i < upgradeWorks.size(); i++) {
+        upgradeWorks[i].index = i;
+        k_work_init_delayable(&upgradeWorks[i].work, linkUpgradeTimeout);
+        bringUpWorks[i].index = i;
+        k_work_init_delayable(&bringUpWorks[i].work, bringUpTimeout);
+    }
+    k_work_init(&linkPolicyWork, linkPolicyApply);
+    MOCNordicHIDevice::setPowerHook(hostPowerChanged);
+    MOCNordicHIDevice::setOutputHook(writeOutputReport);
+    k_work_init_delayable(&activityWork, activityCheck);
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY)
+    k_work_schedule(&activityWork, K_MSEC(CONFIG_MOCNORDIC_IDLE_MS / 2));
+#endif
 
 
     /* callbacks must be inited before any stack function */
@@ -517,12 +1299,17 @@ int MOCNordicBLEMgr::BLEStackInit()
 
 int MOCNordicBLEMgr::setScanTarget(uint8_t index, uint8_t *target)
 {
-    if(PeripheralSequence[index].conn) {
+    if(index > PeripheralSequence.size() - 1)
+        return -1;
+    if(linkState(index) >= LinkState::Connected) {
         return -1;
     }
 
     PeripheralSequence[index].reset();
+    PeripheralSequence[index].clearTarget();
     memcpy(&PeripheralSequence[index].targetMac.a.val, target, 6);
+    if(PeripheralSequence[index].empty())
+        transition(index, LinkState::Targeted);
     return 0;
     
 
@@ -531,14 +1318,14 @@ int MOCNordicBLEMgr::setScanTarget(uint8_t index, uint8_t *target)
 
 int MOCNordicBLEMgr::setScanTarget(bt_addr_le_t *target)
 {
-    for(auto &it: PeripheralSequence) {
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+        auto &it = PeripheralSequence[i];
         if(memcmp(it.targetMac.a.val, target->a.val, 6) == 0) {
             return 1;
         }
-        if(it.occupied || it.conn)
+        if(!claim(i, LinkState::Free, LinkState::Targeted))
             continue;
         it.reset();
-        it.occupied = 1;
         memcpy(&it.targetMac, target, sizeof(bt_addr_le_t));
         return 0;
     }
@@ -547,15 +1334,16 @@ int MOCNordicBLEMgr::setScanTarget(bt_addr_le_t *target)
 
 int MOCNordicBLEMgr::setScanTarget(uint8_t *target)
 {
-    for(auto &it: PeripheralSequence) {
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+        auto &it = PeripheralSequence[i];
         if(memcmp(it.targetMac.a.val, target, 6) == 0) {
             return 1;
         }
-        if(it.occupied || it.conn)
+        if(!claim(i, LinkState::Free, LinkState::Targeted))
             continue;
         
         it.reset();
-        it.occupied = 1;
+        it.clearTarget();
         memcpy(&it.targetMac.a.val, target, 6);
         DEBUG_PRINT("emplaced back new mac to vector.");
         return 0;
@@ -573,17 +1361,22 @@ int MOCNordicBLEMgr::setScanTarget(const std::string_view &generalName)
 	}
     else {
         auto index = getAvailableIndex();
+        if(index < 0 || !claim(index, LinkState::Free, LinkState::Targeted)) {
+            DEBUG_PRINT("no free slot for target");
+            return -ENOMEM;
+        }
         PeripheralSequence[index].reset();
-        PeripheralSequence[index].occupied = 1;
+        PeripheralSequence[index].clearTarget();
+        MOCNordicScanMgr::addTarget();
     }
     return err;
 }
 
 int MOCNordicBLEMgr::removeScanTarget(bt_addr_le_t *target)
 {
-    for(auto &it: PeripheralSequence) {
-        if(memcmp(it.targetMac.a.val, target->a.val, BT_ADDR_SIZE) == 0) {
-            it.reset();
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+        if(memcmp(PeripheralSequence[i].targetMac.a.val, target->a.val, BT_ADDR_SIZE) == 0) {
+            removeScanTarget(i);
             DEBUG_PRINT("erased target from vector.");
             return 0;
         }
@@ -595,10 +1388,10 @@ int MOCNordicBLEMgr::removeScanTarget(bt_addr_le_t *target)
 
 int MOCNordicBLEMgr::removeScanTarget(uint8_t *target)
 {
-    for(auto &it: PeripheralSequence) {
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
 
-        if(memcmp(it.targetMac.a.val, target, BT_ADDR_SIZE) == 0) {
-            it.reset();
+        if(memcmp(PeripheralSequence[i].targetMac.a.val, target, BT_ADDR_SIZE) == 0) {
+            removeScanTarget(i);
             DEBUG_PRINT("erased target from vector.");
             return 0;
         }
@@ -610,10 +1403,26 @@ int MOCNordicBLEMgr::removeScanTarget(uint8_t *target)
 void MOCNordicBLEMgr::printSequenceInfo()
 {
     DEBUG_PRINT("----------------SEQINFO-----------------");
-    for(auto &it: PeripheralSequence) {
-
-        DEBUG_PRINT_HEX("MAC", it.targetMac.a.val, 6);
+    for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+        DEBUG_PRINT("slot %d state %d", i, static_cast<uint8_t>(linkState(i)));
+        DEBUG_PRINT_HEX("MAC", PeripheralSequence[i].targetMac.a.val, 6);
+        const auto &unit = PeripheralSequence[i];
+        DEBUG_PRINT("slot %d idle: %u entries, %u reports on the idle parameters, worst wake %u us", i, unit.idleEntries,
+            unit.slowReports, unit.maxWakeUs);
+        DEBUG_PRINT("slot %d output: %u writes, worst %u us, %u ATT bearers", i, unit.outputWrites, unit.maxOutputUs, unit.bearers);
+    }
+    DEBUG_PRINT("invalid transitions: %u", invalidTransitions());
+    auto pool = ReportMapPool::stats();
+    DEBUG_PRINT("report map pool: %u/%u bytes, peak %u, failed %u", pool.used, pool.capacity, pool.peakUsed, pool.allocFailed);
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    auto forward = forwardStats();
+    for(uint8_t i = 0; i < forward.lanes.size(); i++) {
+        const auto &lane = forward.lanes[i];
+        DEBUG_PRINT("%s lane: queued %u, forwarded %u, wait mean %u us, max %u us", i ? "bulk" : "urgent", lane.queued, lane.forwarded,
+            lane.forwarded ? static_cast<uint32_t>(lane.sumWaitUs / lane.forwarded) : 0, lane.maxWaitUs);
     }
+    DEBUG_PRINT("forward queue: peak %u, dropped %u, held %u, starved %u", forward.peakQueued, forward.dropped, forward.held, forward.starved);
+#endif
     DEBUG_PRINT("----------------SEQ END-----------------");
 }
 
@@ -623,7 +1432,21 @@ int MOCNordicBLEMgr::removeScanTarget(uint8_t index)
         DEBUG_PRINT("index doesn't exists.");
         return -1;
     }
-    PeripheralSequence[index].reset();
+    auto &unit = PeripheralSequence[index];
+    struct bt_conn *conn = unit.conn;
+    if(!transition(index, LinkState::Free))
+        return -1;
+    if(conn) {
+        /* disconnected finds no slot for it any more */
+        atomic_clear(&connSlots[bt_conn_index(conn)]);
+        bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+    }
+    k_work_cancel_delayable(&upgradeWorks[index].work);
+    k_work_cancel_delayable(&bringUpWorks[index].work);
+    unit.discovered.set(-ECONNABORTED);
+    unit.reset();
+    unit.clearTarget();
+    MOCNordicScanMgr::removeTarget();
     return 0;
     
 }
@@ -635,13 +1458,67 @@ int MOCNordicBLEMgr::disconnectTarget(uint8_t index)
         return -1;
     }
     /* bt_scan_filter_remove_all(); */
-	while(0 != bt_unpair(BT_ID_DEFAULT, bt_conn_get_dst(PeripheralSequence[index].conn))) {
-        DEBUG_PRINT("unpair failed, try again...");
-    }
+    struct bt_conn *conn = PeripheralSequence[index].conn;
+    if(linkState(index) < LinkState::Connected || !conn)
+        return -ENOTCONN;
 
-    PeripheralSequence[index].reset();
-    return 0;
+    /* unpair and slot release happen in disconnected, the slot stays a target */
+    return bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
     
 }
 
+bool MOCNordicBLEMgr::claim(uint8_t index, LinkState from, LinkState to)
+{
+    return atomic_cas(&PeripheralSequence[index].state, static_cast<atomic_val_t>(from), static_cast<atomic_val_t>(to));
+}
+
+bool MOCNordicBLEMgr::transition(uint8_t index, LinkState to)
+{
+    auto &state = PeripheralSequence[index].state;
+    const uint32_t allowed = allowedFrom(to);
+    while(true) {
+        atomic_val_t current = atomic_get(&state);
+        if(!(allowed & (1u << current))) {
+            atomic_inc(&invalidTransitionCnt);
+            MOC_TRACE(InvalidTransition, index, (current << 8) | static_cast<uint8_t>(to));
+            DEBUG_PRINT("slot %d: invalid transition %ld -> %d", index, current, static_cast<uint8_t>(to));
+            return false;
+        }
+        if(atomic_cas(&state, current, static_cast<atomic_val_t>(to)))
+            return true;
+    }
+}
+
+int MOCNordicBLEMgr::claimSlot(struct bt_conn *conn)
+{
+    const bt_addr_le_t *peer = bt_conn_get_dst(conn);
+    int slot = -1;
+
+    for(uint8_t i = 0; i < PeripheralSequence.size() && slot < 0; i++) {
+        if(memcmp(PeripheralSequence[i].targetMac.a.val, peer->a.val, BT_ADDR_SIZE) == 0
+            && claim(i, LinkState::Targeted, LinkState::Connected))
+            slot = i;
+    }
+    /* name targets have no address until their first link binds them */
+    for(uint8_t i = 0; i < PeripheralSequence.size() && slot < 0; i++) {
+        if(!PeripheralSequence[i].boundTarget() && claim(i, LinkState::Targeted, LinkState::Connected))
+            slot = i;
+    }
+    /* a peer changing its address falls back to any target */
+    for(uint8_t i = 0; i < PeripheralSequence.size() && slot < 0; i++) {
+        if(claim(i, LinkState::Targeted, LinkState::Connected))
+            slot = i;
+    }
+    for(uint8_t i = 0; i < PeripheralSequence.size() && slot < 0; i++) {
+        if(claim(i, LinkState::Free, LinkState::Connected))
+            slot = i;
+    }
+    if(slot < 0)
+        return -1;
+
+    memcpy(&PeripheralSequence[slot].targetMac, peer, sizeof(bt_addr_le_t));
+    atomic_set(&connSlots[bt_conn_index(conn)], slot + 1);
+    return slot;
+}
+
 } /* MOCNordic */
\ No newline at end of file
@@ -0,0 +1,176 @@
+#define MOCNORDIC_LOG_SUBSYS BLE
+#include <MOCNordic/MOCNordicGattTask.h>
+#include <MOCNordic/MOCNordicLogger.h>
+#include <algorithm>
+
+LOG_MODULE_DECLARE(MOCNordic, CONFIG_LOG_DEFAULT_LEVEL);
+
+namespace MOCNordic {
+
+namespace {
+
+K_MEM_SLAB_DEFINE_STATIC(gattFrames, CONFIG_MOCNORDIC_GATT_FRAME_SIZE, CONFIG_MOCNORDIC_GATT_FRAMES, 8);
+atomic_t peakUsedCnt;
+atomic_t allocFailedCnt;
+atomic_t largestFrame;
+
+void atomicMax(atomic_t *target, atomic_val_t value)
+{
+    atomic_val_t current = atomic_get(target);
+    while(value > current && !atomic_cas(target, current, value)) {
+        current = atomic_get(target);
+    }
+}
+
+} /* namespace */
+
+void *GattFramePool::alloc(size_t size)
+{
+    atomicMax(&largestFrame, size);
+    void *frame = nullptr;
+    if(size > CONFIG_MOCNORDIC_GATT_FRAME_SIZE || k_mem_slab_alloc(&gattFrames, &frame, K_NO_WAIT)) {
+        atomic_inc(&allocFailedCnt);
+        DEBUG_PRINT("no gatt task frame for %u bytes (CONFIG_MOCNORDIC_GATT_FRAME_SIZE %u, %u used)", static_cast<uint32_t>(size),
+            CONFIG_MOCNORDIC_GATT_FRAME_SIZE, k_mem_slab_num_used_get(&gattFrames));
+        return nullptr;
+    }
+    atomicMax(&peakUsedCnt, k_mem_slab_num_used_get(&gattFrames));
+    return frame;
+}
+
+void GattFramePool::free(void *frame)
+{
+    k_mem_slab_free(&gattFrames, frame);
+}
+
+GattFramePool::Stats GattFramePool::stats()
+{
+    return Stats {
+        .capacity = CONFIG_MOCNORDIC_GATT_FRAMES,
+        .used = k_mem_slab_num_used_get(&gattFrames),
+        .peakUsed = static_cast<uint32_t>(atomic_get(&peakUsedCnt)),
+        .allocFailed = static_cast<uint32_t>(atomic_get(&allocFailedCnt)),
+        .largestFrame = static_cast<uint32_t>(atomic_get(&largestFrame)),
+    };
+}
+
+GattRead::GattRead(struct bt_conn *conn, uint16_t handle, Sink sink, void *context) : params {}, conn(conn), sink(sink), context(context), op {}, sinkStopped(false)
+{
+    params.func = onRead;
+    params.handle_count = 1;
+    params.single.handle = handle;
+    params.single.offset = 0;
+}
+
+GattRead::GattRead(struct bt_conn *conn, uint16_t *handles, uint8_t count, Sink sink, void *context) : params {}, conn(conn), sink(sink), context(context), op {}, sinkStopped(false)
+{
+    __ASSERT(count >= 2, "read multiple of %u handles, use the single handle read", count);
+    params.func = onRead;
+    if(count < 2) {
+        /* the stack takes handle_count 1 as a single read and reads the union as single, handle 0 is refused by the server */
+        params.handle_count = 1;
+        params.single.handle = count ? handles[0] : 0;
+        params.single.offset = 0;
+        return;
+    }
+    params.handle_count = count;
+    params.multiple.handles = handles;
+    params.multiple.variable = false;
+}
+
+bool GattRead::await_suspend(std::coroutine_handle<> handle)
+{
+    op.start(handle);
+    int err = bt_gatt_read(conn, &params);
+    if(err) {
+        op.waiter = nullptr;
+        op.err = err;
+        return false;
+    }
+    return true;
+}
+
+uint8_t GattRead::onRead(struct bt_conn *conn, uint8_t err, struct bt_gatt_read_params *params, const void *data, uint16_t length)
+{
+    auto *self = CONTAINER_OF(params, GattRead, params);
+    if(err) {
+        self->op.complete(err);
+        return BT_GATT_ITER_STOP;
+    }
+    /* no data ends a long read, read multiple ends the same way after its only response */
+    if(!data) {
+        self->op.complete(0);
+        return BT_GATT_ITER_STOP;
+    }
+    if(self->sinkStopped)
+        return BT_GATT_ITER_STOP;
+    self->op.length += length;
+    if(self->sink && !self->sink(self->context, static_cast<const uint8_t *>(data), length)) {
+        /* the stack calls a read multiple once more without data whatever is returned, the frame has to outlive it */
+        if(params->handle_count > 1) {
+            self->sinkStopped = true;
+            return BT_GATT_ITER_STOP;
+        }
+        self->op.complete(0);
+        return BT_GATT_ITER_STOP;
+    }
+    return BT_GATT_ITER_CONTINUE;
+}
+
+GattWrite::GattWrite(struct bt_conn *conn, uint16_t handle, const void *data, uint16_t length) : params {}, conn(conn), op {}
+{
+    params.func = onWrite;
+    params.handle = handle;
+    params.offset = 0;
+    params.data = data;
+    params.length = length;
+}
+
+bool GattWrite::await_suspend(std::coroutine_handle<> handle)
+{
+    op.start(handle);
+    op.length = params.length;
+    int err = bt_gatt_write(conn, &params);
+    if(err) {
+        op.waiter = nullptr;
+        op.err = err;
+        return false;
+    }
+    return true;
+}
+
+void GattWrite::onWrite(struct bt_conn *conn, uint8_t err, struct bt_gatt_write_params *params)
+{
+    CONTAINER_OF(params, GattWrite, params)->op.complete(err);
+}
+
+bool GattSubscribe::await_suspend(std::coroutine_handle<> handle)
+{
+    subscription.op.start(handle);
+    subscription.params.subscribe = onSubscribed;
+    int err = bt_gatt_subscribe(conn, &subscription.params);
+    if(err) {
+        subscription.op.waiter = nullptr;
+        subscription.op.err = err;
+        return false;
+    }
+    return true;
+}
+
+void GattSubscribe::onSubscribed(struct bt_conn *conn, uint8_t err, struct bt_gatt_subscribe_params *params)
+{
+    /* also called for unsubscribe, nobody waits then */
+    CONTAINER_OF(params, GattSubscription, params)->op.complete(err);
+}
+
+bool GattBuffer::sink(void *context, const uint8_t *data, uint16_t length)
+{
+    auto &buffer = *static_cast<GattBuffer *>(context);
+    uint32_t fits = std::min<uint32_t>(length, buffer.capacity - buffer.length);
+    memcpy(buffer.data + buffer.length, data, fits);
+    buffer.length += fits;
+    buffer.dropped += length - fits;
+    return true;
+}
+
+} /* MOCNordic */
@@ -0,0 +1,171 @@
+#define MOCNORDIC_LOG_SUBSYS BLE
+#include <MOCNordic/MOCNordicScanMgr.h>
+#include <MOCNordic/MOCNordicBLEMgr.h>
+#include <MOCNordic/MOCNordicLogger.h>
+#include <MOCNordic/MOCNordicTrace.h>
+#include <bluetooth/scan.h>
+
+LOG_MODULE_DECLARE(MOCNordic, CONFIG_LOG_DEFAULT_LEVEL);
+
+namespace MOCNordic {
+
+void MOCNordicScanMgr::init()
+{
+    k_work_init_delayable(&work, update);
+    memset(&stats, 0, sizeof(stats));
+    stats.phase = Phase::Stopped;
+    phase = Phase::Stopped;
+    atomic_clear(&running);
+    atomic_set(&restartFlag, 1);
+}
+
+void MOCNordicScanMgr::addTarget()
+{
+    atomic_set(&restartFlag, 1);
+    k_work_reschedule(&work, K_NO_WAIT);
+}
+
+void MOCNordicScanMgr::removeTarget()
+{
+    atomic_set(&restartFlag, 1);
+    k_work_reschedule(&work, K_NO_WAIT);
+}
+
+void MOCNordicScanMgr::connecting()
+{
+    atomic_set(&connectingFlag, 1);
+    k_work_reschedule(&work, K_NO_WAIT);
+}
+
+void MOCNordicScanMgr::linkSettled()
+{
+    atomic_clear(&connectingFlag);
+    k_work_reschedule(&work, K_NO_WAIT);
+}
+
+void MOCNordicScanMgr::targetLost()
+{
+    k_work_reschedule(&work, K_NO_WAIT);
+}
+
+uint32_t MOCNordicScanMgr::missingTargets()
+{
+    return MOCNordicBLEMgr::targetedCount();
+}
+
+void MOCNordicScanMgr::update(struct k_work *)
+{
+    uint32_t missing = missingTargets();
+    int64_t now = k_uptime_get();
+
+    if(atomic_clear(&restartFlag)) {
+        /* links already up keep most of their connection events, start below full duty */
+        step = MOCNordicBLEMgr::connectedCount() ? Phase::Reduced : Phase::Fast;
+        stepStartMs = now;
+    }
+    /* the schedule runs on while the scanner is off, a link that keeps dropping doesn't get full duty every time */
+    while(phaseParams[static_cast<uint8_t>(step)].durationMs
+        && now - stepStartMs >= phaseParams[static_cast<uint8_t>(step)].durationMs) {
+        stepStartMs += phaseParams[static_cast<uint8_t>(step)].durationMs;
+        step = static_cast<Phase>(static_cast<uint8_t>(step) + 1);
+    }
+
+    if(!missing || atomic_get(&connectingFlag)) {
+        apply(Phase::Stopped);
+        return;
+    }
+
+    apply(step);
+
+    const PhaseParam &param = phaseParams[static_cast<uint8_t>(step)];
+    if(param.durationMs) {
+        int64_t left = param.durationMs - (now - stepStartMs);
+        k_work_reschedule(&work, K_MSEC(left > 0 ? left : 0));
+    }
+}
+
+void MOCNordicScanMgr::account()
+{
+    int64_t now = k_uptime_get();
+    if(atomic_get(&running)) {
+        uint32_t elapsed = static_cast<uint32_t>(now - segmentStartMs);
+        stats.activeMs += elapsed;
+        stats.airMs += elapsed * stats.dutyPermille / 1000;
+    }
+    segmentStartMs = now;
+}
+
+void MOCNordicScanMgr::apply(Phase next)
+{
+    bool isRunning = atomic_get(&running);
+    if(next == phase && (isRunning || next == Phase::Stopped))
+        return;
+
+    account();
+
+    if(next == Phase::Stopped) {
+        if(isRunning)
+            bt_scan_stop();
+        atomic_clear(&running);
+        phase = next;
+        stats.phase = next;
+        stats.dutyPermille = 0;
+        MOC_TRACE(ScanDuty, traceNoLink, 0);
+        DEBUG_PRINT_LEVEL(BLE, INF, "scan stopped, %u targets up", MOCNordicBLEMgr::connectedCount());
+        return;
+    }
+
+    const PhaseParam &param = phaseParams[static_cast<uint8_t>(next)];
+    struct bt_le_scan_param scanParam = {
+        .type = param.type,
+        .options = BT_LE_SCAN_OPT_NONE,
+        .interval = param.interval,
+        .window = param.window,
+    };
+    /* stops a running scan */
+    bt_scan_params_set(&scanParam);
+    int err = bt_scan_start(param.type == BT_LE_SCAN_TYPE_PASSIVE ? BT_SCAN_TYPE_SCAN_PASSIVE : BT_SCAN_TYPE_SCAN_ACTIVE);
+    if(err) {
+        DEBUG_PRINT("scan start failed (err %d)", err);
+        atomic_clear(&running);
+        phase = Phase::Stopped;
+        stats.phase = Phase::Stopped;
+        stats.dutyPermille = 0;
+        return;
+    }
+
+    atomic_set(&running, 1);
+    ++stats.starts;
+    phase = next;
+    stats.phase = next;
+    stats.dutyPermille = param.dutyPermille();
+    MOC_TRACE(ScanDuty, traceNoLink, stats.dutyPermille);
+    DEBUG_PRINT_LEVEL(BLE, INF, "scan phase %u, duty %u permille, %u targets missing",
+        static_cast<uint8_t>(next), stats.dutyPermille, missingTargets());
+}
+
+MOCNordicScanMgr::ScanStats MOCNordicScanMgr::getStats()
+{
+    ScanStats ret = stats;
+    if(atomic_get(&running)) {
+        uint32_t elapsed = static_cast<uint32_t>(k_uptime_get() - segmentStartMs);
+        ret.activeMs += elapsed;
+        ret.airMs += elapsed * ret.dutyPermille / 1000;
+    }
+    return ret;
+}
+
+void MOCNordicScanMgr::printStats()
+{
+    ScanStats current = getStats();
+    auto latePermille = [](const EventGaps &gaps) {
+        return gaps.gaps ? gaps.late * 1000 / gaps.gaps : 0;
+    };
+    DEBUG_PRINT("scan phase %u, duty %u, starts %u, active %u ms, air %u ms",
+        static_cast<uint8_t>(current.phase), current.dutyPermille, current.starts, current.activeMs, current.airMs);
+    DEBUG_PRINT("late connection events: scanning %u/%u (%u permille), idle %u/%u (%u permille)",
+        current.scanning.late, current.scanning.gaps, latePermille(current.scanning),
+        current.idle.late, current.idle.gaps, latePermille(current.idle));
+}
+
+} /* MOCNordic */
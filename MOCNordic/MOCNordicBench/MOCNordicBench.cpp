@@ -0,0 +1,849 @@
+#include <MOCNordic/MOCNordicBench.h>
+#include <MOCNordic/MOCNordicBLEMgr.h>
+#include <MOCNordic/MOCNordicHIDevice.h>
+#include <MOCNordic/MOCNordicRouter.h>
+#include <MOCNordic/MOCNordicLogger.h>
+#include <MOCNordic/MOCNordicProfiler.h>
+#include <MOCNordic/MOCNordicRecorder.h>
+
+#if defined(CONFIG_ARCH_POSIX) && defined(CONFIG_EXTERNAL_LIBC)
+#include <time.h>
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_REPLAY)
+#include <cstdio>
+#include <cstdlib>
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_BSIM) && defined(CONFIG_EXTERNAL_LIBC)
+#include <cstdlib>
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_PRIORITY)
+#include <zephyr/sys/byteorder.h>
+#include <ReportMaps.h>
+#endif
+
+LOG_MODULE_DECLARE(MOCNordic, CONFIG_LOG_DEFAULT_LEVEL);
+
+namespace MOCNordic {
+
+namespace {
+
+constexpr uint8_t benchReportId = 0x01;
+constexpr uint32_t peripheralCnt = CONFIG_MOCNORDIC_BENCH_PERIPHERALS;
+
+/* every peripheral gets one characteristic with a report reference and one without */
+constexpr uint16_t reportCharHandle(uint8_t index)
+{
+    return 0x0020 + index * 0x10;
+}
+
+constexpr uint16_t reportRefHandle(uint8_t index)
+{
+    return reportCharHandle(index) + 2;
+}
+
+constexpr uint16_t rawCharHandle(uint8_t index)
+{
+    return reportCharHandle(index) + 4;
+}
+
+struct EndpointSlot {
+    atomic_t busy;
+    uint64_t queuedAtUs;
+    /* reports this interface completed */
+    atomic_t delivered;
+};
+
+/* a replayed capture may use every peripheral slot */
+std::array<EndpointSlot, Capacity::peripherals> endpoints;
+
+BenchSamples<CONFIG_MOCNORDIC_BENCH_SAMPLES> dispatchNs;
+BenchSamples<CONFIG_MOCNORDIC_BENCH_SAMPLES> endpointAgeUs;
+
+struct {
+    uint32_t injected;
+    uint32_t forwarded;
+    atomic_t delivered;
+    uint32_t notRouted;
+    uint32_t endpointBusy;
+} counters;
+
+uint64_t injectStartNs;
+
+struct k_timer frameTimer;
+
+uint64_t uptimeUs()
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/* emulated interrupt IN endpoint, one report per interface per frame */
+int endpointWrite(uint8_t index, const uint8_t *data, uint32_t length)
+{
+    /* notification in -> endpoint, report id lookup, route and class stage included;
+       released reports are written at the frame start, "release" has their age instead */
+    if(!IS_ENABLED(CONFIG_MOCNORDIC_FRAME_RELEASE))
+        dispatchNs.add(static_cast<uint32_t>(MOCNordicBench::nowNs() - injectStartNs));
+    if(index >= endpoints.size())
+        return -EINVAL;
+
+    if(!atomic_cas(&endpoints[index].busy, 0, 1))
+        return -EAGAIN;
+
+    endpoints[index].queuedAtUs = uptimeUs();
+    return 0;
+}
+
+/* frame start, then the poll of every interface right after it */
+void frameExpired(struct k_timer *timer)
+{
+    MOCNordicHIDevice::startOfFrame();
+    uint64_t now = uptimeUs();
+    for(uint8_t i = 0; i < endpoints.size(); i++) {
+        auto &it = endpoints[i];
+        if(atomic_get(&it.busy)) {
+            endpointAgeUs.add(static_cast<uint32_t>(now - it.queuedAtUs));
+            atomic_inc(&counters.delivered);
+            atomic_inc(&it.delivered);
+            atomic_clear(&it.busy);
+            MOCNordicHIDevice::endpointPolled(i);
+        }
+    }
+}
+
+/* prints "release":{...} for the first count interfaces without a trailing separator, the age is class stage to poll */
+void printRelease(uint32_t count)
+{
+    PollAge total = {};
+    uint32_t coalesced = 0;
+    uint32_t overflows = 0;
+    uint32_t busyFrames = 0;
+    uint32_t dropped = 0;
+    uint32_t maxDepth = 0;
+    auto mean = [] (const PollAge &age) {
+        return age.polled ? static_cast<double>(age.sumUs) / age.polled : 0.0;
+    };
+    /* us², the jitter of the age at poll */
+    auto variance = [&mean] (const PollAge &age) {
+        return age.polled ? static_cast<double>(age.squareSumUs) / age.polled - mean(age) * mean(age) : 0.0;
+    };
+
+    printk("\"release\":{\"mode\":\"%s\",\"depth\":%u,\"interfaces\":[", IS_ENABLED(CONFIG_MOCNORDIC_FRAME_RELEASE) ? "frame" : "immediate",
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+        CONFIG_MOCNORDIC_FRAME_RELEASE_DEPTH
+#else
+        0
+#endif
+        );
+    for(uint8_t i = 0; i < count; i++) {
+        MOCNordicHIDevice::ReleaseStats stats = MOCNordicHIDevice::releaseStats(i);
+        total.polled += stats.age.polled;
+        total.sumUs += stats.age.sumUs;
+        total.squareSumUs += stats.age.squareSumUs;
+        total.maxUs = std::max(total.maxUs, stats.age.maxUs);
+        coalesced += stats.coalesced;
+        overflows += stats.overflows;
+        busyFrames += stats.busyFrames;
+        dropped += stats.dropped;
+        maxDepth = std::max(maxDepth, stats.maxDepth);
+        printk("%s{\"polled\":%u,\"mean_age_us\":%u,\"age_variance_us2\":%u,\"max_age_us\":%u,\"coalesced\":%u,\"overflows\":%u}",
+            i ? "," : "", stats.age.polled, static_cast<uint32_t>(mean(stats.age)), static_cast<uint32_t>(variance(stats.age)),
+            stats.age.maxUs, stats.coalesced, stats.overflows);
+    }
+    printk("],\"polled\":%u,\"mean_age_us\":%u,\"age_variance_us2\":%u,\"max_age_us\":%u,", total.polled,
+        static_cast<uint32_t>(mean(total)), static_cast<uint32_t>(variance(total)), total.maxUs);
+    printk("\"coalesced\":%u,\"overflows\":%u,\"busy_frames\":%u,\"dropped\":%u,\"max_depth\":%u}", coalesced, overflows, busyFrames,
+        dropped, maxDepth);
+}
+
+void attachPeripheral(uint8_t index)
+{
+    /* same table shape as main.cpp, peripheral i -> interface i */
+    MOCNordicRouter::setRoute({index, Route::anyReport, 1u << index});
+    MOCNordicBLEMgr::benchAttach(index);
+    MOCNordicBLEMgr::registerRefHandleCharHandleMap(index, reportRefHandle(index), reportCharHandle(index));
+    MOCNordicBLEMgr::registerCharHandleReportIdMap(index, reportRefHandle(index), benchReportId);
+}
+
+#if defined(CONFIG_MOCNORDIC_BENCH_USBIP)
+/* interfaces below are the injected peripherals, the last one stays vendor */
+constexpr uint8_t controlInterface = CONFIG_USB_HID_DEVICE_COUNT - 1;
+BUILD_ASSERT(peripheralCnt <= controlInterface, "one usb interface per peripheral plus the vendor control interface");
+/* command, peripheral and length take 3 bytes of the vendor report */
+BUILD_ASSERT(CONFIG_MOCNORDIC_BENCH_REPORT_SIZE <= SPPReportDesc::reportPayloadSize - 3, "report doesn't fit an inject command");
+
+/* vendor input report, REPORT_SIZE bytes with benchReportId */
+constexpr uint8_t benchReportMap[] = {
+    0x06, 0x00, 0xff,       /* USAGE_PAGE (Vendor Defined) */
+    0x09, 0x01,             /* USAGE (1) */
+    0xa1, 0x01,             /* COLLECTION (Application) */
+    0x85, benchReportId,    /*   REPORT_ID */
+    0x15, 0x00,             /*   LOGICAL_MINIMUM (0) */
+    0x26, 0xff, 0x00,       /*   LOGICAL_MAXIMUM (255) */
+    0x75, 0x08,             /*   REPORT_SIZE (8) */
+    0x95, CONFIG_MOCNORDIC_BENCH_REPORT_SIZE, /* REPORT_COUNT */
+    0x09, 0x01,             /*   USAGE (1) */
+    0x81, 0x02,             /*   INPUT (Data,Var,Abs) */
+    0xc0,                   /* END_COLLECTION */
+};
+/* USAGE of the collection */
+constexpr uint32_t benchUsageOffset = 4;
+
+struct VendorReport {
+    uint8_t length;
+    uint8_t data[SPPReportDesc::reportPayloadSize];
+};
+
+K_MSGQ_DEFINE(vendorCommands, sizeof(VendorReport), 16, 4);
+
+struct {
+    uint32_t injected;
+    uint32_t forwarded;
+    uint32_t failed;
+    atomic_t dropped;
+} serveCounters;
+
+/* usb stack context, commands are handled on the main thread like notifications on the bt rx thread */
+void vendorOutput(const uint8_t *data, uint32_t length)
+{
+    VendorReport report;
+    report.length = length > sizeof(report.data) ? sizeof(report.data) : length;
+    memcpy(report.data, data, report.length);
+    if(k_msgq_put(&vendorCommands, &report, K_NO_WAIT))
+        atomic_inc(&serveCounters.dropped);
+}
+
+int enumerateBench(uint8_t index)
+{
+    /* an unchanged report map isn't enumerated again, alternate the collection usage so every call is a real cycle */
+    static std::array<bool, peripheralCnt> alternate;
+    uint8_t map[sizeof(benchReportMap)];
+    memcpy(map, benchReportMap, sizeof(map));
+    map[benchUsageOffset] = alternate[index] ? 0x02 : 0x01;
+    alternate[index] = !alternate[index];
+
+    ReportDesc desc(map, sizeof(map));
+    return MOCNordicHIDevice::deviceUnitInit(index, desc, index);
+}
+
+void vendorReply(MOCNordicBench::VendorCommand command, const uint8_t *data, uint32_t length)
+{
+    uint8_t report[1 + SPPReportDesc::reportPayloadSize] = {0};
+    report[0] = SPPReportDesc::reportId;
+    report[1] = static_cast<uint8_t>(command);
+    memcpy(&report[2], data, std::min<uint32_t>(length, sizeof(report) - 2));
+    MOCNordicHIDevice::writeToDevice(controlInterface, report, sizeof(report));
+}
+
+void handleVendorCommand(const VendorReport &report)
+{
+    using VendorCommand = MOCNordicBench::VendorCommand;
+    if(!report.length)
+        return;
+
+    const uint8_t *args = &report.data[1];
+    uint32_t argsLength = report.length - 1;
+    switch(static_cast<VendorCommand>(report.data[0])) {
+    case VendorCommand::Inject: {
+        if(argsLength < 2 || args[0] >= peripheralCnt || args[1] > argsLength - 2) {
+            ++serveCounters.failed;
+            break;
+        }
+        ++serveCounters.injected;
+        int ret = MOCNordicBLEMgr::injectNotification(args[0], reportCharHandle(args[0]), &args[2], args[1]);
+        if(ret)
+            ++serveCounters.failed;
+        else
+            ++serveCounters.forwarded;
+        break;
+    }
+    case VendorCommand::Echo:
+        vendorReply(VendorCommand::Echo, args, argsLength);
+        break;
+    case VendorCommand::Enumerate: {
+        if(argsLength < 1 || args[0] >= peripheralCnt) {
+            ++serveCounters.failed;
+            break;
+        }
+        uint64_t startNs = MOCNordicBench::nowNs();
+        int ret = enumerateBench(args[0]);
+        DEBUG_PRINT("BENCH re-enumerated interface %u in %u us (err %d)", args[0],
+            static_cast<uint32_t>((MOCNordicBench::nowNs() - startNs) / 1000), ret);
+        break;
+    }
+    case VendorCommand::Stats: {
+        uint32_t stats[] = {serveCounters.injected, serveCounters.forwarded, serveCounters.failed,
+            static_cast<uint32_t>(atomic_get(&serveCounters.dropped))};
+        vendorReply(VendorCommand::Stats, reinterpret_cast<const uint8_t *>(stats), sizeof(stats));
+        break;
+    }
+    default:
+        ++serveCounters.failed;
+        break;
+    }
+}
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_REPLAY)
+using RecordHeader = MOCNordicRecorder::RecordHeader;
+
+struct {
+    uint32_t records;
+    uint32_t links;
+    uint32_t notifications;
+    uint32_t skipped;
+    uint32_t malformed;
+} replayCounters;
+
+/* how far the injection ran behind the recorded timing */
+BenchSamples<CONFIG_MOCNORDIC_BENCH_SAMPLES> scheduleLagUs;
+
+/* interfaces follow main.cpp, peripheral i -> interface i */
+void replayLayout(const RecordHeader &header, const uint8_t *payload)
+{
+    uint8_t link = header.link;
+    switch(static_cast<RecordType>(header.type)) {
+    case RecordType::LinkUp:
+        MOCNordicRouter::setRoute({link, Route::anyReport, 1u << link});
+        MOCNordicBLEMgr::benchAttach(link);
+        atomic_clear(&endpoints[link].busy);
+        ++replayCounters.links;
+        break;
+    case RecordType::ReportMap: {
+        ReportDesc desc(payload, header.length);
+        if(MOCNordicHIDevice::benchConfigure(link, desc, link))
+            ++replayCounters.skipped;
+        break;
+    }
+    case RecordType::ReportIds: {
+        MOCNordicRecorder::ReportIdEntry entry;
+        for(uint32_t offset = 0; offset + sizeof(entry) <= header.length; offset += sizeof(entry)) {
+            memcpy(&entry, payload + offset, sizeof(entry));
+            /* the recorded map is keyed by value handle already, the reference handle doesn't matter */
+            MOCNordicBLEMgr::registerRefHandleCharHandleMap(link, entry.valueHandle, entry.valueHandle);
+            MOCNordicBLEMgr::registerCharHandleReportIdMap(link, entry.valueHandle, entry.reportId);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void replayNotification(const RecordHeader &header, const uint8_t *payload)
+{
+    uint16_t valueHandle;
+    if(header.length < sizeof(valueHandle)) {
+        ++replayCounters.malformed;
+        return;
+    }
+    memcpy(&valueHandle, payload, sizeof(valueHandle));
+
+    ++counters.injected;
+    ++replayCounters.notifications;
+    injectStartNs = MOCNordicBench::nowNs();
+    int ret = MOCNordicBLEMgr::injectNotification(header.link, valueHandle, payload + sizeof(valueHandle), header.length - sizeof(valueHandle));
+    if(ret == -EAGAIN)
+        ++counters.endpointBusy;
+    else if(ret)
+        ++counters.notRouted;
+    else
+        ++counters.forwarded;
+}
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_PRIORITY)
+/* the keyboard, every other peripheral is a mouse */
+constexpr uint8_t keyboardIndex = 0;
+BUILD_ASSERT(peripheralCnt >= 2, "the priority bench needs a keyboard and at least one mouse");
+
+/* keys and motion of a burst count from its start, the notifications arrived together */
+uint64_t burstStartNs;
+BenchSamples<CONFIG_MOCNORDIC_BENCH_SAMPLES> keyLatencyNs;
+BenchSamples<CONFIG_MOCNORDIC_BENCH_SAMPLES> motionLatencyNs;
+
+int priorityEndpointWrite(uint8_t index, const uint8_t *data, uint32_t length)
+{
+    uint32_t latencyNs = static_cast<uint32_t>(MOCNordicBench::nowNs() - burstStartNs);
+    int ret = endpointWrite(index, data, length);
+    /* a busy endpoint refused the motion report, it didn't make it */
+    if(index == keyboardIndex)
+        keyLatencyNs.add(latencyNs);
+    else if(!ret)
+        motionLatencyNs.add(latencyNs);
+    return ret;
+}
+
+void priorityInject(uint8_t index, const uint8_t *payload, uint16_t length)
+{
+    ++counters.injected;
+    int ret = MOCNordicBLEMgr::injectNotification(index, reportCharHandle(index), payload, length);
+    if(ret == -EAGAIN)
+        ++counters.endpointBusy;
+    else if(ret)
+        ++counters.notRouted;
+    else
+        ++counters.forwarded;
+}
+
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+/* prints "lanes":{...} without a trailing separator */
+void printLanes()
+{
+    MOCNordicBLEMgr::ForwardStats stats = MOCNordicBLEMgr::forwardStats();
+    printk("\"lanes\":{");
+    for(uint8_t i = 0; i < stats.lanes.size(); i++) {
+        const auto &lane = stats.lanes[i];
+        printk("%s\"%s\":{\"queued\":%u,\"forwarded\":%u,\"max_wait_us\":%u}", i ? "," : "", i ? "bulk" : "urgent",
+            lane.queued, lane.forwarded, lane.maxWaitUs);
+    }
+    printk(",\"held\":%u,\"dropped\":%u,\"starved\":%u,\"peak_queued\":%u}", stats.held, stats.dropped, stats.starved, stats.peakQueued);
+}
+#endif
+#endif
+
+} /* namespace */
+
+uint64_t MOCNordicBench::nowNs()
+{
+#if defined(CONFIG_ARCH_POSIX) && defined(CONFIG_EXTERNAL_LIBC)
+    /* simulated time doesn't advance while code runs, use the host clock */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#elif defined(CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER)
+    return k_cyc_to_ns_floor64(k_cycle_get_64());
+#else
+    /* resolution is one system timer cycle, ~30us on nRF RTC */
+    return k_cyc_to_ns_floor64(k_cycle_get_32());
+#endif
+}
+
+int MOCNordicBench::run()
+{
+    dispatchNs.reset();
+    endpointAgeUs.reset();
+    memset(&counters, 0, sizeof(counters));
+    MOCNordicHIDevice::resetReleaseStats();
+
+    MOCNordicHIDevice::setEndpointWriteHook(endpointWrite);
+    MOCNordicRouter::clear();
+    for(uint8_t i = 0; i < peripheralCnt; i++) {
+        atomic_clear(&endpoints[i].busy);
+        attachPeripheral(i);
+    }
+
+    k_timer_init(&frameTimer, frameExpired, NULL);
+    k_timer_start(&frameTimer, K_MSEC(1), K_MSEC(1));
+
+    std::array<uint8_t, CONFIG_MOCNORDIC_BENCH_REPORT_SIZE> payload;
+    const uint64_t periodUs = 1000000ULL / CONFIG_MOCNORDIC_BENCH_RATE_HZ;
+    const uint64_t startUs = uptimeUs();
+    const uint64_t endUs = startUs + CONFIG_MOCNORDIC_BENCH_DURATION_MS * 1000ULL;
+    MOC_PROFILE_BEGIN(Forwarding);
+
+    for(uint32_t n = 0; ; n++) {
+        uint64_t deadline = startUs + n * periodUs;
+        if(deadline >= endUs)
+            break;
+        k_sleep(K_TIMEOUT_ABS_US(deadline));
+
+        for(uint8_t i = 0; i < peripheralCnt; i++) {
+            payload.fill(static_cast<uint8_t>(n));
+            payload[0] = i;
+            /* one in four reports comes from a characteristic without report reference */
+            uint16_t handle = (n & 0x03) == 0x03 ? rawCharHandle(i) : reportCharHandle(i);
+
+            ++counters.injected;
+            injectStartNs = nowNs();
+            int ret = MOCNordicBLEMgr::injectNotification(i, handle, payload.data(), payload.size());
+            if(ret == -EAGAIN)
+                ++counters.endpointBusy;
+            else if(ret)
+                ++counters.notRouted;
+            else
+                ++counters.forwarded;
+        }
+    }
+
+    /* let the last frame complete */
+    k_sleep(K_MSEC(2));
+    MOC_PROFILE_END(Forwarding);
+    k_timer_stop(&frameTimer);
+    MOCNordicHIDevice::setEndpointWriteHook(nullptr);
+    MOCNordicRouter::clear();
+
+    uint32_t delivered = atomic_get(&counters.delivered);
+    uint32_t throughput = static_cast<uint32_t>(static_cast<uint64_t>(delivered) * 1000 / CONFIG_MOCNORDIC_BENCH_DURATION_MS);
+
+    printk("BENCH {\"peripherals\":%u,\"rate_hz\":%u,\"report_size\":%u,\"duration_ms\":%u,",
+        peripheralCnt, CONFIG_MOCNORDIC_BENCH_RATE_HZ, CONFIG_MOCNORDIC_BENCH_REPORT_SIZE, CONFIG_MOCNORDIC_BENCH_DURATION_MS);
+    printk("\"injected\":%u,\"forwarded\":%u,\"delivered\":%u,\"throughput_rps\":%u,",
+        counters.injected, counters.forwarded, delivered, throughput);
+    printk("\"drops\":{\"not_routed\":%u,\"endpoint_busy\":%u},", counters.notRouted, counters.endpointBusy);
+    printk("\"stages\":{");
+    dispatchNs.print("dispatch_ns");
+    printk(",");
+    endpointAgeUs.print("endpoint_age_us");
+    printk("},");
+    printRelease(peripheralCnt);
+    printk("}\n");
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+    MOCNordicProfiler::report();
+#endif
+    return 0;
+}
+
+#if defined(CONFIG_MOCNORDIC_BENCH_REPLAY)
+int MOCNordicBench::replay()
+{
+    const char *path = getenv("MOCNORDIC_REPLAY_FILE");
+    const char *fast = getenv("MOCNORDIC_REPLAY_FAST");
+    bool keepTiming = !(fast && fast[0] == '1');
+    FILE *file = path ? fopen(path, "rb") : nullptr;
+    if(!file) {
+        DEBUG_PRINT("REPLAY no capture, set MOCNORDIC_REPLAY_FILE");
+        return -ENOENT;
+    }
+
+    MOCNordicRecorder::DumpHeader dumpHeader;
+    if(fread(&dumpHeader, sizeof(dumpHeader), 1, file) != 1 || dumpHeader.magic != MOCNordicRecorder::dumpMagic
+        || dumpHeader.version != MOCNordicRecorder::dumpVersion || dumpHeader.recordHeaderSize != sizeof(RecordHeader)) {
+        DEBUG_PRINT("REPLAY %s is not a version %u capture", path, MOCNordicRecorder::dumpVersion);
+        fclose(file);
+        return -EINVAL;
+    }
+
+    dispatchNs.reset();
+    endpointAgeUs.reset();
+    scheduleLagUs.reset();
+    memset(&counters, 0, sizeof(counters));
+    memset(&replayCounters, 0, sizeof(replayCounters));
+    MOCNordicHIDevice::resetReleaseStats();
+
+    MOCNordicHIDevice::setEndpointWriteHook(endpointWrite);
+    MOCNordicRouter::clear();
+    k_timer_init(&frameTimer, frameExpired, NULL);
+    k_timer_start(&frameTimer, K_MSEC(1), K_MSEC(1));
+
+    /* a report map is the largest payload, a notification is its handle plus the ATT value */
+    static uint8_t payload[std::max<size_t>(Capacity::reportMapSize, sizeof(uint16_t) + Capacity::notifyPayload)];
+    RecordHeader header;
+    bool haveFirst = false;
+    uint32_t lastTimestampUs = 0;
+    uint64_t recordedUs = 0;
+    const uint64_t startUs = uptimeUs();
+    const uint64_t startNs = nowNs();
+    MOC_PROFILE_BEGIN(Forwarding);
+
+    for(uint32_t consumed = 0; consumed + sizeof(header) <= dumpHeader.length; consumed += sizeof(header) + header.length) {
+        if(fread(&header, sizeof(header), 1, file) != 1)
+            break;
+        if(header.length > sizeof(payload)) {
+            /* longer than anything the dongle records, skip it */
+            ++replayCounters.malformed;
+            if(fseek(file, header.length, SEEK_CUR))
+                break;
+            continue;
+        }
+        if(header.length && fread(payload, header.length, 1, file) != 1)
+            break;
+        ++replayCounters.records;
+
+        if(header.link >= Capacity::peripherals) {
+            ++replayCounters.skipped;
+            continue;
+        }
+
+        /* u32 microseconds wrap after ~71 minutes, deltas stay right */
+        if(haveFirst)
+            recordedUs += header.timestampUs - lastTimestampUs;
+        lastTimestampUs = header.timestampUs;
+        haveFirst = true;
+
+        if(static_cast<RecordType>(header.type) != RecordType::Notify) {
+            replayLayout(header, payload);
+            continue;
+        }
+
+        if(keepTiming) {
+            uint64_t deadline = startUs + recordedUs;
+            k_sleep(K_TIMEOUT_ABS_US(deadline));
+            scheduleLagUs.add(static_cast<uint32_t>(uptimeUs() - deadline));
+        }
+        replayNotification(header, payload);
+    }
+    fclose(file);
+
+    /* let the last frame complete */
+    k_sleep(K_MSEC(2));
+    MOC_PROFILE_END(Forwarding);
+    k_timer_stop(&frameTimer);
+    MOCNordicHIDevice::setEndpointWriteHook(nullptr);
+    MOCNordicRouter::clear();
+
+    uint32_t delivered = atomic_get(&counters.delivered);
+    uint32_t elapsedUs = static_cast<uint32_t>(keepTiming ? uptimeUs() - startUs : (nowNs() - startNs) / 1000);
+
+    printk("REPLAY {\"timing\":\"%s\",\"recorded_us\":%u,\"elapsed_us\":%u,\"capture_dropped\":%u,",
+        keepTiming ? "recorded" : "fast", static_cast<uint32_t>(recordedUs), elapsedUs, dumpHeader.dropped);
+    printk("\"records\":%u,\"links\":%u,\"notifications\":%u,\"skipped\":%u,\"malformed\":%u,",
+        replayCounters.records, replayCounters.links, replayCounters.notifications, replayCounters.skipped, replayCounters.malformed);
+    printk("\"injected\":%u,\"forwarded\":%u,\"delivered\":%u,", counters.injected, counters.forwarded, delivered);
+    printk("\"drops\":{\"not_routed\":%u,\"endpoint_busy\":%u},", counters.notRouted, counters.endpointBusy);
+    printk("\"stages\":{");
+    dispatchNs.print("dispatch_ns");
+    printk(",");
+    endpointAgeUs.print("endpoint_age_us");
+    printk(",");
+    scheduleLagUs.print("schedule_lag_us");
+    printk("},");
+    printRelease(Capacity::peripherals);
+    printk("}\n");
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+    MOCNordicProfiler::report();
+#endif
+    return 0;
+}
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_PRIORITY)
+int MOCNordicBench::priority()
+{
+    keyLatencyNs.reset();
+    motionLatencyNs.reset();
+    memset(&counters, 0, sizeof(counters));
+
+    MOCNordicHIDevice::setEndpointWriteHook(priorityEndpointWrite);
+    MOCNordicRouter::clear();
+    for(uint8_t i = 0; i < peripheralCnt; i++) {
+        atomic_clear(&endpoints[i].busy);
+        attachPeripheral(i);
+        if(i == keyboardIndex)
+            MOCNordicBLEMgr::benchReportMap(i, MOCNordicHost::keyboardReportMap, sizeof(MOCNordicHost::keyboardReportMap));
+        else
+            MOCNordicBLEMgr::benchReportMap(i, MOCNordicHost::mouseReportMap, sizeof(MOCNordicHost::mouseReportMap));
+    }
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    MOCNordicBLEMgr::resetForwardStats();
+#endif
+
+    k_timer_init(&frameTimer, frameExpired, NULL);
+    k_timer_start(&frameTimer, K_MSEC(1), K_MSEC(1));
+
+    /* boot keyboard report 1: modifiers, reserved, 6 keys; mouse report 1: buttons, x, y, wheel, pan */
+    std::array<uint8_t, 8> key = {};
+    std::array<uint8_t, 7> motion = {};
+    /* x +1, buttons stay up */
+    sys_put_le16(1, &motion[1]);
+    const uint32_t keyEvery = std::max<uint32_t>(1, CONFIG_MOCNORDIC_BENCH_RATE_HZ / CONFIG_MOCNORDIC_BENCH_PRIORITY_KEY_HZ);
+    const uint64_t periodUs = 1000000ULL / CONFIG_MOCNORDIC_BENCH_RATE_HZ;
+    const uint64_t startUs = uptimeUs();
+    const uint64_t endUs = startUs + CONFIG_MOCNORDIC_BENCH_DURATION_MS * 1000ULL;
+    uint32_t keyChanges = 0;
+    MOC_PROFILE_BEGIN(Forwarding);
+
+    for(uint32_t n = 0; ; n++) {
+        uint64_t deadline = startUs + n * periodUs;
+        if(deadline >= endUs)
+            break;
+        k_sleep(K_TIMEOUT_ABS_US(deadline));
+
+        /* the bt rx thread is cooperative, a burst is handled without another thread running in between */
+        k_sched_lock();
+        burstStartNs = nowNs();
+        for(uint32_t b = 0; b < CONFIG_MOCNORDIC_BENCH_PRIORITY_BURST; b++) {
+            for(uint8_t i = 0; i < peripheralCnt; i++) {
+                if(i == keyboardIndex)
+                    continue;
+                priorityInject(i, motion.data(), motion.size());
+            }
+        }
+        /* 'a' down, then up, as the last notification of the burst */
+        if(!(n % keyEvery)) {
+            key[2] = (keyChanges++ & 0x01) ? 0x00 : 0x04;
+            priorityInject(keyboardIndex, key.data(), key.size());
+        }
+        k_sched_unlock();
+    }
+
+    /* let the last frame complete */
+    k_sleep(K_MSEC(2));
+    MOC_PROFILE_END(Forwarding);
+    k_timer_stop(&frameTimer);
+    MOCNordicHIDevice::setEndpointWriteHook(nullptr);
+    MOCNordicRouter::clear();
+
+    printk("PRIORITY {\"mode\":\"%s\",\"peripherals\":%u,\"rate_hz\":%u,\"burst\":%u,\"key_hz\":%u,\"duration_ms\":%u,",
+        IS_ENABLED(CONFIG_MOCNORDIC_FORWARD_LANES) ? "lanes" : "inline", peripheralCnt, CONFIG_MOCNORDIC_BENCH_RATE_HZ,
+        CONFIG_MOCNORDIC_BENCH_PRIORITY_BURST, CONFIG_MOCNORDIC_BENCH_PRIORITY_KEY_HZ, CONFIG_MOCNORDIC_BENCH_DURATION_MS);
+    printk("\"injected\":%u,\"forwarded\":%u,\"key_changes\":%u,\"delivered\":%u,", counters.injected, counters.forwarded,
+        keyChanges, static_cast<uint32_t>(atomic_get(&counters.delivered)));
+    printk("\"drops\":{\"not_routed\":%u,\"endpoint_busy\":%u},", counters.notRouted, counters.endpointBusy);
+    printk("\"stages\":{");
+    keyLatencyNs.print("key_latency_ns");
+    printk(",");
+    motionLatencyNs.print("motion_latency_ns");
+    printk("}");
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    printk(",");
+    printLanes();
+#endif
+    printk("}\n");
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+    MOCNordicProfiler::report();
+#endif
+    return 0;
+}
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_BSIM)
+int MOCNordicBench::scale()
+{
+    uint32_t count = peripheralCnt;
+#if defined(CONFIG_EXTERNAL_LIBC)
+    /* scripts/mocnordic_bsim.py sweeps the count without rebuilding */
+    const char *requested = getenv("MOCNORDIC_BSIM_PERIPHERALS");
+    if(requested)
+        count = std::clamp<uint32_t>(strtoul(requested, nullptr, 10), 1, Capacity::peripherals);
+#endif
+
+    endpointAgeUs.reset();
+    memset(&counters, 0, sizeof(counters));
+    for(auto &it: endpoints) {
+        atomic_clear(&it.busy);
+        atomic_clear(&it.delivered);
+    }
+
+    /* peripheral i -> interface i like main.cpp, the report map only configures the class stage */
+    MOCNordicHIDevice::setEndpointWriteHook(endpointWrite);
+    MOCNordicRouter::clear();
+    for(uint8_t i = 0; i < count; i++) {
+        MOCNordicRouter::setRoute({i, Route::anyReport, 1u << i});
+    }
+
+    int err = MOCNordicBLEMgr::BLEStackInit();
+    if(err) {
+        DEBUG_PRINT("SCALE ble stack init failed (err %d)", err);
+        return err;
+    }
+
+    const uint64_t startUs = uptimeUs();
+    char name[32];
+    for(uint8_t i = 0; i < count; i++) {
+        MOCNordicBLEMgr::registerGetReportMapCallbackToIndex(i, [i](uint8_t *data, uint32_t length) {
+            ReportDesc desc(data, length);
+            MOCNordicHIDevice::benchConfigure(i, desc, i, MOCNordicBLEMgr::reportMapStream(i));
+        });
+        /* every peripheral gets its own name filter, the scanner connects them in any order */
+        snprintk(name, sizeof(name), "%s%u", CONFIG_MOCNORDIC_BENCH_BSIM_NAME, i);
+        err = MOCNordicBLEMgr::setScanTarget(std::string_view(name));
+        if(err) {
+            DEBUG_PRINT("SCALE no target for %s (err %d)", name, err);
+            return err;
+        }
+    }
+
+    uint32_t ready = 0;
+    while(uptimeUs() - startUs < CONFIG_MOCNORDIC_BENCH_BSIM_READY_MS * 1000ULL) {
+        ready = 0;
+        for(uint8_t i = 0; i < count; i++) {
+            if(MOCNordicBLEMgr::isForwarding(i) && MOCNordicBLEMgr::linkStats(i).readyMs >= 0)
+                ++ready;
+        }
+        if(ready == count)
+            break;
+        k_sleep(K_MSEC(10));
+    }
+    uint32_t bringUpMs = static_cast<uint32_t>((uptimeUs() - startUs) / 1000);
+
+    /* only reports of the measuring window count, bring-up traffic is left out */
+    std::array<MOCNordicBLEMgr::LinkStats, Capacity::peripherals> before;
+    for(uint8_t i = 0; i < count; i++) {
+        before[i] = MOCNordicBLEMgr::linkStats(i);
+        atomic_clear(&endpoints[i].delivered);
+    }
+    endpointAgeUs.reset();
+    MOCNordicHIDevice::resetReleaseStats();
+    k_timer_init(&frameTimer, frameExpired, NULL);
+    k_timer_start(&frameTimer, K_MSEC(1), K_MSEC(1));
+    MOC_PROFILE_BEGIN(Forwarding);
+    k_sleep(K_MSEC(CONFIG_MOCNORDIC_BENCH_DURATION_MS));
+    MOC_PROFILE_END(Forwarding);
+    k_timer_stop(&frameTimer);
+    MOCNordicHIDevice::setEndpointWriteHook(nullptr);
+
+    printk("SCALE {\"peripherals\":%u,\"ready\":%u,\"bring_up_ms\":%u,\"duration_ms\":%u,\"links\":[",
+        count, ready, bringUpMs, CONFIG_MOCNORDIC_BENCH_DURATION_MS);
+    uint32_t notifications = 0;
+    uint32_t forwardFailed = 0;
+    uint32_t delivered = 0;
+    for(uint8_t i = 0; i < count; i++) {
+        MOCNordicBLEMgr::LinkStats stats = MOCNordicBLEMgr::linkStats(i);
+        uint32_t linkNotifications = stats.notifications - before[i].notifications;
+        uint32_t linkFailed = stats.forwardFailed - before[i].forwardFailed;
+        uint32_t linkDelivered = atomic_get(&endpoints[i].delivered);
+        notifications += linkNotifications;
+        forwardFailed += linkFailed;
+        delivered += linkDelivered;
+        printk("%s{\"index\":%u,\"state\":%u,\"ready_ms\":%d,\"bearers\":%u,\"interval_us\":%u,", i ? "," : "",
+            i, static_cast<uint8_t>(stats.state), stats.readyMs, stats.bearers, stats.connIntervalUs);
+        printk("\"notifications\":%u,\"forward_failed\":%u,\"delivered\":%u,\"rate_hz\":%u}",
+            linkNotifications, linkFailed, linkDelivered,
+            static_cast<uint32_t>(static_cast<uint64_t>(linkDelivered) * 1000 / CONFIG_MOCNORDIC_BENCH_DURATION_MS));
+    }
+    printk("],\"notifications\":%u,\"forward_failed\":%u,\"delivered\":%u,\"stages\":{", notifications, forwardFailed, delivered);
+    endpointAgeUs.print("endpoint_age_us");
+    printk("},");
+    printRelease(count);
+    printk("}\n");
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+    MOCNordicProfiler::report();
+#endif
+    return ready == count ? 0 : -ETIMEDOUT;
+}
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_USBIP)
+int MOCNordicBench::serve()
+{
+    memset(&serveCounters, 0, sizeof(serveCounters));
+
+    /* every interface comes up vendor, usb/ip exports the device once it is enabled */
+    int err = MOCNordicHIDevice::init();
+    if(err) {
+        DEBUG_PRINT("usb enable failed (err %d)", err);
+        return err;
+    }
+
+    MOCNordicRouter::clear();
+    for(uint8_t i = 0; i < peripheralCnt; i++) {
+        attachPeripheral(i);
+        err = enumerateBench(i);
+        if(err) {
+            DEBUG_PRINT("bench interface %u not enumerated (err %d)", i, err);
+            return err;
+        }
+    }
+
+    MOCNordicHIDevice::setVendorOutputHook(vendorOutput);
+    printk("BENCH usbip ready, %u bench interfaces, vendor interface %u, report size %u\n",
+        peripheralCnt, controlInterface, CONFIG_MOCNORDIC_BENCH_REPORT_SIZE);
+
+    VendorReport report;
+    while(1) {
+        k_msgq_get(&vendorCommands, &report, K_FOREVER);
+        handleVendorCommand(report);
+    }
+
+    return 0;
+}
+#endif
+
+} /* MOCNordic */
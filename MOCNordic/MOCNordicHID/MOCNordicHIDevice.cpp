@@ -1,49 +1,325 @@
+#define MOCNORDIC_LOG_SUBSYS HID
 #include <MOCNordic/MOCNordicHIDevice.h>
 #include <MOCNordic/MOCNordicLogger.h>
+#include <MOCNordic/MOCNordicTrace.h>
+#include <MOCNordic/MOCNordicRecorder.h>
+#include <MOCNordic/MOCNordicProfiler.h>
+#include <MOCNordic/MOCNordicRouter.h>
+#include <algorithm>
 
 LOG_MODULE_REGISTER(HIDevice, CONFIG_LOG_DEFAULT_LEVEL);
 namespace MOCNordic {
 
+namespace {
+
+/* a stored layout is only used while the route table still sends its peripheral there, same fallback as main.cpp */
+bool routedTo(uint8_t peripheral, uint8_t index)
+{
+    if(peripheral == MOCNordicUsbLayout::noPeripheral)
+        return false;
+    uint32_t interfaces = MOCNordicRouter::interfacesOf(peripheral);
+    return interfaces ? (interfaces & BIT(index)) : peripheral == index;
+}
+
+} /* namespace */
+
+
+void MOCNordicHIDeviceUnit::initKernelObjects()
+{
+    k_mutex_init(&touchpadLock);
+    k_work_init_delayable(&touchpadFlush, MOCNordicHIDevice::touchpadTimeout);
+}
+
+void MOCNordicHIDevice::touchpadTimeout(struct k_work *work)
+{
+    auto *unit = CONTAINER_OF(k_work_delayable_from_work(work), MOCNordicHIDeviceUnit, touchpadFlush);
+    uint8_t index = static_cast<uint8_t>(unit - deviceUnits.data());
+    k_mutex_lock(&unit->touchpadLock, K_FOREVER);
+    if(unit->touchpad.holding()) {
+        int err = unit->touchpad.flushHeld([index] (const uint8_t *report, uint32_t length) {
+            return reportWrite(index, report, length);
+        });
+        DEBUG_TRACE(HID, "HID_%d touchpad frame incomplete after %u ms (err %d)", index, CONFIG_MOCNORDIC_TOUCHPAD_HOLD_MS, err);
+    }
+    k_mutex_unlock(&unit->touchpadLock);
+}
+
+int MOCNordicHIDevice::reportWrite(uint8_t index, const uint8_t *data, uint32_t length)
+{
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+    auto &unit = deviceUnits[index];
+    k_spinlock_key_t key = k_spin_lock(&releaseLock);
+    /* only touchpad frames replace each other, a key, a click or relative motion is never lost */
+    bool queued = unit.release.push(data, length, k_cycle_get_32(), [&unit] (const uint8_t *older, const uint8_t *newer, uint32_t reportLength) {
+        return unit.reportDesc.getType(0) == ReportDescType::Touchpad && unit.touchpad.supersedes(older, newer, reportLength);
+    });
+    k_spin_unlock(&releaseLock, key);
+    return queued ? 0 : -EAGAIN;
+#else
+    return reportSubmit(index, data, length, k_cycle_get_32());
+#endif
+}
+
+int MOCNordicHIDevice::reportSubmit(uint8_t index, const uint8_t *data, uint32_t length, uint32_t arrivalCyc)
+{
+    int ret = endpointWrite(index, data, length);
+    MOC_TRACE(UsbWrite, index, ret ? ret : length);
+    if(!ret) {
+        /* k_cycle_get_32 may be 0, the report is still in flight then */
+        atomic_set(&deviceUnits[index].inFlightCyc, arrivalCyc | 0x01);
+    }
+    if(!ret && !deviceUnits[index].firstReportSent) {
+        deviceUnits[index].firstReportSent = true;
+        MOC_TRACE(FirstReport, index, length);
+        if(atomic_cas(&bootReportSent, 0, 1)) {
+            DEBUG_PRINT("[TEST] first report on HID_%u %u ms after boot, %u usb enumerations", index,
+                k_uptime_get_32(), static_cast<uint32_t>(atomic_get(&enumerationCnt)));
+        }
+    }
+    return ret;
+}
+
+void MOCNordicHIDevice::startOfFrame()
+{
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+    if(usb_dc_status.suspended)
+        return;
+    std::array<uint8_t, maxHIDevice> order;
+    std::array<uint32_t, maxHIDevice> waitedCyc;
+    uint32_t pendingCnt = 0;
+    uint32_t now = k_cycle_get_32();
+    k_spinlock_key_t key = k_spin_lock(&releaseLock);
+    for(uint8_t i = 0; i < maxHIDevice; i++) {
+        if(deviceUnits[i].release.empty())
+            continue;
+        waitedCyc[i] = now - deviceUnits[i].release.headArrival();
+        order[pendingCnt++] = i;
+    }
+    k_spin_unlock(&releaseLock, key);
+    std::sort(order.begin(), order.begin() + pendingCnt, [&waitedCyc] (uint8_t a, uint8_t b) {
+        return waitedCyc[a] > waitedCyc[b];
+    });
+
+    for(uint32_t i = 0; i < pendingCnt; i++) {
+        auto &release = deviceUnits[order[i]].release;
+        key = k_spin_lock(&releaseLock);
+        auto *entry = release.beginRelease();
+        k_spin_unlock(&releaseLock, key);
+        if(!entry)
+            continue;
+        /* written without the lock, new reports only go behind it meanwhile */
+        int err = reportSubmit(order[i], entry->data.data(), entry->length, entry->arrivalCyc);
+        key = k_spin_lock(&releaseLock);
+        /* a busy endpoint is tried again next frame, anything else would fail again */
+        release.endRelease(err);
+        k_spin_unlock(&releaseLock, key);
+        if(err && err != -EAGAIN) {
+            /* reportWrite already told the class stage it went out, the dropped key state has to be sent again */
+            deviceUnits[order[i]].keyboard.resync();
+        }
+    }
+#endif
+}
+
+void MOCNordicHIDevice::endpointPolled(uint8_t index)
+{
+    if(index > deviceUnits.size() - 1)
+        return;
+    auto &unit = deviceUnits[index];
+    uint32_t arrivalCyc = atomic_set(&unit.inFlightCyc, 0);
+    if(!arrivalCyc)
+        return;
+    uint32_t ageUs = k_cyc_to_us_floor32(k_cycle_get_32() - arrivalCyc);
+    ++unit.pollAge.polled;
+    unit.pollAge.sumUs += ageUs;
+    unit.pollAge.squareSumUs += static_cast<uint64_t>(ageUs) * ageUs;
+    unit.pollAge.maxUs = std::max(unit.pollAge.maxUs, ageUs);
+}
+
+MOCNordicHIDevice::ReleaseStats MOCNordicHIDevice::releaseStats(uint8_t index)
+{
+    ReleaseStats ret = {};
+    if(index > deviceUnits.size() - 1)
+        return ret;
+    ret.age = deviceUnits[index].pollAge;
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+    auto &stats = deviceUnits[index].release.getStats();
+    ret.queued = stats.queued;
+    ret.coalesced = stats.coalesced;
+    ret.overflows = stats.overflows;
+    ret.busyFrames = stats.busyFrames;
+    ret.dropped = stats.dropped;
+    ret.maxDepth = stats.maxDepth;
+#endif
+    return ret;
+}
+
+void MOCNordicHIDevice::resetReleaseStats()
+{
+    for(auto &it: deviceUnits) {
+        it.pollAge = {};
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+        k_spinlock_key_t key = k_spin_lock(&releaseLock);
+        it.release.resetStats();
+        k_spin_unlock(&releaseLock, key);
+#endif
+    }
+}
+
+void MOCNordicHIDevice::clearRelease()
+{
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+    k_spinlock_key_t key = k_spin_lock(&releaseLock);
+    for(auto &it: deviceUnits) {
+        it.release.clear();
+    }
+    k_spin_unlock(&releaseLock, key);
+#endif
+    for(auto &it: deviceUnits) {
+        atomic_clear(&it.inFlightCyc);
+    }
+}
+
+uint32_t MOCNordicHIDevice::readVendorStream(uint8_t *dst, uint32_t length)
+{
+    auto read = vendorStream == VendorStream::Recording ? MOCNordicRecorder::readDump : MOCNordicTrace::readDump;
+    /* 0 ended the previous dump, the next call starts a new one */
+    uint32_t copied = read(dst, length);
+    if(!copied)
+        copied = read(dst, length);
+    return copied;
+}
 
 int MOCNordicHIDevice::writeToDevice(uint8_t index, uint8_t *data, uint32_t length)
 {
+    if(index > deviceUnits.size() - 1)
+        return -EINVAL;
+    if(usb_dc_status.suspended)
+        return suspendedReport(index, data, length);
 
-    return hid_int_ep_write(deviceUnits[index].device, data, length, NULL);
+    auto forwarder = deviceUnits[index].forwarder;
+    if(!forwarder)
+        return reportWrite(index, data, length);
+    return forwarder(index, data, length);
 }
 
 int MOCNordicHIDevice::writeToDevice(uint8_t index, uint8_t reportId, uint8_t *data, uint32_t length)
 {
-    
-    uint8_t fullReport[64] = {0};
+    if(index > deviceUnits.size() - 1)
+        return -EINVAL;
+    if(usb_dc_status.suspended)
+        return -EAGAIN;
+
+    /* one endpoint packet, longer reports are cut like before but no longer overrun the buffer */
+    uint8_t fullReport[Capacity::usbReportSize] = {0};
+    uint32_t copied = std::min<uint32_t>(length, sizeof(fullReport) - 1);
     fullReport[0] = reportId;
-    memcpy(&fullReport[1], data, length);
-    
+    memcpy(&fullReport[1], data, copied);
 
-    return hid_int_ep_write(deviceUnits[index].device, fullReport, ((length + 1 > sizeof(fullReport)) ? sizeof(fullReport) : length + 1), NULL);
+    return endpointWrite(index, fullReport, copied + 1);
 
 }
 
+void MOCNordicHIDevice::configureUnit(uint8_t index, ReportDesc &desc, uint8_t peripheral, const ReportMapStream *stream)
+{
+    auto &unit = deviceUnits[index];
+    unit.reportDesc = desc;
+    /* a stream of another map (truncated, restored layout) is ignored, the stages parse desc themselves then */
+    if(stream && !stream->describes(desc.size()))
+        stream = nullptr;
+    if(stream) {
+        if(unit.reportDesc.getType(0) == ReportDescType::UNKNOWN)
+            unit.reportDesc.setType(0, stream->type());
+    }
+    else {
+        unit.reportDesc.recognize();
+    }
+    if(IS_ENABLED(CONFIG_MOCNORDIC_KEYBOARD_DEDUP) || IS_ENABLED(CONFIG_MOCNORDIC_KEYBOARD_NKRO)) {
+        /* nkro rewrites the report map, so this goes before anything else parses it */
+        bool active = stream
+            ? unit.keyboard.init(unit.reportDesc, stream->keyboardLayout(), stream->reportParser(),
+                IS_ENABLED(CONFIG_MOCNORDIC_KEYBOARD_DEDUP), IS_ENABLED(CONFIG_MOCNORDIC_KEYBOARD_NKRO))
+            : unit.keyboard.init(unit.reportDesc, IS_ENABLED(CONFIG_MOCNORDIC_KEYBOARD_DEDUP), IS_ENABLED(CONFIG_MOCNORDIC_KEYBOARD_NKRO));
+        if(active) {
+            DEBUG_PRINT("HID_%d keyboard stage active", index);
+        }
+    }
+    else {
+        unit.keyboard.clear();
+    }
+    /* nkro only rewrites keyboard reports, the touchpad layout of the peripheral's map still holds */
+    bool touchpad = stream
+        ? unit.touchpad.init(stream->touchpadLayout(), stream->reportParser())
+        : unit.touchpad.init(unit.reportDesc.data(), unit.reportDesc.size());
+    if(touchpad) {
+        unit.reportDesc.setType(0, ReportDescType::Touchpad);
+        DEBUG_PRINT("HID_%d is a precision touchpad, %u contacts", index, unit.touchpad.getLayout().slotCnt);
+    }
+    /* reports arrive in the peripheral's layout, before any stage rewrote them */
+    if(stream) {
+        unit.wake.init(stream->wakeLayout(), stream->reportParser().usesReportIds());
+        unit.reportIds = stream->reportParser().usesReportIds();
+    }
+    else {
+        unit.wake.init(desc.data(), desc.size());
+        HIDReportParser parser;
+        HIDParserVisitor ignore;
+        parser.parse(desc.data(), desc.size(), ignore);
+        unit.reportIds = parser.usesReportIds();
+    }
+    unit.forwarder = forwarderFor(unit.reportDesc.getType(0));
+    unit.sourceCrc = MOCNordicUsbLayout::checksum(desc.data(), desc.size());
+    unit.sourceLength = desc.size();
+    unit.peripheral = peripheral;
+    unit.firstReportSent = false;
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+    /* held reports are in the old layout */
+    k_spinlock_key_t key = k_spin_lock(&releaseLock);
+    unit.release.clear();
+    k_spin_unlock(&releaseLock, key);
+#endif
+}
+
 /* this function can be called multiple times */
-int MOCNordicHIDevice::deviceUnitInit(uint8_t index, ReportDesc &desc)
+int MOCNordicHIDevice::deviceUnitInit(uint8_t index, ReportDesc &desc, uint8_t peripheral, const ReportMapStream *stream)
 {
-    int err = 0;
     if(index > deviceUnits.size() - 1) {
         DEBUG_PRINT("index outof range, check.");
         return -1;
     }
-   
+
+#if !defined(CONFIG_USB_DEVICE_HID)
+    /* no usb device stack (nrf52_bsim), the interface only gets its class stage, reports end in the bench endpoint */
+    configureUnit(index, desc, peripheral, stream);
+    return 0;
+#else
+    int err = 0;
     if(deviceUnits[index].device) {
+        /* the usual case after a restored boot, the host already has this layout */
+        if(deviceUnits[index].sourceLength == desc.size()
+            && deviceUnits[index].sourceCrc == MOCNordicUsbLayout::checksum(desc.data(), desc.size())) {
+            if(deviceUnits[index].peripheral != peripheral) {
+                deviceUnits[index].peripheral = peripheral;
+                MOCNordicUsbLayout::store(index, desc, peripheral);
+            }
+            DEBUG_PRINT("HID_%d layout unchanged, no re-enumeration", index);
+            return 0;
+        }
+
+        MOC_TRACE(UsbEnumerate, index, desc.size());
+        /* closed when the host configures the device again */
+        MOC_PROFILE_BEGIN(Reenumeration);
         usb_disable();
         for(int i = 0; i < static_cast<int>(deviceUnits.size()); i++) {
             if(i == index) {
                 DEBUG_PRINT("hot enumerating for HID_%d", index);
                 /* deviceUnits[index].reportDesc.insert(desc.data(), desc.size(), ReportDescType::Keyboard); */
-                deviceUnits[index].reportDesc = desc;
-                auto touchpadRec = deviceUnits[index].reportDesc.touchpadRec();
-                if(touchpadRec.isValid()) {
-                    deviceUnits[index].reportDesc.reportContactCnt[0] = touchpadRec.contactCountReportId;
-                    deviceUnits[index].reportDesc.reportContactCnt[1] = touchpadRec.fingerCnt;
+                if(deviceUnits[index].keyboard.isActive()) {
+                    auto &stats = deviceUnits[index].keyboard.getStats();
+                    DEBUG_PRINT("HID_%d keyboard stage: %u in, %u suppressed, %u converted, %u dropped", index,
+                        stats.reportsIn, stats.suppressed, stats.converted, stats.dropped);
                 }
+                configureUnit(index, desc, peripheral, stream);
                 usb_hid_register_device(deviceUnits[index].device, deviceUnits[index].reportDesc.data(), deviceUnits[index].reportDesc.size(), &deviceUnits[index].callbacks);
                 
                 err = usb_hid_init(deviceUnits[index].device);
@@ -60,8 +336,12 @@ int MOCNordicHIDevice::deviceUnitInit(uint8_t index, ReportDesc &desc)
             }
         }
 
-        int ret = usb_enable(NULL);
-      
+        /* next boot enumerates with this layout directly */
+        MOCNordicUsbLayout::store(index, desc, peripheral);
+
+        /* the stack forgets the status callback on usb_disable */
+        int ret = usb_enable(usbStatus);
+        atomic_inc(&enumerationCnt);
         
         return ret;
     }
@@ -73,45 +353,90 @@ int MOCNordicHIDevice::deviceUnitInit(uint8_t index, ReportDesc &desc)
     if (hid_dev == NULL) {
 		return -1;
 	}
-    /* deviceUnits[index].msgqCtl.init(); */
-    deviceUnits[index].reportDesc = desc;
+    /* deviceUnits[index].reportPool.init(); */
     deviceUnits[index].device = hid_dev;
+    configureUnit(index, desc, peripheral, stream);
     
     deviceUnits[index].callbacks.get_report = [] (const struct device *dev, struct usb_setup_packet *setup, int32_t *len, uint8_t **data) {
         uint8_t index = getIndexFromDev(dev);
-        if(deviceUnits[index].reportDesc.getType(0) == ReportDescType::Touchpad) {
-            if((setup->wValue & 0xFF) == deviceUnits[index].reportDesc.reportContactCnt[0]) {
-                *data = deviceUnits[index].reportDesc.reportContactCnt.data();
-                *len = deviceUnits[index].reportDesc.reportContactCnt.size();
+#if defined(CONFIG_MOCNORDIC_TRACE) || defined(CONFIG_MOCNORDIC_RECORD)
+        /* vendor interface feature report streams the event trace dump or the recorded session */
+        if(deviceUnits[index].reportDesc.getType(0) == ReportDescType::CustomSPP
+            && (setup->wValue >> 8) == HID_REPORT_TYPE_FEATURE && (setup->wValue & 0xFF) == SPPReportDesc::reportId) {
+            static uint8_t featureReport[1 + SPPReportDesc::reportPayloadSize];
+            memset(featureReport, 0, sizeof(featureReport));
+            featureReport[0] = SPPReportDesc::reportId;
+            readVendorStream(&featureReport[1], SPPReportDesc::reportPayloadSize);
+            *data = featureReport;
+            *len = sizeof(featureReport);
+            return 0;
+        }
+#endif
+        if(deviceUnits[index].reportDesc.getType(0) == ReportDescType::Touchpad
+            && (setup->wValue >> 8) == HID_REPORT_TYPE_FEATURE) {
+            /* capabilities, certification, input mode and selective reporting */
+            const uint8_t *feature;
+            uint32_t featureLength;
+            if(deviceUnits[index].touchpad.getFeature(setup->wValue & 0xFF, &feature, &featureLength)) {
+                *data = const_cast<uint8_t *>(feature);
+                *len = featureLength;
                 return 0;
             }
- 
         }
         
         return -ENOTSUP;
         
     };
 
-    /* deviceUnits[index].callbacks.set_report = [] (const struct device *dev, struct usb_setup_packet *setup, int32_t *len, uint8_t **data) {
+    deviceUnits[index].callbacks.set_report = [] (const struct device *dev, struct usb_setup_packet *setup, int32_t *len, uint8_t **data) {
+        uint8_t index = getIndexFromDev(dev);
+#if defined(CONFIG_MOCNORDIC_TRACE) || defined(CONFIG_MOCNORDIC_RECORD)
+        /* report id, then the VendorStream the next feature reads return */
+        if(deviceUnits[index].reportDesc.getType(0) == ReportDescType::CustomSPP
+            && (setup->wValue >> 8) == HID_REPORT_TYPE_FEATURE && (setup->wValue & 0xFF) == SPPReportDesc::reportId && *len >= 2) {
+            auto stream = static_cast<VendorStream>((*data)[1]);
+            if(stream != VendorStream::Trace && stream != VendorStream::Recording)
+                return -EINVAL;
+            vendorStream = stream;
+            /* a new dump request, whatever an earlier one left half read starts over */
+            MOCNordicTrace::dumpAbort();
+            return 0;
+        }
+#endif
+        /* hosts without the interrupt OUT endpoint in use send LED state this way */
+        if((setup->wValue >> 8) == HID_REPORT_TYPE_OUTPUT) {
+            uint8_t reportId = setup->wValue & 0xFF;
+            const uint8_t *report = *data;
+            uint32_t reportLength = *len;
+            if(reportId && reportLength && report[0] == reportId) {
+                ++report;
+                --reportLength;
+            }
+            return forwardOutput(index, reportId, report, reportLength) ? -ENOTSUP : 0;
+        }
+        if(deviceUnits[index].reportDesc.getType(0) == ReportDescType::Touchpad
+            && (setup->wValue >> 8) == HID_REPORT_TYPE_FEATURE) {
+            if(deviceUnits[index].touchpad.setFeature(setup->wValue & 0xFF, *data, *len)) {
+                DEBUG_TRACE(HID, "touchpad feature 0x%02x set, input mode %u", setup->wValue & 0xFF, deviceUnits[index].touchpad.inputMode());
+                return 0;
+            }
+        }
 
-        
-        return 0;
-    }; */
+        return -ENOTSUP;
+    };
 
     
     /* use std::bind will be better */
     deviceUnits[index].callbacks.int_in_ready = [] (const struct device *dev) {
-        /* DEBUG_PRINT("int_in_ready_cb"); */
-        /* int index = getIndexFromDev(dev);
-        if(-1 != index) {
-            k_sem_give(&deviceUnits[index].write_pending);
-        } */
-        
+        /* the IN transfer completed, the host polled the report */
+        int index = getIndexFromDev(dev);
+        if(-1 != index)
+            endpointPolled(index);
     };
 
 
     deviceUnits[index].callbacks.int_out_ready = [] (const struct device *dev) {
-        DEBUG_PRINT("int_out_ready_cb");
+        DEBUG_TRACE(HID, "int_out_ready_cb");
         static uint8_t out_buf[CONFIG_HID_INTERRUPT_EP_MPS] = {0};
         int ret;
         uint32_t retBytes = 0;
@@ -120,6 +445,21 @@ int MOCNordicHIDevice::deviceUnitInit(uint8_t index, ReportDesc &desc)
             DEBUG_PRINT("hid_int_ep_read failed: %d", ret);
             return;
         }
+        uint8_t index = getIndexFromDev(dev);
+#if defined(CONFIG_MOCNORDIC_BENCH)
+        if(vendorOutputHook && deviceUnits[index].reportDesc.getType(0) == ReportDescType::CustomSPP
+            && retBytes > 1 && out_buf[0] == SPPReportDesc::reportId) {
+            vendorOutputHook(&out_buf[1], retBytes - 1);
+            return;
+        }
+#endif
+        if(deviceUnits[index].reportIds) {
+            if(retBytes > 1)
+                forwardOutput(index, out_buf[0], &out_buf[1], retBytes - 1);
+        }
+        else if(retBytes) {
+            forwardOutput(index, 0, out_buf, retBytes);
+        }
         /* DEBUG_PRINT_HEX("out ep", out_buf, retBytes);
         hid_int_ep_write(dev, out_buf, retBytes, NULL); */
     };
@@ -142,8 +482,10 @@ int MOCNordicHIDevice::deviceUnitInit(uint8_t index, ReportDesc &desc)
         deviceUnits[index].device = nullptr;
         return err;
     }
+    MOC_TRACE(UsbEnumerate, index, desc.size());
     DEBUG_PRINT("default initialize for %s", deviceName);
     return 0;
+#endif
 }
 
 int MOCNordicHIDevice::createDefault(uint8_t index)
@@ -163,34 +505,135 @@ int MOCNordicHIDevice::init()
     /* delayLogger.init(); */
     k_mutex_init(&initMutex);
     
+    MOCNordicUsbLayout::init();
     for(int i = 0; i < maxHIDevice; i++) {
+        /* kept out of the caller's stack, ~900 bytes */
+        static ReportDesc restored;
+        uint8_t peripheral;
+        if(!MOCNordicUsbLayout::restore(i, restored, peripheral) && routedTo(peripheral, i)
+            && !deviceUnitInit(i, restored, peripheral)) {
+            DEBUG_PRINT("HID_%d restored for peripheral %u", i, peripheral);
+            continue;
+        }
         createDefault(i);
     }
     
-    return usb_enable([] (enum usb_dc_status_code status, const uint8_t *param)
-    {
-        switch (status) {
-        case USB_DC_RESET:
-            usb_dc_status.configured = false;
-            usb_dc_status.suspended = false;
-            break;
-        case USB_DC_CONFIGURED:
-            usb_dc_status.configured = true;
-            break;
-        case USB_DC_DISCONNECTED:
-            usb_dc_status.configured = false;
-            usb_dc_status.suspended = false;
-            break;
-        case USB_DC_SUSPEND:
-            usb_dc_status.suspended = true;
-            break;
-        case USB_DC_RESUME:
-            usb_dc_status.suspended = false;
-            break;
-        default:
-            break;
+#if defined(CONFIG_USB_DEVICE_HID)
+    int ret = usb_enable(usbStatus);
+    atomic_inc(&enumerationCnt);
+    return ret;
+#else
+    return 0;
+#endif
+}
+
+void MOCNordicHIDevice::usbStatus(enum usb_dc_status_code status, const uint8_t *param)
+{
+    switch (status) {
+    case USB_DC_RESET:
+        usb_dc_status.configured = false;
+        clearRelease();
+        setSuspended(false);
+        break;
+    case USB_DC_CONFIGURED:
+        usb_dc_status.configured = true;
+        for(auto &it: deviceUnits) {
+            it.keyboard.resync();
         }
-    });
+        MOC_TRACE(UsbConfigured, traceNoLink, 0);
+        MOC_PROFILE_END(Reenumeration);
+        break;
+    case USB_DC_DISCONNECTED:
+        usb_dc_status.configured = false;
+        clearRelease();
+        setSuspended(false);
+        break;
+    case USB_DC_SUSPEND:
+        setSuspended(true);
+        break;
+    case USB_DC_RESUME:
+        setSuspended(false);
+        break;
+    case USB_DC_SOF:
+        startOfFrame();
+        break;
+    default:
+        break;
+    }
+}
+
+int MOCNordicHIDevice::forwardOutput(uint8_t index, uint8_t reportId, const uint8_t *data, uint32_t length)
+{
+    auto &unit = deviceUnits[index];
+    if(!outputHook || unit.peripheral == MOCNordicUsbLayout::noPeripheral)
+        return -ENOENT;
+    int err = outputHook(unit.peripheral, reportId, data, length);
+    if(err)
+        DEBUG_TRACE(HID, "HID_%d output report %02x not forwarded (err %d)", index, reportId, err);
+    return err;
+}
+
+void MOCNordicHIDevice::setSuspended(bool suspended)
+{
+    if(usb_dc_status.suspended == suspended)
+        return;
+    usb_dc_status.suspended = suspended;
+
+    if(suspended) {
+        clearRelease();
+        ++powerStatistics.suspends;
+        MOC_TRACE(UsbSuspend, traceNoLink, 0);
+    }
+    else {
+        /* reports were dropped while suspended, the next one always goes out */
+        for(auto &it: deviceUnits) {
+            it.keyboard.resync();
+        }
+        uint32_t requestCyc = atomic_set(&wakeRequestCyc, 0);
+        uint32_t wakeUs = requestCyc ? k_cyc_to_us_floor32(k_cycle_get_32() - requestCyc) : 0;
+        MOC_TRACE(UsbResume, traceNoLink, wakeUs);
+        if(requestCyc) {
+            powerStatistics.lastWakeUs = wakeUs;
+            powerStatistics.maxWakeUs = std::max(powerStatistics.maxWakeUs, wakeUs);
+            DEBUG_PRINT("[TEST] host resumed %u us after the remote wakeup request", wakeUs);
+        }
+    }
+
+    if(powerHook)
+        powerHook(suspended);
+}
+
+int MOCNordicHIDevice::suspendedReport(uint8_t index, const uint8_t *data, uint32_t length)
+{
+    ++powerStatistics.droppedSuspended;
+    if(!deviceUnits[index].wake.isPress(data, length))
+        return -EAGAIN;
+
+    /* k_cycle_get_32 may be 0, the request is still outstanding then */
+    if(!atomic_cas(&wakeRequestCyc, 0, k_cycle_get_32() | 0x01))
+        return -EAGAIN;
+    ++powerStatistics.wakeRequests;
+    MOC_TRACE(RemoteWakeup, index, length);
+
+#if defined(CONFIG_USB_DEVICE_HID)
+    int err = usb_wakeup_request();
+#else
+    int err = -ENOTSUP;
+#endif
+    if(err) {
+        /* the host didn't enable remote wakeup for this configuration */
+        atomic_clear(&wakeRequestCyc);
+        ++powerStatistics.wakeRefused;
+        DEBUG_PRINT("HID_%d remote wakeup refused (err %d)", index, err);
+    }
+    return -EAGAIN;
+}
+
+const KeyboardStage::Stats *MOCNordicHIDevice::keyboardStats(uint8_t index)
+{
+    if(index > deviceUnits.size() - 1)
+        return nullptr;
+    return &deviceUnits[index].keyboard.getStats();
 }
 
 void MOCNordicHIDevice::printDesc(uint8_t index)
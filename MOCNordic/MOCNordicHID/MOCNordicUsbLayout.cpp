@@ -0,0 +1,180 @@
+#define MOCNORDIC_LOG_SUBSYS HID
+#include <MOCNordic/MOCNordicUsbLayout.h>
+#include <MOCNordic/MOCNordicLogger.h>
+#include <MOCNordic/MOCNordicRouter.h>
+#include <stdio.h>
+
+#if defined(CONFIG_MOCNORDIC_USB_LAYOUT_PERSIST)
+#include <zephyr/settings/settings.h>
+#endif
+
+LOG_MODULE_DECLARE(HIDevice, CONFIG_LOG_DEFAULT_LEVEL);
+
+namespace MOCNordic {
+
+#if defined(CONFIG_MOCNORDIC_USB_LAYOUT_PERSIST)
+
+namespace {
+
+/* bump when Record changes, older records are ignored */
+constexpr uint8_t layoutVersion = 1;
+
+struct Record {
+    struct {
+        uint8_t version;
+        uint8_t peripheral;
+        /* ReportDescType of the first part */
+        uint8_t type;
+        uint8_t reserved;
+        uint16_t length;
+        uint32_t crc;
+    } header;
+    uint8_t desc[sizeof(ReportDesc::desc)];
+};
+
+struct LoadContext {
+    Record *record;
+    ssize_t length;
+};
+
+/* too large for the caller's stack, restore and the store work share it */
+Record record;
+K_MUTEX_DEFINE(recordLock);
+bool ready;
+
+/* copied by store() from the bring-up, written by storeWork; only held for the copy */
+std::array<Record, MOCNordicRouter::maxInterfaces> staged;
+K_MUTEX_DEFINE(stagedLock);
+/* interfaces with a staged record not written yet */
+atomic_t stagedMask;
+struct k_work storeWork;
+
+void makeKey(char *key, size_t size, uint8_t index)
+{
+    snprintf(key, size, "moc/usb/%u", index);
+}
+
+/* settings_save_one may erase a flash page, kept off the bt rx thread */
+void storeStaged(struct k_work *work)
+{
+    uint32_t mask = atomic_clear(&stagedMask);
+    while(mask) {
+        uint8_t index = static_cast<uint8_t>(__builtin_ctz(mask));
+        mask &= mask - 1;
+
+        char key[16];
+        makeKey(key, sizeof(key), index);
+
+        k_mutex_lock(&recordLock, K_FOREVER);
+        k_mutex_lock(&stagedLock, K_FOREVER);
+        uint32_t length = sizeof(record.header) + staged[index].header.length;
+        memcpy(&record, &staged[index], length);
+        k_mutex_unlock(&stagedLock);
+        int err = settings_save_one(key, &record, length);
+        k_mutex_unlock(&recordLock);
+
+        if(err) {
+            DEBUG_PRINT("HID_%u layout not stored (err %d)", index, err);
+        }
+    }
+}
+
+} /* namespace */
+
+int MOCNordicUsbLayout::init()
+{
+    int err = settings_subsys_init();
+    if(err) {
+        DEBUG_PRINT("settings init failed (err %d), usb layout not restored", err);
+        return err;
+    }
+    k_work_init(&storeWork, storeStaged);
+    ready = true;
+    return 0;
+}
+
+int MOCNordicUsbLayout::restore(uint8_t index, ReportDesc &desc, uint8_t &peripheral)
+{
+    if(!ready)
+        return -ENOENT;
+
+    char key[16];
+    makeKey(key, sizeof(key), index);
+
+    k_mutex_lock(&recordLock, K_FOREVER);
+    LoadContext context = {&record, -ENOENT};
+    settings_load_subtree_direct(key, [] (const char *name, size_t length, settings_read_cb read, void *arg, void *param) {
+        auto &context = *static_cast<LoadContext *>(param);
+        /* only the key itself, not anything below it */
+        if(name && name[0])
+            return 0;
+        if(length > sizeof(Record))
+            return 0;
+        context.length = read(arg, context.record, length);
+        return 0;
+    }, &context);
+
+    int ret = -ENOENT;
+    const auto &header = record.header;
+    if(context.length >= static_cast<ssize_t>(sizeof(header)) && header.version == layoutVersion
+        && header.length == context.length - sizeof(header) && header.crc == checksum(record.desc, header.length)) {
+        desc.clear();
+        desc.insert(record.desc, header.length, static_cast<ReportDescType>(header.type));
+        peripheral = header.peripheral;
+        ret = 0;
+    }
+    else if(context.length != -ENOENT) {
+        DEBUG_PRINT("stored layout of HID_%u invalid, ignored", index);
+    }
+    k_mutex_unlock(&recordLock);
+    return ret;
+}
+
+int MOCNordicUsbLayout::store(uint8_t index, ReportDesc &desc, uint8_t peripheral)
+{
+    if(!ready)
+        return -ENODEV;
+
+    uint32_t length = desc.size();
+    if(index >= staged.size())
+        return -EINVAL;
+    if(length > sizeof(record.desc))
+        return -ENOMEM;
+
+    /* a newer layout of the interface replaces one still waiting */
+    auto &it = staged[index];
+    k_mutex_lock(&stagedLock, K_FOREVER);
+    it.header.version = layoutVersion;
+    it.header.peripheral = peripheral;
+    it.header.type = static_cast<uint8_t>(desc.getType(0));
+    it.header.reserved = 0;
+    it.header.length = static_cast<uint16_t>(length);
+    it.header.crc = checksum(desc.data(), length);
+    memcpy(it.desc, desc.data(), length);
+    k_mutex_unlock(&stagedLock);
+
+    atomic_or(&stagedMask, BIT(index));
+    k_work_submit(&storeWork);
+    return 0;
+}
+
+#else
+
+int MOCNordicUsbLayout::init()
+{
+    return 0;
+}
+
+int MOCNordicUsbLayout::restore(uint8_t index, ReportDesc &desc, uint8_t &peripheral)
+{
+    return -ENOTSUP;
+}
+
+int MOCNordicUsbLayout::store(uint8_t index, ReportDesc &desc, uint8_t peripheral)
+{
+    return 0;
+}
+
+#endif
+
+} /* MOCNordic */
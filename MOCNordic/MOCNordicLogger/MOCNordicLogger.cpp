@@ -0,0 +1,118 @@
+#include <MOCNordic/MOCNordicLogger.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <algorithm>
+#include <cstring>
+
+namespace MTNordic {
+namespace MTNordicLogger {
+
+#if defined(CONFIG_MOCNORDIC_DEFERRED_LOG)
+
+namespace {
+
+std::array<DeferredLogger::Record, DeferredLogger::entryCnt> records;
+/* set by the producer once a reserved record is filled */
+std::array<atomic_t, DeferredLogger::entryCnt> recordReady;
+struct k_spinlock reserveLock;
+uint32_t head;
+atomic_t tail;
+atomic_t droppedCnt;
+
+void loggerThread(void *p1, void *p2, void *p3)
+{
+    while(1) {
+        k_msleep(CONFIG_MOCNORDIC_DEFERRED_LOG_FLUSH_MS);
+        DeferredLogger::flush();
+    }
+}
+
+} /* namespace */
+
+K_THREAD_DEFINE(MOCDeferredLogThread, CONFIG_MOCNORDIC_DEFERRED_LOG_STACK_SIZE, loggerThread, NULL, NULL, NULL,
+                K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+DeferredLogger::Record *DeferredLogger::reserve()
+{
+    Record *record = nullptr;
+    k_spinlock_key_t key = k_spin_lock(&reserveLock);
+    if(head - static_cast<uint32_t>(atomic_get(&tail)) < entryCnt) {
+        record = &records[head & (entryCnt - 1)];
+        atomic_clear(&recordReady[head & (entryCnt - 1)]);
+        ++head;
+    }
+    k_spin_unlock(&reserveLock, key);
+
+    if(!record) {
+        atomic_inc(&droppedCnt);
+        return nullptr;
+    }
+    record->cycles = k_cycle_get_32();
+    return record;
+}
+
+void DeferredLogger::commit(Record *record)
+{
+    atomic_set(&recordReady[record - records.data()], 1);
+}
+
+void DeferredLogger::captureHex(const char *fmt, const char *func, uint16_t line, const void *data, uint32_t length)
+{
+    if(!data || !length)
+        return;
+
+    Record *record = reserve();
+    if(!record)
+        return;
+
+    record->fmt = fmt;
+    record->func = func;
+    record->line = line;
+    record->argc = 0;
+    record->hexLength = static_cast<uint8_t>(std::min(length, maxHexLength));
+    memcpy(record->hex, data, record->hexLength);
+    commit(record);
+}
+
+uint32_t DeferredLogger::dropped()
+{
+    return atomic_get(&droppedCnt);
+}
+
+void DeferredLogger::flush()
+{
+    static uint32_t reportedDropped = 0;
+
+    while(static_cast<uint32_t>(atomic_get(&tail)) != head) {
+        uint32_t slot = static_cast<uint32_t>(atomic_get(&tail)) & (entryCnt - 1);
+        if(!atomic_get(&recordReady[slot]))
+            break;
+
+        const Record &record = records[slot];
+        uint32_t us = k_cyc_to_us_floor32(record.cycles);
+        printk("<%u.%03u> ", us / 1000, us % 1000);
+        if(record.hexLength) {
+            printk("[%s.%d] %s:", record.func, record.line, record.fmt);
+            for(uint8_t i = 0; i < record.hexLength; i++) {
+                printk(" %02x", record.hex[i]);
+            }
+            printk("\r\n");
+        }
+        else {
+            /* extra args are ignored by the format */
+            printk(record.fmt, record.func, record.line, record.args[0], record.args[1], record.args[2], record.args[3]);
+        }
+        atomic_inc(&tail);
+    }
+
+    uint32_t droppedNow = dropped();
+    if(droppedNow != reportedDropped) {
+        printk("[deferred log] %u traces dropped\r\n", droppedNow - reportedDropped);
+        reportedDropped = droppedNow;
+    }
+}
+
+#endif
+
+} /* MTNordicLogger */
+} /* MTNordic */
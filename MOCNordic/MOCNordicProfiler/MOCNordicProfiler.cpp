@@ -0,0 +1,184 @@
+#include <MOCNordic/MOCNordicProfiler.h>
+#include <algorithm>
+#include <array>
+
+namespace MOCNordic {
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+
+namespace {
+
+constexpr uint32_t maxThreads = CONFIG_MOCNORDIC_PROFILER_THREADS;
+constexpr uint32_t scenarioCnt = static_cast<uint32_t>(ProfileScenario::Count);
+
+constexpr const char *scenarioNames[] = {
+    "bring_up",
+    "forwarding",
+    "reenumeration",
+};
+static_assert(sizeof(scenarioNames) / sizeof(scenarioNames[0]) == scenarioCnt, "every scenario needs a report name");
+
+struct ThreadEntry {
+    const struct k_thread *thread;
+    size_t stackSize;
+    /* since boot */
+    size_t stackPeak;
+};
+
+/* execution cycles of every tracked thread and of the whole cpu at one point in time */
+struct Sample {
+    std::array<uint64_t, maxThreads> busy;
+    uint64_t all;
+    /* threads seen after the table was full */
+    uint32_t untracked;
+};
+
+struct Window {
+    bool active;
+    uint32_t runs;
+    Sample start;
+    uint64_t wallCycles;
+    std::array<uint64_t, maxThreads> busyCycles;
+    /* the stack watermark can't be reset, this is the peak since boot when the window last closed */
+    std::array<size_t, maxThreads> stackPeak;
+};
+
+std::array<ThreadEntry, maxThreads> threads;
+uint32_t threadCnt;
+uint32_t untracked;
+std::array<Window, scenarioCnt> windows;
+
+K_MUTEX_DEFINE(profileLock);
+
+int threadSlot(const struct k_thread *thread)
+{
+    for(uint32_t i = 0; i < threadCnt; i++) {
+        if(threads[i].thread == thread)
+            return i;
+    }
+    if(threadCnt == maxThreads)
+        return -1;
+    threads[threadCnt] = {thread, thread->stack_info.size, 0};
+    return threadCnt++;
+}
+
+void takeSample(Sample &sample)
+{
+    sample.busy.fill(0);
+    sample.untracked = 0;
+    k_thread_foreach_unlocked([] (const struct k_thread *thread, void *user) {
+        auto &sample = *static_cast<Sample *>(user);
+        int slot = threadSlot(thread);
+        if(slot < 0) {
+            ++sample.untracked;
+            return;
+        }
+
+        size_t unused;
+        if(!k_thread_stack_space_get(thread, &unused)) {
+            threads[slot].stackPeak = std::max(threads[slot].stackPeak, threads[slot].stackSize - unused);
+        }
+        k_thread_runtime_stats_t stats;
+        if(!k_thread_runtime_stats_get(const_cast<k_tid_t>(thread), &stats)) {
+            sample.busy[slot] = stats.execution_cycles;
+        }
+    }, &sample);
+
+    k_thread_runtime_stats_t all;
+    k_thread_runtime_stats_all_get(&all);
+    sample.all = all.execution_cycles;
+    untracked = std::max(untracked, sample.untracked);
+}
+
+/* adds the part between window.start and sample */
+void accumulate(Window &window, const Sample &sample)
+{
+    window.wallCycles += sample.all - window.start.all;
+    for(uint32_t i = 0; i < threadCnt; i++) {
+        /* a thread which exited in between reads 0 */
+        if(sample.busy[i] > window.start.busy[i])
+            window.busyCycles[i] += sample.busy[i] - window.start.busy[i];
+        window.stackPeak[i] = std::max(window.stackPeak[i], threads[i].stackPeak);
+    }
+}
+
+size_t suggestedSize(size_t peak)
+{
+    return ROUND_UP(peak + peak * CONFIG_MOCNORDIC_PROFILER_MARGIN_PERCENT / 100, 64);
+}
+
+void printThreadName(uint32_t slot)
+{
+    const char *name = k_thread_name_get(const_cast<k_tid_t>(threads[slot].thread));
+    if(name && name[0])
+        printk("\"%s\"", name);
+    else
+        printk("\"thread@%p\"", threads[slot].thread);
+}
+
+} /* namespace */
+
+void MOCNordicProfiler::begin(ProfileScenario scenario)
+{
+    auto &window = windows[static_cast<uint8_t>(scenario)];
+    k_mutex_lock(&profileLock, K_FOREVER);
+    takeSample(window.start);
+    window.active = true;
+    k_mutex_unlock(&profileLock);
+}
+
+void MOCNordicProfiler::end(ProfileScenario scenario)
+{
+    auto &window = windows[static_cast<uint8_t>(scenario)];
+    k_mutex_lock(&profileLock, K_FOREVER);
+    if(window.active) {
+        Sample sample;
+        takeSample(sample);
+        accumulate(window, sample);
+        window.active = false;
+        ++window.runs;
+    }
+    k_mutex_unlock(&profileLock);
+}
+
+void MOCNordicProfiler::report()
+{
+    k_mutex_lock(&profileLock, K_FOREVER);
+    Sample now;
+    takeSample(now);
+
+    printk("PROFILE {\"margin_percent\":%u,\"untracked\":%u,\"scenarios\":{", CONFIG_MOCNORDIC_PROFILER_MARGIN_PERCENT, untracked);
+    for(uint32_t s = 0; s < scenarioCnt; s++) {
+        /* open windows are reported up to now and keep running */
+        Window window = windows[s];
+        if(window.active) {
+            accumulate(window, now);
+            ++window.runs;
+        }
+        printk("%s\"%s\":{\"runs\":%u,\"active\":%s,\"wall_ms\":%u,\"threads\":{", s ? "," : "", scenarioNames[s],
+            window.runs, window.active ? "true" : "false", static_cast<uint32_t>(k_cyc_to_ms_floor64(window.wallCycles)));
+        for(uint32_t i = 0; window.runs && i < threadCnt; i++) {
+            uint32_t permille = window.wallCycles ? static_cast<uint32_t>(window.busyCycles[i] * 1000 / window.wallCycles) : 0;
+            printk("%s", i ? "," : "");
+            printThreadName(i);
+            printk(":{\"cpu_permille\":%u,\"stack_peak_since_boot\":%u}", permille, static_cast<uint32_t>(window.stackPeak[i]));
+        }
+        printk("}}");
+    }
+
+    size_t reclaimable = 0;
+    printk("},\"threads\":[");
+    for(uint32_t i = 0; i < threadCnt; i++) {
+        size_t suggested = std::min(suggestedSize(threads[i].stackPeak), threads[i].stackSize);
+        reclaimable += threads[i].stackSize - suggested;
+        printk("%s{\"name\":", i ? "," : "");
+        printThreadName(i);
+        printk(",\"stack_size\":%u,\"stack_peak\":%u,\"suggested\":%u}", static_cast<uint32_t>(threads[i].stackSize), static_cast<uint32_t>(threads[i].stackPeak), static_cast<uint32_t>(suggested));
+    }
+    printk("],\"reclaimable\":%u}\n", static_cast<uint32_t>(reclaimable));
+    k_mutex_unlock(&profileLock);
+}
+
+#endif
+
+} /* MOCNordic */
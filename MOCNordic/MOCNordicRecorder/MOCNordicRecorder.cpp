@@ -0,0 +1,183 @@
+#include <MOCNordic/MOCNordicRecorder.h>
+#include <MOCNordic/MOCNordicBLEMgr.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(CONFIG_MOCNORDIC_RECORD) && defined(CONFIG_ARCH_POSIX) && defined(CONFIG_EXTERNAL_LIBC)
+#include <cstdio>
+#include <cstdlib>
+#include <posix_native_task.h>
+#endif
+
+namespace MOCNordic {
+
+#if defined(CONFIG_MOCNORDIC_RECORD)
+
+namespace {
+
+std::array<uint8_t, CONFIG_MOCNORDIC_RECORD_BUFFER_SIZE> buffer;
+uint32_t used;
+uint32_t dropped;
+struct k_spinlock appendLock;
+atomic_t paused;
+
+uint32_t dumpLength;
+uint32_t dumpOffset;
+bool dumping;
+
+/* header plus up to two payload parts, all or nothing */
+void append(RecordType type, uint8_t link, const void *first, uint32_t firstLength, const void *second = nullptr, uint32_t secondLength = 0)
+{
+    uint32_t payloadLength = firstLength + secondLength;
+    uint32_t total = sizeof(MOCNordicRecorder::RecordHeader) + payloadLength;
+    MOCNordicRecorder::RecordHeader header = {
+        .timestampUs = k_cyc_to_us_floor32(k_cycle_get_32()),
+        .type = static_cast<uint8_t>(type),
+        .link = link,
+        .length = static_cast<uint16_t>(payloadLength),
+    };
+
+    k_spinlock_key_t key = k_spin_lock(&appendLock);
+    if(atomic_get(&paused) || payloadLength > UINT16_MAX || total > buffer.size() - used) {
+        ++dropped;
+        k_spin_unlock(&appendLock, key);
+        return;
+    }
+    uint8_t *dst = buffer.data() + used;
+    memcpy(dst, &header, sizeof(header));
+    memcpy(dst + sizeof(header), first, firstLength);
+    if(secondLength)
+        memcpy(dst + sizeof(header) + firstLength, second, secondLength);
+    used += total;
+    k_spin_unlock(&appendLock, key);
+}
+
+} /* namespace */
+
+void MOCNordicRecorder::linkUp(uint8_t link, uint32_t connIntervalUs)
+{
+    append(RecordType::LinkUp, link, &connIntervalUs, sizeof(connIntervalUs));
+}
+
+void MOCNordicRecorder::linkDown(uint8_t link)
+{
+    append(RecordType::LinkDown, link, nullptr, 0);
+}
+
+void MOCNordicRecorder::reportMap(uint8_t link, const uint8_t *map, uint32_t length)
+{
+    append(RecordType::ReportMap, link, map, length);
+}
+
+void MOCNordicRecorder::reportIds(uint8_t link, const ReportHandleMap &handleMap)
+{
+    std::array<ReportIdEntry, Capacity::subscriptions> entries;
+    uint32_t count = 0;
+    for(const auto &[valueHandle, reportId]: handleMap.charHandleReportIdMap) {
+        if(count == entries.size())
+            break;
+        entries[count++] = {valueHandle, reportId, 0};
+    }
+    append(RecordType::ReportIds, link, entries.data(), count * sizeof(ReportIdEntry));
+}
+
+void MOCNordicRecorder::notification(uint8_t link, uint16_t valueHandle, const void *data, uint16_t length)
+{
+    append(RecordType::Notify, link, &valueHandle, sizeof(valueHandle), data, length);
+}
+
+uint32_t MOCNordicRecorder::readDump(uint8_t *dst, uint32_t length)
+{
+    if(!dumping) {
+        /* appends finish under the lock, after this the buffer doesn't change */
+        k_spinlock_key_t key = k_spin_lock(&appendLock);
+        atomic_set(&paused, 1);
+        dumpLength = used;
+        k_spin_unlock(&appendLock, key);
+        dumpOffset = 0;
+        dumping = true;
+    }
+
+    DumpHeader header = {
+        .magic = dumpMagic,
+        .version = dumpVersion,
+        .recordHeaderSize = sizeof(RecordHeader),
+        .length = dumpLength,
+        .dropped = dropped,
+    };
+    uint32_t streamLength = sizeof(header) + dumpLength;
+
+    if(dumpOffset >= streamLength) {
+        dumping = false;
+        return 0;
+    }
+
+    uint32_t copied = 0;
+    if(dumpOffset < sizeof(header)) {
+        copied = std::min<uint32_t>(sizeof(header) - dumpOffset, length);
+        memcpy(dst, reinterpret_cast<const uint8_t *>(&header) + dumpOffset, copied);
+        dumpOffset += copied;
+    }
+    uint32_t chunk = std::min(length - copied, streamLength - dumpOffset);
+    memcpy(dst + copied, buffer.data() + dumpOffset - sizeof(header), chunk);
+    dumpOffset += chunk;
+    if(dumpOffset >= streamLength) {
+        /* the host has all of it, the next session records from now on */
+        restart();
+        dumping = true;
+    }
+    return copied + chunk;
+}
+
+void MOCNordicRecorder::restart()
+{
+    k_spinlock_key_t key = k_spin_lock(&appendLock);
+    used = 0;
+    dropped = 0;
+    dumping = false;
+    atomic_set(&paused, 0);
+    k_spin_unlock(&appendLock, key);
+    /* a session without the layouts can't be replayed */
+    MOCNordicBLEMgr::recordLayouts();
+}
+
+#if defined(CONFIG_ARCH_POSIX) && defined(CONFIG_EXTERNAL_LIBC)
+int MOCNordicRecorder::dumpToFile(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if(!file)
+        return -EIO;
+
+    /* drop a partially read stream, the dump restarts from the first byte */
+    dumping = false;
+    uint8_t chunk[256];
+    uint32_t length;
+    while((length = readDump(chunk, sizeof(chunk))) != 0) {
+        fwrite(chunk, 1, length, file);
+    }
+    fclose(file);
+    return 0;
+}
+
+static void dumpOnExit()
+{
+    const char *path = getenv("MOCNORDIC_RECORD_FILE");
+    if(path) {
+        MOCNordicRecorder::dumpToFile(path);
+    }
+}
+
+NATIVE_TASK(dumpOnExit, ON_EXIT_PRE, 0);
+#else
+int MOCNordicRecorder::dumpToFile(const char *path)
+{
+    return -ENOTSUP;
+}
+#endif
+
+#endif
+
+} /* MOCNordic */
@@ -0,0 +1,74 @@
+#include <MOCNordic/MOCNordicRouter.h>
+#include <MOCNordic/MOCNordicHIDevice.h>
+#include <MOCNordic/MOCNordicLogger.h>
+
+LOG_MODULE_DECLARE(MOCNordic, CONFIG_LOG_DEFAULT_LEVEL);
+
+namespace MOCNordic {
+
+int MOCNordicRouter::setRoute(const Route &route)
+{
+    if(!validRoute(route)) {
+        DEBUG_PRINT("invalid route for peripheral %d", route.peripheral);
+        return -EINVAL;
+    }
+
+    PeripheralRoutes &routes = table[route.peripheral];
+    if(route.reportId == Route::anyReport) {
+        routes.defaultMask = route.interfaceMask;
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < routes.reportRouteCnt; i++) {
+        if(routes.reportRoutes[i].reportId == route.reportId) {
+            routes.reportRoutes[i].interfaceMask = route.interfaceMask;
+            return 0;
+        }
+    }
+    if(routes.reportRouteCnt >= routes.reportRoutes.size())
+        return -ENOMEM;
+
+    routes.reportRoutes[routes.reportRouteCnt++] = {route.reportId, route.interfaceMask};
+    return 0;
+}
+
+void MOCNordicRouter::clear()
+{
+    for(auto &it: table) {
+        it.defaultMask = 0;
+        it.reportRouteCnt = 0;
+    }
+}
+
+uint32_t MOCNordicRouter::interfacesOf(uint8_t peripheral)
+{
+    if(peripheral >= maxPeripherals)
+        return 0;
+
+    const PeripheralRoutes &routes = table[peripheral];
+    uint32_t mask = routes.defaultMask;
+    for(uint32_t i = 0; i < routes.reportRouteCnt; i++) {
+        mask |= routes.reportRoutes[i].interfaceMask;
+    }
+    return mask;
+}
+
+int MOCNordicRouter::forward(uint8_t peripheral, int reportId, uint8_t *report, uint32_t length)
+{
+    uint32_t mask = lookup(peripheral, reportId);
+    if(!mask)
+        return -ENOENT;
+
+    int ret = 0;
+    /* more than one bit mirrors the peripheral */
+    while(mask) {
+        uint8_t interface = static_cast<uint8_t>(__builtin_ctz(mask));
+        mask &= mask - 1;
+        int err = MOCNordicHIDevice::writeToDevice(interface, report, length);
+        if(err && !ret)
+            ret = err;
+    }
+    return ret;
+}
+
+} /* MOCNordic */
@@ -0,0 +1,131 @@
+#include <MOCNordic/MOCNordicTrace.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(CONFIG_MOCNORDIC_TRACE) && defined(CONFIG_ARCH_POSIX) && defined(CONFIG_EXTERNAL_LIBC)
+#include <cstdio>
+#include <cstdlib>
+#include <posix_native_task.h>
+#endif
+
+namespace MOCNordic {
+
+#if defined(CONFIG_MOCNORDIC_TRACE)
+
+/* a host which stopped reading halfway doesn't keep recording off */
+static void dumpExpired(struct k_work *work)
+{
+    MOCNordicTrace::dumpAbort();
+}
+
+static K_WORK_DELAYABLE_DEFINE(dumpTimeout, dumpExpired);
+
+void MOCNordicTrace::dumpBegin()
+{
+    atomic_set(&paused, 1);
+    uint32_t total = static_cast<uint32_t>(atomic_get(&head));
+    dumpCount = std::min(total, entryCnt);
+    dumpFirst = total - dumpCount;
+    dumpOffset = 0;
+    dumping = true;
+}
+
+uint32_t MOCNordicTrace::readDump(uint8_t *dst, uint32_t length)
+{
+    k_spinlock_key_t key = k_spin_lock(&dumpLock);
+    if(!dumping)
+        dumpBegin();
+
+    DumpHeader header = {
+        .magic = dumpMagic,
+        .version = dumpVersion,
+        .recordSize = sizeof(Record),
+        .count = dumpCount,
+        .lost = dumpFirst,
+    };
+    uint32_t streamLength = sizeof(header) + dumpCount * sizeof(Record);
+    uint32_t copied = 0;
+
+    if(dumpOffset >= streamLength) {
+        dumping = false;
+        atomic_set(&paused, 0);
+        k_spin_unlock(&dumpLock, key);
+        k_work_cancel_delayable(&dumpTimeout);
+        return 0;
+    }
+
+    while(copied < length && dumpOffset < streamLength) {
+        const uint8_t *src;
+        uint32_t available;
+        if(dumpOffset < sizeof(header)) {
+            src = reinterpret_cast<const uint8_t *>(&header) + dumpOffset;
+            available = sizeof(header) - dumpOffset;
+        }
+        else {
+            uint32_t recordOffset = dumpOffset - sizeof(header);
+            const Record &rec = ring[(dumpFirst + recordOffset / sizeof(Record)) & (entryCnt - 1)];
+            src = reinterpret_cast<const uint8_t *>(&rec) + recordOffset % sizeof(Record);
+            available = sizeof(Record) - recordOffset % sizeof(Record);
+        }
+        uint32_t chunk = std::min(available, length - copied);
+        memcpy(dst + copied, src, chunk);
+        copied += chunk;
+        dumpOffset += chunk;
+    }
+    k_spin_unlock(&dumpLock, key);
+
+    k_work_reschedule(&dumpTimeout, K_MSEC(CONFIG_MOCNORDIC_TRACE_DUMP_TIMEOUT_MS));
+    return copied;
+}
+
+void MOCNordicTrace::dumpAbort()
+{
+    k_spinlock_key_t key = k_spin_lock(&dumpLock);
+    dumping = false;
+    atomic_set(&paused, 0);
+    k_spin_unlock(&dumpLock, key);
+}
+
+void MOCNordicTrace::clear()
+{
+    atomic_set(&head, 0);
+    dumpAbort();
+}
+
+#if defined(CONFIG_ARCH_POSIX) && defined(CONFIG_EXTERNAL_LIBC)
+int MOCNordicTrace::dumpToFile(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if(!file)
+        return -EIO;
+
+    /* drop a partially read stream */
+    dumpAbort();
+    uint8_t buffer[64];
+    uint32_t length;
+    while((length = readDump(buffer, sizeof(buffer))) != 0) {
+        fwrite(buffer, 1, length, file);
+    }
+    fclose(file);
+    return 0;
+}
+
+static void dumpOnExit()
+{
+    const char *path = getenv("MOCNORDIC_TRACE_FILE");
+    if(path) {
+        MOCNordicTrace::dumpToFile(path);
+    }
+}
+
+NATIVE_TASK(dumpOnExit, ON_EXIT_PRE, 0);
+#else
+int MOCNordicTrace::dumpToFile(const char *path)
+{
+    return -ENOTSUP;
+}
+#endif
+
+#endif
+
+} /* MOCNordic */
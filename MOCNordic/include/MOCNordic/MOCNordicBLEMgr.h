@@ -12,13 +12,68 @@
 #include <bluetooth/gatt_dm.h>
 #include <bluetooth/scan.h>
 #include <vector>
+#include <algorithm>
 #include <array>
 #include <string>
 #include <set>
 #include <unordered_map>
 #include <MOCNordic/MOCZephyrType.h>
+#include <MOCNordic/MOCNordicHandleMap.h>
+#include <MOCNordic/MOCNordicRouter.h>
+#include <MOCNordic/MOCNordicConfig.h>
+#include <MOCNordic/MOCNordicGattTask.h>
+#include <MOCNordic/MOCNordicReportMapStream.h>
+#include <MOCNordic/MOCNordicPriority.h>
 namespace MOCNordic {
 
+/**
+ * @brief one heap every peripheral's report map is grown in while it is read, CONFIG_MOCNORDIC_REPORT_MAP_POOL_SIZE
+ * @note a slot only holds what its map needs, a map the pool can't grow any more is cut like one over CONFIG_MOCNORDIC_REPORT_MAP_SIZE
+ */
+class ReportMapPool {
+public:
+    ReportMapPool() = delete;
+
+    struct Stats {
+        uint32_t capacity;
+        /* bytes handed out, without the heap's own chunk headers */
+        uint32_t used;
+        uint32_t peakUsed;
+        uint32_t allocFailed;
+    };
+
+    static uint8_t *alloc(size_t size);
+    /* nullptr is fine */
+    static void free(uint8_t *map, size_t size);
+    static Stats stats();
+};
+
+/**
+ * @brief life cycle of one peripheral slot, every change is a compare and swap from an allowed state
+ */
+enum class LinkState : uint8_t {
+    Free = 0,
+    /* waiting for the scanner */
+    Targeted,
+    Connected,
+    Secured,
+    Discovering,
+    /* notifications are forwarded */
+    Subscribed,
+};
+
+/**
+ * @brief connection parameters a forwarding link runs with, see MOCNordicBLEMgr::applyLinkPolicy
+ */
+enum class LinkProfile : uint8_t {
+    /* 7.5 ms, no peripheral latency */
+    Active = 0,
+    /* no notification for CONFIG_MOCNORDIC_IDLE_MS, subrated or a longer interval */
+    Idle,
+    /* the usb host sleeps */
+    Suspended,
+};
+
 class MOCNordicBLEMgr {
 
 public:
@@ -55,6 +110,109 @@ public:
 
     static void printSequenceInfo();
 
+    /* layout records of every link whose bring-up finished, a new recording session starts with them */
+    static void recordLayouts();
+
+    /* USB suspend or resume, moves every forwarding link to the matching connection parameters */
+    static void hostPowerChanged(bool suspended);
+
+    /**
+     * @brief output report from the usb host to the peripheral, without the report id prefix
+     * @note reportId 0 if the peripheral doesn't use report ids; a report queued while the previous one is
+     *       still being written replaces it, only the latest state (LEDs) reaches the peripheral
+     * @retval 0 queued, -ENOTCONN link not forwarding, -ENOENT no such output report, -EMSGSIZE too long
+     */
+    static int writeOutputReport(uint8_t index, uint8_t reportId, const uint8_t *data, uint32_t length);
+
+    static LinkState linkState(uint8_t index)
+    {
+        return static_cast<LinkState>(atomic_get(&PeripheralSequence[index].state));
+    }
+
+    /* lock free, true once the slot is subscribed and its forwarder is set */
+    static bool isForwarding(uint8_t index)
+    {
+        return index < PeripheralSequence.size() && linkState(index) == LinkState::Subscribed;
+    }
+
+    /* links currently up */
+    static uint32_t connectedCount()
+    {
+        uint32_t cnt = 0;
+        for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+            if(linkState(i) >= LinkState::Connected)
+                ++cnt;
+        }
+        return cnt;
+    }
+
+    /* targets without a link, the scan manager scans while this isn't 0 */
+    static uint32_t targetedCount()
+    {
+        uint32_t cnt = 0;
+        for(uint8_t i = 0; i < PeripheralSequence.size(); i++) {
+            if(linkState(i) == LinkState::Targeted)
+                ++cnt;
+        }
+        return cnt;
+    }
+
+    /* one slot as seen from outside, for the scaling bench and the shell */
+    struct LinkStats {
+        LinkState state;
+        /* connected to the last bring-up step, -1 while the bring-up runs */
+        int32_t readyMs;
+        uint32_t connIntervalUs;
+        uint32_t notifications;
+        /* notifications the forwarder refused (endpoint busy, no route) */
+        uint32_t forwardFailed;
+        /* output reports from the host the peripheral acknowledged, worst us from the host to the write response */
+        uint32_t outputWrites;
+        uint32_t maxOutputUs;
+        uint8_t bearers;
+    };
+
+    static LinkStats linkStats(uint8_t index);
+
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    /* one lane of the forwarding thread, see ReportLane */
+    struct LaneStats {
+        uint32_t queued;
+        uint32_t forwarded;
+        /* notifySubscribe to the forwarder call */
+        uint32_t maxWaitUs;
+        uint64_t sumWaitUs;
+    };
+
+    struct ForwardStats {
+        std::array<LaneStats, reportLanes> lanes;
+        /* urgent by content, queued bulk behind earlier reports of the same link */
+        uint32_t held;
+        /* the queue was full, also forward failures of the link */
+        uint32_t dropped;
+        /* bulk forwarded ahead of waiting urgent reports, CONFIG_MOCNORDIC_FORWARD_URGENT_BURST */
+        uint32_t starved;
+        uint32_t peakQueued;
+    };
+
+    static ForwardStats forwardStats();
+    static void resetForwardStats();
+#endif
+
+    /* the link's report map as parsed during the read, nullptr for a slot out of range */
+    static const ReportMapStream *reportMapStream(uint8_t index)
+    {
+        if(index > PeripheralSequence.size() - 1)
+            return nullptr;
+        return &PeripheralSequence[index].mapStream;
+    }
+
+    /* transitions rejected because the slot wasn't in an allowed state, each one is a race that lost */
+    static uint32_t invalidTransitions()
+    {
+        return static_cast<uint32_t>(atomic_get(&invalidTransitionCnt));
+    }
+
     struct BLECallback {
         struct bt_conn_auth_cb auth_cb;
         struct bt_conn_auth_info_cb auth_info_cb;
@@ -89,18 +247,52 @@ public:
     {
         if(index > PeripheralSequence.size() - 1)
             return;
-        auto charHandle = PeripheralSequence[index].refHandleCharHandleMap.find(refHandle);
-        if(charHandle != PeripheralSequence[index].refHandleCharHandleMap.end()) {
-            PeripheralSequence[index].charHandleReportIdMap[charHandle->second] = reportId;
-        }
+        PeripheralSequence[index].handleMap.registerReportId(refHandle, reportId);
     }
 
     static void registerRefHandleCharHandleMap(uint16_t index, uint16_t refHandle, uint16_t charHandle)
     {
         if(index > PeripheralSequence.size() - 1)
             return;
-        PeripheralSequence[index].refHandleCharHandleMap[refHandle] = charHandle;
+        PeripheralSequence[index].handleMap.registerRefHandle(refHandle, charHandle);
+    }
+
+#if defined(CONFIG_MOCNORDIC_BENCH)
+    /* bench only, walks the slot to subscribed without a link so reports can be injected */
+    static void benchAttach(uint8_t index)
+    {
+        if(index > PeripheralSequence.size() - 1)
+            return;
+        forwardLanesStart();
+        atomic_set(&PeripheralSequence[index].state, static_cast<atomic_val_t>(LinkState::Free));
+        PeripheralSequence[index].reset();
+        PeripheralSequence[index].clearTarget();
+        PeripheralSequence[index].forwarder = pickForwarder(index);
+        for(auto next: {LinkState::Targeted, LinkState::Connected, LinkState::Secured, LinkState::Discovering, LinkState::Subscribed}) {
+            transition(index, next);
+        }
+    }
+
+    /* bench only, the report map as if the link had read it, sets what the lanes classify by */
+    static void benchReportMap(uint8_t index, const uint8_t *map, uint32_t length)
+    {
+        if(index > PeripheralSequence.size() - 1)
+            return;
+        auto &unit = PeripheralSequence[index];
+        unit.resetReportMap();
+        unit.reportMapInsert(map, length);
+        unit.mapStream.finish();
+        priorityInit(index);
     }
+
+    /* bench only, enters the forwarding path exactly where notifySubscribe does */
+    static int injectNotification(uint8_t index, uint16_t valueHandle, const void *data, uint16_t length)
+    {
+        if(index > PeripheralSequence.size() - 1)
+            return -EINVAL;
+        return dispatchNotification(index, valueHandle, data, length);
+    }
+#endif
 private:
     struct NameAndAddr {
         char name_str[32];
@@ -115,90 +307,375 @@ private:
             return sizeof(addr);
         }
     };
-    /* inline static MOCZephyr::ZMsgqControl<NameAndAddr, 16> scanRecvMsgqCtl; */
+    /* inline static MOCZephyr::ZPoolQueue<NameAndAddr, 16> scanRecvPool; */
     
     inline static MOCZephyr::ZWorkControl<32> subscribeWorkCtl;
     inline static int currentWorkCnt = 0;
-    struct PeripheralUnit {
-        struct SubscribeParam {
-            struct bt_gatt_subscribe_params subscribeParams;
-            struct bt_gatt_discover_params discoverParams;
-            
+
+    /* report path of one link, reportId is -1 if the report has no report id prefix */
+    using NotifyForwarder = int (*)(uint8_t index, int reportId, uint8_t *data, uint32_t length);
+
+    /* report reference descriptor, second byte */
+    enum ReportRefType : uint8_t {
+        ReportRefInput = 1,
+        ReportRefOutput = 2,
+        ReportRefFeature = 3,
+    };
+
+    /* one writable report characteristic, it is an output report once its reference said so */
+    struct OutputReport {
+        uint16_t valueHandle;
+        uint16_t refHandle;
+        /* -1 until the report reference was read */
+        int16_t reportId;
+        uint8_t length;
+        /* latest report from the host, not handed to the stack yet */
+        bool pending;
+        /* a writeOutput task owns the report */
+        bool writing;
+        /* the host sent the pending report */
+        uint32_t queuedCyc;
+        std::array<uint8_t, Capacity::usbReportSize> data;
+    };
+
+    /* one peripheral slot, capacities from Kconfig through PeripheralUnit below */
+    template <size_t SubscribeCnt, size_t OutputCnt, size_t ReportMapSize>
+    struct BasicPeripheralUnit {
+        /* first buffer of a map, most maps fit it */
+        inline static constexpr size_t reportMapInitialSize = std::min<size_t>(256, ReportMapSize);
+
+        /* ms after connected, -1 until reached */
+        struct LinkTiming {
+            /* link upgrade finished or timed out, discovery starts */
+            int32_t upgradedMs;
+            int32_t discoveredMs;
+            int32_t refsMs;
+            int32_t subscribedMs;
+            int32_t reportMapMs;
         };
         int64_t linkTimeMs;
-        struct bt_gatt_read_params reportMapReadParams;
-        uint8_t occupied;
+        LinkTiming timing;
+        /* LinkState, only changed through transition() */
+        atomic_t state;
         bt_addr_le_t targetMac;
         struct bt_conn *conn;
-        std::array<SubscribeParam, 10> subscribeParams;
-        uint8_t subscribed;
+        /* filled during discovery, written by subscribeAll */
+        std::array<GattSubscription, SubscribeCnt> subscribeParams;
         uint8_t curSubIndex;
-
-        std::array<uint8_t, 768> reportMap;
-
-
-        std::unordered_map<uint16_t, uint8_t> charHandleReportIdMap;
-        std::unordered_map<uint16_t, uint16_t> refHandleCharHandleMap;
+        /* connection interval and last notification, for the scan manager's event gap stats */
+        uint32_t connIntervalUs;
+        uint32_t lastNotifyCyc;
+        /* bt rx thread only */
+        uint32_t notifyCnt;
+        /* bt rx thread, and the forwarding thread with CONFIG_MOCNORDIC_FORWARD_LANES */
+        atomic_t forwardFailCnt;
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+        /* key and button state of the report map, bt rx thread only */
+        ReportPriority priority;
+        /* reports of this link waiting per lane, left alone by reset() since the forwarding thread counts them down */
+        std::array<atomic_t, reportLanes> laneQueued;
+#endif
+
+        /* report reference descriptors of the subscribed and the output characteristics, read in one read multiple */
+        std::array<uint16_t, SubscribeCnt + OutputCnt> refHandles;
+        uint8_t refCnt;
+        /* written from the usb host, pending, writing and data under outputLock */
+        std::array<OutputReport, OutputCnt> outputs;
+        uint8_t outputCnt;
+        uint32_t outputWrites;
+        /* host to peripheral write response */
+        uint32_t maxOutputUs;
+        /* ATT bearers when the bring-up requests were issued, more than 1 with EATT */
+        uint8_t bearers;
+        /* value handle of the first report map, 0 until discovery found one */
+        uint16_t reportMapHandle;
+        /* set by the discovery manager callbacks or a lost link, bringUp waits on it */
+        GattEvent discovered;
+
+        /* set by the activity monitor once the link went quiet, cleared by the next notification */
+        atomic_t idle;
+        /* profile last requested from the controller, only changed on the system work queue */
+        LinkProfile profile;
+        /* the peer rejected subrating, idle falls back to the longer interval */
+        bool subrateRefused;
+        /* report that woke an idle link, 0 once the link is fast again */
+        uint32_t wakeCyc;
+        /* reports that arrived before the fast parameters were in place */
+        uint32_t slowReports;
+        uint32_t idleEntries;
+        uint32_t maxWakeUs;
+
+        /* LinkUpgrade bits still outstanding */
+        atomic_t upgradePending;
+        /* BringUp bits */
+        atomic_t bringUpFlags;
+        struct bt_gatt_exchange_params mtuParams;
+
+        /* from ReportMapPool, nullptr until the first chunk of the map arrived */
+        uint8_t *reportMap;
+        uint32_t reportMapCapacity;
+        /* parsed chunk by chunk while the map is read, ready when the read ends */
+        ReportMapStream mapStream;
+
+        ReportHandleMap handleMap;
         uint32_t reportMapLength;
+        /* bytes over ReportMapSize or the pool, not stored */
+        uint32_t reportMapTruncated;
         std::function<void(uint8_t *, uint32_t)> getReportMapCallback;
         std::function<void(uint8_t *, uint32_t)> getNotifyCallback;
+        /* picked once per link before it becomes subscribed */
+        NotifyForwarder forwarder;
         /* void (*getReportMapCallback)(uint8_t *data, uint32_t length); */
         /* void (*getNotifyCallback)(uint8_t *data, uint32_t length); */
-        std::array<uint8_t, 768> &getReportMap()
+        uint8_t *getReportMap()
         {
             return reportMap;
         }
 
         void resetReportMap()
         {
-            reportMap.fill(0x00);
+            uint8_t *map = reportMap;
+            reportMap = nullptr;
+            ReportMapPool::free(map, reportMapCapacity);
+            reportMapCapacity = 0;
             reportMapLength = 0;
+            reportMapTruncated = 0;
+            mapStream.reset();
+        }
+
+        /* doubles the buffer until length more bytes fit, at most ReportMapSize */
+        bool reportMapReserve(size_t length)
+        {
+            size_t needed = std::min<size_t>(reportMapLength + length, ReportMapSize);
+            if(needed <= reportMapCapacity)
+                return true;
+            size_t capacity = std::max<size_t>(reportMapCapacity, reportMapInitialSize);
+            while(capacity < needed)
+                capacity *= 2;
+            capacity = std::min(capacity, ReportMapSize);
+            uint8_t *grown = ReportMapPool::alloc(capacity);
+            if(!grown)
+                return false;
+            if(reportMapLength)
+                memcpy(grown, reportMap, reportMapLength);
+            ReportMapPool::free(reportMap, reportMapCapacity);
+            reportMap = grown;
+            reportMapCapacity = capacity;
+            return true;
         }
 
-        void reportMapInsert(const uint8_t *data, size_t length)
+        /* false once the map doesn't fit, the rest is counted and dropped; stored bytes go through mapStream right away */
+        bool reportMapInsert(const uint8_t *data, size_t length)
         {
-            memcpy(reportMap.data() + reportMapLength, data, length);
-            reportMapLength += length;
-            /* reportMap.insert(reportMap.end(), data, static_cast<uint8_t *>(data + length)); */
+            size_t fits = reportMapReserve(length) ? std::min<size_t>(length, reportMapCapacity - reportMapLength) : 0;
+            if(fits) {
+                memcpy(reportMap + reportMapLength, data, fits);
+                mapStream.feed(data, fits);
+            }
+            reportMapLength += fits;
+            reportMapTruncated += length - fits;
+            return fits == length;
         }
 
-        PeripheralUnit() : getReportMapCallback(nullptr), getNotifyCallback(nullptr)
+        BasicPeripheralUnit() : state(ATOMIC_INIT(static_cast<atomic_val_t>(LinkState::Free))), reportMap(nullptr), reportMapCapacity(0),
+            getReportMapCallback(nullptr), getNotifyCallback(nullptr)
         {
             resetReportMap();
             reset();
+            clearTarget();
         }
 
+        /* link data only, the state is left to transition() */
         void reset()
         {
             
             conn = nullptr;
             curSubIndex = 0;
-            subscribed = 0;
-            occupied = 0;
+            forwarder = nullptr;
+            connIntervalUs = 0;
+            lastNotifyCyc = 0;
+            notifyCnt = 0;
+            atomic_clear(&forwardFailCnt);
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+            priority.clear();
+#endif
+            refCnt = 0;
+            outputCnt = 0;
+            outputWrites = 0;
+            maxOutputUs = 0;
+            bearers = 1;
+            reportMapHandle = 0;
+            timing = {-1, -1, -1, -1, -1};
+            atomic_clear(&upgradePending);
+            atomic_clear(&bringUpFlags);
+            atomic_clear(&idle);
+            profile = LinkProfile::Active;
+            subrateRefused = false;
+            wakeCyc = 0;
+            slowReports = 0;
+            idleEntries = 0;
+            maxWakeUs = 0;
             resetReportMap();
+            handleMap.clear();
+        }
+
+        /* the target keeps its address across reconnects, only dropping the target forgets it */
+        void clearTarget()
+        {
             memset(&targetMac, 0, sizeof(targetMac));
-            
+        }
 
+        bool boundTarget() const
+        {
+            static constexpr uint8_t unbound[BT_ADDR_SIZE] = {};
+            return memcmp(targetMac.a.val, unbound, BT_ADDR_SIZE) != 0;
         }
 
         bool empty()
         {
-            return !occupied;
+            return static_cast<LinkState>(atomic_get(&state)) == LinkState::Free;
         }
         
     };
     
-    inline static std::array<PeripheralUnit, CONFIG_BT_MAX_PAIRED> PeripheralSequence;
+    using PeripheralUnit = BasicPeripheralUnit<Capacity::subscriptions, Capacity::outputReports, Capacity::reportMapSize>;
+    inline static std::array<PeripheralUnit, Capacity::peripherals> PeripheralSequence;
+
+    enum LinkUpgrade : uint8_t {
+        UpgradeMtu = 0,
+        UpgradeDataLen,
+        UpgradePhy,
+    };
+
+    enum BringUp : uint8_t {
+        BringUpPaired = 0,
+        /* report map and report ids are final until the link drops */
+        BringUpDone,
+    };
+
+    /* upgrade timeout per slot, kept out of PeripheralUnit so CONTAINER_OF stays on a standard layout type */
+    struct LinkWork {
+        struct k_work_delayable work;
+        uint8_t index;
+    };
+    inline static std::array<LinkWork, Capacity::peripherals> upgradeWorks;
+    /* CONFIG_MOCNORDIC_BRINGUP_TIMEOUT_MS from discovery to the last bring-up step */
+    inline static std::array<LinkWork, Capacity::peripherals> bringUpWorks;
+    /* 7.5 ms without peripheral latency, links are created and resumed with it */
+    inline static constexpr struct bt_le_conn_param activeConnParam = {
+        .interval_min = 6,
+        .interval_max = 6,
+        .latency = 0,
+        .timeout = 50,
+    };
+#if defined(CONFIG_MOCNORDIC_SUSPEND_LINK_POLICY)
+    inline static constexpr struct bt_le_conn_param suspendConnParam = {
+        .interval_min = CONFIG_MOCNORDIC_SUSPEND_INTERVAL,
+        .interval_max = CONFIG_MOCNORDIC_SUSPEND_INTERVAL,
+        .latency = CONFIG_MOCNORDIC_SUSPEND_LATENCY,
+        .timeout = CONFIG_MOCNORDIC_SUSPEND_TIMEOUT,
+    };
+    /* supervision timeout in 10 ms units, interval in 1.25 ms units */
+    static_assert(suspendConnParam.timeout * 10 * 4 > (1 + suspendConnParam.latency) * suspendConnParam.interval_max * 5 * 2,
+        "CONFIG_MOCNORDIC_SUSPEND_TIMEOUT must exceed (1 + latency) * interval * 2");
+#endif
+#if defined(CONFIG_MOCNORDIC_IDLE_LINK_POLICY)
+    inline static constexpr struct bt_le_conn_param idleConnParam = {
+        .interval_min = CONFIG_MOCNORDIC_IDLE_INTERVAL,
+        .interval_max = CONFIG_MOCNORDIC_IDLE_INTERVAL,
+        .latency = CONFIG_MOCNORDIC_IDLE_LATENCY,
+        .timeout = activeConnParam.timeout,
+    };
+    static_assert(idleConnParam.timeout * 10 * 4 > (1 + idleConnParam.latency) * idleConnParam.interval_max * 5 * 2,
+        "idle interval and latency don't fit the supervision timeout of the active parameters");
+#if defined(CONFIG_BT_SUBRATING)
+    /* idle links keep the active interval and skip events, a report brings the link back within one subrated event */
+    inline static constexpr struct bt_conn_le_subrate_param activeSubrate = {
+        .subrate_min = 1,
+        .subrate_max = 1,
+        .max_latency = 0,
+        .continuation_number = 0,
+        .supervision_timeout = activeConnParam.timeout,
+    };
+    inline static constexpr struct bt_conn_le_subrate_param idleSubrate = {
+        .subrate_min = CONFIG_MOCNORDIC_IDLE_SUBRATE,
+        .subrate_max = CONFIG_MOCNORDIC_IDLE_SUBRATE,
+        .max_latency = 0,
+        .continuation_number = CONFIG_MOCNORDIC_IDLE_CONTINUATION,
+        .supervision_timeout = activeConnParam.timeout,
+    };
+    static_assert(idleSubrate.continuation_number < idleSubrate.subrate_max, "continuation number must be below the subrate factor");
+    static_assert(activeConnParam.timeout * 10 * 4 > idleSubrate.subrate_max * activeConnParam.interval_max * 5 * 2,
+        "subrated interval doesn't fit the supervision timeout of the active parameters");
+#endif
+#endif
+    /* set by hostPowerChanged, the parameters are applied on the system work queue */
+    inline static atomic_t hostSuspended = ATOMIC_INIT(0);
+    inline static struct k_work linkPolicyWork;
+    /* every CONFIG_MOCNORDIC_IDLE_MS / 2, marks quiet links idle */
+    inline static struct k_work_delayable activityWork;
+    static void linkPolicyApply(struct k_work *work);
+    static void activityCheck(struct k_work *work);
+    /**
+     * @brief moves one link to the profile its idle flag and the host state ask for
+     * @note suspended beats idle beats active; with subrating, idle and active only differ in the subrate factor
+     */
+    static void applyLinkPolicy(uint8_t index);
+    static const struct bt_le_conn_param &connParamFor(uint8_t index, LinkProfile profile);
+    static bool usesSubrating(uint8_t index);
+    /* the fast parameters of a woken link are in place, prints how long that took */
+    static void wakeDone(uint8_t index);
+
+    /* bt_conn_index -> slot + 1, 0 if the connection has no slot; set in connected, cleared in disconnected */
+    inline static std::array<atomic_t, CONFIG_BT_MAX_CONN> connSlots;
+    inline static atomic_t invalidTransitionCnt = ATOMIC_INIT(0);
+
+    /**
+     * @retval slot of the connection, -1 if it has none (not claimed yet or already released)
+     */
+    static int slotOf(const struct bt_conn *conn)
+    {
+        return static_cast<int>(atomic_get(&connSlots[bt_conn_index(conn)])) - 1;
+    }
+
     static PeripheralUnit *getPeripheralUnitByConn(struct bt_conn *conn)
     {
-        uint8_t index = bt_conn_index(conn);
-        /* for(auto &it: PeripheralSequence) {
-            if(conn == it.conn)
-                return &it;
-        } */
-        return &PeripheralSequence[index];
+        int slot = slotOf(conn);
+        return slot < 0 ? nullptr : &PeripheralSequence[slot];
+    }
+
+    /* states a transition into the given state may start from */
+    static constexpr uint32_t allowedFrom(LinkState to)
+    {
+        constexpr auto bit = [](LinkState state) { return 1u << static_cast<uint8_t>(state); };
+        switch(to) {
+        case LinkState::Free:
+            return ~bit(LinkState::Free);
+        case LinkState::Targeted:
+            return ~bit(LinkState::Targeted);
+        case LinkState::Connected:
+            return bit(LinkState::Free) | bit(LinkState::Targeted);
+        case LinkState::Secured:
+            return bit(LinkState::Connected);
+        case LinkState::Discovering:
+            return bit(LinkState::Secured);
+        case LinkState::Subscribed:
+            return bit(LinkState::Discovering);
+        }
+        return 0;
     }
 
+    /**
+     * @brief compare and swap from the current state if allowedFrom(to) has it
+     * @retval false and the invalid transition is counted otherwise
+     */
+    static bool transition(uint8_t index, LinkState to);
+    /* plain compare and swap for picking a slot, losing to another claimer is expected and not counted */
+    static bool claim(uint8_t index, LinkState from, LinkState to);
+    /* claims a slot for a new link, prefers the target with the same address, then an unbound target, then any target,
+       then a free slot; binds the slot to the peer's address so the peer gets it back on reconnect */
+    static int claimSlot(struct bt_conn *conn);
+
     
 
     inline static std::set<std::string> scanTargetNameSequence;
@@ -210,17 +687,87 @@ private:
     static void disconnected(struct bt_conn *conn, uint8_t reason);
     static void security_changed(struct bt_conn *conn, bt_security_t level, enum bt_security_err err);
     
-    static uint8_t read_report_map_cb(struct bt_conn *conn, uint8_t err,
-                                 struct bt_gatt_read_params *params,
-                                 const void *data, uint16_t length);
-
     static void dm_discover_completed(struct bt_gatt_dm *dm, void *context);
+
+    /**
+     * @brief discovery, then report map, report references and CCC writes of one link as one coroutine
+     * @note report map, report references and subscriptions run concurrently; on timeout the link is dropped,
+     *       the stack then fails whatever is outstanding and the task returns
+     */
+    static GattTask bringUp(uint8_t index);
+    static GattTask readReportMap(uint8_t index);
+    static GattTask readReportRefs(uint8_t index);
+    static GattTask subscribeAll(uint8_t index);
+    /* report id of a subscribed characteristic, or of an output report if the reference says output */
+    static void registerReportRef(uint8_t index, uint16_t refHandle, const uint8_t *ref, uint32_t length);
+    /* writes the output report until nothing is pending, runs detached */
+    static GattTask writeOutput(uint8_t index, uint8_t output);
+    inline static struct k_spinlock outputLock;
+    static void bringUpTimeout(struct k_work *work);
+    static void recordLayout(uint8_t index);
+    /* stores now - linkTimeMs, prints the bring-up breakdown once every step is done */
+    static void linkMilestone(uint8_t index, int32_t &milestone);
+
+    /**
+     * @brief right after encryption, requests max ATT MTU, max data length and 2M PHY
+     * @note discovery waits until every request completed or CONFIG_MOCNORDIC_LINK_UPGRADE_TIMEOUT_MS passed
+     */
+    static void linkUpgradeStart(struct bt_conn *conn);
+    static void linkUpgradeDone(uint8_t index, LinkUpgrade step);
+    static void linkUpgradeTimeout(struct k_work *work);
+    /* starts discovery once the link is paired and the upgrade is over, only the first call per link does */
+    static void discoveryStart(uint8_t index);
     static void ServiceNotFound(struct bt_conn *conn, void *context);
 
     inline static unsigned int subscribe_count = 0;
 
 
     static uint8_t notifySubscribe(struct bt_conn *conn, struct bt_gatt_subscribe_params *params, const void *data, uint16_t length);
+    /* forwards right away, or queues for the forwarding thread with CONFIG_MOCNORDIC_FORWARD_LANES */
+    static int dispatchNotification(uint8_t index, uint16_t valueHandle, const void *data, uint16_t length);
+    /**
+     * @brief report id lookup + notify callback, shared by notifySubscribe and the bench injector
+     * @retval 0 forwarded, -ENOENT slot not subscribed or nothing registered
+     */
+    static int forwardNotification(uint8_t index, uint16_t valueHandle, const void *data, uint16_t length);
+    /**
+     * @brief report id prefix from the handle map, then the value cut to the largest notification the MTU allows
+     * @param reportId set to the report id, -1 if the report has no prefix
+     * @retval report length
+     */
+    static uint16_t buildReport(PeripheralUnit &unit, uint16_t valueHandle, const void *data, uint16_t length, uint8_t *report, int &reportId);
+    /* the link's forwarder on a built report, -ENOENT if the slot isn't subscribed */
+    static int forwardReport(uint8_t index, int reportId, uint8_t *report, uint32_t length);
+    /* the key and button layout the lanes classify by, from the parsed report map */
+    static void priorityInit(uint8_t index);
+    /* starts the forwarding thread once, BLEStackInit and the bench call it */
+    static void forwardLanesStart();
+#if defined(CONFIG_MOCNORDIC_FORWARD_LANES)
+    struct QueuedReport {
+        uint32_t queuedCyc;
+        int16_t reportId;
+        uint16_t length;
+        uint8_t index;
+        /* built by buildReport */
+        std::array<uint8_t, 1 + Capacity::notifyPayload> report;
+    };
+    inline static MOCZephyr::ZPoolQueue<QueuedReport, CONFIG_MOCNORDIC_FORWARD_QUEUE, reportLanes> forwardQueue;
+    inline static bool forwardStarted = false;
+    /* queued and held in the bt rx thread, the rest in the forwarding thread */
+    inline static std::array<LaneStats, reportLanes> laneStats;
+    inline static uint32_t heldCnt;
+    /**
+     * @brief classifies the notification and queues the built report on its lane
+     * @note a report never overtakes an earlier one of its link, it joins the lane those wait in
+     * @retval 0 queued, -ENOENT slot not subscribed, -ENOMEM queue full
+     */
+    static int queueNotification(uint8_t index, uint16_t valueHandle, const void *data, uint16_t length);
+    static void forwardThread(void *p1, void *p2, void *p3);
+#endif
+    /* routing table if the peripheral has a route, else the registered notify callback, else the interface of its own index */
+    static NotifyForwarder pickForwarder(uint8_t index);
+    static int forwardToCallback(uint8_t index, int reportId, uint8_t *data, uint32_t length);
+    static int forwardToOwnInterface(uint8_t index, int reportId, uint8_t *data, uint32_t length);
 
 
     static void BLEStackCallbacksInit();
@@ -0,0 +1,110 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+namespace MOCNordic {
+
+/**
+ * @brief fixed size latency sample store, summarized into percentiles after the run
+ */
+template <size_t Capacity>
+struct BenchSamples {
+    struct Summary {
+        uint32_t count;
+        uint32_t p50;
+        uint32_t p90;
+        uint32_t p99;
+        uint32_t max;
+    };
+
+    std::array<uint32_t, Capacity> samples;
+    uint32_t count;
+    /* samples which didn't fit, still counted */
+    uint32_t overflow;
+
+    void reset()
+    {
+        count = 0;
+        overflow = 0;
+    }
+
+    void add(uint32_t value)
+    {
+        if(count < Capacity)
+            samples[count++] = value;
+        else
+            ++overflow;
+    }
+
+    Summary summarize()
+    {
+        Summary ret = {};
+        if(!count)
+            return ret;
+
+        std::sort(samples.begin(), samples.begin() + count);
+        ret.count = count + overflow;
+        ret.p50 = samples[(count - 1) * 50 / 100];
+        ret.p90 = samples[(count - 1) * 90 / 100];
+        ret.p99 = samples[(count - 1) * 99 / 100];
+        ret.max = samples[count - 1];
+        return ret;
+    }
+
+    /* prints "name":{...} without a trailing separator */
+    void print(const char *name)
+    {
+        Summary summary = summarize();
+        printk("\"%s\":{\"count\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}", name,
+            summary.count, summary.p50, summary.p90, summary.p99, summary.max);
+    }
+};
+
+/**
+ * @brief synthetic report injection benchmark for the forwarding path, see CONFIG_MOCNORDIC_BENCH
+ */
+class MOCNordicBench {
+public:
+    MOCNordicBench() = delete;
+
+    /* runs the configured scenario and prints one "BENCH {json}" line */
+    static int run();
+
+#if defined(CONFIG_MOCNORDIC_BENCH_USBIP)
+    /* first byte of a vendor output report, must match scripts/mocnordic_usbip.py */
+    enum class VendorCommand : uint8_t {
+        /* peripheral, length, payload, injected as a notification of the peripheral */
+        Inject = 0x01,
+        /* payload is written back on the vendor interface, usb/ip round trip without forwarding */
+        Echo = 0x02,
+        /* interface, deviceUnitInit with the other bench report map, the whole device re-enumerates */
+        Enumerate = 0x03,
+        /* replies injected, forwarded, failed and dropped commands as 4 little endian u32 */
+        Stats = 0x04,
+    };
+
+    /* exports the interfaces over usb/ip and serves vendor commands, doesn't return */
+    static int serve();
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_REPLAY)
+    /* replays the MOCNORDIC_REPLAY_FILE capture of scripts/mocnordic_record.py and prints one "REPLAY {json}" line */
+    static int replay();
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_PRIORITY)
+    /* keyboard and mouse bursts, prints one "PRIORITY {json}" line with the key and motion latency */
+    static int priority();
+#endif
+
+#if defined(CONFIG_MOCNORDIC_BENCH_BSIM)
+    /* connects the simulated peripherals, forwards their reports and prints one "SCALE {json}" line */
+    static int scale();
+#endif
+
+    /* host monotonic clock on native_sim, cycle counter elsewhere */
+    static uint64_t nowNs();
+};
+
+} /* MOCNordic */
@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * capacities of the fixed size containers come from Kconfig (menu "Capacities"),
+ * the host build has no autoconf.h and gets the Kconfig defaults here
+ */
+#if !defined(CONFIG_MOCNORDIC_REPORT_MAP_SIZE)
+#define CONFIG_MOCNORDIC_REPORT_MAP_SIZE 768
+#endif
+#if !defined(CONFIG_MOCNORDIC_REPORT_DESC_SIZE)
+#define CONFIG_MOCNORDIC_REPORT_DESC_SIZE 768
+#endif
+#if !defined(CONFIG_MOCNORDIC_REPORT_DESC_PARTS)
+#define CONFIG_MOCNORDIC_REPORT_DESC_PARTS 16
+#endif
+#if !defined(CONFIG_MOCNORDIC_SUBSCRIPTIONS)
+#define CONFIG_MOCNORDIC_SUBSCRIPTIONS 10
+#endif
+#if !defined(CONFIG_MOCNORDIC_OUTPUT_REPORTS)
+#define CONFIG_MOCNORDIC_OUTPUT_REPORTS 2
+#endif
+
+namespace MOCNordic {
+namespace Capacity {
+
+/* report map read from one peripheral */
+inline constexpr size_t reportMapSize = CONFIG_MOCNORDIC_REPORT_MAP_SIZE;
+/* report descriptor of one usb interface, the peripheral map plus whatever the class stages add */
+inline constexpr size_t reportDescSize = CONFIG_MOCNORDIC_REPORT_DESC_SIZE;
+inline constexpr size_t reportDescParts = CONFIG_MOCNORDIC_REPORT_DESC_PARTS;
+/* notifying characteristics subscribed per peripheral */
+inline constexpr size_t subscriptions = CONFIG_MOCNORDIC_SUBSCRIPTIONS;
+/* output report characteristics written per peripheral */
+inline constexpr size_t outputReports = CONFIG_MOCNORDIC_OUTPUT_REPORTS;
+
+static_assert(reportDescSize >= reportMapSize, "a peripheral report map must fit a usb report descriptor");
+static_assert(subscriptions <= 0xFF, "subscription counters are 8 bits");
+static_assert(subscriptions + outputReports <= 0xFF, "report reference counters are 8 bits");
+
+#if defined(__ZEPHYR__)
+inline constexpr size_t peripherals = CONFIG_MOCNORDIC_PERIPHERALS;
+/* BT_ATT_MTU of the host stack, the smaller L2CAP MTU, l2cap header is 4 bytes */
+inline constexpr size_t attMtu = std::min<size_t>(CONFIG_BT_L2CAP_TX_MTU, CONFIG_BT_BUF_ACL_RX_SIZE - 4);
+/* notification value, opcode and handle take 3 bytes */
+inline constexpr size_t notifyPayload = attMtu - 3;
+/* read response value, opcode takes 1 byte */
+inline constexpr size_t readPayload = attMtu - 1;
+#if defined(CONFIG_HID_INTERRUPT_EP_MPS)
+inline constexpr size_t usbReportSize = CONFIG_HID_INTERRUPT_EP_MPS;
+#else
+/* no usb device stack (nrf52_bsim), the emulated endpoint takes full speed packets */
+inline constexpr size_t usbReportSize = 64;
+#endif
+
+static_assert(peripherals <= CONFIG_BT_MAX_CONN, "every peripheral needs its own connection");
+static_assert(peripherals <= 32, "peripheral masks are 32 bits");
+static_assert(attMtu >= 23, "ATT needs at least the default MTU");
+static_assert(usbReportSize <= 64, "full speed interrupt endpoints carry at most 64 bytes");
+#endif
+
+} /* Capacity */
+} /* MOCNordic */
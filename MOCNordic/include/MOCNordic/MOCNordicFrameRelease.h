@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <array>
+#include <algorithm>
+namespace MOCNordic {
+
+/**
+ * @brief reports of one interface held until the next usb frame, oldest first, see CONFIG_MOCNORDIC_FRAME_RELEASE
+ * @note not locked, MOCNordicHIDevice holds its spinlock around every call;
+ *       the head stays put between beginRelease() and endRelease() so it can be written without the lock
+ */
+template <size_t Depth, size_t ReportSize>
+class FrameReleaseQueue {
+public:
+    struct Entry {
+        /* class stage handed the report over, age at poll counts from here */
+        uint32_t arrivalCyc;
+        uint32_t length;
+        std::array<uint8_t, ReportSize> data;
+    };
+
+    struct Stats {
+        uint32_t queued;
+        /* replaced a waiting report instead of taking a slot */
+        uint32_t coalesced;
+        /* every slot was taken, the report was refused */
+        uint32_t overflows;
+        /* the endpoint still had the last report at the frame start */
+        uint32_t busyFrames;
+        /* the endpoint failed the report for good, it was dropped */
+        uint32_t dropped;
+        uint32_t maxDepth;
+    };
+
+    FrameReleaseQueue() : head(0), count(0), releasing(false), stats {}
+    {
+    }
+
+    /* waiting reports are dropped, a report being written stays until its endRelease() */
+    void clear()
+    {
+        count = releasing ? 1 : 0;
+    }
+
+    /**
+     * @brief supersedes(const uint8_t *older, const uint8_t *newer, uint32_t length) decides whether
+     *        the report may replace the newest waiting one
+     * @retval false if the report was longer than a slot or every slot is taken
+     */
+    template <typename Supersedes>
+    bool push(const uint8_t *report, uint32_t length, uint32_t arrivalCyc, Supersedes &&supersedes)
+    {
+        if(length > ReportSize)
+            return false;
+        /* the head may be on its way to the endpoint, it is never replaced then */
+        if(count && !(releasing && count == 1)) {
+            Entry &tail = entries[(head + count - 1) % Depth];
+            if(tail.length == length && supersedes(tail.data.data(), report, length)) {
+                memcpy(tail.data.data(), report, length);
+                tail.arrivalCyc = arrivalCyc;
+                ++stats.coalesced;
+                return true;
+            }
+        }
+        if(count == Depth) {
+            ++stats.overflows;
+            return false;
+        }
+        Entry &entry = entries[(head + count) % Depth];
+        entry.arrivalCyc = arrivalCyc;
+        entry.length = length;
+        memcpy(entry.data.data(), report, length);
+        ++count;
+        ++stats.queued;
+        stats.maxDepth = std::max<uint32_t>(stats.maxDepth, count);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return !count;
+    }
+
+    /* arrival of the oldest waiting report, only valid if not empty */
+    uint32_t headArrival() const
+    {
+        return entries[head].arrivalCyc;
+    }
+
+    /* the oldest report, nullptr if there is none or it is being released already */
+    const Entry *beginRelease()
+    {
+        if(!count || releasing)
+            return nullptr;
+        releasing = true;
+        return &entries[head];
+    }
+
+    /**
+     * @param err of the endpoint write, -EAGAIN keeps the report first for the next frame,
+     *        any other error drops it like a sent one
+     */
+    void endRelease(int err)
+    {
+        if(!releasing)
+            return;
+        releasing = false;
+        if(err == -EAGAIN) {
+            ++stats.busyFrames;
+            return;
+        }
+        if(err)
+            ++stats.dropped;
+        if(count) {
+            head = (head + 1) % Depth;
+            --count;
+        }
+    }
+
+    const Stats &getStats() const
+    {
+        return stats;
+    }
+
+    void resetStats()
+    {
+        stats = {};
+    }
+
+private:
+    std::array<Entry, Depth> entries;
+    uint32_t head;
+    uint32_t count;
+    bool releasing;
+    Stats stats;
+};
+
+} /* MOCNordic */
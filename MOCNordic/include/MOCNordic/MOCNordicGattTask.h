@@ -0,0 +1,457 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <array>
+#include <coroutine>
+#include <cstdint>
+#include <utility>
+namespace MOCNordic {
+
+/**
+ * @brief fixed size blocks every GattTask frame is allocated from, no heap
+ * @note CONFIG_MOCNORDIC_GATT_FRAME_SIZE and CONFIG_MOCNORDIC_GATT_FRAMES, a frame which doesn't fit fails the task with -ENOMEM
+ */
+class GattFramePool {
+public:
+    GattFramePool() = delete;
+
+    struct Stats {
+        uint32_t capacity;
+        uint32_t used;
+        uint32_t peakUsed;
+        uint32_t allocFailed;
+        /* largest frame asked for, size CONFIG_MOCNORDIC_GATT_FRAME_SIZE from it */
+        uint32_t largestFrame;
+    };
+
+    static void *alloc(size_t size);
+    static void free(void *frame);
+    static Stats stats();
+};
+
+/**
+ * @brief outcome of one awaited GATT operation
+ * @note err is 0, a negative errno if the request couldn't be sent or the link went down, or the positive ATT error of the peer
+ */
+struct GattResult {
+    int err;
+    /* bytes handed to the sink of a read */
+    uint32_t length;
+    /* request to completion */
+    uint32_t us;
+};
+
+/* coroutine waiting for one stack callback, the awaitables below embed it next to their bt params */
+struct GattOp {
+    std::coroutine_handle<> waiter;
+    int err;
+    uint32_t length;
+    uint32_t startCyc;
+    uint32_t us;
+
+    void start(std::coroutine_handle<> handle)
+    {
+        waiter = handle;
+        err = 0;
+        length = 0;
+        us = 0;
+        startCyc = k_cycle_get_32();
+    }
+
+    /* resumes the waiter, the op may be gone once this returns */
+    void complete(int result)
+    {
+        err = result;
+        us = k_cyc_to_us_floor32(k_cycle_get_32() - startCyc);
+        auto handle = std::exchange(waiter, nullptr);
+        if(handle)
+            handle.resume();
+    }
+
+    GattResult result() const
+    {
+        return GattResult {err, length, us};
+    }
+};
+
+/**
+ * @brief lazily started coroutine returning 0 or an error, frames come from GattFramePool
+ * @note co_await runs it to completion, detach() runs it without a parent and frees the frame at the end;
+ *       every awaited operation completes through a stack callback, so a frame is never freed while the stack holds its params
+ */
+class GattTask {
+public:
+    /* whenAll counts its children down here */
+    struct Join {
+        atomic_t remaining;
+        std::coroutine_handle<> parent;
+    };
+
+    struct promise_type {
+        int value = 0;
+        std::coroutine_handle<> continuation;
+        Join *join = nullptr;
+        bool detached = false;
+
+        static void *operator new(size_t size) noexcept
+        {
+            return GattFramePool::alloc(size);
+        }
+
+        static void operator delete(void *frame)
+        {
+            GattFramePool::free(frame);
+        }
+
+        static GattTask get_return_object_on_allocation_failure()
+        {
+            return GattTask();
+        }
+
+        GattTask get_return_object()
+        {
+            return GattTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                auto &promise = handle.promise();
+                if(promise.join) {
+                    /* the last child resumes the parent */
+                    if(atomic_dec(&promise.join->remaining) == 1)
+                        return promise.join->parent;
+                    return std::noop_coroutine();
+                }
+                if(promise.detached) {
+                    handle.destroy();
+                    return std::noop_coroutine();
+                }
+                return promise.continuation ? promise.continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_value(int result)
+        {
+            value = result;
+        }
+
+        void unhandled_exception()
+        {
+            k_panic();
+        }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    GattTask() : handle(nullptr) {}
+    explicit GattTask(Handle handle) : handle(handle) {}
+
+    GattTask(const GattTask &) = delete;
+    GattTask &operator=(const GattTask &) = delete;
+
+    GattTask(GattTask &&src) noexcept : handle(std::exchange(src.handle, nullptr)) {}
+
+    GattTask &operator=(GattTask &&src) noexcept
+    {
+        if(this != &src) {
+            reset();
+            handle = std::exchange(src.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~GattTask()
+    {
+        reset();
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(handle);
+    }
+
+    /**
+     * @brief runs the task without a parent, the frame frees itself when it returns
+     * @retval -ENOMEM no frame was available, the task never ran
+     */
+    int detach()
+    {
+        if(!handle)
+            return -ENOMEM;
+        auto started = std::exchange(handle, nullptr);
+        started.promise().detached = true;
+        started.resume();
+        return 0;
+    }
+
+    bool await_ready() const noexcept
+    {
+        return !handle;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) noexcept
+    {
+        handle.promise().continuation = parent;
+        return handle;
+    }
+
+    int await_resume() const noexcept
+    {
+        return handle ? handle.promise().value : -ENOMEM;
+    }
+
+private:
+    template <size_t Count>
+    friend class GattJoin;
+
+    void reset()
+    {
+        if(handle)
+            handle.destroy();
+        handle = nullptr;
+    }
+
+    Handle handle;
+};
+
+/**
+ * @brief starts every child at once and resumes the parent when the last one returned
+ * @note children without a frame count as -ENOMEM and don't run
+ */
+template <size_t Count>
+class GattJoin {
+public:
+    template <typename... Tasks>
+    explicit GattJoin(Tasks &&... tasks) : tasks {std::forward<Tasks>(tasks)...} {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> parent) noexcept
+    {
+        join.parent = parent;
+        /* one extra count so a child finishing while the others start can't resume the parent early */
+        atomic_set(&join.remaining, Count + 1);
+        for(auto &task: tasks) {
+            if(!task) {
+                atomic_dec(&join.remaining);
+                continue;
+            }
+            task.handle.promise().join = &join;
+            task.handle.resume();
+        }
+        /* every child already returned, don't suspend */
+        return atomic_dec(&join.remaining) != 1;
+    }
+
+    std::array<int, Count> await_resume() noexcept
+    {
+        std::array<int, Count> results;
+        for(size_t i = 0; i < Count; i++)
+            results[i] = tasks[i].await_resume();
+        return results;
+    }
+
+private:
+    std::array<GattTask, Count> tasks;
+    GattTask::Join join;
+};
+
+/**
+ * @brief co_await whenAll(a(), b(), c()) runs the tasks concurrently, the result holds each task's return value in order
+ */
+template <typename... Tasks>
+GattJoin<sizeof...(Tasks)> whenAll(Tasks &&... tasks)
+{
+    return GattJoin<sizeof...(Tasks)>(std::forward<Tasks>(tasks)...);
+}
+
+/**
+ * @brief single handle read, long values arrive in chunks, or a read multiple of fixed size values
+ */
+struct GattRead {
+    /* every chunk of the value, return false to stop reading */
+    using Sink = bool (*)(void *context, const uint8_t *data, uint16_t length);
+
+    struct bt_gatt_read_params params;
+    struct bt_conn *conn;
+    Sink sink;
+    void *context;
+    GattOp op;
+    /* the sink asked to stop, a read multiple still waits for its closing callback */
+    bool sinkStopped;
+
+    GattRead(struct bt_conn *conn, uint16_t handle, Sink sink, void *context);
+    /* read multiple of at least 2 handles, handles must stay valid until the read completed */
+    GattRead(struct bt_conn *conn, uint16_t *handles, uint8_t count, Sink sink, void *context);
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle);
+
+    GattResult await_resume() const noexcept
+    {
+        return op.result();
+    }
+
+private:
+    static uint8_t onRead(struct bt_conn *conn, uint8_t err, struct bt_gatt_read_params *params, const void *data, uint16_t length);
+};
+
+/* write request, data must stay valid until the write completed */
+struct GattWrite {
+    struct bt_gatt_write_params params;
+    struct bt_conn *conn;
+    GattOp op;
+
+    GattWrite(struct bt_conn *conn, uint16_t handle, const void *data, uint16_t length);
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle);
+
+    GattResult await_resume() const noexcept
+    {
+        return op.result();
+    }
+
+private:
+    static void onWrite(struct bt_conn *conn, uint8_t err, struct bt_gatt_write_params *params);
+};
+
+/**
+ * @brief subscription which outlives the coroutine, notifications keep arriving through params.notify
+ * @note fill params except subscribe, GattSubscribe sets it
+ */
+struct GattSubscription {
+    struct bt_gatt_subscribe_params params;
+    /* CCC auto discovery, only used if params.ccc_handle is 0 */
+    struct bt_gatt_discover_params discoverParams;
+    GattOp op;
+};
+
+/* CCC write of one subscription */
+struct GattSubscribe {
+    struct bt_conn *conn;
+    GattSubscription &subscription;
+
+    GattSubscribe(struct bt_conn *conn, GattSubscription &subscription) : conn(conn), subscription(subscription) {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle);
+
+    GattResult await_resume() const noexcept
+    {
+        return subscription.op.result();
+    }
+
+private:
+    static void onSubscribed(struct bt_conn *conn, uint8_t err, struct bt_gatt_subscribe_params *params);
+};
+
+/**
+ * @brief one shot connection event with an int result, set from any callback, awaited by at most one coroutine
+ * @note set() before the wait is kept, the wait then doesn't suspend; reset() only while nobody waits
+ */
+class GattEvent {
+public:
+    GattEvent() : isSet(false), value(0), waiter(nullptr) {}
+
+    void reset()
+    {
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        isSet = false;
+        value = 0;
+        waiter = nullptr;
+        k_spin_unlock(&lock, key);
+    }
+
+    /* later calls are ignored until reset() */
+    void set(int result)
+    {
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        if(isSet) {
+            k_spin_unlock(&lock, key);
+            return;
+        }
+        isSet = true;
+        value = result;
+        auto handle = std::exchange(waiter, nullptr);
+        k_spin_unlock(&lock, key);
+        if(handle)
+            handle.resume();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        bool suspend = !isSet;
+        if(suspend)
+            waiter = handle;
+        k_spin_unlock(&lock, key);
+        return suspend;
+    }
+
+    int await_resume() const noexcept
+    {
+        return value;
+    }
+
+private:
+    struct k_spinlock lock;
+    bool isSet;
+    int value;
+    std::coroutine_handle<> waiter;
+};
+
+/* GattRead sink filling a plain buffer, what doesn't fit is counted in dropped */
+struct GattBuffer {
+    uint8_t *data;
+    uint32_t capacity;
+    uint32_t length;
+    uint32_t dropped;
+
+    GattBuffer(uint8_t *data, uint32_t capacity) : data(data), capacity(capacity), length(0), dropped(0) {}
+
+    static bool sink(void *context, const uint8_t *data, uint16_t length);
+};
+
+} /* MOCNordic */
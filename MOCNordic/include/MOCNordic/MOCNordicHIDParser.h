@@ -0,0 +1,625 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+namespace MOCNordic {
+
+/**
+ * @brief HID report descriptor parser, no zephyr dependency so it's built on the host as well
+ * @note bit offsets are relative to the report payload, the report id byte is not counted
+ */
+
+enum class HIDReportType : uint8_t {
+    Input = 1,
+    Output = 2,
+    Feature = 3,
+};
+
+/* usages are kept extended, usage page in the upper 16 bits */
+inline constexpr uint32_t HIDUsage(uint16_t page, uint16_t id)
+{
+    return (static_cast<uint32_t>(page) << 16) | id;
+}
+
+namespace HIDUsages {
+inline constexpr uint32_t GenericDesktopPointer = HIDUsage(0x01, 0x01);
+inline constexpr uint32_t GenericDesktopMouse = HIDUsage(0x01, 0x02);
+inline constexpr uint32_t GenericDesktopKeyboard = HIDUsage(0x01, 0x06);
+inline constexpr uint32_t GenericDesktopX = HIDUsage(0x01, 0x30);
+inline constexpr uint32_t GenericDesktopY = HIDUsage(0x01, 0x31);
+inline constexpr uint32_t DigitizerTouchPad = HIDUsage(0x0D, 0x05);
+inline constexpr uint32_t DigitizerConfiguration = HIDUsage(0x0D, 0x0E);
+inline constexpr uint32_t DigitizerFinger = HIDUsage(0x0D, 0x22);
+inline constexpr uint32_t DigitizerTipSwitch = HIDUsage(0x0D, 0x42);
+inline constexpr uint32_t DigitizerConfidence = HIDUsage(0x0D, 0x47);
+inline constexpr uint32_t DigitizerContactId = HIDUsage(0x0D, 0x51);
+inline constexpr uint32_t DigitizerInputMode = HIDUsage(0x0D, 0x52);
+inline constexpr uint32_t DigitizerContactCount = HIDUsage(0x0D, 0x54);
+inline constexpr uint32_t DigitizerContactCountMax = HIDUsage(0x0D, 0x55);
+inline constexpr uint32_t DigitizerScanTime = HIDUsage(0x0D, 0x56);
+inline constexpr uint32_t DigitizerSurfaceSwitch = HIDUsage(0x0D, 0x57);
+inline constexpr uint32_t DigitizerButtonSwitch = HIDUsage(0x0D, 0x58);
+inline constexpr uint32_t DigitizerPadType = HIDUsage(0x0D, 0x59);
+inline constexpr uint32_t VendorPTPCertification = HIDUsage(0xFF00, 0xC5);
+inline constexpr uint16_t KeyboardPage = 0x07;
+inline constexpr uint16_t ButtonPage = 0x09;
+inline constexpr uint16_t ConsumerPage = 0x0C;
+inline constexpr uint16_t VendorPageFirst = 0xFF00;
+} /* HIDUsages */
+
+struct HIDItem {
+    /* first byte with the size bits cleared */
+    uint8_t tag;
+    uint8_t size;
+    uint32_t data;
+
+    int32_t signedData() const
+    {
+        if(size == 1)
+            return static_cast<int8_t>(data);
+        if(size == 2)
+            return static_cast<int16_t>(data);
+        return static_cast<int32_t>(data);
+    }
+};
+
+namespace HIDItemTag {
+inline constexpr uint8_t Input = 0x80;
+inline constexpr uint8_t Output = 0x90;
+inline constexpr uint8_t Feature = 0xB0;
+inline constexpr uint8_t Collection = 0xA0;
+inline constexpr uint8_t EndCollection = 0xC0;
+inline constexpr uint8_t UsagePage = 0x04;
+inline constexpr uint8_t LogicalMinimum = 0x14;
+inline constexpr uint8_t LogicalMaximum = 0x24;
+inline constexpr uint8_t ReportSize = 0x74;
+inline constexpr uint8_t ReportId = 0x84;
+inline constexpr uint8_t ReportCount = 0x94;
+inline constexpr uint8_t Push = 0xA4;
+inline constexpr uint8_t Pop = 0xB4;
+inline constexpr uint8_t Usage = 0x08;
+inline constexpr uint8_t UsageMinimum = 0x18;
+inline constexpr uint8_t UsageMaximum = 0x28;
+inline constexpr uint8_t LongItem = 0xFC;
+} /* HIDItemTag */
+
+struct HIDCollection {
+    uint16_t index;
+    /* 0 physical, 1 application, 2 logical, ... as in the collection item */
+    uint8_t kind;
+    uint8_t depth;
+    uint32_t usage;
+    /* byte offsets of the collection item and the end collection item in the descriptor */
+    uint32_t beginOffset;
+    uint32_t endOffset;
+};
+
+struct HIDField {
+    HIDReportType type;
+    uint8_t reportId;
+    uint16_t bitOffset;
+    uint8_t bitSize;
+    uint16_t count;
+    /* variable field: usage of this field, array field: usage minimum */
+    uint32_t usage;
+    /* array field: usage maximum */
+    uint32_t usageMax;
+    /* main item data bits */
+    uint8_t flags;
+    int32_t logicalMin;
+    int32_t logicalMax;
+    /* innermost collection and the application collection around it */
+    uint16_t collection;
+    uint32_t collectionUsage;
+    uint32_t applicationUsage;
+
+    bool isConstant() const
+    {
+        return flags & 0x01;
+    }
+
+    bool isVariable() const
+    {
+        return flags & 0x02;
+    }
+
+    bool isRelative() const
+    {
+        return flags & 0x04;
+    }
+
+    uint32_t bitEnd() const
+    {
+        return bitOffset + bitSize * count;
+    }
+};
+
+class HIDParserVisitor {
+public:
+    virtual ~HIDParserVisitor() = default;
+    virtual void onCollection(const HIDCollection &collection) {}
+    virtual void onEndCollection(const HIDCollection &collection) {}
+    virtual void onField(const HIDField &field) {}
+};
+
+class HIDReportParser {
+public:
+    inline static constexpr uint32_t maxUsages = 16;
+    inline static constexpr uint32_t maxDepth = 8;
+    inline static constexpr uint32_t maxReports = 32;
+    inline static constexpr uint32_t maxGlobalStack = 4;
+
+    HIDReportParser()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        memset(&global, 0, sizeof(global));
+        globalStackDepth = 0;
+        clearLocal();
+        depth = 0;
+        collectionCnt = 0;
+        reportCnt = 0;
+        reportIdSeen = false;
+        malformed = false;
+        restartStream();
+    }
+
+    /**
+     * @brief walks a complete report descriptor
+     * @retval false if the descriptor is malformed, what was parsed until then is still reported
+     */
+    bool parse(const uint8_t *data, uint32_t length, HIDParserVisitor &visitor)
+    {
+        restartStream();
+        feed(data, length, visitor);
+        return finish();
+    }
+
+    /**
+     * @brief walks the next part of a descriptor which arrives in chunks, items may be split between them
+     * @note offsets handed to the visitor count from the first fed byte; reset() starts a new descriptor
+     */
+    bool feed(const uint8_t *data, uint32_t length, HIDParserVisitor &visitor)
+    {
+        uint32_t offset = 0;
+        HIDItem item;
+        while(offset < length) {
+            if(skipRemaining) {
+                uint32_t skip = std::min(skipRemaining, length - offset);
+                skipRemaining -= skip;
+                offset += skip;
+                streamOffset += skip;
+                continue;
+            }
+            if(!pendingLength) {
+                /* usual case, the whole item is in this chunk */
+                uint32_t itemOffset = offset;
+                if(nextItem(data, length, offset, item)) {
+                    handleItem(item, streamOffset, visitor);
+                    streamOffset += offset - itemOffset;
+                    continue;
+                }
+            }
+            /* the item continues in the next chunk, collect it byte by byte */
+            pending[pendingLength++] = data[offset++];
+            uint32_t needed = itemLength(pending.data(), pendingLength);
+            if(!needed)
+                continue;
+            if(pending[0] == longItemPrefix) {
+                /* only the length of a long item matters, the rest is skipped */
+                skipRemaining = needed - pendingLength;
+                streamOffset += pendingLength;
+                pendingLength = 0;
+                continue;
+            }
+            if(pendingLength < needed)
+                continue;
+            uint32_t pendingOffset = 0;
+            nextItem(pending.data(), pendingLength, pendingOffset, item);
+            handleItem(item, streamOffset, visitor);
+            streamOffset += pendingLength;
+            pendingLength = 0;
+        }
+        return !malformed;
+    }
+
+    /* end of a fed descriptor, an item cut off by the end makes it malformed */
+    bool finish()
+    {
+        if(pendingLength || skipRemaining)
+            malformed = true;
+        pendingLength = 0;
+        skipRemaining = 0;
+        return !malformed;
+    }
+
+    /* bytes fed since the descriptor started */
+    uint32_t fedLength() const
+    {
+        return streamOffset + pendingLength;
+    }
+
+    bool isMalformed() const
+    {
+        return malformed;
+    }
+
+    /**
+     * @brief decode the item at offset and move offset behind it
+     * @retval false if the item doesn't fit into the buffer
+     */
+    static bool nextItem(const uint8_t *data, uint32_t length, uint32_t &offset, HIDItem &item)
+    {
+        uint8_t prefix = data[offset];
+        if(prefix == longItemPrefix) {
+            /* long items are reserved and never used, skip them */
+            if(offset + 2 >= length)
+                return false;
+            uint32_t itemLength = 3 + data[offset + 1];
+            if(offset + itemLength > length)
+                return false;
+            item.tag = HIDItemTag::LongItem;
+            item.size = 0;
+            item.data = 0;
+            offset += itemLength;
+            return true;
+        }
+
+        uint8_t size = (prefix & 0x03) == 0x03 ? 4 : (prefix & 0x03);
+        if(offset + 1 + size > length)
+            return false;
+
+        item.tag = prefix & 0xFC;
+        item.size = size;
+        item.data = 0;
+        for(uint8_t i = 0; i < size; i++) {
+            item.data |= static_cast<uint32_t>(data[offset + 1 + i]) << (8 * i);
+        }
+        offset += 1 + size;
+        return true;
+    }
+
+    /* size of a report without the report id byte */
+    uint32_t reportBits(HIDReportType type, uint8_t reportId) const
+    {
+        for(uint32_t i = 0; i < reportCnt; i++) {
+            if(reports[i].type == type && reports[i].id == reportId)
+                return reports[i].bits;
+        }
+        return 0;
+    }
+
+    uint32_t reportBytes(HIDReportType type, uint8_t reportId) const
+    {
+        return (reportBits(type, reportId) + 7) / 8;
+    }
+
+    bool usesReportIds() const
+    {
+        return reportIdSeen;
+    }
+
+    struct GlobalState {
+        uint16_t usagePage;
+        int32_t logicalMin;
+        int32_t logicalMax;
+        uint32_t reportSize;
+        uint32_t reportCount;
+        uint8_t reportId;
+    };
+
+    /* global items as of the item being visited */
+    const GlobalState &globalState() const
+    {
+        return global;
+    }
+
+protected:
+    inline static constexpr uint8_t longItemPrefix = HIDItemTag::LongItem + 0x02;
+
+    /* whole length of the item starting in data, 0 while a long item's length byte is missing */
+    static uint32_t itemLength(const uint8_t *data, uint32_t available)
+    {
+        if(data[0] == longItemPrefix)
+            return available < 2 ? 0 : 3 + data[1];
+        return 1 + ((data[0] & 0x03) == 0x03 ? 4 : (data[0] & 0x03));
+    }
+
+    void restartStream()
+    {
+        pendingLength = 0;
+        skipRemaining = 0;
+        streamOffset = 0;
+    }
+
+    struct ReportSize {
+        HIDReportType type;
+        uint8_t id;
+        uint32_t bits;
+    };
+
+    void clearLocal()
+    {
+        usageCnt = 0;
+        usageMin = 0;
+        usageMax = 0;
+        hasUsageMin = false;
+        hasUsageMax = false;
+    }
+
+    uint32_t extendUsage(const HIDItem &item) const
+    {
+        if(item.size == 4)
+            return item.data;
+        return HIDUsage(global.usagePage, static_cast<uint16_t>(item.data));
+    }
+
+    uint32_t &reportOffset(HIDReportType type, uint8_t reportId)
+    {
+        for(uint32_t i = 0; i < reportCnt; i++) {
+            if(reports[i].type == type && reports[i].id == reportId)
+                return reports[i].bits;
+        }
+        if(reportCnt < maxReports) {
+            reports[reportCnt] = {type, reportId, 0};
+            return reports[reportCnt++].bits;
+        }
+        malformed = true;
+        overflowReport.bits = 0;
+        return overflowReport.bits;
+    }
+
+    void handleMainField(HIDReportType type, const HIDItem &item, HIDParserVisitor &visitor)
+    {
+        uint32_t &offset = reportOffset(type, global.reportId);
+
+        HIDField field;
+        field.type = type;
+        field.reportId = global.reportId;
+        field.bitSize = static_cast<uint8_t>(global.reportSize);
+        field.flags = static_cast<uint8_t>(item.data);
+        field.logicalMin = global.logicalMin;
+        field.logicalMax = global.logicalMax;
+        if(depth) {
+            const HIDCollection &inner = collectionStack[depth - 1];
+            field.collection = inner.index;
+            field.collectionUsage = inner.usage;
+        }
+        else {
+            field.collection = 0xFFFF;
+            field.collectionUsage = 0;
+        }
+        field.applicationUsage = applicationUsage();
+
+        if(!field.isVariable() || field.isConstant()) {
+            /* array or padding, one field for the whole item */
+            field.bitOffset = static_cast<uint16_t>(offset);
+            field.count = static_cast<uint16_t>(global.reportCount);
+            field.usage = hasUsageMin ? usageMin : (usageCnt ? usages[0] : 0);
+            field.usageMax = hasUsageMax ? usageMax : (usageCnt ? usages[usageCnt - 1] : 0);
+            visitor.onField(field);
+        }
+        else {
+            /* variable, one field per usage, the last usage covers the remaining count */
+            uint32_t i = 0;
+            while(i < global.reportCount) {
+                field.bitOffset = static_cast<uint16_t>(offset + i * global.reportSize);
+                uint32_t remaining = global.reportCount - i;
+                if(hasUsageMin && hasUsageMax && usageMin + i <= usageMax) {
+                    field.usage = usageMin + i;
+                    field.count = 1;
+                }
+                else if(i + 1 < usageCnt) {
+                    field.usage = usages[i];
+                    field.count = 1;
+                }
+                else {
+                    field.usage = usageCnt ? usages[usageCnt - 1] : (hasUsageMax ? usageMax : 0);
+                    field.count = static_cast<uint16_t>(remaining);
+                }
+                field.usageMax = field.usage;
+                visitor.onField(field);
+                i += field.count;
+            }
+        }
+
+        offset += global.reportSize * global.reportCount;
+    }
+
+    uint32_t applicationUsage() const
+    {
+        for(uint32_t i = depth; i > 0; i--) {
+            if(collectionStack[i - 1].kind == 0x01)
+                return collectionStack[i - 1].usage;
+        }
+        return 0;
+    }
+
+    void handleItem(const HIDItem &item, uint32_t itemOffset, HIDParserVisitor &visitor)
+    {
+        switch(item.tag) {
+        case HIDItemTag::Input:
+            handleMainField(HIDReportType::Input, item, visitor);
+            clearLocal();
+            break;
+        case HIDItemTag::Output:
+            handleMainField(HIDReportType::Output, item, visitor);
+            clearLocal();
+            break;
+        case HIDItemTag::Feature:
+            handleMainField(HIDReportType::Feature, item, visitor);
+            clearLocal();
+            break;
+        case HIDItemTag::Collection: {
+            if(depth >= maxDepth) {
+                malformed = true;
+                break;
+            }
+            HIDCollection &collection = collectionStack[depth];
+            collection.index = collectionCnt++;
+            collection.kind = static_cast<uint8_t>(item.data);
+            collection.depth = depth;
+            collection.usage = usageCnt ? usages[0] : (hasUsageMin ? usageMin : 0);
+            collection.beginOffset = itemOffset;
+            collection.endOffset = 0;
+            ++depth;
+            visitor.onCollection(collection);
+            clearLocal();
+            break;
+        }
+        case HIDItemTag::EndCollection:
+            if(!depth) {
+                malformed = true;
+                break;
+            }
+            --depth;
+            collectionStack[depth].endOffset = itemOffset;
+            visitor.onEndCollection(collectionStack[depth]);
+            clearLocal();
+            break;
+        case HIDItemTag::UsagePage:
+            global.usagePage = static_cast<uint16_t>(item.data);
+            break;
+        case HIDItemTag::LogicalMinimum:
+            global.logicalMin = item.signedData();
+            break;
+        case HIDItemTag::LogicalMaximum:
+            /* logical maximum is unsigned when the minimum is not negative */
+            global.logicalMax = global.logicalMin >= 0 ? static_cast<int32_t>(item.data) : item.signedData();
+            break;
+        case HIDItemTag::ReportSize:
+            global.reportSize = item.data;
+            break;
+        case HIDItemTag::ReportId:
+            global.reportId = static_cast<uint8_t>(item.data);
+            reportIdSeen = true;
+            break;
+        case HIDItemTag::ReportCount:
+            global.reportCount = item.data;
+            break;
+        case HIDItemTag::Push:
+            if(globalStackDepth < maxGlobalStack)
+                globalStack[globalStackDepth++] = global;
+            else
+                malformed = true;
+            break;
+        case HIDItemTag::Pop:
+            if(globalStackDepth)
+                global = globalStack[--globalStackDepth];
+            else
+                malformed = true;
+            break;
+        case HIDItemTag::Usage:
+            if(usageCnt < maxUsages)
+                usages[usageCnt++] = extendUsage(item);
+            break;
+        case HIDItemTag::UsageMinimum:
+            usageMin = extendUsage(item);
+            hasUsageMin = true;
+            break;
+        case HIDItemTag::UsageMaximum:
+            usageMax = extendUsage(item);
+            hasUsageMax = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    GlobalState global;
+    std::array<GlobalState, maxGlobalStack> globalStack;
+    uint32_t globalStackDepth;
+
+    std::array<uint32_t, maxUsages> usages;
+    uint32_t usageCnt;
+    uint32_t usageMin;
+    uint32_t usageMax;
+    bool hasUsageMin;
+    bool hasUsageMax;
+
+    std::array<HIDCollection, maxDepth> collectionStack;
+    uint32_t depth;
+    uint16_t collectionCnt;
+
+    std::array<ReportSize, maxReports> reports;
+    ReportSize overflowReport;
+    uint32_t reportCnt;
+    bool reportIdSeen = false;
+    bool malformed;
+
+    /* a short item split between two chunks, at most 5 bytes */
+    std::array<uint8_t, 5> pending;
+    uint32_t pendingLength;
+    /* rest of a long item still to come */
+    uint32_t skipRemaining;
+    uint32_t streamOffset;
+};
+
+/* little endian bit field access as used by HID reports */
+struct HIDBits {
+    static uint32_t get(const uint8_t *buffer, uint32_t bitOffset, uint32_t bitSize)
+    {
+        uint32_t value = 0;
+        for(uint32_t i = 0; i < bitSize && i < 32; i++) {
+            uint32_t bit = bitOffset + i;
+            value |= static_cast<uint32_t>((buffer[bit >> 3] >> (bit & 0x07)) & 0x01) << i;
+        }
+        return value;
+    }
+
+    static void set(uint8_t *buffer, uint32_t bitOffset, uint32_t bitSize, uint32_t value)
+    {
+        for(uint32_t i = 0; i < bitSize && i < 32; i++) {
+            uint32_t bit = bitOffset + i;
+            if((value >> i) & 0x01)
+                buffer[bit >> 3] |= (1U << (bit & 0x07));
+            else
+                buffer[bit >> 3] &= ~(1U << (bit & 0x07));
+        }
+    }
+
+    static void copy(uint8_t *dst, uint32_t dstOffset, const uint8_t *src, uint32_t srcOffset, uint32_t bitSize)
+    {
+        if(!(dstOffset & 0x07) && !(srcOffset & 0x07) && !(bitSize & 0x07)) {
+            memcpy(dst + (dstOffset >> 3), src + (srcOffset >> 3), bitSize >> 3);
+            return;
+        }
+        for(uint32_t i = 0; i < bitSize; i++) {
+            set(dst, dstOffset + i, 1, get(src, srcOffset + i, 1));
+        }
+    }
+
+    static void clear(uint8_t *buffer, uint32_t bitOffset, uint32_t bitSize)
+    {
+        if(!(bitOffset & 0x07) && !(bitSize & 0x07)) {
+            memset(buffer + (bitOffset >> 3), 0, bitSize >> 3);
+            return;
+        }
+        for(uint32_t i = 0; i < bitSize; i++) {
+            set(buffer, bitOffset + i, 1, 0);
+        }
+    }
+
+    static bool isZero(const uint8_t *buffer, uint32_t bitOffset, uint32_t bitSize)
+    {
+        if(!(bitOffset & 0x07) && !(bitSize & 0x07)) {
+            const uint8_t *bytes = buffer + (bitOffset >> 3);
+            for(uint32_t i = 0; i < (bitSize >> 3); i++) {
+                if(bytes[i])
+                    return false;
+            }
+            return true;
+        }
+        for(uint32_t i = 0; i < bitSize; i++) {
+            if(get(buffer, bitOffset + i, 1))
+                return false;
+        }
+        return true;
+    }
+};
+
+} /* MOCNordic */
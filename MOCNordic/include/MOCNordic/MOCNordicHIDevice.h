@@ -15,289 +15,58 @@
 #include <memory>
 #include <array>
 #include <MOCNordic/MOCZephyrType.h>
+#include <MOCNordic/MOCNordicReportDesc.h>
+#include <MOCNordic/MOCNordicTouchpad.h>
+#include <MOCNordic/MOCNordicKeyboard.h>
+#include <MOCNordic/MOCNordicWake.h>
+#include <MOCNordic/MOCNordicReportMapStream.h>
+#include <MOCNordic/MOCNordicFrameRelease.h>
+#include <MOCNordic/MOCNordicUsbLayout.h>
+#include <MOCNordic/MOCNordicConfig.h>
 namespace MOCNordic {
 
 
-enum class ReportDescType {
-    Keyboard,
-    Mouse,
-    Touchpad,
-    CustomSPP,
-    UNKNOWN,
-};
-
-
-
-struct ReportDesc {
-
-    struct TouchpadRecRet {
-        uint8_t fingerCnt;
-        uint8_t contactCountReportId;
-        bool isValid()
-        {
-            return (fingerCnt && contactCountReportId);
-        }
-        TouchpadRecRet() : fingerCnt(0), contactCountReportId(0) {}
-    };
-
-    /**
-     * @brief touchpad won't be available in usb hid if we don't answer the max contact count report
-     */
-    TouchpadRecRet touchpadRec()
-    {
-        TouchpadRecRet ret;
-        auto length = getDescLength();
-        uint32_t index = 0;
-        uint8_t *dataPtr = desc.data();
-
-        uint8_t reportId = 0;
-       
-        while(index < length) {
-            uint8_t itemTag = dataPtr[index] & (((0x0FU) << (4U)) | ((0x03U) << (2U)));
-            uint8_t itemSize = ((uint8_t)(dataPtr[index] & (0x03U<<(0U))) == (3U) ? 4 : (uint8_t)(dataPtr[index] & (0x03U<<(0U))));
-            if(index + itemSize >= length)
-                break;
-
-            int32_t itemData = 0;
-
-            if(itemSize == 1)
-                itemData = dataPtr[index + 1];
-            else if(itemSize == 2)
-                itemData = *((int16_t *)(&dataPtr[index + 1]));
-            else if(itemSize == 4)
-                itemData = *((int32_t *)(&dataPtr[index + 1]));
-
-            /* usage */
-            if((itemTag & (0x03U<<(2U))) == (0x02U<<(2U))) {
-                /* touchpad, currently only support one touchpad */
-                if(itemData == 0x05) {
-                    ret.fingerCnt = 0;
-                }
-
-                /* finger */
-                if(itemData == 0x22) {
-                    ++ret.fingerCnt;
-                }
-
-                if(itemData == 0x55) {
-                    ret.contactCountReportId = reportId;
-                }
-            }
-            /* reportId */
-            else if((itemTag & (0x03U<<(2U))) == (0x01U<<(2U))) {
-                if(itemTag == ((0x01U<<(2U))|(0x08U<<(4U))|((uint8_t)0&(0x03U<<(0U))))) {
-                    reportId = itemData;
-                    
-                }
-            }
-
-            index += (itemSize + 1);
-            
-        }
-        if(ret.contactCountReportId && ret.fingerCnt) {
-            setType(0, ReportDescType::Touchpad);
-        }
-        return ret;
-    }
-
-    /* reportId, cnt */
-    std::array<uint8_t, 2> reportContactCnt;
-
-    /* first byte reportId */
-    inline static uint8_t reportCertIn[] =
-    {
-        0x00, 0xfc, 0x28, 0xfe, 0x84, 0x40, 0xcb, 0x9a, 0x87, 0x0d, 0xbe, 0x57, 0x3c, 0xb6, 0x70, 0x09, 0x88, 0x07, 0x97, 0x2d, 0x2b, 0xe3, 0x38, 0x34, 0xb6, 0x6c, 0xed, 0xb0, 0xf7, 0xe5, 0x9c, 0xf6,0xc2, 
-        0x2e, 0x84, 0x1b, 0xe8, 0xb4, 0x51, 0x78, 0x43, 0x1f, 0x28, 0x4b, 0x7c, 0x2d, 0x53, 0xaf, 0xfc, 0x47, 0x70, 0x1b, 0x59, 0x6f, 0x74, 0x43, 0xc4, 0xf3, 0x47, 0x18, 0x53, 0x1a, 0xa2, 0xa1,0x71, 
-        0xc7, 0x95, 0x0e, 0x31, 0x55, 0x21, 0xd3, 0xb5, 0x1e, 0xe9, 0x0c, 0xba, 0xec, 0xb8, 0x89, 0x19, 0x3e, 0xb3, 0xaf, 0x75, 0x81, 0x9d, 0x53, 0xb9, 0x41, 0x57, 0xf4, 0x6d, 0x39, 0x25, 0x29,0x7c, 
-        0x87, 0xd9, 0xb4, 0x98, 0x45, 0x7d, 0xa7, 0x26, 0x9c, 0x65, 0x3b, 0x85, 0x68, 0x89, 0xd7, 0x3b, 0xbd, 0xff, 0x14, 0x67, 0xf2, 0x2b, 0xf0, 0x2a, 0x41, 0x54, 0xf0, 0xfd, 0x2c, 0x66, 0x7c,0xf8, 
-        0xc0, 0x8f, 0x33, 0x13, 0x03, 0xf1, 0xd3, 0xc1, 0x0b, 0x89, 0xd9, 0x1b, 0x62, 0xcd, 0x51, 0xb7, 0x80, 0xb8, 0xaf, 0x3a, 0x10, 0xc1, 0x8a, 0x5b, 0xe8, 0x8a, 0x56, 0xf0, 0x8c, 0xaa, 0xfa,0x35, 
-        0xe9, 0x42, 0xc4, 0xd8, 0x55, 0xc3, 0x38, 0xcc, 0x2b, 0x53, 0x5c, 0x69, 0x52, 0xd5, 0xc8, 0x73, 0x02, 0x38, 0x7c, 0x73, 0xb6, 0x41, 0xe7, 0xff, 0x05, 0xd8, 0x2b, 0x79, 0x9a, 0xe2, 0x34,0x60, 
-        0x8f, 0xa3, 0x32, 0x1f, 0x09, 0x78, 0x62, 0xbc, 0x80, 0xe3, 0x0f, 0xbd, 0x65, 0x20, 0x08, 0x13, 0xc1, 0xe2, 0xee, 0x53, 0x2d, 0x86, 0x7e, 0xa7, 0x5a, 0xc5, 0xd3, 0x7d, 0x98, 0xbe, 0x31,0x48, 
-        0x1f, 0xfb, 0xda, 0xaf, 0xa2, 0xa8, 0x6a, 0x89, 0xd6, 0xbf, 0xf2, 0xd3, 0x32, 0x2a, 0x9a, 0xe4, 0xcf, 0x17, 0xb7, 0xb8, 0xf4, 0xe1, 0x33, 0x08, 0x24, 0x8b, 0xc4, 0x43, 0xa5, 0xe5, 0x24,0xc2
-    };
-    /* can't save with desc because usb initilize use one memory block */
-    struct DescApartStorage {
-        ReportDescType type;
-        uint32_t length;
-    };
-    /* 4 device compose max */
-    std::array<DescApartStorage, 16> storageSequence;
-    /* spp + reportMap may not over 512 bytes, use vector will cause memory error */
-    std::array<uint8_t, 768> desc;
-    
-    ReportDescType getType(uint8_t index)
-    {
-        return storageSequence[index].type;
-    }
-
-    void setType(uint8_t index, ReportDescType type)
-    {
-        storageSequence[index].type = type;
-    }
-
-    uint8_t *data()
-    {
-        return desc.data();
-    }
-
-    size_t size()
-    {
-        return getDescLength();
-    }
-
-    bool insert(const uint8_t *data, uint32_t length, ReportDescType type)
-    {
-        uint32_t previoutLength = 0;
-
-        for(auto &it: storageSequence) {
-            if(it.length) {
-                previoutLength += it.length;
-            }
-            else {
-                it.length = length;
-                it.type = type;
-                
-                memcpy(desc.data() + previoutLength, data, length);
-                return true;
-            }
-
-        }
-
-        return false;
-    }
-
-    uint32_t getDescLength()
-    {
-        uint32_t retval = 0;
-        for(auto &it: storageSequence) {
-            if(it.length)
-                retval += it.length;
-            
-        }
-        return retval;
-    }
-
-    bool remove(size_t index)
-    {
-        if(index > storageSequence.size() - 1)
-            return false;
-
-        storageSequence[index].length = 0;
-    }
-
-
-    void clear()
-    {
-        desc.fill(0x00);
-        for(auto &it: storageSequence) {
-            it.length = 0;
-            it.type = ReportDescType::UNKNOWN;
-        }
-    }
-
-    ReportDesc()
-    {
-        clear();
-    }
-
-    ReportDesc(const uint8_t *data, uint32_t length)
-    {
-        insert(data, length, ReportDescType::UNKNOWN);
-
-    }
-
-    ReportDesc(const uint8_t *data, uint32_t length, ReportDescType type)
-    {
-        insert(data, length, type);
-
-    }
-
-    ReportDesc(ReportDesc &src)
-    {
-        clear();
-        /* std::copy(desc.begin(), src.desc.begin(), src.desc.end()); */
-        /* std::copy(storageSequence.begin(), src.storageSequence.begin(), src.storageSequence.end()); */
-        memcpy(desc.data(), src.desc.data(), src.desc.size());
-        memcpy(storageSequence.data(), src.storageSequence.data(), storageSequence.size() * sizeof(DescApartStorage));
-    }
-
-    ReportDesc &operator=(ReportDesc &src) noexcept
-    {
-        clear();
-        /* std::copy(desc.begin(), src.desc.begin(), src.desc.end()); */
-        /* std::copy(storageSequence.begin(), src.storageSequence.begin(), src.storageSequence.end()); */
-        memcpy(desc.data(), src.desc.data(), src.desc.size());
-        memcpy(storageSequence.data(), src.storageSequence.data(), storageSequence.size() * sizeof(DescApartStorage));
-        return *this;
-    }
-
-    ReportDesc &operator=(ReportDesc &&src) noexcept
-    {
-        desc = std::move(src.desc);
-        storageSequence = std::move(src.storageSequence);
-        return *this;
-    }
-
-    static uint32_t getReportSize(uint8_t reportId)
-    {
-        return 0;
-    }
-
-    void recognize()
-    {
-
-        for(auto seqMember: storageSequence) {
-            if(!seqMember.length || seqMember.type != ReportDescType::UNKNOWN)
-                continue;
-            
-        }
-        
-    }
-
-};
-
-struct SPPReportDesc : ReportDesc {
-    
 
-    inline static const uint8_t SPPReportDescBase[] = {
-        0x06, 0x01,0xff, // USAGE_PAGE (Generic Desktop)
-        0x09, 0x00, // USAGE (0)
-        0xa1, 0x01, // COLLECTION (Application)
-        0x85, 0x0C,
-        0x15, 0x00, //     LOGICAL_MINIMUM (0)
-        0x25, 0x01, //     LOGICAL_MAXIMUM (255)�
-        0x19, 0x00, //     USAGE_MINIMUM (1)
-        0x29, 0xff, //     USAGE_MAXIMUM (8)
-        0x95, 63, //     REPORT_COUNT (8)
-        0x75, 0x08, //     REPORT_SIZE (8)
-        0x09,0x01,
-        0x81, 0x01, //     INPUT (Data,Var,Abs)
-        0x09,0x02,
-        0x91, 0x02, //   OUTPUT (Data,Var,Abs)
-        0x09,0x04,
-        0xB1, 0x02, //   OUTPUT (Data,Var,Abs)
-        0xc0 ,       // END_COLLECTION
-
-        
-    };
-
-
-
-
-    SPPReportDesc(uint8_t reportId)
-    {
-        insert(SPPReportDescBase, sizeof(SPPReportDescBase), ReportDescType::CustomSPP);
-        /* desc[8] = reportId; */
-    }
-
-    
+/* class specific report path of one interface, picked when the interface is enumerated */
+using ReportForwarder = int (*)(uint8_t index, const uint8_t *data, uint32_t length);
 
+/* how long reports waited in the endpoint, from leaving the class stage until the host polled them */
+struct PollAge {
+    uint32_t polled;
+    uint64_t sumUs;
+    uint64_t squareSumUs;
+    uint32_t maxUs;
 };
 
 struct MOCNordicHIDeviceUnit {
     ReportDesc reportDesc;
+    ReportForwarder forwarder;
     const struct device *device;
     struct hid_ops callbacks;
+    bool firstReportSent;
+    /* peripheral report map the interface was enumerated with, equal maps don't enumerate again */
+    uint32_t sourceCrc;
+    uint32_t sourceLength;
+    uint8_t peripheral;
+    /* only used when the report map is a precision touchpad */
+    PTPTouchpad touchpad;
+    /* the forwarding path and touchpadFlush both feed the touchpad stage */
+    struct k_mutex touchpadLock;
+    /* sends a held hybrid frame CONFIG_MOCNORDIC_TOUCHPAD_HOLD_MS after it started */
+    struct k_work_delayable touchpadFlush;
+    /* active when the report map has a keyboard collection */
+    KeyboardStage keyboard;
+    /* parsed from the peripheral's report map, picks the reports that wake a suspended host */
+    WakeFilter wake;
+    /* the peripheral's report map has report ids, output reports from the host start with one */
+    bool reportIds;
+    /* class stage hand over of the report in the endpoint, 0 once the host took it */
+    atomic_t inFlightCyc;
+    PollAge pollAge;
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+    /* reports waiting for the next frame, under MOCNordicHIDevice::releaseLock */
+    FrameReleaseQueue<CONFIG_MOCNORDIC_FRAME_RELEASE_DEPTH, Capacity::usbReportSize> release;
+#endif
     /* struct k_sem write_pending; */
     
     int write(uint8_t *buffer, uint32_t length)
@@ -309,23 +78,45 @@ struct MOCNordicHIDeviceUnit {
     }
 
 
-    /* ZMsgqControl msgqCtl; */
+    /* MOCZephyr::ZPoolQueue<Report, 8> reportPool; */
     MOCNordicHIDeviceUnit(MOCNordicHIDeviceUnit &&src) noexcept
     {
         /* printk("MOCNordicHIDeviceUnit called move func.\r\n"); */
         device = std::move(src.device);
         callbacks = std::move(src.callbacks);
+        firstReportSent = src.firstReportSent;
+        sourceCrc = src.sourceCrc;
+        sourceLength = src.sourceLength;
+        peripheral = src.peripheral;
+        forwarder = src.forwarder;
+        touchpad = src.touchpad;
+        keyboard = src.keyboard;
+        wake = src.wake;
+        reportIds = src.reportIds;
+        atomic_set(&inFlightCyc, atomic_get(&src.inFlightCyc));
+        pollAge = src.pollAge;
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+        release = src.release;
+#endif
         reportDesc = std::move(src.reportDesc);
-
+        initKernelObjects();
     }
 
     MOCNordicHIDeviceUnit()
     {
         /* printk("MOCNordicHIDeviceUnit called create func.\r\n"); */
         device = nullptr;
+        forwarder = nullptr;
+        firstReportSent = false;
+        reportIds = false;
+        atomic_clear(&inFlightCyc);
+        pollAge = {};
+        sourceCrc = 0;
+        sourceLength = 0;
+        peripheral = MOCNordicUsbLayout::noPeripheral;
         memset(&callbacks, 0, sizeof(hid_ops));
         /* k_sem_init(&write_pending, 0, 1); */
-
+        initKernelObjects();
     }
 
     MOCNordicHIDeviceUnit(MOCNordicHIDeviceUnit &src)
@@ -333,36 +124,248 @@ struct MOCNordicHIDeviceUnit {
         /* printk("MOCNordicHIDeviceUnit called copy func.\r\n"); */
         device = src.device;
         callbacks = src.callbacks;
+        firstReportSent = src.firstReportSent;
+        sourceCrc = src.sourceCrc;
+        sourceLength = src.sourceLength;
+        peripheral = src.peripheral;
+        forwarder = src.forwarder;
+        touchpad = src.touchpad;
+        keyboard = src.keyboard;
+        wake = src.wake;
+        reportIds = src.reportIds;
+        atomic_set(&inFlightCyc, atomic_get(&src.inFlightCyc));
+        pollAge = src.pollAge;
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+        release = src.release;
+#endif
         reportDesc = src.reportDesc;
-
+        initKernelObjects();
     }
+
+    /* never copied, a copy gets its own */
+    void initKernelObjects();
 };
 
 class MOCNordicHIDevice {
+    /* a unit sets touchpadTimeout up as its flush handler */
+    friend struct MOCNordicHIDeviceUnit;
 public:
 
+    /* interfaces come up with the stored layout where it is still routed, spp otherwise, then usb is enabled once */
     static int init();
     /* defaults to be spp */
     static int createDefault(uint8_t index);
-    static int deviceUnitInit(uint8_t index, ReportDesc &desc);
+    /**
+     * @brief re-enumerates and stores the layout unless the interface already has this report map
+     * @note stream is the map parsed while it was read, the class stages then skip their own parser runs
+     */
+    static int deviceUnitInit(uint8_t index, ReportDesc &desc, uint8_t peripheral = MOCNordicUsbLayout::noPeripheral,
+        const ReportMapStream *stream = nullptr);
 
+    /* forwards one report through the interface's class specific path */
     static int writeToDevice(uint8_t index, uint8_t *data, uint32_t length);
     static int writeToDevice(uint8_t index, uint8_t reportId, uint8_t *data, uint32_t length);
     static void printDesc(uint8_t index);
+    /* reports the keyboard stage dropped or converted, nullptr if index is out of range */
+    static const KeyboardStage::Stats *keyboardStats(uint8_t index);
+
+    /* USB suspend and resume, called from the usb stack */
+    using PowerHook = void (*)(bool suspended);
+    static void setPowerHook(PowerHook hook)
+    {
+        powerHook = hook;
+    }
+
+    /* output report of an interface for the peripheral it was enumerated with, without the report id prefix */
+    using OutputHook = int (*)(uint8_t peripheral, uint8_t reportId, const uint8_t *data, uint32_t length);
+    static void setOutputHook(OutputHook hook)
+    {
+        outputHook = hook;
+    }
+
+    static bool hostSuspended()
+    {
+        return usb_dc_status.suspended;
+    }
+
+    struct PowerStats {
+        uint32_t suspends;
+        /* reports not written because the host was suspended */
+        uint32_t droppedSuspended;
+        uint32_t wakeRequests;
+        /* the host didn't enable remote wakeup or the controller refused */
+        uint32_t wakeRefused;
+        /* press to USB resume */
+        uint32_t lastWakeUs;
+        uint32_t maxWakeUs;
+    };
+
+    static const PowerStats &powerStats()
+    {
+        return powerStatistics;
+    }
+
+    /**
+     * @brief a usb frame starts, with CONFIG_MOCNORDIC_FRAME_RELEASE every interface writes its oldest held report,
+     *        interfaces in the order those reports arrived
+     * @note USB_DC_SOF from the usb stack, the bench calls it from its emulated frame
+     */
+    static void startOfFrame();
+    /* the host took the report of the interface's IN endpoint */
+    static void endpointPolled(uint8_t index);
+
+    struct ReleaseStats {
+        PollAge age;
+        /* FrameReleaseQueue counters, 0 without CONFIG_MOCNORDIC_FRAME_RELEASE */
+        uint32_t queued;
+        uint32_t coalesced;
+        uint32_t overflows;
+        uint32_t busyFrames;
+        uint32_t dropped;
+        uint32_t maxDepth;
+    };
+
+    static ReleaseStats releaseStats(uint8_t index);
+    static void resetReleaseStats();
+
     /* int create(uint8_t index); */
 
+#if defined(CONFIG_MOCNORDIC_BENCH)
+    /* class stage and forwarder of an interface without usb, replayed reports take the real path */
+    static int benchConfigure(uint8_t index, ReportDesc &desc, uint8_t peripheral, const ReportMapStream *stream = nullptr)
+    {
+        if(index > deviceUnits.size() - 1)
+            return -EINVAL;
+        configureUnit(index, desc, peripheral, stream);
+        return 0;
+    }
+
+    /* replaces hid_int_ep_write so the forwarding path can run without a USB host */
+    using EndpointWriteHook = int (*)(uint8_t index, const uint8_t *data, uint32_t length);
+    static void setEndpointWriteHook(EndpointWriteHook hook)
+    {
+        endpointWriteHook = hook;
+    }
+
+    /* output reports of the vendor interface without the report id, called from the usb stack */
+    using VendorOutputHook = void (*)(const uint8_t *data, uint32_t length);
+    static void setVendorOutputHook(VendorOutputHook hook)
+    {
+        vendorOutputHook = hook;
+    }
+#endif
+
 private:
 
 #if CONFIG_USB_HID_DEVICE_COUNT
     inline static constexpr int maxHIDevice = CONFIG_USB_HID_DEVICE_COUNT;
+#elif defined(CONFIG_MOCNORDIC_BENCH_BSIM)
+    /* no usb on nrf52_bsim, one emulated interface per peripheral */
+    inline static constexpr int maxHIDevice = Capacity::peripherals;
 #else
     inline static constexpr int maxHIDevice = 2;
 #endif
+    static_assert(1 + SPPReportDesc::reportPayloadSize <= Capacity::usbReportSize, "vendor reports must fit one endpoint packet");
+    static_assert(1 + KeyboardStage::maxReportSize <= Capacity::usbReportSize, "keyboard reports must fit one endpoint packet");
     /* inline static MOCZephyr::ZWorkControl<5> delayLogger; */
     inline static std::array<MOCNordicHIDeviceUnit, maxHIDevice> deviceUnits;
 
     inline static struct k_mutex initMutex;
 
+    /* boot to first forwarded report, printed once */
+    inline static atomic_t bootReportSent = ATOMIC_INIT(0);
+    inline static atomic_t enumerationCnt = ATOMIC_INIT(0);
+
+    /* class stage, forwarder and source checksum of one interface */
+    static void configureUnit(uint8_t index, ReportDesc &desc, uint8_t peripheral, const ReportMapStream *stream = nullptr);
+
+    /* dump read through the vendor feature report, the host picks one by setting that feature report */
+    enum class VendorStream : uint8_t {
+        Trace = 1,
+        Recording = 2,
+    };
+    inline static VendorStream vendorStream = VendorStream::Trace;
+    /* next part of the selected dump, restarts it once it ended */
+    static uint32_t readVendorStream(uint8_t *dst, uint32_t length);
+
+#if defined(CONFIG_MOCNORDIC_BENCH)
+    inline static EndpointWriteHook endpointWriteHook = nullptr;
+    inline static VendorOutputHook vendorOutputHook = nullptr;
+#endif
+    static int endpointWrite(uint8_t index, const uint8_t *data, uint32_t length)
+    {
+#if defined(CONFIG_MOCNORDIC_BENCH)
+        if(endpointWriteHook)
+            return endpointWriteHook(index, data, length);
+#endif
+#if defined(CONFIG_USB_DEVICE_HID)
+        return hid_int_ep_write(deviceUnits[index].device, data, length, NULL);
+#else
+        return -ENODEV;
+#endif
+    }
+    /**
+     * @brief every report a class stage forwards goes through here, written right away or held for the next frame
+     *        with CONFIG_MOCNORDIC_FRAME_RELEASE
+     */
+    static int reportWrite(uint8_t index, const uint8_t *data, uint32_t length);
+    /* endpointWrite with tracing, arrivalCyc is when the class stage handed the report over */
+    static int reportSubmit(uint8_t index, const uint8_t *data, uint32_t length, uint32_t arrivalCyc);
+#if defined(CONFIG_MOCNORDIC_FRAME_RELEASE)
+    inline static struct k_spinlock releaseLock;
+#endif
+    /* held reports are dropped, nothing written before the host is back is still current */
+    static void clearRelease();
+
+    template <ReportDescType Type>
+    static int forwardAs(uint8_t index, const uint8_t *data, uint32_t length)
+    {
+        auto write = [index] (const uint8_t *report, uint32_t reportLength) {
+            return reportWrite(index, report, reportLength);
+        };
+        auto &unit = deviceUnits[index];
+
+        if constexpr (Type == ReportDescType::Keyboard) {
+            /* repeated reports are dropped, 6KRO reports may become a bitmap */
+            return unit.keyboard.feed(data, length, write);
+        }
+        else if constexpr (Type == ReportDescType::Touchpad) {
+            /* touchpads with a keyboard in the same report map */
+            if(unit.keyboard.handles(data, length))
+                return unit.keyboard.feed(data, length, write);
+            /* hybrid frames are packed, so not every notification turns into a usb transaction */
+            k_mutex_lock(&unit.touchpadLock, K_FOREVER);
+            uint32_t held = unit.touchpad.getStats().framesHeld;
+            int ret = unit.touchpad.feed(data, length, write);
+            if(unit.touchpad.getStats().framesHeld != held)
+                k_work_reschedule(&unit.touchpadFlush, K_MSEC(CONFIG_MOCNORDIC_TOUCHPAD_HOLD_MS));
+            k_mutex_unlock(&unit.touchpadLock);
+            return ret;
+        }
+        else {
+            return write(data, length);
+        }
+    }
+
+    /* the peripheral stopped in the middle of a hybrid frame, the contacts it sent go out */
+    static void touchpadTimeout(struct k_work *work);
+
+    static ReportForwarder forwarderFor(ReportDescType type)
+    {
+        switch(type) {
+        case ReportDescType::Keyboard:
+            return forwardAs<ReportDescType::Keyboard>;
+        case ReportDescType::Touchpad:
+            return forwardAs<ReportDescType::Touchpad>;
+        case ReportDescType::Mouse:
+            return forwardAs<ReportDescType::Mouse>;
+        case ReportDescType::CustomSPP:
+            return forwardAs<ReportDescType::CustomSPP>;
+        default:
+            return forwardAs<ReportDescType::UNKNOWN>;
+        }
+    }
+
     static int getIndexFromDev(const struct device *dev)
     {
         const char* name = dev->name;
@@ -375,6 +378,20 @@ private:
         bool configured;
     };
     inline static struct usb_controller_status usb_dc_status;
+    static void usbStatus(enum usb_dc_status_code status, const uint8_t *param);
+    static void setSuspended(bool suspended);
+    /**
+     * @brief nothing reaches a suspended endpoint, a press asks the host to resume once per suspend
+     * @note the waking report itself is dropped, the host resumes before the next one arrives
+     */
+    static int suspendedReport(uint8_t index, const uint8_t *data, uint32_t length);
+    inline static PowerHook powerHook = nullptr;
+    inline static OutputHook outputHook = nullptr;
+    /* interrupt OUT endpoint or SET_REPORT(Output), reportId 0 if the interface has none */
+    static int forwardOutput(uint8_t index, uint8_t reportId, const uint8_t *data, uint32_t length);
+    inline static PowerStats powerStatistics;
+    /* cycle of the wakeup request, 0 if none is outstanding */
+    inline static atomic_t wakeRequestCyc = ATOMIC_INIT(0);
     inline static struct k_thread HIDWriteThread[maxHIDevice];
     /* inline static uint8_t HIDWriteThreadStack[256]; */
     static void reportThread(void *p1, void *p2, void *p3);
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+namespace MOCNordic {
+
+/**
+ * @brief GATT handles of one peripheral, report reference descriptor -> characteristic value -> report id
+ * @note no zephyr dependency, it is built on the host as well
+ */
+struct ReportHandleMap {
+    std::unordered_map<uint16_t, uint8_t> charHandleReportIdMap;
+    std::unordered_map<uint16_t, uint16_t> refHandleCharHandleMap;
+
+    void registerRefHandle(uint16_t refHandle, uint16_t charHandle)
+    {
+        refHandleCharHandleMap[refHandle] = charHandle;
+    }
+
+    /**
+     * @retval false if the reference descriptor wasn't registered before
+     */
+    bool registerReportId(uint16_t refHandle, uint8_t reportId)
+    {
+        auto charHandle = refHandleCharHandleMap.find(refHandle);
+        if(charHandle == refHandleCharHandleMap.end())
+            return false;
+
+        charHandleReportIdMap[charHandle->second] = reportId;
+        return true;
+    }
+
+    /**
+     * @retval report id, -1 if the characteristic has no report reference
+     */
+    int findReportId(uint16_t charHandle) const
+    {
+        auto hidChar = charHandleReportIdMap.find(charHandle);
+        if(hidChar == charHandleReportIdMap.end())
+            return -1;
+        return hidChar->second;
+    }
+
+    void clear()
+    {
+        charHandleReportIdMap.clear();
+        refHandleCharHandleMap.clear();
+    }
+};
+
+} /* MOCNordic */
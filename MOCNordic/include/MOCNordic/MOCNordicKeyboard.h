@@ -0,0 +1,443 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <MOCNordic/MOCNordicHIDParser.h>
+#include <MOCNordic/MOCNordicReportDesc.h>
+namespace MOCNordic {
+
+/**
+ * @brief keyboard application collections of a report map and their input reports
+ */
+struct KeyboardLayout : HIDParserVisitor {
+    inline static constexpr uint32_t maxKeyboards = 2;
+
+    struct Keyboard {
+        uint8_t reportId;
+        /* collection item and end collection item offsets in the report map */
+        uint32_t beginOffset;
+        uint32_t endOffset;
+        /* input report length including the report id */
+        uint32_t inputLength;
+        int32_t modifiersOffset;
+        uint32_t modifiersCnt;
+        int32_t keysOffset;
+        uint32_t keysCnt;
+        uint32_t keysUsageMin;
+        uint32_t keysUsageMax;
+        uint32_t dataBits;
+        uint32_t outputBits;
+        /* other input fields than modifiers and the key array */
+        bool extraFields;
+        /* globals after the collection, restored when the collection is replaced */
+        HIDReportParser::GlobalState globalsAfter;
+    };
+
+    std::array<Keyboard, maxKeyboards> keyboards;
+    uint32_t keyboardCnt;
+    /* needed for the global state at the end of a collection */
+    const HIDReportParser *parser;
+
+    KeyboardLayout()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        keyboards = {};
+        keyboardCnt = 0;
+        current = -1;
+        parser = nullptr;
+    }
+
+    void onCollection(const HIDCollection &collection) override
+    {
+        if(current >= 0 || collection.kind != 0x01 || collection.usage != HIDUsages::GenericDesktopKeyboard)
+            return;
+        if(keyboardCnt >= maxKeyboards)
+            return;
+
+        Keyboard &it = keyboards[keyboardCnt];
+        it = {};
+        it.beginOffset = collection.beginOffset;
+        it.modifiersOffset = -1;
+        it.keysOffset = -1;
+        currentCollection = collection.index;
+        current = static_cast<int32_t>(keyboardCnt++);
+    }
+
+    void onEndCollection(const HIDCollection &collection) override
+    {
+        if(current < 0 || collection.index != currentCollection)
+            return;
+        keyboards[current].endOffset = collection.endOffset;
+        if(parser)
+            keyboards[current].globalsAfter = parser->globalState();
+        current = -1;
+    }
+
+    void onField(const HIDField &field) override
+    {
+        if(current < 0)
+            return;
+        Keyboard &it = keyboards[current];
+
+        if(field.type == HIDReportType::Output) {
+            it.outputBits += field.bitSize * field.count;
+            return;
+        }
+        if(field.type != HIDReportType::Input)
+            return;
+
+        if(!it.dataBits && !it.reportId)
+            it.reportId = field.reportId;
+        if(field.reportId != it.reportId) {
+            it.extraFields = true;
+            return;
+        }
+        it.dataBits += field.bitSize * field.count;
+
+        if(field.isConstant())
+            return;
+
+        uint16_t page = static_cast<uint16_t>(field.usage >> 16);
+        uint16_t id = static_cast<uint16_t>(field.usage);
+        if(page == HIDUsages::KeyboardPage && field.isVariable() && field.bitSize == 1 && id >= 0xE0 && id <= 0xE7) {
+            if(it.modifiersOffset < 0)
+                it.modifiersOffset = field.bitOffset;
+            it.modifiersCnt += field.count;
+        }
+        else if(page == HIDUsages::KeyboardPage && !field.isVariable() && field.bitSize == 8 && it.keysOffset < 0) {
+            it.keysOffset = field.bitOffset;
+            it.keysCnt = field.count;
+            it.keysUsageMin = field.usage;
+            it.keysUsageMax = field.usageMax;
+        }
+        else {
+            it.extraFields = true;
+        }
+    }
+
+private:
+    int32_t current;
+    uint16_t currentCollection;
+};
+
+/**
+ * @brief keyboard forwarding stage: drops byte identical consecutive reports and
+ *        optionally turns 6 key array reports into an NKRO bitmap
+ * @note a report is only remembered after the endpoint took it, so a failed write never hides the next copy
+ */
+class KeyboardStage {
+public:
+    inline static constexpr uint32_t maxReportSize = 32;
+    /* bitmap covers usages 0x00 - 0xDF, modifiers stay a byte of their own */
+    inline static constexpr uint32_t maxBitmapKeys = 0xE0;
+
+    struct Stats {
+        uint32_t reportsIn;
+        uint32_t suppressed;
+        uint32_t converted;
+        /* error rollover and truncated reports of converted keyboards */
+        uint32_t dropped;
+    };
+
+    KeyboardStage()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        entries = {};
+        entryCnt = 0;
+        dedup = false;
+        stats = {};
+    }
+
+    /**
+     * @brief find the keyboard reports of the report map, rewrites the map if nkro is requested and possible
+     * @retval true if the stage is active for this report map
+     */
+    bool init(ReportDesc &desc, bool dedupEnabled, bool nkroEnabled)
+    {
+        KeyboardLayout parsed;
+        HIDReportParser parser;
+        parsed.parser = &parser;
+        parser.parse(desc.data(), desc.size(), parsed);
+        parsed.parser = nullptr;
+        return init(desc, parsed, parser, dedupEnabled, nkroEnabled);
+    }
+
+    /* same with the layout of a parser which already walked desc, offsets must refer to desc as it is */
+    bool init(ReportDesc &desc, const KeyboardLayout &parsed, const HIDReportParser &parser, bool dedupEnabled, bool nkroEnabled)
+    {
+        clear();
+        KeyboardLayout layout = parsed;
+        layout.parser = nullptr;
+        if(!findKeyboards(parser, layout))
+            return false;
+
+        dedup = dedupEnabled;
+        for(uint32_t i = 0; i < layout.keyboardCnt; i++) {
+            const KeyboardLayout::Keyboard &it = layout.keyboards[i];
+            if(!it.reportId || it.inputLength > maxReportSize)
+                continue;
+            Entry &entry = entries[entryCnt++];
+            entry = {};
+            entry.reportId = it.reportId;
+            entry.inputLength = it.inputLength;
+        }
+
+        /* rewriting moves the later collections, go from the back so earlier offsets stay valid */
+        if(nkroEnabled) {
+            for(uint32_t i = layout.keyboardCnt; i > 0; i--) {
+                convertDescriptor(desc, layout.keyboards[i - 1]);
+            }
+        }
+        return entryCnt;
+    }
+
+    bool isActive() const
+    {
+        return entryCnt;
+    }
+
+    bool handles(const uint8_t *report, uint32_t length) const
+    {
+        return length && findEntry(report[0]);
+    }
+
+    /* host state is gone after a bus reset or reconnect, the next report always goes out */
+    void resync()
+    {
+        for(uint32_t i = 0; i < entryCnt; i++) {
+            entries[i].lastLength = 0;
+        }
+    }
+
+    const Stats &getStats() const
+    {
+        return stats;
+    }
+
+    template <typename Emit>
+    int feed(const uint8_t *report, uint32_t length, Emit &&emit)
+    {
+        Entry *entry = length ? findEntry(report[0]) : nullptr;
+        if(!entry)
+            return emit(report, length);
+        ++stats.reportsIn;
+
+        std::array<uint8_t, maxReportSize> converted;
+        if(entry->nkro) {
+            /* the host only knows the bitmap layout, a 6 key report can't go out as it is */
+            if(length < entry->inputLength || toBitmap(*entry, report, converted.data())) {
+                ++stats.dropped;
+                return 0;
+            }
+            ++stats.converted;
+            report = converted.data();
+            length = entry->nkroLength;
+        }
+
+        if(dedup && entry->lastLength == length && !memcmp(entry->last.data(), report, length)) {
+            ++stats.suppressed;
+            return 0;
+        }
+
+        int ret = emit(report, length);
+        if(!ret && length <= entry->last.size()) {
+            memcpy(entry->last.data(), report, length);
+            entry->lastLength = length;
+        }
+        else {
+            entry->lastLength = 0;
+        }
+        return ret;
+    }
+
+private:
+    struct Entry {
+        uint8_t reportId;
+        bool nkro;
+        uint32_t inputLength;
+        /* 6KRO layout: modifiers byte, keys array, both relative to the report id */
+        uint32_t modifiersByte;
+        uint32_t keysByte;
+        uint32_t keysCnt;
+        uint32_t bitmapKeys;
+        uint32_t nkroLength;
+        std::array<uint8_t, maxReportSize> last;
+        uint32_t lastLength;
+    };
+
+    static bool findKeyboards(const HIDReportParser &parser, KeyboardLayout &layout)
+    {
+        if(!parser.usesReportIds())
+            return false;
+
+        for(uint32_t i = 0; i < layout.keyboardCnt; i++) {
+            KeyboardLayout::Keyboard &it = layout.keyboards[i];
+            it.inputLength = 1 + parser.reportBytes(HIDReportType::Input, it.reportId);
+        }
+        return layout.keyboardCnt;
+    }
+
+    Entry *findEntry(uint8_t reportId)
+    {
+        for(uint32_t i = 0; i < entryCnt; i++) {
+            if(entries[i].reportId == reportId)
+                return &entries[i];
+        }
+        return nullptr;
+    }
+
+    const Entry *findEntry(uint8_t reportId) const
+    {
+        return const_cast<KeyboardStage *>(this)->findEntry(reportId);
+    }
+
+    /* @retval true for error rollover (phantom state), the device doesn't know which keys are down */
+    bool toBitmap(const Entry &entry, const uint8_t *report, uint8_t *dst) const
+    {
+        memset(dst, 0, entry.nkroLength);
+        dst[0] = entry.reportId;
+        dst[1] = report[entry.modifiersByte];
+        for(uint32_t i = 0; i < entry.keysCnt; i++) {
+            uint8_t key = report[entry.keysByte + i];
+            if(key == 0x01)
+                return true;
+            /* 0x02 post fail, 0x03 undefined error */
+            if(key < 0x04 || key >= entry.bitmapKeys)
+                continue;
+            dst[2 + key / 8] |= 1U << (key % 8);
+        }
+        return false;
+    }
+
+    static uint32_t putItem(uint8_t *dst, uint8_t tag, int32_t value)
+    {
+        uint32_t length = 0;
+        if(value >= -128 && value <= 127) {
+            dst[length++] = tag | 0x01;
+            dst[length++] = static_cast<uint8_t>(value);
+        }
+        else if(value >= -32768 && value <= 32767) {
+            dst[length++] = tag | 0x02;
+            dst[length++] = static_cast<uint8_t>(value);
+            dst[length++] = static_cast<uint8_t>(value >> 8);
+        }
+        else {
+            dst[length++] = tag | 0x03;
+            for(int i = 0; i < 4; i++)
+                dst[length++] = static_cast<uint8_t>(value >> (8 * i));
+        }
+        return length;
+    }
+
+    /* modifiers, one reserved byte and an array of 8 bit key codes, the boot keyboard layout */
+    static bool isConvertible(const KeyboardLayout::Keyboard &it)
+    {
+        return !it.extraFields && it.reportId && it.endOffset > it.beginOffset
+            && it.modifiersOffset == 0 && it.modifiersCnt == 8
+            && it.keysOffset >= 8 && !(it.keysOffset & 0x07) && it.keysCnt
+            && static_cast<uint16_t>(it.keysUsageMin) == 0
+            && it.dataBits == static_cast<uint32_t>(it.keysOffset) + it.keysCnt * 8
+            && (it.outputBits == 0 || it.outputBits == 8);
+    }
+
+    bool convertDescriptor(ReportDesc &desc, const KeyboardLayout::Keyboard &it)
+    {
+        Entry *entry = findEntry(it.reportId);
+        if(!entry || !isConvertible(it))
+            return false;
+
+        uint32_t bitmapKeys = std::min<uint32_t>(static_cast<uint16_t>(it.keysUsageMax) + 1, maxBitmapKeys);
+        bitmapKeys = (bitmapKeys + 7) & ~0x07U;
+        if(2 + bitmapKeys / 8 > maxReportSize)
+            return false;
+
+        std::array<uint8_t, 96> collection;
+        uint32_t length = 0;
+        /* starts at the collection item, the keyboard usage in front of it stays */
+        const uint8_t head[] = {
+            0xA1, 0x01,         // COLLECTION (Application)
+            0x85, it.reportId,  //   REPORT_ID
+            0x05, 0x07,         //   USAGE_PAGE (Keyboard)
+            0x19, 0xE0,         //   USAGE_MINIMUM (Left Control)
+            0x29, 0xE7,         //   USAGE_MAXIMUM (Right GUI)
+            0x15, 0x00,         //   LOGICAL_MINIMUM (0)
+            0x25, 0x01,         //   LOGICAL_MAXIMUM (1)
+            0x75, 0x01,         //   REPORT_SIZE (1)
+            0x95, 0x08,         //   REPORT_COUNT (8)
+            0x81, 0x02,         //   INPUT (Data,Var,Abs)
+            0x19, 0x00,         //   USAGE_MINIMUM (0)
+        };
+        memcpy(collection.data(), head, sizeof(head));
+        length += sizeof(head);
+        length += putItem(&collection[length], HIDItemTag::UsageMaximum, static_cast<int32_t>(bitmapKeys - 1));
+        length += putItem(&collection[length], HIDItemTag::ReportCount, static_cast<int32_t>(bitmapKeys));
+        const uint8_t bitmap[] = {
+            0x81, 0x02,         //   INPUT (Data,Var,Abs)
+        };
+        memcpy(&collection[length], bitmap, sizeof(bitmap));
+        length += sizeof(bitmap);
+        if(it.outputBits) {
+            const uint8_t leds[] = {
+                0x05, 0x08,     //   USAGE_PAGE (LEDs)
+                0x19, 0x01,     //   USAGE_MINIMUM (Num Lock)
+                0x29, 0x05,     //   USAGE_MAXIMUM (Kana)
+                0x95, 0x05,     //   REPORT_COUNT (5)
+                0x91, 0x02,     //   OUTPUT (Data,Var,Abs)
+                0x95, 0x03,     //   REPORT_COUNT (3)
+                0x91, 0x03,     //   OUTPUT (Cnst,Var,Abs)
+            };
+            memcpy(&collection[length], leds, sizeof(leds));
+            length += sizeof(leds);
+        }
+        collection[length++] = HIDItemTag::EndCollection;
+
+        /* later collections may depend on globals the original collection left behind */
+        const HIDReportParser::GlobalState &globals = it.globalsAfter;
+        length += putItem(&collection[length], HIDItemTag::UsagePage, globals.usagePage);
+        length += putItem(&collection[length], HIDItemTag::LogicalMinimum, globals.logicalMin);
+        length += putItem(&collection[length], HIDItemTag::LogicalMaximum, globals.logicalMax);
+        length += putItem(&collection[length], HIDItemTag::ReportSize, static_cast<int32_t>(globals.reportSize));
+        length += putItem(&collection[length], HIDItemTag::ReportCount, static_cast<int32_t>(globals.reportCount));
+        if(globals.reportId)
+            length += putItem(&collection[length], HIDItemTag::ReportId, globals.reportId);
+
+        uint32_t oldLength = desc.size();
+        uint32_t tailOffset = it.endOffset + 1;
+        uint32_t newLength = oldLength - (tailOffset - it.beginOffset) + length;
+        if(newLength > desc.desc.size())
+            return false;
+
+        std::array<uint8_t, sizeof(ReportDesc::desc)> rewritten;
+        memcpy(rewritten.data(), desc.data(), it.beginOffset);
+        memcpy(rewritten.data() + it.beginOffset, collection.data(), length);
+        memcpy(rewritten.data() + it.beginOffset + length, desc.data() + tailOffset, oldLength - tailOffset);
+
+        ReportDescType type = desc.getType(0);
+        desc.clear();
+        desc.insert(rewritten.data(), newLength, type);
+
+        entry->nkro = true;
+        entry->modifiersByte = 1;
+        entry->keysByte = 1 + it.keysOffset / 8;
+        entry->keysCnt = it.keysCnt;
+        entry->bitmapKeys = bitmapKeys;
+        entry->nkroLength = 2 + bitmapKeys / 8;
+        return true;
+    }
+
+    std::array<Entry, KeyboardLayout::maxKeyboards> entries;
+    uint32_t entryCnt;
+    bool dedup;
+    Stats stats;
+};
+
+} /* MOCNordic */
@@ -1,15 +1,22 @@
 #pragma once
 
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <array>
+#include <cstdint>
+#include <type_traits>
 namespace MTNordic {
 /* test */
 namespace MTNordicLogger {
 
 
-#define DEBUG_PRINT(fmt, ...) \
-        do { \
-            LOG_INF("[%s.%d] " fmt "\r\n" ,__func__ , __LINE__, ##__VA_ARGS__); \
-        } while(0)
+/* subsystem of DEBUG_PRINT and DEBUG_PRINT_HEX, a file defines it before its first include, e.g. #define MOCNORDIC_LOG_SUBSYS BLE */
+#ifndef MOCNORDIC_LOG_SUBSYS
+#define MOCNORDIC_LOG_SUBSYS APP
+#endif
+
+/* info print of the file's subsystem, compiled out below CONFIG_MOCNORDIC_LOG_LEVEL_<subsystem> 3 */
+#define DEBUG_PRINT(fmt, ...) DEBUG_PRINT_LEVEL(MOCNORDIC_LOG_SUBSYS, INF, fmt, ##__VA_ARGS__)
 #define DEBUG_PRINT_NONNEXT(fmt, ...) \
         do { \
             printk("[%s.%d] " fmt, __func__, __LINE__, ##__VA_ARGS__); \
@@ -19,15 +26,147 @@ namespace MTNordicLogger {
             printk(fmt, ##__VA_ARGS__); \
         } while(0)
 
-#define DEBUG_PRINT_HEX(fmt, array_name, array_length) \
+#define DEBUG_PRINT_HEX(fmt, array_name, array_length) DEBUG_PRINT_HEX_LEVEL(MOCNORDIC_LOG_SUBSYS, INF, fmt, array_name, array_length)
+
+/* per subsystem compile time levels, 0 off, 1 err, 2 wrn, 3 inf, 4 dbg */
+#define MOC_LOG_LEVEL_OFF 0
+#define MOC_LOG_LEVEL_ERR 1
+#define MOC_LOG_LEVEL_WRN 2
+#define MOC_LOG_LEVEL_INF 3
+#define MOC_LOG_LEVEL_DBG 4
+
+#ifndef CONFIG_MOCNORDIC_LOG_LEVEL_BLE
+#define CONFIG_MOCNORDIC_LOG_LEVEL_BLE MOC_LOG_LEVEL_INF
+#endif
+#ifndef CONFIG_MOCNORDIC_LOG_LEVEL_HID
+#define CONFIG_MOCNORDIC_LOG_LEVEL_HID MOC_LOG_LEVEL_INF
+#endif
+#ifndef CONFIG_MOCNORDIC_LOG_LEVEL_APP
+#define CONFIG_MOCNORDIC_LOG_LEVEL_APP MOC_LOG_LEVEL_INF
+#endif
+
+#define MOC_LOG_LEVEL_BLE CONFIG_MOCNORDIC_LOG_LEVEL_BLE
+#define MOC_LOG_LEVEL_HID CONFIG_MOCNORDIC_LOG_LEVEL_HID
+#define MOC_LOG_LEVEL_APP CONFIG_MOCNORDIC_LOG_LEVEL_APP
+
+#define MOC_LOG_ENABLED(subsys, level) ((MOC_LOG_LEVEL_##level) <= (MOC_LOG_LEVEL_##subsys))
+
+/**
+ * @brief immediate print with the log backend severity of the level, the whole statement including the format string
+ *        is dropped when the level is compiled out
+ * @example DEBUG_PRINT_LEVEL(BLE, DBG, "handle: %d", handle);
+ */
+#define DEBUG_PRINT_LEVEL(subsys, level, fmt, ...) \
+        do { \
+            if constexpr (MOC_LOG_ENABLED(subsys, level)) { \
+                LOG_##level("[%s.%d] " fmt "\r\n" ,__func__ , __LINE__, ##__VA_ARGS__); \
+            } \
+        } while(0)
+
+#define DEBUG_PRINT_HEX_LEVEL(subsys, level, fmt, array_name, array_length) \
+        do { \
+            if constexpr (MOC_LOG_ENABLED(subsys, level)) { \
+                LOG_HEXDUMP_##level(array_name, array_length, fmt); \
+            } \
+        } while(0)
+
+#if defined(CONFIG_MOCNORDIC_DEFERRED_LOG)
+
+/**
+ * @brief hot path print, only the format pointer and up to 4 integer args are captured, formatting is done by a low priority thread
+ * @note args are stored as uint32_t, don't pass strings or floats
+ */
+#define DEBUG_TRACE(subsys, fmt, ...) \
+        do { \
+            if constexpr (MOC_LOG_ENABLED(subsys, INF)) { \
+                ::MTNordic::MTNordicLogger::DeferredLogger::capture("[%s.%d] " fmt "\r\n", __func__, __LINE__, ##__VA_ARGS__); \
+            } \
+        } while(0)
+
+/* only the first DeferredLogger::maxHexLength bytes are kept */
+#define DEBUG_TRACE_HEX(subsys, fmt, array_name, array_length) \
         do { \
-            LOG_HEXDUMP_INF(array_name, array_length, fmt); \
+            if constexpr (MOC_LOG_ENABLED(subsys, INF)) { \
+                ::MTNordic::MTNordicLogger::DeferredLogger::captureHex(fmt, __func__, __LINE__, array_name, array_length); \
+            } \
         } while(0)
 
+#else
+
+#define DEBUG_TRACE(subsys, fmt, ...) DEBUG_PRINT_LEVEL(subsys, INF, fmt, ##__VA_ARGS__)
+#define DEBUG_TRACE_HEX(subsys, fmt, array_name, array_length) DEBUG_PRINT_HEX_LEVEL(subsys, INF, fmt, array_name, array_length)
+
+#endif
+
+#if defined(CONFIG_MOCNORDIC_DEFERRED_LOG)
+
+class DeferredLogger {
+public:
+    DeferredLogger() = delete;
+
+    inline static constexpr uint32_t maxArgs = 4;
+    inline static constexpr uint32_t maxHexLength = 16;
+    inline static constexpr uint32_t entryCnt = CONFIG_MOCNORDIC_DEFERRED_LOG_ENTRIES;
+    static_assert((entryCnt & (entryCnt - 1)) == 0, "deferred log entries must be power of two");
+
+    struct Record {
+        const char *fmt;
+        const char *func;
+        uint32_t cycles;
+        uint16_t line;
+        /* 0 for printf style, otherwise the captured hex length */
+        uint8_t hexLength;
+        uint8_t argc;
+        union {
+            uint32_t args[maxArgs];
+            uint8_t hex[maxHexLength];
+        };
+    };
+
+    template <typename... Args>
+    static void capture(const char *fmt, const char *func, uint16_t line, Args... args)
+    {
+        static_assert(sizeof...(Args) <= maxArgs, "DEBUG_TRACE supports up to 4 args");
+        Record *record = reserve();
+        if(!record)
+            return;
+
+        record->fmt = fmt;
+        record->func = func;
+        record->line = line;
+        record->hexLength = 0;
+        record->argc = sizeof...(Args);
+        [[maybe_unused]] uint32_t i = 0;
+        ((record->args[i++] = toArg(args)), ...);
+        commit(record);
+    }
+
+    static void captureHex(const char *fmt, const char *func, uint16_t line, const void *data, uint32_t length);
+
+    static uint32_t dropped();
+
+    /* formats everything pending, called by the logger thread */
+    static void flush();
+
+private:
+    template <typename T>
+    static uint32_t toArg(T value)
+    {
+        /* the record is formatted later, a string may be gone by then and a pointer doesn't fit 32 bits on 64 bit hosts */
+        static_assert(!std::is_pointer_v<T>, "DEBUG_TRACE can't capture pointers, use DEBUG_PRINT_LEVEL");
+        static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "DEBUG_TRACE only captures integers");
+        return static_cast<uint32_t>(value);
+    }
+
+    static Record *reserve();
+    static void commit(Record *record);
+};
+
+#endif
+
 
 
 } /* MTNordicLogger */
 
 
 } /* MTNordic */
-
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <MOCNordic/MOCNordicHIDParser.h>
+#include <MOCNordic/MOCNordicWake.h>
+namespace MOCNordic {
+
+/**
+ * @brief forwarding lane of a notification, see CONFIG_MOCNORDIC_FORWARD_LANES
+ */
+enum class ReportLane : uint8_t {
+    /* a key, modifier or button changed */
+    Urgent = 0,
+    /* motion, touchpad frames, vendor (SPP) data and repeated key state */
+    Bulk,
+};
+
+inline constexpr uint32_t reportLanes = 2;
+
+/**
+ * @brief picks the lane of a peripheral's notification from the key and button fields of its report map
+ * @note keeps the state of those fields per report id, only call it from the thread receiving the notifications;
+ *       a report counts as urgent when that state changed, so presses and releases are urgent and a held button
+ *       moving the pointer is not
+ */
+class ReportPriority {
+public:
+    ReportPriority()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        layout.clear();
+        digests.fill(0);
+    }
+
+    /* false if the map has no key or button field, every report is bulk then */
+    bool init(const uint8_t *desc, uint32_t length)
+    {
+        WakeLayout parsed;
+        HIDReportParser parser;
+        parser.parse(desc, length, parsed);
+        return init(parsed);
+    }
+
+    bool init(const WakeLayout &parsed)
+    {
+        layout = parsed;
+        digests.fill(0);
+        return layout.fieldCnt;
+    }
+
+    /**
+     * @param reportId report id of the characteristic, -1 if it has none
+     * @param payload notification value, without a report id prefix
+     */
+    ReportLane classify(int reportId, const uint8_t *payload, uint32_t length)
+    {
+        uint8_t id = reportId < 0 ? 0 : static_cast<uint8_t>(reportId);
+        uint32_t payloadBits = length * 8;
+        bool changed = false;
+        for(uint32_t i = 0; i < layout.fieldCnt; i++) {
+            const WakeLayout::Field &field = layout.fields[i];
+            if(field.reportId != id || field.bitOffset + field.bitSize > payloadBits)
+                continue;
+            /* 0 is the all released state every field starts in */
+            uint32_t digest = digestOf(payload, field.bitOffset, field.bitSize);
+            if(digest != digests[i]) {
+                digests[i] = digest;
+                changed = true;
+            }
+        }
+        return changed ? ReportLane::Urgent : ReportLane::Bulk;
+    }
+
+private:
+    /* FNV-1a over the field 32 bits at a time, 0 if every bit is clear */
+    static uint32_t digestOf(const uint8_t *payload, uint32_t bitOffset, uint32_t bitSize)
+    {
+        if(HIDBits::isZero(payload, bitOffset, bitSize))
+            return 0;
+        uint32_t digest = 2166136261u;
+        for(uint32_t bit = 0; bit < bitSize; bit += 32) {
+            digest ^= HIDBits::get(payload, bitOffset + bit, std::min<uint32_t>(32, bitSize - bit));
+            digest *= 16777619u;
+        }
+        return digest | 0x01;
+    }
+
+    WakeLayout layout;
+    std::array<uint32_t, WakeLayout::maxFields> digests;
+};
+
+} /* MOCNordic */
@@ -0,0 +1,50 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <cstdint>
+namespace MOCNordic {
+
+/* load windows the profiler attributes cpu time and stack peaks to, names must match the report */
+enum class ProfileScenario : uint8_t {
+    BringUp = 0,
+    Forwarding,
+    Reenumeration,
+    Count,
+};
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+#define MOC_PROFILE_BEGIN(scenario) \
+        do { \
+            ::MOCNordic::MOCNordicProfiler::begin(::MOCNordic::ProfileScenario::scenario); \
+        } while(0)
+#define MOC_PROFILE_END(scenario) \
+        do { \
+            ::MOCNordic::MOCNordicProfiler::end(::MOCNordic::ProfileScenario::scenario); \
+        } while(0)
+#else
+#define MOC_PROFILE_BEGIN(scenario) do { } while(0)
+#define MOC_PROFILE_END(scenario) do { } while(0)
+#endif
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+/**
+ * @brief per thread stack high-water marks and cpu time inside scenario windows, summarized into a stack sizing report
+ * @note zephyr can't reset a high-water mark, a scenario records the peak reached by the time it ends,
+ *       begin and end are thread context only, they walk every thread
+ */
+class MOCNordicProfiler {
+public:
+    MOCNordicProfiler() = delete;
+
+    /* a window which is already open is restarted */
+    static void begin(ProfileScenario scenario);
+    static void end(ProfileScenario scenario);
+
+    /**
+     * @brief prints one "PROFILE {json}" line, open windows are measured up to now
+     * @note convert it with scripts/mocnordic_stack_report.py
+     */
+    static void report();
+};
+#endif
+
+} /* MOCNordic */
@@ -0,0 +1,87 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <cstdint>
+#include <MOCNordic/MOCNordicHandleMap.h>
+namespace MOCNordic {
+
+enum class RecordType : uint8_t {
+    /* u32 connection interval in us */
+    LinkUp = 1,
+    /* the peripheral's report map */
+    ReportMap,
+    /* ReportIdEntry per characteristic with a report reference */
+    ReportIds,
+    /* u16 value handle, then the notification as it entered notifySubscribe */
+    Notify,
+    LinkDown,
+};
+
+/**
+ * @brief captures the layout and notification stream of every link for replay on native_sim
+ * @note a session starts empty, every subscribed link writes its layout first, then notifications are appended
+ *       until the buffer is full; reading the dump ends the session and starts the next one.
+ *       dump layout: DumpHeader, then DumpHeader::length bytes of RecordHeader + payload, little endian
+ */
+class MOCNordicRecorder {
+public:
+    MOCNordicRecorder() = delete;
+
+    struct RecordHeader {
+        uint32_t timestampUs;
+        uint8_t type;
+        uint8_t link;
+        uint16_t length;
+    };
+    static_assert(sizeof(RecordHeader) == 8, "record layout is shared with scripts/mocnordic_record.py and the replayer");
+
+    struct ReportIdEntry {
+        uint16_t valueHandle;
+        uint8_t reportId;
+        uint8_t reserved;
+    };
+
+    struct DumpHeader {
+        /* 'MOCR' */
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordHeaderSize;
+        uint32_t length;
+        /* records which didn't fit */
+        uint32_t dropped;
+    };
+
+    inline static constexpr uint32_t dumpMagic = 0x52434F4D;
+    inline static constexpr uint16_t dumpVersion = 1;
+
+#if defined(CONFIG_MOCNORDIC_RECORD)
+    static void linkUp(uint8_t link, uint32_t connIntervalUs);
+    static void linkDown(uint8_t link);
+    static void reportMap(uint8_t link, const uint8_t *map, uint32_t length);
+    static void reportIds(uint8_t link, const ReportHandleMap &handleMap);
+    /* bt rx thread, one spinlock and a copy */
+    static void notification(uint8_t link, uint16_t valueHandle, const void *data, uint16_t length);
+
+    /**
+     * @brief copy the next part of the dump stream, recording is paused until the stream is fully read
+     * @retval bytes copied, 0 once the stream ended, a new session starts then
+     */
+    static uint32_t readDump(uint8_t *dst, uint32_t length);
+
+    /* write a complete dump to a host file, native_sim only */
+    static int dumpToFile(const char *path);
+
+    /* drops everything, the layouts of the subscribed links are written again */
+    static void restart();
+#else
+    static void linkUp(uint8_t link, uint32_t connIntervalUs) {}
+    static void linkDown(uint8_t link) {}
+    static void reportMap(uint8_t link, const uint8_t *map, uint32_t length) {}
+    static void reportIds(uint8_t link, const ReportHandleMap &handleMap) {}
+    static void notification(uint8_t link, uint16_t valueHandle, const void *data, uint16_t length) {}
+    static uint32_t readDump(uint8_t *dst, uint32_t length) { return 0; }
+    static int dumpToFile(const char *path) { return -ENOTSUP; }
+    static void restart() {}
+#endif
+};
+
+} /* MOCNordic */
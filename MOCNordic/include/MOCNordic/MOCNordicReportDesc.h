@@ -0,0 +1,260 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <utility>
+#include <MOCNordic/MOCNordicHIDParser.h>
+#include <MOCNordic/MOCNordicConfig.h>
+namespace MOCNordic {
+
+enum class ReportDescType {
+    Keyboard,
+    Mouse,
+    Touchpad,
+    CustomSPP,
+    UNKNOWN,
+};
+
+
+/**
+ * @brief classifies a report map by its application collections,
+ *        touchpad wins over keyboard, keyboard over mouse, so combo devices get the richer handling
+ */
+struct ApplicationClassifier : HIDParserVisitor {
+    bool touchpad = false;
+    bool keyboard = false;
+    bool mouse = false;
+
+    void clear()
+    {
+        touchpad = false;
+        keyboard = false;
+        mouse = false;
+    }
+
+    void onCollection(const HIDCollection &collection) override
+    {
+        if(collection.kind != 0x01)
+            return;
+        if(collection.usage == HIDUsages::DigitizerTouchPad)
+            touchpad = true;
+        else if(collection.usage == HIDUsages::GenericDesktopKeyboard)
+            keyboard = true;
+        else if(collection.usage == HIDUsages::GenericDesktopMouse || collection.usage == HIDUsages::GenericDesktopPointer)
+            mouse = true;
+    }
+
+    ReportDescType type() const
+    {
+        if(touchpad)
+            return ReportDescType::Touchpad;
+        if(keyboard)
+            return ReportDescType::Keyboard;
+        if(mouse)
+            return ReportDescType::Mouse;
+        return ReportDescType::UNKNOWN;
+    }
+};
+
+/**
+ * @brief report descriptor built from typed parts, sized by template so stacks and interfaces can differ
+ */
+template <size_t DescSize, size_t PartCnt>
+struct BasicReportDesc {
+
+    /* can't save with desc because usb initilize use one memory block */
+    struct DescApartStorage {
+        ReportDescType type;
+        uint32_t length;
+    };
+    std::array<DescApartStorage, PartCnt> storageSequence;
+    /* use vector will cause memory error */
+    std::array<uint8_t, DescSize> desc;
+    
+    ReportDescType getType(uint8_t index)
+    {
+        return storageSequence[index].type;
+    }
+
+    void setType(uint8_t index, ReportDescType type)
+    {
+        storageSequence[index].type = type;
+    }
+
+    uint8_t *data()
+    {
+        return desc.data();
+    }
+
+    size_t size()
+    {
+        return getDescLength();
+    }
+
+    bool insert(const uint8_t *data, uint32_t length, ReportDescType type)
+    {
+        uint32_t previoutLength = 0;
+
+        for(auto &it: storageSequence) {
+            if(it.length) {
+                previoutLength += it.length;
+            }
+            else {
+                if(previoutLength + length > desc.size())
+                    return false;
+                it.length = length;
+                it.type = type;
+                
+                memcpy(desc.data() + previoutLength, data, length);
+                return true;
+            }
+
+        }
+
+        return false;
+    }
+
+    uint32_t getDescLength()
+    {
+        uint32_t retval = 0;
+        for(auto &it: storageSequence) {
+            if(it.length)
+                retval += it.length;
+            
+        }
+        return retval;
+    }
+
+    bool remove(size_t index)
+    {
+        if(index > storageSequence.size() - 1)
+            return false;
+
+        storageSequence[index].length = 0;
+        return true;
+    }
+
+
+    void clear()
+    {
+        desc.fill(0x00);
+        for(auto &it: storageSequence) {
+            it.length = 0;
+            it.type = ReportDescType::UNKNOWN;
+        }
+    }
+
+    BasicReportDesc()
+    {
+        clear();
+    }
+
+    BasicReportDesc(const uint8_t *data, uint32_t length)
+    {
+        clear();
+        insert(data, length, ReportDescType::UNKNOWN);
+
+    }
+
+    BasicReportDesc(const uint8_t *data, uint32_t length, ReportDescType type)
+    {
+        clear();
+        insert(data, length, type);
+
+    }
+
+    BasicReportDesc(BasicReportDesc &src)
+    {
+        clear();
+        /* std::copy(desc.begin(), src.desc.begin(), src.desc.end()); */
+        /* std::copy(storageSequence.begin(), src.storageSequence.begin(), src.storageSequence.end()); */
+        memcpy(desc.data(), src.desc.data(), src.desc.size());
+        memcpy(storageSequence.data(), src.storageSequence.data(), storageSequence.size() * sizeof(DescApartStorage));
+    }
+
+    BasicReportDesc &operator=(BasicReportDesc &src) noexcept
+    {
+        clear();
+        /* std::copy(desc.begin(), src.desc.begin(), src.desc.end()); */
+        /* std::copy(storageSequence.begin(), src.storageSequence.begin(), src.storageSequence.end()); */
+        memcpy(desc.data(), src.desc.data(), src.desc.size());
+        memcpy(storageSequence.data(), src.storageSequence.data(), storageSequence.size() * sizeof(DescApartStorage));
+        return *this;
+    }
+
+    BasicReportDesc &operator=(BasicReportDesc &&src) noexcept
+    {
+        desc = std::move(src.desc);
+        storageSequence = std::move(src.storageSequence);
+        return *this;
+    }
+
+    static uint32_t getReportSize(uint8_t reportId)
+    {
+        return 0;
+    }
+
+    /* classify the parts of unknown type, see ApplicationClassifier */
+    void recognize()
+    {
+        uint32_t offset = 0;
+        for(auto &seqMember: storageSequence) {
+            if(!seqMember.length)
+                continue;
+
+            if(seqMember.type == ReportDescType::UNKNOWN) {
+                ApplicationClassifier visitor;
+                HIDReportParser parser;
+                parser.parse(desc.data() + offset, seqMember.length, visitor);
+                seqMember.type = visitor.type();
+            }
+            offset += seqMember.length;
+        }
+    }
+
+};
+
+using ReportDesc = BasicReportDesc<Capacity::reportDescSize, Capacity::reportDescParts>;
+
+struct SPPReportDesc : ReportDesc {
+
+    /* must match REPORT_ID and REPORT_COUNT in SPPReportDescBase */
+    inline static constexpr uint8_t reportId = 0x0C;
+    inline static constexpr uint32_t reportPayloadSize = 63;
+
+    inline static const uint8_t SPPReportDescBase[] = {
+        0x06, 0x01,0xff, // USAGE_PAGE (Generic Desktop)
+        0x09, 0x00, // USAGE (0)
+        0xa1, 0x01, // COLLECTION (Application)
+        0x85, 0x0C,
+        0x15, 0x00, //     LOGICAL_MINIMUM (0)
+        0x25, 0x01, //     LOGICAL_MAXIMUM (255)�
+        0x19, 0x00, //     USAGE_MINIMUM (1)
+        0x29, 0xff, //     USAGE_MAXIMUM (8)
+        0x95, 63, //     REPORT_COUNT (8)
+        0x75, 0x08, //     REPORT_SIZE (8)
+        0x09,0x01,
+        0x81, 0x01, //     INPUT (Data,Var,Abs)
+        0x09,0x02,
+        0x91, 0x02, //   OUTPUT (Data,Var,Abs)
+        0x09,0x04,
+        0xB1, 0x02, //   OUTPUT (Data,Var,Abs)
+        0xc0 ,       // END_COLLECTION
+
+        
+    };
+
+
+
+
+    SPPReportDesc(uint8_t reportId)
+    {
+        insert(SPPReportDescBase, sizeof(SPPReportDescBase), ReportDescType::CustomSPP);
+        /* desc[8] = reportId; */
+    }
+
+    
+
+};
+
+} /* MOCNordic */
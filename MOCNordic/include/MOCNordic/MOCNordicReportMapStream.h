@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <MOCNordic/MOCNordicHIDParser.h>
+#include <MOCNordic/MOCNordicReportDesc.h>
+#include <MOCNordic/MOCNordicKeyboard.h>
+#include <MOCNordic/MOCNordicTouchpad.h>
+#include <MOCNordic/MOCNordicWake.h>
+namespace MOCNordic {
+
+/**
+ * @brief everything the class stages need from a report map, gathered in one parser pass while the map arrives
+ * @note feed() takes the chunks of the long read as they come, items may be split between them;
+ *       after finish() the classification, report sizes and stage layouts are ready without another walk
+ */
+class ReportMapStream : HIDParserVisitor {
+public:
+    ReportMapStream()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        parser.reset();
+        classifier.clear();
+        keyboards.clear();
+        touchpad.clear();
+        wake.clear();
+        finished = false;
+    }
+
+    void feed(const uint8_t *data, uint32_t length)
+    {
+        /* the keyboard layout keeps the globals at the end of its collection */
+        keyboards.parser = &parser;
+        parser.feed(data, length, *this);
+        keyboards.parser = nullptr;
+    }
+
+    /* false if the map was malformed or ended inside an item */
+    bool finish()
+    {
+        finished = true;
+        return parser.finish();
+    }
+
+    /* finished, well formed and exactly the length bytes given to the interface */
+    bool describes(uint32_t length) const
+    {
+        return finished && !parser.isMalformed() && parser.fedLength() == length;
+    }
+
+    uint32_t length() const
+    {
+        return parser.fedLength();
+    }
+
+    ReportDescType type() const
+    {
+        return classifier.type();
+    }
+
+    const HIDReportParser &reportParser() const
+    {
+        return parser;
+    }
+
+    const KeyboardLayout &keyboardLayout() const
+    {
+        return keyboards;
+    }
+
+    const PTPLayout &touchpadLayout() const
+    {
+        return touchpad;
+    }
+
+    const WakeLayout &wakeLayout() const
+    {
+        return wake;
+    }
+
+private:
+    void onCollection(const HIDCollection &collection) override
+    {
+        classifier.onCollection(collection);
+        keyboards.onCollection(collection);
+    }
+
+    void onEndCollection(const HIDCollection &collection) override
+    {
+        keyboards.onEndCollection(collection);
+    }
+
+    void onField(const HIDField &field) override
+    {
+        keyboards.onField(field);
+        touchpad.onField(field);
+        wake.onField(field);
+    }
+
+    HIDReportParser parser;
+    ApplicationClassifier classifier;
+    KeyboardLayout keyboards;
+    PTPLayout touchpad;
+    WakeLayout wake;
+    bool finished;
+};
+
+} /* MOCNordic */
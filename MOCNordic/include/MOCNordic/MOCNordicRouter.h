@@ -0,0 +1,117 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <MOCNordic/MOCNordicConfig.h>
+namespace MOCNordic {
+
+/**
+ * @brief one routing rule, reports of a peripheral (optionally only one report id) go to every interface in the mask
+ */
+struct Route {
+    inline static constexpr int16_t anyReport = -1;
+
+    uint8_t peripheral;
+    int16_t reportId;
+    uint32_t interfaceMask;
+};
+
+/**
+ * @brief peripheral -> usb interface routing table, declared at compile time or set at runtime before the link subscribes
+ * @note the hot path is a table lookup and one plain function call per interface
+ */
+class MOCNordicRouter {
+public:
+    MOCNordicRouter() = delete;
+
+    inline static constexpr uint32_t maxPeripherals = Capacity::peripherals;
+#if CONFIG_USB_HID_DEVICE_COUNT
+    inline static constexpr uint32_t maxInterfaces = CONFIG_USB_HID_DEVICE_COUNT;
+#elif defined(CONFIG_MOCNORDIC_BENCH_BSIM)
+    inline static constexpr uint32_t maxInterfaces = Capacity::peripherals;
+#else
+    inline static constexpr uint32_t maxInterfaces = 2;
+#endif
+    static_assert(maxInterfaces <= 32, "interface mask is 32 bits");
+    /* report id specific rules per peripheral */
+    inline static constexpr uint32_t maxReportRoutes = 4;
+
+    static constexpr bool validRoute(const Route &route)
+    {
+        return route.peripheral < maxPeripherals
+            && route.reportId >= Route::anyReport && route.reportId <= 0xFF
+            && route.interfaceMask
+            && (maxInterfaces == 32 || route.interfaceMask < (1ULL << maxInterfaces));
+    }
+
+    /* for static_assert on a table declared at compile time */
+    template <size_t N>
+    static constexpr bool validRoutes(const Route (&routes)[N])
+    {
+        for(size_t i = 0; i < N; i++) {
+            if(!validRoute(routes[i]))
+                return false;
+        }
+        return true;
+    }
+
+    template <size_t N>
+    static int setRoutes(const Route (&routes)[N])
+    {
+        clear();
+        for(size_t i = 0; i < N; i++) {
+            int err = setRoute(routes[i]);
+            if(err)
+                return err;
+        }
+        return 0;
+    }
+
+    /**
+     * @retval 0 set, -EINVAL invalid route, -ENOMEM too many report id routes for the peripheral
+     */
+    static int setRoute(const Route &route);
+
+    static void clear();
+
+    static bool hasRoute(uint8_t peripheral)
+    {
+        return interfacesOf(peripheral);
+    }
+
+    /* every interface a peripheral reaches, these get the peripheral's report map */
+    static uint32_t interfacesOf(uint8_t peripheral);
+
+    static uint32_t lookup(uint8_t peripheral, int reportId)
+    {
+        const PeripheralRoutes &routes = table[peripheral];
+        for(uint32_t i = 0; i < routes.reportRouteCnt; i++) {
+            if(routes.reportRoutes[i].reportId == reportId)
+                return routes.reportRoutes[i].interfaceMask;
+        }
+        return routes.defaultMask;
+    }
+
+    /**
+     * @brief hot path, reportId is -1 if the report has no report id prefix
+     * @retval first error of the interfaces, -ENOENT if nothing is routed
+     */
+    static int forward(uint8_t peripheral, int reportId, uint8_t *report, uint32_t length);
+
+private:
+    struct ReportRoute {
+        int16_t reportId;
+        uint32_t interfaceMask;
+    };
+
+    struct PeripheralRoutes {
+        uint32_t defaultMask;
+        uint32_t reportRouteCnt;
+        std::array<ReportRoute, maxReportRoutes> reportRoutes;
+    };
+
+    inline static std::array<PeripheralRoutes, maxPeripherals> table;
+};
+
+} /* MOCNordic */
@@ -0,0 +1,125 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <array>
+#include <cstdint>
+namespace MOCNordic {
+
+/**
+ * @brief scans only while targets are missing, backs off fast -> reduced -> slow (or passive) and stops once every target is up
+ * @note every decision is made in one delayable work item, callers only kick it
+ */
+class MOCNordicScanMgr {
+public:
+    MOCNordicScanMgr() = delete;
+
+    enum class Phase : uint8_t {
+        Fast = 0,
+        Reduced,
+        Slow,
+        Stopped,
+    };
+
+    struct PhaseParam {
+        uint8_t type;
+        /* 0.625 ms units */
+        uint16_t interval;
+        uint16_t window;
+        /* time in phase before backing off, 0 stays */
+        uint32_t durationMs;
+
+        constexpr uint16_t dutyPermille() const
+        {
+            return static_cast<uint16_t>(static_cast<uint32_t>(window) * 1000 / interval);
+        }
+    };
+
+    /* connection event gaps of subscribed links, split by scanner state */
+    struct EventGaps {
+        uint32_t gaps;
+        /* gap over 1.5 connection intervals, a connection event was lost or late */
+        uint32_t late;
+    };
+
+    struct ScanStats {
+        Phase phase;
+        uint16_t dutyPermille;
+        uint32_t starts;
+        /* wall time with the scanner on */
+        uint32_t activeMs;
+        /* activeMs weighted by window / interval */
+        uint32_t airMs;
+        EventGaps scanning;
+        EventGaps idle;
+    };
+
+    static void init();
+
+    /* a slot became a target, the backoff starts over */
+    static void addTarget();
+
+    /* a target was removed, the backoff starts over for the remaining ones */
+    static void removeTarget();
+
+    /* a filter matched, bt_scan is creating the link, the scanner stays off until the link settles */
+    static void connecting();
+
+    /* pairing finished or failed, or the connection attempt failed, continue the backoff for the remaining targets */
+    static void linkSettled();
+
+    /* a link went down, scan for it again at the current step of the backoff */
+    static void targetLost();
+
+    /**
+     * @brief gap between two notifications of one link, gaps over 4 intervals are the peripheral idling and ignored
+     */
+    static void recordEventGap(uint32_t gapUs, uint32_t intervalUs)
+    {
+        if(!intervalUs || gapUs > intervalUs * 4)
+            return;
+        EventGaps &bucket = atomic_get(&running) ? stats.scanning : stats.idle;
+        ++bucket.gaps;
+        if(gapUs > intervalUs + intervalUs / 2)
+            ++bucket.late;
+    }
+
+    static ScanStats getStats();
+    static void printStats();
+
+private:
+    static constexpr std::array<PhaseParam, 3> phaseParams = {{
+        /* 100 % */
+        {BT_LE_SCAN_TYPE_ACTIVE, BT_GAP_SCAN_FAST_INTERVAL_MIN, BT_GAP_SCAN_FAST_WINDOW, CONFIG_MOCNORDIC_SCAN_FAST_MS},
+        /* 160 ms / 30 ms, ~19 % */
+        {BT_LE_SCAN_TYPE_ACTIVE, 0x0100, BT_GAP_SCAN_FAST_WINDOW, CONFIG_MOCNORDIC_SCAN_REDUCED_MS},
+        /* 1.28 s / 11.25 ms, < 1 % */
+#if defined(CONFIG_MOCNORDIC_SCAN_PASSIVE_IDLE)
+        {BT_LE_SCAN_TYPE_PASSIVE, BT_GAP_SCAN_SLOW_INTERVAL_1, BT_GAP_SCAN_SLOW_WINDOW_1, 0},
+#else
+        {BT_LE_SCAN_TYPE_ACTIVE, BT_GAP_SCAN_SLOW_INTERVAL_1, BT_GAP_SCAN_SLOW_WINDOW_1, 0},
+#endif
+    }};
+
+    static void update(struct k_work *work);
+    static void apply(Phase next);
+    static void account();
+    static uint32_t missingTargets();
+
+    inline static struct k_work_delayable work;
+
+    inline static atomic_t connectingFlag = ATOMIC_INIT(0);
+    inline static atomic_t restartFlag = ATOMIC_INIT(0);
+    inline static atomic_t running = ATOMIC_INIT(0);
+
+    /* only touched from the work item */
+    inline static Phase phase = Phase::Stopped;
+    /* backoff step, kept while the scanner is off until the targets change */
+    inline static Phase step = Phase::Fast;
+    inline static int64_t stepStartMs;
+    inline static int64_t segmentStartMs;
+
+    inline static ScanStats stats;
+};
+
+} /* MOCNordic */
@@ -0,0 +1,611 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <MOCNordic/MOCNordicHIDParser.h>
+namespace MOCNordic {
+
+/**
+ * @brief where the precision touchpad fields live, found once from the report map
+ */
+struct PTPLayout : HIDParserVisitor {
+    inline static constexpr uint32_t maxSlots = 10;
+
+    struct Field {
+        uint16_t bitOffset;
+        uint8_t bitSize;
+        uint8_t reportId;
+
+        bool present() const
+        {
+            return bitSize;
+        }
+    };
+
+    struct Slot {
+        uint16_t bitOffset;
+        uint16_t bitEnd;
+        uint16_t collection;
+        /* a contact keeps its id and tip while it moves */
+        Field tip;
+        Field contactId;
+    };
+
+    uint8_t inputReportId;
+    std::array<Slot, maxSlots> slots;
+    uint32_t slotCnt;
+    /* slots have the same layout, contacts can be moved between them */
+    bool uniformSlots;
+    Field contactCount;
+    Field scanTime;
+    Field buttons;
+
+    Field contactCountMax;
+    Field padType;
+    Field certification;
+    uint16_t certificationBytes;
+    Field inputMode;
+    Field surfaceSwitch;
+    Field buttonSwitch;
+
+    PTPLayout()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        inputReportId = 0;
+        slots = {};
+        slotCnt = 0;
+        uniformSlots = true;
+        contactCount = {};
+        scanTime = {};
+        buttons = {};
+        contactCountMax = {};
+        padType = {};
+        certification = {};
+        certificationBytes = 0;
+        inputMode = {};
+        surfaceSwitch = {};
+        buttonSwitch = {};
+    }
+
+    /* windows won't use the touchpad without the input report and the capabilities feature */
+    bool isValid() const
+    {
+        return inputReportId && slotCnt && contactCount.present() && contactCountMax.present();
+    }
+
+    uint32_t slotBits() const
+    {
+        return slotCnt ? slots[0].bitEnd - slots[0].bitOffset : 0;
+    }
+
+    void onField(const HIDField &field) override
+    {
+        if(field.type == HIDReportType::Input) {
+            if(field.applicationUsage != HIDUsages::DigitizerTouchPad)
+                return;
+            if(field.collectionUsage == HIDUsages::DigitizerFinger) {
+                addToSlot(field);
+                return;
+            }
+            if(field.isConstant())
+                return;
+            if(field.usage == HIDUsages::DigitizerContactCount) {
+                contactCount = toField(field);
+                inputReportId = field.reportId;
+            }
+            else if(field.usage == HIDUsages::DigitizerScanTime) {
+                scanTime = toField(field);
+            }
+            else if((field.usage >> 16) == HIDUsages::ButtonPage) {
+                /* consecutive button fields are merged */
+                if(buttons.present() && buttons.bitOffset + buttons.bitSize == field.bitOffset)
+                    buttons.bitSize += field.bitSize * field.count;
+                else
+                    buttons = {field.bitOffset, static_cast<uint8_t>(field.bitSize * field.count), field.reportId};
+            }
+            return;
+        }
+
+        if(field.type != HIDReportType::Feature || field.isConstant())
+            return;
+
+        switch(field.usage) {
+        case HIDUsages::DigitizerContactCountMax:
+            contactCountMax = toField(field);
+            break;
+        case HIDUsages::DigitizerPadType:
+            padType = toField(field);
+            break;
+        case HIDUsages::VendorPTPCertification:
+            certification = toField(field);
+            certificationBytes = static_cast<uint16_t>(field.bitSize * field.count / 8);
+            break;
+        case HIDUsages::DigitizerInputMode:
+            inputMode = toField(field);
+            break;
+        case HIDUsages::DigitizerSurfaceSwitch:
+            surfaceSwitch = toField(field);
+            break;
+        case HIDUsages::DigitizerButtonSwitch:
+            buttonSwitch = toField(field);
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    static Field toField(const HIDField &field)
+    {
+        return {field.bitOffset, field.bitSize, field.reportId};
+    }
+
+    void addToSlot(const HIDField &field)
+    {
+        if(inputReportId && field.reportId != inputReportId) {
+            uniformSlots = false;
+            return;
+        }
+        inputReportId = field.reportId;
+
+        if(!slotCnt || slots[slotCnt - 1].collection != field.collection) {
+            if(slotCnt >= maxSlots) {
+                uniformSlots = false;
+                return;
+            }
+            slots[slotCnt++] = {field.bitOffset, static_cast<uint16_t>(field.bitEnd()), field.collection, {}, {}};
+        }
+        Slot &slot = slots[slotCnt - 1];
+        slot.bitOffset = std::min<uint16_t>(slot.bitOffset, field.bitOffset);
+        slot.bitEnd = std::max<uint16_t>(slot.bitEnd, static_cast<uint16_t>(field.bitEnd()));
+        if(field.usage == HIDUsages::DigitizerTipSwitch)
+            slot.tip = toField(field);
+        else if(field.usage == HIDUsages::DigitizerContactId)
+            slot.contactId = toField(field);
+    }
+};
+
+/**
+ * @brief precision touchpad support for one usb interface:
+ *        feature reports windows asks for are answered from tables built at enumeration,
+ *        hybrid mode frames are packed into as few parallel mode reports as the slots allow
+ * @note a frame is held until all its contacts arrived, the next frame starts or the caller gives up on it with flushHeld();
+ *       in mouse input mode, the default until the host sets touchpad mode, reports go out as the peripheral sent them
+ */
+class PTPTouchpad {
+public:
+    /* one interrupt packet, CONFIG_HID_INTERRUPT_EP_MPS */
+    inline static constexpr uint32_t maxReportSize = 64;
+    inline static constexpr uint32_t maxFeatureSize = 8;
+
+    enum InputMode : uint8_t {
+        Mouse = 0x00,
+        Touchpad = 0x03,
+    };
+
+    struct Stats {
+        uint32_t reportsIn;
+        uint32_t reportsOut;
+        uint32_t framesPacked;
+        uint32_t framesIncomplete;
+        /* frames that started being held, a caller bounding the hold time restarts its timer on a change */
+        uint32_t framesHeld;
+        /* held frames flushHeld() sent without the missing contacts */
+        uint32_t framesTimedOut;
+    };
+
+    PTPTouchpad()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        layout.clear();
+        inputLength = 0;
+        packing = false;
+        capsReport = {};
+        capsLength = 0;
+        inputModeReport = {};
+        inputModeLength = 0;
+        selectiveReport = {};
+        selectiveLength = 0;
+        pending = {};
+        pendingExpected = 0;
+        pendingReceived = 0;
+        pendingPacked = 0;
+        stats = {};
+    }
+
+    /**
+     * @brief parse the report map and precompute the feature reports
+     * @retval true if the report map describes a precision touchpad
+     */
+    bool init(const uint8_t *desc, uint32_t length)
+    {
+        PTPLayout parsed;
+        HIDReportParser parser;
+        parser.parse(desc, length, parsed);
+        return init(parsed, parser);
+    }
+
+    /* same with the layout and report sizes of a parser which already walked the report map */
+    bool init(const PTPLayout &parsed, const HIDReportParser &parser)
+    {
+        clear();
+        layout = parsed;
+        if(!layout.isValid() || !parser.usesReportIds())
+            return false;
+
+        inputLength = 1 + parser.reportBytes(HIDReportType::Input, layout.inputReportId);
+        uint32_t slotBits = layout.slotBits();
+        for(uint32_t i = 1; i < layout.slotCnt; i++) {
+            if(static_cast<uint32_t>(layout.slots[i].bitEnd - layout.slots[i].bitOffset) != slotBits)
+                layout.uniformSlots = false;
+        }
+        packing = layout.uniformSlots && layout.slotCnt > 1 && inputLength <= maxReportSize;
+
+        capsLength = buildFeature(parser, layout.contactCountMax, capsReport);
+        HIDBits::set(&capsReport[1], layout.contactCountMax.bitOffset, layout.contactCountMax.bitSize, layout.slotCnt);
+        if(layout.padType.present() && layout.padType.reportId == layout.contactCountMax.reportId) {
+            /* a clickpad reports only button 1, anything more means discrete buttons */
+            HIDBits::set(&capsReport[1], layout.padType.bitOffset, layout.padType.bitSize, layout.buttons.bitSize > 1 ? 0x02 : 0x00);
+        }
+
+        inputModeLength = buildFeature(parser, layout.inputMode, inputModeReport);
+        selectiveLength = buildFeature(parser, layout.surfaceSwitch, selectiveReport);
+        /* both reporting switches default to on */
+        if(selectiveLength) {
+            HIDBits::set(&selectiveReport[1], layout.surfaceSwitch.bitOffset, layout.surfaceSwitch.bitSize, 1);
+            if(layout.buttonSwitch.reportId == layout.surfaceSwitch.reportId)
+                HIDBits::set(&selectiveReport[1], layout.buttonSwitch.bitOffset, layout.buttonSwitch.bitSize, 1);
+        }
+        return true;
+    }
+
+    bool isValid() const
+    {
+        return layout.isValid();
+    }
+
+    const PTPLayout &getLayout() const
+    {
+        return layout;
+    }
+
+    const Stats &getStats() const
+    {
+        return stats;
+    }
+
+    uint8_t inputMode() const
+    {
+        if(!inputModeLength)
+            return InputMode::Touchpad;
+        return static_cast<uint8_t>(HIDBits::get(&inputModeReport[1], layout.inputMode.bitOffset, layout.inputMode.bitSize));
+    }
+
+    /* a hybrid frame waits for contacts */
+    bool holding() const
+    {
+        return pendingExpected;
+    }
+
+    bool surfaceEnabled() const
+    {
+        return !selectiveLength || HIDBits::get(&selectiveReport[1], layout.surfaceSwitch.bitOffset, layout.surfaceSwitch.bitSize);
+    }
+
+    bool buttonEnabled() const
+    {
+        return !selectiveLength || layout.buttonSwitch.reportId != layout.surfaceSwitch.reportId
+            || HIDBits::get(&selectiveReport[1], layout.buttonSwitch.bitOffset, layout.buttonSwitch.bitSize);
+    }
+
+    /**
+     * @brief answer a GET_REPORT(Feature), data includes the report id
+     * @retval false if the report is not one of the touchpad feature reports
+     */
+    bool getFeature(uint8_t reportId, const uint8_t **data, uint32_t *length)
+    {
+        if(!isValid() || !reportId)
+            return false;
+
+        if(reportId == capsReport[0]) {
+            *data = capsReport.data();
+            *length = capsLength;
+            return true;
+        }
+        if(layout.certification.present() && reportId == layout.certification.reportId) {
+            /* the blob is the same for every interface, only the report id differs */
+            certificationReport[0] = reportId;
+            *data = certificationReport;
+            *length = 1 + std::min<uint32_t>(layout.certificationBytes, sizeof(certificationReport) - 1);
+            return true;
+        }
+        if(inputModeLength && reportId == inputModeReport[0]) {
+            *data = inputModeReport.data();
+            *length = inputModeLength;
+            return true;
+        }
+        if(selectiveLength && reportId == selectiveReport[0]) {
+            *data = selectiveReport.data();
+            *length = selectiveLength;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief handle a SET_REPORT(Feature), data includes the report id
+     * @retval false if the report is not handled here
+     */
+    bool setFeature(uint8_t reportId, const uint8_t *data, uint32_t length)
+    {
+        if(!isValid() || !reportId || !length)
+            return false;
+
+        std::array<uint8_t, maxFeatureSize> *target = nullptr;
+        uint32_t targetLength = 0;
+        if(inputModeLength && reportId == inputModeReport[0]) {
+            target = &inputModeReport;
+            targetLength = inputModeLength;
+        }
+        else if(selectiveLength && reportId == selectiveReport[0]) {
+            target = &selectiveReport;
+            targetLength = selectiveLength;
+        }
+        if(!target)
+            return false;
+
+        /* report id stays ours, some hosts strip it */
+        const uint8_t *payload = data[0] == reportId ? data + 1 : data;
+        uint32_t payloadLength = data[0] == reportId ? length - 1 : length;
+        memcpy(target->data() + 1, payload, std::min(payloadLength, targetLength - 1));
+        return true;
+    }
+
+    /**
+     * @brief newer can replace older before either reached the host without losing a touch or a click:
+     *        same contact count, buttons, contact ids and tips, only positions and scan time differ
+     * @note both are input reports as they go out, report id included
+     */
+    bool supersedes(const uint8_t *older, const uint8_t *newer, uint32_t length) const
+    {
+        if(!isValid() || length != inputLength || older[0] != layout.inputReportId || newer[0] != layout.inputReportId)
+            return false;
+        const uint8_t *before = older + 1;
+        const uint8_t *after = newer + 1;
+        auto same = [before, after] (const PTPLayout::Field &field) {
+            return HIDBits::get(before, field.bitOffset, field.bitSize) == HIDBits::get(after, field.bitOffset, field.bitSize);
+        };
+        /* a hybrid continuation carries a count of 0, it completes a frame and can't be replaced */
+        if(!HIDBits::get(before, layout.contactCount.bitOffset, layout.contactCount.bitSize) || !same(layout.contactCount))
+            return false;
+        if(layout.buttons.present() && !same(layout.buttons))
+            return false;
+        for(uint32_t i = 0; i < layout.slotCnt; i++) {
+            const PTPLayout::Slot &slot = layout.slots[i];
+            if(!slot.tip.present() || !same(slot.tip) || (slot.contactId.present() && !same(slot.contactId)))
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief forward one input report, emit(const uint8_t *report, uint32_t length) is called for
+     *        every report that goes out, zero or more times
+     * @retval the first error emit returned, 0 otherwise
+     */
+    template <typename Emit>
+    int feed(const uint8_t *report, uint32_t length, Emit &&emit)
+    {
+        if(!length || report[0] != layout.inputReportId || length < inputLength)
+            return emit(report, length);
+
+        ++stats.reportsIn;
+        if(inputMode() != InputMode::Touchpad) {
+            /* packing and selective reporting are touchpad mode features */
+            int ret = 0;
+            if(pendingExpected) {
+                ++stats.framesIncomplete;
+                ret = flushPending(emit);
+            }
+            ++stats.reportsOut;
+            int err = emit(report, inputLength);
+            return ret ? ret : err;
+        }
+        if(!packing)
+            return emitFiltered(report, inputLength, emit);
+
+        const uint8_t *payload = report + 1;
+        uint32_t expected = HIDBits::get(payload, layout.contactCount.bitOffset, layout.contactCount.bitSize);
+        int ret = 0;
+
+        if(expected) {
+            /* first report of a frame */
+            if(pendingExpected) {
+                ++stats.framesIncomplete;
+                ret = flushPending(emit);
+            }
+
+            uint32_t carried = occupiedSlots(payload);
+            if(carried >= expected || carried == layout.slotCnt) {
+                /* parallel mode or already as full as it gets */
+                int err = emitFiltered(report, inputLength, emit);
+                return ret ? ret : err;
+            }
+
+            memcpy(pending.data(), report, inputLength);
+            pendingPacked = 0;
+            for(uint32_t i = 0; i < layout.slotCnt; i++) {
+                if(slotOccupied(payload, i))
+                    moveSlot(pending.data() + 1, pendingPacked++, payload, i);
+            }
+            clearSlots(pending.data() + 1, pendingPacked);
+            pendingExpected = expected;
+            pendingReceived = pendingPacked;
+            ++stats.framesHeld;
+            return ret;
+        }
+
+        if(!pendingExpected) {
+            /* all contacts lifted or a continuation of a frame we already flushed */
+            return emitFiltered(report, inputLength, emit);
+        }
+
+        for(uint32_t i = 0; i < layout.slotCnt && pendingReceived < pendingExpected; i++) {
+            if(!slotOccupied(payload, i))
+                continue;
+            if(pendingPacked == layout.slotCnt) {
+                /* more contacts than slots, continue in a hybrid report of our own */
+                int err = emitFiltered(pending.data(), inputLength, emit);
+                ret = ret ? ret : err;
+                HIDBits::set(pending.data() + 1, layout.contactCount.bitOffset, layout.contactCount.bitSize, 0);
+                clearSlots(pending.data() + 1, 0);
+                pendingPacked = 0;
+            }
+            moveSlot(pending.data() + 1, pendingPacked++, payload, i);
+            ++pendingReceived;
+        }
+
+        if(pendingReceived >= pendingExpected) {
+            ++stats.framesPacked;
+            int err = flushPending(emit);
+            ret = ret ? ret : err;
+        }
+        return ret;
+    }
+
+    /**
+     * @brief sends a held frame with the contacts it has, for a peripheral which stopped in the middle of one
+     * @retval what emit returned, 0 if nothing was held
+     */
+    template <typename Emit>
+    int flushHeld(Emit &&emit)
+    {
+        if(!pendingExpected)
+            return 0;
+        ++stats.framesTimedOut;
+        return flushPending(emit);
+    }
+
+private:
+    static uint32_t buildFeature(const HIDReportParser &parser, const PTPLayout::Field &field, std::array<uint8_t, maxFeatureSize> &report)
+    {
+        report.fill(0x00);
+        if(!field.present())
+            return 0;
+        uint32_t length = 1 + parser.reportBytes(HIDReportType::Feature, field.reportId);
+        if(length > report.size())
+            return 0;
+        report[0] = field.reportId;
+        return length;
+    }
+
+    bool slotOccupied(const uint8_t *payload, uint32_t slot) const
+    {
+        const PTPLayout::Slot &it = layout.slots[slot];
+        return !HIDBits::isZero(payload, it.bitOffset, it.bitEnd - it.bitOffset);
+    }
+
+    uint32_t occupiedSlots(const uint8_t *payload) const
+    {
+        uint32_t ret = 0;
+        for(uint32_t i = 0; i < layout.slotCnt; i++) {
+            if(slotOccupied(payload, i))
+                ++ret;
+        }
+        return ret;
+    }
+
+    void moveSlot(uint8_t *dst, uint32_t dstSlot, const uint8_t *src, uint32_t srcSlot) const
+    {
+        if(dst == src && dstSlot == srcSlot)
+            return;
+        HIDBits::copy(dst, layout.slots[dstSlot].bitOffset, src, layout.slots[srcSlot].bitOffset, layout.slotBits());
+    }
+
+    void clearSlots(uint8_t *payload, uint32_t first) const
+    {
+        for(uint32_t i = first; i < layout.slotCnt; i++) {
+            HIDBits::clear(payload, layout.slots[i].bitOffset, layout.slotBits());
+        }
+    }
+
+    template <typename Emit>
+    int flushPending(Emit &&emit)
+    {
+        uint8_t *payload = pending.data() + 1;
+        /* an incomplete frame still in its first report announces only the contacts it carries */
+        if(pendingReceived < pendingExpected && HIDBits::get(payload, layout.contactCount.bitOffset, layout.contactCount.bitSize))
+            HIDBits::set(payload, layout.contactCount.bitOffset, layout.contactCount.bitSize, pendingReceived);
+        pendingExpected = 0;
+        return emitFiltered(pending.data(), inputLength, emit);
+    }
+
+    /* selective reporting, the host turns surface and button reporting off independently */
+    template <typename Emit>
+    int emitFiltered(const uint8_t *report, uint32_t length, Emit &&emit)
+    {
+        bool surface = surfaceEnabled();
+        bool button = buttonEnabled();
+        if(surface && button) {
+            ++stats.reportsOut;
+            return emit(report, length);
+        }
+        if(!surface && !button)
+            return 0;
+
+        std::array<uint8_t, maxReportSize> filtered;
+        length = std::min<uint32_t>(length, filtered.size());
+        memcpy(filtered.data(), report, length);
+        if(!surface) {
+            HIDBits::set(filtered.data() + 1, layout.contactCount.bitOffset, layout.contactCount.bitSize, 0);
+            clearSlots(filtered.data() + 1, 0);
+        }
+        if(!button && layout.buttons.present()) {
+            HIDBits::clear(filtered.data() + 1, layout.buttons.bitOffset, layout.buttons.bitSize);
+        }
+        ++stats.reportsOut;
+        return emit(filtered.data(), length);
+    }
+
+    PTPLayout layout;
+    /* input report length including the report id */
+    uint32_t inputLength;
+    bool packing;
+
+    std::array<uint8_t, maxFeatureSize> capsReport;
+    uint32_t capsLength;
+    std::array<uint8_t, maxFeatureSize> inputModeReport;
+    uint32_t inputModeLength;
+    std::array<uint8_t, maxFeatureSize> selectiveReport;
+    uint32_t selectiveLength;
+
+    std::array<uint8_t, maxReportSize> pending;
+    uint32_t pendingExpected;
+    uint32_t pendingReceived;
+    uint32_t pendingPacked;
+    Stats stats;
+
+    /* first byte reportId */
+    inline static uint8_t certificationReport[] =
+    {
+        0x00, 0xfc, 0x28, 0xfe, 0x84, 0x40, 0xcb, 0x9a, 0x87, 0x0d, 0xbe, 0x57, 0x3c, 0xb6, 0x70, 0x09, 0x88, 0x07, 0x97, 0x2d, 0x2b, 0xe3, 0x38, 0x34, 0xb6, 0x6c, 0xed, 0xb0, 0xf7, 0xe5, 0x9c, 0xf6,0xc2, 
+        0x2e, 0x84, 0x1b, 0xe8, 0xb4, 0x51, 0x78, 0x43, 0x1f, 0x28, 0x4b, 0x7c, 0x2d, 0x53, 0xaf, 0xfc, 0x47, 0x70, 0x1b, 0x59, 0x6f, 0x74, 0x43, 0xc4, 0xf3, 0x47, 0x18, 0x53, 0x1a, 0xa2, 0xa1,0x71, 
+        0xc7, 0x95, 0x0e, 0x31, 0x55, 0x21, 0xd3, 0xb5, 0x1e, 0xe9, 0x0c, 0xba, 0xec, 0xb8, 0x89, 0x19, 0x3e, 0xb3, 0xaf, 0x75, 0x81, 0x9d, 0x53, 0xb9, 0x41, 0x57, 0xf4, 0x6d, 0x39, 0x25, 0x29,0x7c, 
+        0x87, 0xd9, 0xb4, 0x98, 0x45, 0x7d, 0xa7, 0x26, 0x9c, 0x65, 0x3b, 0x85, 0x68, 0x89, 0xd7, 0x3b, 0xbd, 0xff, 0x14, 0x67, 0xf2, 0x2b, 0xf0, 0x2a, 0x41, 0x54, 0xf0, 0xfd, 0x2c, 0x66, 0x7c,0xf8, 
+        0xc0, 0x8f, 0x33, 0x13, 0x03, 0xf1, 0xd3, 0xc1, 0x0b, 0x89, 0xd9, 0x1b, 0x62, 0xcd, 0x51, 0xb7, 0x80, 0xb8, 0xaf, 0x3a, 0x10, 0xc1, 0x8a, 0x5b, 0xe8, 0x8a, 0x56, 0xf0, 0x8c, 0xaa, 0xfa,0x35, 
+        0xe9, 0x42, 0xc4, 0xd8, 0x55, 0xc3, 0x38, 0xcc, 0x2b, 0x53, 0x5c, 0x69, 0x52, 0xd5, 0xc8, 0x73, 0x02, 0x38, 0x7c, 0x73, 0xb6, 0x41, 0xe7, 0xff, 0x05, 0xd8, 0x2b, 0x79, 0x9a, 0xe2, 0x34,0x60, 
+        0x8f, 0xa3, 0x32, 0x1f, 0x09, 0x78, 0x62, 0xbc, 0x80, 0xe3, 0x0f, 0xbd, 0x65, 0x20, 0x08, 0x13, 0xc1, 0xe2, 0xee, 0x53, 0x2d, 0x86, 0x7e, 0xa7, 0x5a, 0xc5, 0xd3, 0x7d, 0x98, 0xbe, 0x31,0x48, 
+        0x1f, 0xfb, 0xda, 0xaf, 0xa2, 0xa8, 0x6a, 0x89, 0xd6, 0xbf, 0xf2, 0xd3, 0x32, 0x2a, 0x9a, 0xe4, 0xcf, 0x17, 0xb7, 0xb8, 0xf4, 0xe1, 0x33, 0x08, 0x24, 0x8b, 0xc4, 0x43, 0xa5, 0xe5, 0x24,0xc2
+    };
+};
+
+} /* MOCNordic */
@@ -0,0 +1,128 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <array>
+#include <cstdint>
+namespace MOCNordic {
+
+enum class TraceEvent : uint8_t {
+    ScanMatch = 1,
+    Connected,
+    SecurityChanged,
+    PairingComplete,
+    DiscoveryStart,
+    DiscoveryComplete,
+    Subscribe,
+    ReportMapStart,
+    ReportMapDone,
+    UsbEnumerate,
+    UsbConfigured,
+    FirstReport,
+    NotifyRx,
+    UsbWrite,
+    Disconnected,
+    ScanDuty,
+    InvalidTransition,
+    UsbSuspend,
+    /* arg: us since the remote wakeup request, 0 if the host resumed on its own */
+    UsbResume,
+    RemoteWakeup,
+    /* arg: report id, the peripheral acknowledged an output report from the host */
+    OutputWrite,
+    /* arg: us from the first report of an idle link to its fast parameters */
+    LinkFast,
+};
+
+/* link index for events which don't belong to a peripheral */
+inline constexpr uint8_t traceNoLink = 0xFF;
+
+#if defined(CONFIG_MOCNORDIC_TRACE)
+#define MOC_TRACE(event, link, arg) \
+        do { \
+            ::MOCNordic::MOCNordicTrace::record(::MOCNordic::TraceEvent::event, link, arg); \
+        } while(0)
+#else
+#define MOC_TRACE(event, link, arg) do { } while(0)
+#endif
+
+/**
+ * @brief fixed size binary event ring, writers only do one atomic increment so it's safe from any context
+ * @note dump layout: DumpHeader followed by DumpHeader::count Records, oldest first, little endian
+ */
+class MOCNordicTrace {
+public:
+    MOCNordicTrace() = delete;
+
+    struct Record {
+        uint32_t timestampUs;
+        uint8_t event;
+        uint8_t link;
+        uint16_t arg;
+    };
+    static_assert(sizeof(Record) == 8, "trace record layout is shared with scripts/mocnordic_trace.py");
+
+    struct DumpHeader {
+        /* 'MOCT' */
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t count;
+        uint32_t lost;
+    };
+
+    inline static constexpr uint32_t dumpMagic = 0x54434F4D;
+    inline static constexpr uint16_t dumpVersion = 1;
+
+#if defined(CONFIG_MOCNORDIC_TRACE)
+    inline static constexpr uint32_t entryCnt = CONFIG_MOCNORDIC_TRACE_ENTRIES;
+    static_assert((entryCnt & (entryCnt - 1)) == 0, "trace entries must be power of two");
+
+    static void record(TraceEvent event, uint8_t link, uint32_t arg)
+    {
+        if(atomic_get(&paused))
+            return;
+        uint32_t seq = static_cast<uint32_t>(atomic_inc(&head));
+        Record &slot = ring[seq & (entryCnt - 1)];
+        slot.timestampUs = k_cyc_to_us_floor32(k_cycle_get_32());
+        slot.event = static_cast<uint8_t>(event);
+        slot.link = link;
+        slot.arg = static_cast<uint16_t>(arg);
+    }
+
+    /**
+     * @brief copy the next part of the dump stream, recording is paused until the stream is fully read,
+     *        dumpAbort() is called or no part was read for CONFIG_MOCNORDIC_TRACE_DUMP_TIMEOUT_MS
+     * @retval bytes copied, 0 once the stream ended, the call after that starts a new dump
+     */
+    static uint32_t readDump(uint8_t *dst, uint32_t length);
+
+    /* drop a partly read dump and record again, the next read starts a new dump */
+    static void dumpAbort();
+
+    /* write a complete dump to a host file, native_sim only */
+    static int dumpToFile(const char *path);
+
+    static void clear();
+
+private:
+    static void dumpBegin();
+
+    inline static std::array<Record, entryCnt> ring;
+    inline static atomic_t head;
+    inline static atomic_t paused;
+
+    inline static uint32_t dumpFirst;
+    inline static uint32_t dumpCount;
+    inline static uint32_t dumpOffset;
+    inline static bool dumping = false;
+    inline static struct k_spinlock dumpLock;
+#else
+    static void record(TraceEvent event, uint8_t link, uint32_t arg) {}
+    static uint32_t readDump(uint8_t *dst, uint32_t length) { return 0; }
+    static void dumpAbort() {}
+    static int dumpToFile(const char *path) { return -ENOTSUP; }
+    static void clear() {}
+#endif
+};
+
+} /* MOCNordic */
@@ -0,0 +1,39 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <cstdint>
+#include <MOCNordic/MOCNordicReportDesc.h>
+namespace MOCNordic {
+
+/**
+ * @brief last report map and peripheral of every usb interface, kept in settings so the host enumerates once at boot
+ * @note the peripheral's own report map is stored, keyboard and touchpad stages rebuild the host layout from it
+ */
+class MOCNordicUsbLayout {
+public:
+    MOCNordicUsbLayout() = delete;
+
+    inline static constexpr uint8_t noPeripheral = 0xFF;
+
+    /* identifies a report map, interfaces whose map didn't change aren't enumerated again */
+    static uint32_t checksum(const uint8_t *data, uint32_t length)
+    {
+        return crc32_ieee(data, length);
+    }
+
+    static int init();
+
+    /**
+     * @brief loads the stored layout of one interface
+     * @return 0, -ENOENT nothing or nothing valid stored, -ENOTSUP without CONFIG_MOCNORDIC_USB_LAYOUT_PERSIST
+     */
+    static int restore(uint8_t index, ReportDesc &desc, uint8_t &peripheral);
+
+    /**
+     * @brief copies the layout, the system workqueue writes it to flash; only called when the layout of the interface changed
+     * @note a failed write is only logged
+     */
+    static int store(uint8_t index, ReportDesc &desc, uint8_t peripheral);
+};
+
+} /* MOCNordic */
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <MOCNordic/MOCNordicHIDParser.h>
+namespace MOCNordic {
+
+/**
+ * @brief input fields of a report map which count as a press: keyboard keys, modifiers and buttons
+ * @note movement, wheels and consumer controls are left out, they don't wake a suspended host
+ */
+struct WakeLayout : HIDParserVisitor {
+    inline static constexpr uint32_t maxFields = 8;
+
+    struct Field {
+        uint8_t reportId;
+        uint16_t bitOffset;
+        uint16_t bitSize;
+    };
+
+    std::array<Field, maxFields> fields;
+    uint32_t fieldCnt;
+
+    WakeLayout()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        fields = {};
+        fieldCnt = 0;
+    }
+
+    void onField(const HIDField &field) override
+    {
+        if(field.type != HIDReportType::Input || field.isConstant())
+            return;
+        /* array fields carry the usage minimum, a key array is on the keyboard page as well */
+        uint16_t page = field.usage >> 16;
+        if(page != HIDUsages::KeyboardPage && page != HIDUsages::ButtonPage)
+            return;
+        uint16_t bitSize = static_cast<uint16_t>(field.bitSize * field.count);
+        /* variable fields come one usage at a time, consecutive ones are merged */
+        if(fieldCnt && fields[fieldCnt - 1].reportId == field.reportId
+            && fields[fieldCnt - 1].bitOffset + fields[fieldCnt - 1].bitSize == field.bitOffset) {
+            fields[fieldCnt - 1].bitSize += bitSize;
+            return;
+        }
+        if(fieldCnt < maxFields)
+            fields[fieldCnt++] = {field.reportId, field.bitOffset, bitSize};
+    }
+};
+
+/**
+ * @brief decides whether a report of the peripheral should wake the host, reports are in the peripheral's layout
+ */
+class WakeFilter {
+public:
+    WakeFilter()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        layout.clear();
+        reportIds = false;
+    }
+
+    /* false if the report map has nothing that can wake the host */
+    bool init(const uint8_t *desc, uint32_t length)
+    {
+        WakeLayout parsed;
+        HIDReportParser parser;
+        parser.parse(desc, length, parsed);
+        return init(parsed, parser.usesReportIds());
+    }
+
+    bool init(const WakeLayout &parsed, bool usesReportIds)
+    {
+        layout = parsed;
+        reportIds = usesReportIds;
+        return layout.fieldCnt;
+    }
+
+    /* a key, modifier or button is down; a release is all zero and doesn't count */
+    bool isPress(const uint8_t *report, uint32_t length) const
+    {
+        if(!length)
+            return false;
+        uint8_t reportId = reportIds ? report[0] : 0;
+        const uint8_t *payload = reportIds ? report + 1 : report;
+        uint32_t payloadBits = (reportIds ? length - 1 : length) * 8;
+        for(uint32_t i = 0; i < layout.fieldCnt; i++) {
+            const WakeLayout::Field &field = layout.fields[i];
+            if(field.reportId != reportId || field.bitOffset + field.bitSize > payloadBits)
+                continue;
+            if(!HIDBits::isZero(payload, field.bitOffset, field.bitSize))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    WakeLayout layout;
+    bool reportIds;
+};
+
+} /* MOCNordic */
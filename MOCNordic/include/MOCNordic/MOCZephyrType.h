@@ -6,6 +6,8 @@
 #include <array>
 #include <cstdint>
 #include <functional>
+#include <new>
+#include <utility>
 namespace MOCZephyr {
 
 template <size_t BufferSize>
@@ -39,36 +41,272 @@ struct ZRingbufControl {
 
 
 
-template <typename T, size_t length>
-struct ZMsgqControl {
-    struct k_msgq queue;
+/**
+ * @brief typed pool + fifo, blocks are handed over by pointer instead of being copied in and out like k_msgq
+ * @note a Handle owns one block and gives it back to the pool when destroyed, put() moves the ownership into the fifo;
+ *       with more than one lane every lane has its own fifo, get() takes lane 0 first
+ */
+template <typename T, size_t Capacity, size_t Lanes = 1>
+struct ZPoolQueue {
+    static_assert(Capacity > 0, "pool must hold at least one block");
+    static_assert(Lanes > 0, "queue must have at least one lane");
 
-    std::array<uint8_t, sizeof(T) * length> buffer;
-    
-    virtual void init()
+    struct Block {
+        /* first word is reserved for k_fifo */
+        void *fifoReserved;
+        T value;
+    };
+
+    class Handle {
+    public:
+        Handle() : owner(nullptr), block(nullptr) {}
+        Handle(ZPoolQueue *owner, Block *block) : owner(owner), block(block) {}
+
+        Handle(const Handle &) = delete;
+        Handle &operator=(const Handle &) = delete;
+
+        Handle(Handle &&src) noexcept : owner(src.owner), block(src.block)
+        {
+            src.owner = nullptr;
+            src.block = nullptr;
+        }
+
+        Handle &operator=(Handle &&src) noexcept
+        {
+            if(this != &src) {
+                reset();
+                owner = src.owner;
+                block = src.block;
+                src.owner = nullptr;
+                src.block = nullptr;
+            }
+            return *this;
+        }
+
+        ~Handle()
+        {
+            reset();
+        }
+
+        /* give the block back to the pool */
+        void reset()
+        {
+            if(block) {
+                owner->release(block);
+            }
+            owner = nullptr;
+            block = nullptr;
+        }
+
+        T *get() const
+        {
+            return block ? &block->value : nullptr;
+        }
+
+        T *operator->() const
+        {
+            return &block->value;
+        }
+
+        T &operator*() const
+        {
+            return block->value;
+        }
+
+        explicit operator bool() const
+        {
+            return block != nullptr;
+        }
+
+    private:
+        friend struct ZPoolQueue;
+        Block *detach()
+        {
+            Block *retval = block;
+            owner = nullptr;
+            block = nullptr;
+            return retval;
+        }
+
+        ZPoolQueue *owner;
+        Block *block;
+    };
+
+    struct Stats {
+        uint32_t capacity;
+        uint32_t used;
+        uint32_t queued;
+        uint32_t peakUsed;
+        uint32_t allocFailed;
+        /* a later lane was served ahead of turn because it had been passed over starveLimit times */
+        uint32_t starved;
+    };
+
+    struct k_mem_slab slab;
+    std::array<struct k_fifo, Lanes> fifos;
+    /* one count per block in any lane, get() waits on it */
+    struct k_sem pending;
+    alignas(Block) std::array<uint8_t, sizeof(Block) * Capacity> buffer;
+
+    atomic_t queuedCnt;
+    atomic_t peakUsedCnt;
+    atomic_t allocFailedCnt;
+    atomic_t starvedCnt;
+    /* consumer only, gets that took an earlier lane while this one waited */
+    std::array<uint32_t, Lanes> passedOver;
+    uint32_t starveLimit;
+
+    static constexpr size_t capacity()
     {
-        buffer.fill(0x00);
-        k_msgq_init(&queue, (char *)buffer.data(), sizeof(T), length);
+        return Capacity;
     }
 
-    virtual int put(uint8_t *src)
+    static constexpr size_t lanes()
     {
-        return k_msgq_put(&queue, src, K_NO_WAIT);
+        return Lanes;
     }
 
-    virtual int put(uint8_t *src, k_timeout_t timeout)
+    /* starveLimit 0 is strict lane order, a later lane may wait for as long as earlier ones have blocks */
+    int init(uint32_t starveLimit = 0)
     {
-        return k_msgq_put(&queue, src, timeout);
+        atomic_set(&queuedCnt, 0);
+        atomic_set(&peakUsedCnt, 0);
+        atomic_set(&allocFailedCnt, 0);
+        atomic_set(&starvedCnt, 0);
+        for(auto &it: fifos) {
+            k_fifo_init(&it);
+        }
+        passedOver.fill(0);
+        this->starveLimit = starveLimit;
+        k_sem_init(&pending, 0, K_SEM_MAX_LIMIT);
+        return k_mem_slab_init(&slab, buffer.data(), sizeof(Block), Capacity);
     }
-    
-    virtual int get(uint8_t *dst)
+
+    /**
+     * @retval empty handle if the pool is exhausted
+     */
+    template <typename... Args>
+    Handle alloc(k_timeout_t timeout, Args &&... args)
+    {
+        void *mem = nullptr;
+        if(k_mem_slab_alloc(&slab, &mem, timeout)) {
+            atomic_inc(&allocFailedCnt);
+            return Handle();
+        }
+
+        atomic_val_t used = k_mem_slab_num_used_get(&slab);
+        atomic_val_t peak = atomic_get(&peakUsedCnt);
+        while(used > peak && !atomic_cas(&peakUsedCnt, peak, used)) {
+            peak = atomic_get(&peakUsedCnt);
+        }
+
+        Block *block = static_cast<Block *>(mem);
+        block->fifoReserved = nullptr;
+        new (&block->value) T(std::forward<Args>(args)...);
+        return Handle(this, block);
+    }
+
+    Handle alloc()
+    {
+        return alloc(K_NO_WAIT);
+    }
+
+    /**
+     * @brief hand the block over to the consumer, the handle is empty afterwards
+     */
+    int put(Handle &&handle, size_t lane = 0)
+    {
+        if(!handle || handle.owner != this || lane >= Lanes)
+            return -EINVAL;
+
+        atomic_inc(&queuedCnt);
+        k_fifo_put(&fifos[lane], handle.detach());
+        k_sem_give(&pending);
+        return 0;
+    }
+
+    /**
+     * @brief the first block of the earliest lane which has one, unless a later lane was passed over starveLimit times
+     * @note one consumer only, the pass counts aren't shared
+     * @retval empty handle on timeout
+     */
+    Handle get(k_timeout_t timeout, size_t *lane = nullptr)
+    {
+        if(k_sem_take(&pending, timeout))
+            return Handle();
+
+        Block *block = nullptr;
+        size_t picked = 0;
+        for(size_t i = Lanes - 1; starveLimit && i > 0 && !block; i--) {
+            if(passedOver[i] >= starveLimit && (block = static_cast<Block *>(k_fifo_get(&fifos[i], K_NO_WAIT)))) {
+                picked = i;
+                atomic_inc(&starvedCnt);
+            }
+        }
+        for(size_t i = 0; i < Lanes && !block; i++) {
+            if((block = static_cast<Block *>(k_fifo_get(&fifos[i], K_NO_WAIT))))
+                picked = i;
+        }
+        /* the count is given after the block is in its fifo */
+        if(!block)
+            return Handle();
+
+        passedOver[picked] = 0;
+        for(size_t i = picked + 1; i < Lanes; i++) {
+            if(!k_fifo_is_empty(&fifos[i]))
+                ++passedOver[i];
+        }
+        if(lane)
+            *lane = picked;
+        atomic_dec(&queuedCnt);
+        return Handle(this, block);
+    }
+
+    Handle get()
+    {
+        return get(K_FOREVER);
+    }
+
+    uint32_t used()
+    {
+        return k_mem_slab_num_used_get(&slab);
+    }
+
+    uint32_t available()
+    {
+        return k_mem_slab_num_free_get(&slab);
+    }
+
+    uint32_t queued()
+    {
+        return atomic_get(&queuedCnt);
+    }
+
+    /* peak starts over at what is in use now */
+    void resetStats()
+    {
+        atomic_set(&peakUsedCnt, used());
+        atomic_clear(&allocFailedCnt);
+        atomic_clear(&starvedCnt);
+    }
+
+    Stats stats()
     {
-        return k_msgq_get(&queue, dst, K_FOREVER);
+        return Stats {
+            .capacity = static_cast<uint32_t>(Capacity),
+            .used = used(),
+            .queued = queued(),
+            .peakUsed = static_cast<uint32_t>(atomic_get(&peakUsedCnt)),
+            .allocFailed = static_cast<uint32_t>(atomic_get(&allocFailedCnt)),
+            .starved = static_cast<uint32_t>(atomic_get(&starvedCnt)),
+        };
     }
 
-    virtual int get(uint8_t *dst, k_timeout_t timeout)
+private:
+    void release(Block *block)
     {
-        return k_msgq_get(&queue, dst, timeout);
+        block->value.~T();
+        k_mem_slab_free(&slab, block);
     }
 
 };
@@ -116,8 +354,12 @@ struct ZWorkControl {
     static int workQInit(uint8_t priority)
     {
         printk("inited for work stack\r\n");
+        /* named so the stack profiler can report it */
+        static const struct k_work_queue_config config = {
+            .name = "ZWorkControl",
+        };
         k_work_queue_init(&work_q);
-        k_work_queue_start(&work_q, ZWorkControlStackArea, stack_size, priority, NULL);
+        k_work_queue_start(&work_q, ZWorkControlStackArea, stack_size, priority, &config);
         workQInited = 1;
         return 0;
     }
@@ -0,0 +1,281 @@
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/sys/byteorder.h>
+#include <bluetooth/services/hids.h>
+#include <bsim_args_runner.h>
+#include <posix_board_if.h>
+#include <ReportMaps.h>
+#include <array>
+#include <cstring>
+#if defined(CONFIG_EXTERNAL_LIBC)
+#include <cstdlib>
+#endif
+
+/* simulated HOGP peripheral for scripts/mocnordic_bsim.py, one HID service of the configured kind */
+
+enum class Kind : uint8_t {
+    Keyboard = 0,
+    Mouse,
+    Touchpad,
+};
+
+constexpr const char *kindNames[] = {"keyboard", "mouse", "touchpad"};
+
+/* report 1 of each map in ReportMaps.h, without the report id */
+constexpr uint8_t keyboardReportSize = 8;
+constexpr uint8_t consumerReportSize = 2;
+constexpr uint8_t ledReportSize = 1;
+constexpr uint8_t mouseReportSize = 7;
+/* 5 contacts of 5 bytes, scan time, contact count, button byte */
+constexpr uint8_t touchpadReportSize = 5 * 5 + 2 + 1 + 1;
+
+/* only the kind picked at run time is registered, the gatt db is dynamic */
+BT_HIDS_DEF(keyboardHids, ledReportSize, keyboardReportSize, consumerReportSize);
+BT_HIDS_DEF(mouseHids, mouseReportSize);
+BT_HIDS_DEF(touchpadHids, touchpadReportSize);
+
+namespace {
+
+Kind kind;
+uint32_t rateHz;
+struct bt_hids *hids;
+struct bt_conn *conn;
+atomic_t secured;
+K_SEM_DEFINE(disconnectedSem, 0, 1);
+
+struct {
+    uint32_t sent;
+    uint32_t failed;
+    uint32_t outputs;
+    uint32_t connections;
+} counters;
+
+Kind pickKind()
+{
+#if defined(CONFIG_MOCSIM_MOUSE)
+    Kind ret = Kind::Mouse;
+#elif defined(CONFIG_MOCSIM_TOUCHPAD)
+    Kind ret = Kind::Touchpad;
+#else
+    Kind ret = Kind::Keyboard;
+#endif
+#if defined(CONFIG_EXTERNAL_LIBC)
+    const char *requested = getenv("MOCSIM_KIND");
+    for(uint8_t i = 0; requested && i < ARRAY_SIZE(kindNames); i++) {
+        if(!strcmp(requested, kindNames[i]))
+            ret = static_cast<Kind>(i);
+    }
+#endif
+    return ret;
+}
+
+uint32_t pickRate()
+{
+    uint32_t ret = CONFIG_MOCSIM_RATE_HZ;
+#if defined(CONFIG_EXTERNAL_LIBC)
+    const char *requested = getenv("MOCSIM_RATE_HZ");
+    if(requested && strtoul(requested, nullptr, 10))
+        ret = strtoul(requested, nullptr, 10);
+#endif
+    return ret;
+}
+
+/* the dongle is device 0, peripherals are numbered from 0 after it */
+uint32_t peripheralIndex()
+{
+    uint32_t device = bsim_args_get_global_device_nbr();
+    return device ? device - 1 : 0;
+}
+
+/* LED report written by the dongle, only counted */
+void ledWritten(struct bt_hids_rep *rep, struct bt_conn *writer, bool write)
+{
+    if(write)
+        ++counters.outputs;
+}
+
+int hidsInit()
+{
+    struct bt_hids_init_param param;
+    memset(&param, 0, sizeof(param));
+    param.info.bcd_hid = 0x0101;
+    param.info.b_country_code = 0x00;
+    param.info.flags = BT_HIDS_REMOTE_WAKE | BT_HIDS_NORMALLY_CONNECTABLE;
+
+    auto addInput = [&param](uint8_t id, uint8_t size) {
+        auto &report = param.inp_rep_group_init.reports[param.inp_rep_group_init.cnt++];
+        report.id = id;
+        report.size = size;
+    };
+
+    switch(kind) {
+    case Kind::Keyboard: {
+        hids = &keyboardHids;
+        param.rep_map.data = MOCNordicHost::keyboardReportMap;
+        param.rep_map.size = sizeof(MOCNordicHost::keyboardReportMap);
+        addInput(1, keyboardReportSize);
+        addInput(2, consumerReportSize);
+        auto &led = param.outp_rep_group_init.reports[param.outp_rep_group_init.cnt++];
+        led.id = 1;
+        led.size = ledReportSize;
+        led.handler = ledWritten;
+        break;
+    }
+    case Kind::Mouse:
+        hids = &mouseHids;
+        param.rep_map.data = MOCNordicHost::mouseReportMap;
+        param.rep_map.size = sizeof(MOCNordicHost::mouseReportMap);
+        addInput(1, mouseReportSize);
+        break;
+    case Kind::Touchpad:
+        hids = &touchpadHids;
+        param.rep_map.data = MOCNordicHost::touchpadReportMap;
+        param.rep_map.size = sizeof(MOCNordicHost::touchpadReportMap);
+        addInput(1, touchpadReportSize);
+        break;
+    }
+    return bt_hids_init(hids, &param);
+}
+
+int advertise()
+{
+    static char name[32];
+    snprintk(name, sizeof(name), "%s%u", CONFIG_MOCSIM_NAME, peripheralIndex());
+    static const uint8_t flags = BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR;
+    static const uint8_t uuids[] = {BT_UUID_16_ENCODE(BT_UUID_HIDS_VAL)};
+    struct bt_data ad[] = {
+        {BT_DATA_FLAGS, sizeof(flags), &flags},
+        {BT_DATA_UUID16_ALL, sizeof(uuids), uuids},
+        {BT_DATA_NAME_COMPLETE, static_cast<uint8_t>(strlen(name)), reinterpret_cast<const uint8_t *>(name)},
+    };
+    struct bt_le_adv_param param;
+    memset(&param, 0, sizeof(param));
+    param.id = BT_ID_DEFAULT;
+    param.options = BT_LE_ADV_OPT_CONNECTABLE;
+    param.interval_min = BT_GAP_ADV_FAST_INT_MIN_2;
+    param.interval_max = BT_GAP_ADV_FAST_INT_MAX_2;
+    return bt_le_adv_start(&param, ad, ARRAY_SIZE(ad), NULL, 0);
+}
+
+void connected(struct bt_conn *newConn, uint8_t err)
+{
+    if(err)
+        return;
+    conn = bt_conn_ref(newConn);
+    ++counters.connections;
+    bt_hids_connected(hids, conn);
+}
+
+void disconnected(struct bt_conn *oldConn, uint8_t reason)
+{
+    if(oldConn != conn)
+        return;
+    atomic_clear(&secured);
+    bt_hids_disconnected(hids, conn);
+    bt_conn_unref(conn);
+    conn = nullptr;
+    k_sem_give(&disconnectedSem);
+}
+
+void securityChanged(struct bt_conn *changed, bt_security_t level, enum bt_security_err err)
+{
+    if(!err && level >= BT_SECURITY_L2)
+        atomic_set(&secured, 1);
+}
+
+BT_CONN_CB_DEFINE(connCallbacks) = {
+    .connected = connected,
+    .disconnected = disconnected,
+    .security_changed = securityChanged,
+};
+
+/* report n of the stream, returns the length */
+uint8_t fillReport(uint32_t n, uint8_t *report)
+{
+    switch(kind) {
+    case Kind::Keyboard:
+        /* 'a' down on even reports, all keys up on odd ones */
+        memset(report, 0, keyboardReportSize);
+        if(!(n & 0x01))
+            report[2] = 0x04;
+        return keyboardReportSize;
+    case Kind::Mouse:
+        /* x += 1, no buttons */
+        memset(report, 0, mouseReportSize);
+        report[1] = 0x01;
+        return mouseReportSize;
+    case Kind::Touchpad: {
+        /* contact 0 tip down and confident, sliding along x */
+        memset(report, 0, touchpadReportSize);
+        uint16_t x = n % 4096;
+        uint16_t y = 2048;
+        uint16_t scanTime = static_cast<uint16_t>(static_cast<uint64_t>(n) * 10000 / rateHz);
+        report[0] = 0x03;
+        sys_put_le16(x, &report[1]);
+        sys_put_le16(y, &report[3]);
+        sys_put_le16(scanTime, &report[25]);
+        report[27] = 1;
+        return touchpadReportSize;
+    }
+    }
+    return 0;
+}
+
+} /* namespace */
+
+int main(void)
+{
+    kind = pickKind();
+    rateHz = pickRate();
+
+    int err = hidsInit();
+    if(err) {
+        printk("SIMPERIPHERAL hids init failed (err %d)\n", err);
+        posix_exit(1);
+        return err;
+    }
+    err = bt_enable(NULL);
+    if(err) {
+        printk("SIMPERIPHERAL bt enable failed (err %d)\n", err);
+        posix_exit(1);
+        return err;
+    }
+    err = advertise();
+    if(err) {
+        printk("SIMPERIPHERAL advertising failed (err %d)\n", err);
+        posix_exit(1);
+        return err;
+    }
+
+    std::array<uint8_t, touchpadReportSize> report;
+    const uint64_t periodUs = 1000000ULL / rateHz;
+    const uint64_t startUs = k_ticks_to_us_floor64(k_uptime_ticks());
+    uint64_t statsUs = startUs + CONFIG_MOCSIM_STATS_MS * 1000ULL;
+    for(uint32_t n = 0; ; n++) {
+        k_sleep(K_TIMEOUT_ABS_US(startUs + n * periodUs));
+
+        /* the dongle subscribes once the link is encrypted, sends before that only count as failed */
+        if(conn && atomic_get(&secured)) {
+            uint8_t length = fillReport(n, report.data());
+            if(bt_hids_inp_rep_send(hids, conn, 0, report.data(), length, NULL))
+                ++counters.failed;
+            else
+                ++counters.sent;
+        }
+
+        if(k_sem_take(&disconnectedSem, K_NO_WAIT) == 0)
+            advertise();
+
+        if(k_ticks_to_us_floor64(k_uptime_ticks()) >= statsUs) {
+            statsUs += CONFIG_MOCSIM_STATS_MS * 1000ULL;
+            printk("SIMPERIPHERAL {\"index\":%u,\"kind\":\"%s\",\"rate_hz\":%u,\"uptime_ms\":%u,\"connections\":%u,\"sent\":%u,\"failed\":%u,\"outputs\":%u}\n",
+                peripheralIndex(), kindNames[static_cast<uint8_t>(kind)], rateHz, k_uptime_get_32(),
+                counters.connections, counters.sent, counters.failed, counters.outputs);
+        }
+    }
+
+    return 0;
+}
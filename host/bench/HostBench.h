@@ -0,0 +1,55 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/* tiny microbenchmark runner, prints one "BENCH {json}" line per case like the firmware bench */
+namespace MOCNordicHost {
+
+template <typename T>
+inline void doNotOptimize(T &&value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+inline const char *benchFilter = nullptr;
+
+template <typename Fn>
+void bench(const char *name, Fn &&fn)
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr int repetitions = 7;
+    constexpr auto minBatchTime = std::chrono::milliseconds(20);
+
+    if(benchFilter && !strstr(name, benchFilter))
+        return;
+
+    /* grow the batch until it runs long enough to be measured */
+    uint64_t iterations = 1;
+    while(1) {
+        auto start = Clock::now();
+        for(uint64_t i = 0; i < iterations; i++)
+            fn();
+        if(Clock::now() - start >= minBatchTime)
+            break;
+        iterations *= 2;
+    }
+
+    std::array<double, repetitions> nsPerOp;
+    for(auto &it: nsPerOp) {
+        auto start = Clock::now();
+        for(uint64_t i = 0; i < iterations; i++)
+            fn();
+        auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        it = elapsed / iterations;
+    }
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+
+    printf("BENCH {\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"min_ns\":%.2f,\"max_ns\":%.2f}\n",
+        name, static_cast<unsigned long long>(iterations), nsPerOp[repetitions / 2], nsPerOp.front(), nsPerOp.back());
+}
+
+} /* MOCNordicHost */
@@ -0,0 +1,523 @@
+#include <MOCNordic/MOCNordicReportDesc.h>
+#include <MOCNordic/MOCNordicHandleMap.h>
+#include <MOCNordic/MOCNordicTouchpad.h>
+#include <MOCNordic/MOCNordicKeyboard.h>
+#include <MOCNordic/MOCNordicReportMapStream.h>
+#include <MOCNordic/MOCNordicFrameRelease.h>
+#include <MOCNordic/MOCNordicPriority.h>
+#include <HostBench.h>
+#include <vector>
+#include <ReportMaps.h>
+
+using namespace MOCNordic;
+using namespace MOCNordicHost;
+
+namespace {
+
+struct NamedMap {
+    const char *name;
+    const uint8_t *data;
+    uint32_t length;
+};
+
+const NamedMap reportMaps[] = {
+    {"keyboard", keyboardReportMap, sizeof(keyboardReportMap)},
+    {"mouse", mouseReportMap, sizeof(mouseReportMap)},
+    {"touchpad", touchpadReportMap, sizeof(touchpadReportMap)},
+    {"boot_keyboard", bootKeyboardReportMap, sizeof(bootKeyboardReportMap)},
+};
+
+/* prints a CHECK line, the suite fails if any check does */
+bool check(const char *name, bool pass)
+{
+    printf("CHECK {\"name\":\"%s\",\"pass\":%s}\n", name, pass ? "true" : "false");
+    return pass;
+}
+
+/* what the class stages take from a parsed map, two streams agreeing on it configure the same interface */
+std::vector<uint32_t> streamSignature(const ReportMapStream &stream, uint32_t length)
+{
+    const HIDReportParser &parser = stream.reportParser();
+    std::vector<uint32_t> signature = {stream.describes(length), static_cast<uint32_t>(stream.type()), parser.usesReportIds()};
+    for(uint8_t id = 0; id < 16; id++) {
+        for(auto type: {HIDReportType::Input, HIDReportType::Output, HIDReportType::Feature})
+            signature.push_back(parser.reportBytes(type, id));
+    }
+    const WakeLayout &wake = stream.wakeLayout();
+    signature.push_back(wake.fieldCnt);
+    for(uint32_t i = 0; i < wake.fieldCnt; i++)
+        signature.insert(signature.end(), {wake.fields[i].reportId, wake.fields[i].bitOffset, wake.fields[i].bitSize});
+    const KeyboardLayout &keyboards = stream.keyboardLayout();
+    signature.push_back(keyboards.keyboardCnt);
+    for(uint32_t i = 0; i < keyboards.keyboardCnt; i++) {
+        const auto &it = keyboards.keyboards[i];
+        signature.insert(signature.end(), {it.reportId, it.inputLength, static_cast<uint32_t>(it.modifiersOffset),
+            static_cast<uint32_t>(it.keysOffset), it.keysCnt, it.outputBits});
+    }
+    const PTPLayout &touchpad = stream.touchpadLayout();
+    signature.insert(signature.end(), {touchpad.inputReportId, touchpad.slotCnt, touchpad.contactCount.bitOffset, touchpad.buttons.bitOffset});
+    return signature;
+}
+
+std::vector<uint32_t> streamMap(ReportMapStream &stream, const NamedMap &map)
+{
+    stream.reset();
+    stream.feed(map.data, map.length);
+    stream.finish();
+    return streamSignature(stream, map.length);
+}
+
+/* a slot's stream is reset and reused for the next peripheral, it must not remember the previous map */
+bool checkStreamReuse()
+{
+    bool ok = true;
+    char name[64];
+    ReportMapStream reused;
+    for(auto &previous: reportMaps) {
+        for(auto &map: reportMaps) {
+            ReportMapStream fresh;
+            streamMap(reused, previous);
+            snprintf(name, sizeof(name), "stream_reuse/%s_after_%s", map.name, previous.name);
+            ok &= check(name, streamMap(reused, map) == streamMap(fresh, map));
+        }
+    }
+    return ok;
+}
+
+/* touchpadReportMap report 1: 5 slots of 5 bytes, scan time, contact count, button */
+constexpr uint32_t ptpReportLength = 30;
+constexpr uint32_t ptpContactCountByte = 1 + 27;
+
+void ptpContact(uint8_t *report, uint32_t slot, uint8_t id)
+{
+    uint8_t *it = report + 1 + slot * 5;
+    it[0] = 0x03 | (id << 2);
+    it[1] = 0x10 * (id + 1);
+    it[3] = 0x20 * (id + 1);
+}
+
+/* windows switches the touchpad to touchpad input mode after enumeration */
+void ptpTouchpadMode(PTPTouchpad &touchpad)
+{
+    const uint8_t inputMode[] = {0x04, PTPTouchpad::InputMode::Touchpad};
+    touchpad.setFeature(0x04, inputMode, sizeof(inputMode));
+}
+
+/* the reports a stage sends for a sequence of notifications */
+struct ReportCapture {
+    std::vector<std::vector<uint8_t>> reports;
+
+    int operator()(const uint8_t *report, uint32_t length)
+    {
+        reports.emplace_back(report, report + length);
+        return 0;
+    }
+};
+
+struct PtpCapture : ReportCapture {
+    /* ids of the contacts in report i, slot order */
+    std::vector<uint8_t> contacts(size_t i) const
+    {
+        std::vector<uint8_t> ids;
+        for(uint32_t slot = 0; slot < 5; slot++) {
+            uint8_t flags = reports[i][1 + slot * 5];
+            if(flags & 0x02)
+                ids.push_back(flags >> 2);
+        }
+        return ids;
+    }
+
+    uint8_t contactCount(size_t i) const
+    {
+        return reports[i][ptpContactCountByte];
+    }
+};
+
+bool checkTouchpad()
+{
+    bool ok = true;
+    /* one contact per notification, contact count only in the first */
+    uint8_t hybrid[3][ptpReportLength] = {{0x01}, {0x01}, {0x01}};
+    for(uint8_t i = 0; i < 3; i++)
+        ptpContact(hybrid[i], 0, i);
+    hybrid[0][ptpContactCountByte] = 3;
+
+    {
+        PTPTouchpad touchpad;
+        touchpad.init(touchpadReportMap, sizeof(touchpadReportMap));
+        PtpCapture out;
+        for(auto &it: hybrid)
+            touchpad.feed(it, sizeof(it), out);
+        ok &= check("ptp/mouse_mode_passes_reports", out.reports.size() == 3 && !touchpad.holding()
+            && out.reports[1] == std::vector<uint8_t>(hybrid[1], hybrid[1] + ptpReportLength));
+    }
+
+    {
+        PTPTouchpad touchpad;
+        touchpad.init(touchpadReportMap, sizeof(touchpadReportMap));
+        ptpTouchpadMode(touchpad);
+        PtpCapture out;
+        for(auto &it: hybrid)
+            touchpad.feed(it, sizeof(it), out);
+        ok &= check("ptp/hybrid_frame_packed", out.reports.size() == 1 && out.contactCount(0) == 3
+            && out.contacts(0) == std::vector<uint8_t>({0, 1, 2}) && touchpad.getStats().framesPacked == 1);
+    }
+
+    {
+        PTPTouchpad touchpad;
+        touchpad.init(touchpadReportMap, sizeof(touchpadReportMap));
+        ptpTouchpadMode(touchpad);
+        PtpCapture out;
+        touchpad.feed(hybrid[0], sizeof(hybrid[0]), out);
+        touchpad.feed(hybrid[1], sizeof(hybrid[1]), out);
+        bool held = touchpad.holding() && out.reports.empty() && touchpad.getStats().framesHeld == 1;
+        touchpad.flushHeld(out);
+        ok &= check("ptp/held_frame_flushed", held && !touchpad.holding() && out.reports.size() == 1 && out.contactCount(0) == 2
+            && out.contacts(0) == std::vector<uint8_t>({0, 1}) && touchpad.getStats().framesTimedOut == 1);
+        /* the rest of the flushed frame is not held again */
+        touchpad.feed(hybrid[2], sizeof(hybrid[2]), out);
+        ok &= check("ptp/late_contact_after_flush", !touchpad.holding() && out.reports.size() == 2);
+        ok &= check("ptp/flush_without_held_frame", !touchpad.flushHeld(out) && out.reports.size() == 2);
+    }
+
+    {
+        PTPTouchpad touchpad;
+        touchpad.init(touchpadReportMap, sizeof(touchpadReportMap));
+        ptpTouchpadMode(touchpad);
+        PtpCapture out;
+        touchpad.feed(hybrid[0], sizeof(hybrid[0]), out);
+        touchpad.feed(hybrid[0], sizeof(hybrid[0]), out);
+        ok &= check("ptp/next_frame_flushes_held", out.reports.size() == 1 && out.contactCount(0) == 1
+            && touchpad.holding() && touchpad.getStats().framesIncomplete == 1);
+    }
+    return ok;
+}
+
+/* keyboardReportMap report 1: modifiers, reserved byte, 6 key array */
+constexpr uint32_t kbdReportLength = 9;
+
+/* keys set in an NKRO bitmap report: report id, modifiers, one bit per usage */
+std::vector<uint8_t> bitmapKeys(const std::vector<uint8_t> &report)
+{
+    std::vector<uint8_t> keys;
+    for(uint32_t i = 2; i < report.size(); i++) {
+        for(uint32_t bit = 0; bit < 8; bit++) {
+            if(report[i] & (1U << bit))
+                keys.push_back(static_cast<uint8_t>((i - 2) * 8 + bit));
+        }
+    }
+    return keys;
+}
+
+bool checkKeyboard()
+{
+    bool ok = true;
+    const uint8_t pressed[kbdReportLength] = {0x01, 0x02, 0x00, 0x04, 0x05};
+    const uint8_t sixKeys[kbdReportLength] = {0x01, 0x00, 0x00, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09};
+    const uint8_t rollover[kbdReportLength] = {0x01, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01};
+    const uint8_t released[kbdReportLength] = {0x01};
+
+    {
+        ReportDesc desc(keyboardReportMap, sizeof(keyboardReportMap));
+        KeyboardStage stage;
+        stage.init(desc, true, false);
+        ReportCapture out;
+        stage.feed(pressed, sizeof(pressed), out);
+        stage.feed(pressed, sizeof(pressed), out);
+        ok &= check("kbd/duplicate_suppressed", out.reports.size() == 1 && stage.getStats().suppressed == 1);
+        stage.feed(released, sizeof(released), out);
+        stage.feed(pressed, sizeof(pressed), out);
+        ok &= check("kbd/transition_passes", out.reports.size() == 3
+            && out.reports[2] == std::vector<uint8_t>(pressed, pressed + sizeof(pressed)));
+        /* the host lost its state, the same report has to go out again */
+        stage.resync();
+        stage.feed(pressed, sizeof(pressed), out);
+        ok &= check("kbd/resync_resends", out.reports.size() == 4);
+    }
+
+    {
+        ReportDesc desc(keyboardReportMap, sizeof(keyboardReportMap));
+        KeyboardStage stage;
+        stage.init(desc, true, true);
+        ReportCapture out;
+        stage.feed(pressed, sizeof(pressed), out);
+        ok &= check("kbd/nkro_keys_to_bits", out.reports.size() == 1 && out.reports[0][0] == 0x01 && out.reports[0][1] == 0x02
+            && bitmapKeys(out.reports[0]) == std::vector<uint8_t>({0x04, 0x05}));
+        stage.feed(sixKeys, sizeof(sixKeys), out);
+        ok &= check("kbd/nkro_full_array_to_bits", out.reports.size() == 2
+            && bitmapKeys(out.reports[1]) == std::vector<uint8_t>({0x04, 0x05, 0x06, 0x07, 0x08, 0x09}));
+        /* the keyboard ran out of slots, the host keeps the last known keys */
+        stage.feed(rollover, sizeof(rollover), out);
+        ok &= check("kbd/nkro_rollover_dropped", out.reports.size() == 2 && stage.getStats().dropped == 1);
+        stage.feed(released, sizeof(released), out);
+        ok &= check("kbd/nkro_release_after_rollover", out.reports.size() == 3 && out.reports[2][1] == 0x00
+            && bitmapKeys(out.reports[2]).empty());
+    }
+    return ok;
+}
+
+/* what BLEDevice::init() does with every report map before deviceUnitInit */
+void benchDescriptors()
+{
+    char name[64];
+    for(auto &map: reportMaps) {
+        snprintf(name, sizeof(name), "desc/clear_insert/%s", map.name);
+        bench(name, [&] {
+            ReportDesc desc;
+            desc.clear();
+            desc.insert(map.data, map.length, ReportDescType::UNKNOWN);
+            doNotOptimize(desc);
+        });
+
+        ReportDesc source;
+        source.insert(map.data, map.length, ReportDescType::UNKNOWN);
+
+        snprintf(name, sizeof(name), "desc/copy_assign/%s", map.name);
+        ReportDesc target;
+        bench(name, [&] {
+            target = source;
+            doNotOptimize(target);
+        });
+
+        snprintf(name, sizeof(name), "desc/get_length/%s", map.name);
+        bench(name, [&] {
+            auto length = source.getDescLength();
+            doNotOptimize(length);
+        });
+
+        snprintf(name, sizeof(name), "desc/parse/%s", map.name);
+        bench(name, [&] {
+            HIDParserVisitor visitor;
+            HIDReportParser parser;
+            bool ret = parser.parse(source.data(), source.size(), visitor);
+            doNotOptimize(ret);
+        });
+
+        snprintf(name, sizeof(name), "desc/touchpad_init/%s", map.name);
+        bench(name, [&] {
+            PTPTouchpad touchpad;
+            bool ret = touchpad.init(source.data(), source.size());
+            doNotOptimize(ret);
+        });
+
+        /* configureUnit without a stream: every stage walks the whole map on its own */
+        snprintf(name, sizeof(name), "desc/stage_passes/%s", map.name);
+        bench(name, [&] {
+            ReportDesc desc = source;
+            desc.recognize();
+            KeyboardStage keyboard;
+            PTPTouchpad touchpad;
+            WakeFilter wake;
+            bool ret = keyboard.init(desc, true, false);
+            ret |= touchpad.init(source.data(), source.size());
+            ret |= wake.init(source.data(), source.size());
+            doNotOptimize(ret);
+        });
+
+        /* the same layouts from one pass over the chunks of a long read, 22 bytes at the default ATT MTU, 244 at 247 */
+        for(uint32_t chunk: {22u, 244u}) {
+            snprintf(name, sizeof(name), "desc/stream_%u/%s", chunk, map.name);
+            bench(name, [&] {
+                ReportMapStream stream;
+                for(uint32_t offset = 0; offset < source.size(); offset += chunk)
+                    stream.feed(source.data() + offset, std::min<uint32_t>(chunk, source.size() - offset));
+                bool ret = stream.finish();
+                doNotOptimize(ret);
+            });
+        }
+    }
+
+    bench("desc/spp_default", [] {
+        SPPReportDesc desc(0x01);
+        doNotOptimize(desc);
+    });
+}
+
+/* per notification work of forwardNotification() */
+void benchNotificationLookup()
+{
+    /* 8 report characteristics, value handles spaced like a typical HOGP database */
+    ReportHandleMap handleMap;
+    constexpr uint16_t firstChar = 0x0012;
+    constexpr int charCnt = 8;
+    for(int i = 0; i < charCnt; i++) {
+        uint16_t charHandle = firstChar + i * 4;
+        handleMap.registerRefHandle(charHandle + 2, charHandle);
+        handleMap.registerReportId(charHandle + 2, static_cast<uint8_t>(i + 1));
+    }
+
+    uint16_t handle = firstChar;
+    bench("notify/lookup/hit", [&] {
+        int reportId = handleMap.findReportId(handle);
+        doNotOptimize(reportId);
+        handle = handle == firstChar + (charCnt - 1) * 4 ? firstChar : handle + 4;
+    });
+
+    bench("notify/lookup/miss", [&] {
+        int reportId = handleMap.findReportId(0x00FF);
+        doNotOptimize(reportId);
+    });
+
+    uint8_t payload[9] = {0x00, 0x01, 0x10, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00};
+    bench("notify/lookup_copy/mouse", [&] {
+        char response[247];
+        int reportId = handleMap.findReportId(firstChar + 4);
+        uint16_t responseLength = sizeof(payload);
+        if(reportId >= 0) {
+            response[0] = static_cast<char>(reportId);
+            memcpy(&response[1], payload, responseLength);
+            ++responseLength;
+        }
+        doNotOptimize(response);
+        doNotOptimize(responseLength);
+    });
+}
+
+/* what writeToDevice() does for a touchpad interface, 3 contacts per frame */
+void benchTouchpad()
+{
+    PTPTouchpad touchpad;
+    touchpad.init(touchpadReportMap, sizeof(touchpadReportMap));
+    ptpTouchpadMode(touchpad);
+    uint32_t written = 0;
+    auto emit = [&written] (const uint8_t *report, uint32_t length) {
+        doNotOptimize(report);
+        ++written;
+        return 0;
+    };
+
+    uint8_t parallel[ptpReportLength] = {0x01};
+    for(uint8_t i = 0; i < 3; i++)
+        ptpContact(parallel, i, i);
+    parallel[ptpContactCountByte] = 3;
+    bench("ptp/feed/parallel", [&] {
+        int ret = touchpad.feed(parallel, sizeof(parallel), emit);
+        doNotOptimize(ret);
+    });
+
+    /* one contact per notification, contact count only in the first */
+    uint8_t hybrid[3][ptpReportLength] = {{0x01}, {0x01}, {0x01}};
+    for(uint8_t i = 0; i < 3; i++)
+        ptpContact(hybrid[i], 0, i);
+    hybrid[0][ptpContactCountByte] = 3;
+    bench("ptp/feed/hybrid_frame", [&] {
+        for(auto &it: hybrid) {
+            int ret = touchpad.feed(it, sizeof(it), emit);
+            doNotOptimize(ret);
+        }
+    });
+
+    /* what reportWrite() does with CONFIG_MOCNORDIC_FRAME_RELEASE: a moved frame replaces the waiting one, released once per frame */
+    FrameReleaseQueue<4, 64> release;
+    auto supersedes = [&touchpad] (const uint8_t *older, const uint8_t *newer, uint32_t length) {
+        return touchpad.supersedes(older, newer, length);
+    };
+    uint8_t moved[ptpReportLength];
+    memcpy(moved, parallel, sizeof(moved));
+    moved[2] += 1;
+    bench("ptp/release/coalesce_frame", [&] {
+        bool ret = release.push(parallel, sizeof(parallel), 0, supersedes);
+        ret &= release.push(moved, sizeof(moved), 1, supersedes);
+        auto *entry = release.beginRelease();
+        doNotOptimize(entry);
+        release.endRelease(0);
+        doNotOptimize(ret);
+    });
+
+    bench("ptp/get_feature/caps", [&] {
+        const uint8_t *data;
+        uint32_t length;
+        bool ret = touchpad.getFeature(0x02, &data, &length);
+        doNotOptimize(ret);
+        doNotOptimize(data);
+    });
+
+    doNotOptimize(written);
+}
+
+/* what writeToDevice() does for a keyboard interface */
+void benchKeyboard()
+{
+    auto emit = [] (const uint8_t *report, uint32_t length) {
+        doNotOptimize(report);
+        return 0;
+    };
+
+    uint8_t pressed[9] = {0x01, 0x02, 0x00, 0x04, 0x05, 0x00, 0x00, 0x00, 0x00};
+    uint8_t released[9] = {0x01};
+
+    ReportDesc desc(keyboardReportMap, sizeof(keyboardReportMap));
+    KeyboardStage dedup;
+    dedup.init(desc, true, false);
+    bench("kbd/feed/duplicate", [&] {
+        int ret = dedup.feed(pressed, sizeof(pressed), emit);
+        doNotOptimize(ret);
+    });
+    bench("kbd/feed/transition", [&] {
+        int ret = dedup.feed(pressed, sizeof(pressed), emit);
+        ret |= dedup.feed(released, sizeof(released), emit);
+        doNotOptimize(ret);
+    });
+
+    ReportDesc nkroDesc(keyboardReportMap, sizeof(keyboardReportMap));
+    KeyboardStage nkro;
+    nkro.init(nkroDesc, true, true);
+    bench("kbd/feed/nkro_transition", [&] {
+        int ret = nkro.feed(pressed, sizeof(pressed), emit);
+        ret |= nkro.feed(released, sizeof(released), emit);
+        doNotOptimize(ret);
+    });
+
+    bench("kbd/init/nkro", [&] {
+        ReportDesc it(keyboardReportMap, sizeof(keyboardReportMap));
+        KeyboardStage stage;
+        bool ret = stage.init(it, true, true);
+        doNotOptimize(ret);
+    });
+}
+
+/* lane pick notifySubscribe does for every notification with CONFIG_MOCNORDIC_FORWARD_LANES */
+void benchPriority()
+{
+    /* payloads without the report id, it comes from the characteristic */
+    uint8_t motion[7] = {0x00, 0x01, 0x00, 0xff, 0xff, 0x00, 0x00};
+    uint8_t keyDown[8] = {0x00, 0x00, 0x04};
+    uint8_t keyUp[8] = {};
+
+    ReportPriority mouse;
+    mouse.init(mouseReportMap, sizeof(mouseReportMap));
+    bench("lane/classify/motion", [&] {
+        ReportLane lane = mouse.classify(1, motion, sizeof(motion));
+        doNotOptimize(lane);
+    });
+
+    ReportPriority keyboard;
+    keyboard.init(keyboardReportMap, sizeof(keyboardReportMap));
+    bench("lane/classify/key_transition", [&] {
+        ReportLane lane = keyboard.classify(1, keyDown, sizeof(keyDown));
+        lane = keyboard.classify(1, keyUp, sizeof(keyUp));
+        doNotOptimize(lane);
+    });
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    /* optional substring filter, e.g. ./MOCNordicDescBench notify/ */
+    if(argc > 1)
+        benchFilter = argv[1];
+
+    bool ok = checkStreamReuse();
+    ok &= checkTouchpad();
+    ok &= checkKeyboard();
+    if(!ok)
+        return 1;
+
+    benchDescriptors();
+    benchNotificationLookup();
+    benchTouchpad();
+    benchKeyboard();
+    benchPriority();
+    return 0;
+}
@@ -0,0 +1,244 @@
+#pragma once
+#include <cstdint>
+
+/* report maps of the device mix the dongle is used with, shared by the host benchmarks */
+namespace MOCNordicHost {
+
+/* boot keyboard with LEDs (report 1) and consumer control (report 2) */
+inline const uint8_t keyboardReportMap[] = {
+    0x05, 0x01,       // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,       // USAGE (Keyboard)
+    0xA1, 0x01,       // COLLECTION (Application)
+    0x85, 0x01,       //   REPORT_ID (1)
+    0x05, 0x07,       //   USAGE_PAGE (Keyboard)
+    0x19, 0xE0,       //   USAGE_MINIMUM (Left Control)
+    0x29, 0xE7,       //   USAGE_MAXIMUM (Right GUI)
+    0x15, 0x00,       //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,       //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,       //   REPORT_SIZE (1)
+    0x95, 0x08,       //   REPORT_COUNT (8)
+    0x81, 0x02,       //   INPUT (Data,Var,Abs)
+    0x95, 0x01,       //   REPORT_COUNT (1)
+    0x75, 0x08,       //   REPORT_SIZE (8)
+    0x81, 0x01,       //   INPUT (Cnst)
+    0x95, 0x05,       //   REPORT_COUNT (5)
+    0x75, 0x01,       //   REPORT_SIZE (1)
+    0x05, 0x08,       //   USAGE_PAGE (LEDs)
+    0x19, 0x01,       //   USAGE_MINIMUM (Num Lock)
+    0x29, 0x05,       //   USAGE_MAXIMUM (Kana)
+    0x91, 0x02,       //   OUTPUT (Data,Var,Abs)
+    0x95, 0x01,       //   REPORT_COUNT (1)
+    0x75, 0x03,       //   REPORT_SIZE (3)
+    0x91, 0x01,       //   OUTPUT (Cnst)
+    0x95, 0x06,       //   REPORT_COUNT (6)
+    0x75, 0x08,       //   REPORT_SIZE (8)
+    0x15, 0x00,       //   LOGICAL_MINIMUM (0)
+    0x25, 0x65,       //   LOGICAL_MAXIMUM (101)
+    0x05, 0x07,       //   USAGE_PAGE (Keyboard)
+    0x19, 0x00,       //   USAGE_MINIMUM (0)
+    0x29, 0x65,       //   USAGE_MAXIMUM (101)
+    0x81, 0x00,       //   INPUT (Data,Ary,Abs)
+    0xC0,             // END_COLLECTION
+    0x05, 0x0C,       // USAGE_PAGE (Consumer)
+    0x09, 0x01,       // USAGE (Consumer Control)
+    0xA1, 0x01,       // COLLECTION (Application)
+    0x85, 0x02,       //   REPORT_ID (2)
+    0x15, 0x00,       //   LOGICAL_MINIMUM (0)
+    0x26, 0xFF, 0x03, //   LOGICAL_MAXIMUM (1023)
+    0x19, 0x00,       //   USAGE_MINIMUM (0)
+    0x2A, 0xFF, 0x03, //   USAGE_MAXIMUM (1023)
+    0x75, 0x10,       //   REPORT_SIZE (16)
+    0x95, 0x01,       //   REPORT_COUNT (1)
+    0x81, 0x00,       //   INPUT (Data,Ary,Abs)
+    0xC0,             // END_COLLECTION
+};
+
+/* 5 button mouse with 16 bit motion, wheel and AC pan (report 1) */
+inline const uint8_t mouseReportMap[] = {
+    0x05, 0x01,       // USAGE_PAGE (Generic Desktop)
+    0x09, 0x02,       // USAGE (Mouse)
+    0xA1, 0x01,       // COLLECTION (Application)
+    0x85, 0x01,       //   REPORT_ID (1)
+    0x09, 0x01,       //   USAGE (Pointer)
+    0xA1, 0x00,       //   COLLECTION (Physical)
+    0x05, 0x09,       //     USAGE_PAGE (Button)
+    0x19, 0x01,       //     USAGE_MINIMUM (1)
+    0x29, 0x05,       //     USAGE_MAXIMUM (5)
+    0x15, 0x00,       //     LOGICAL_MINIMUM (0)
+    0x25, 0x01,       //     LOGICAL_MAXIMUM (1)
+    0x75, 0x01,       //     REPORT_SIZE (1)
+    0x95, 0x05,       //     REPORT_COUNT (5)
+    0x81, 0x02,       //     INPUT (Data,Var,Abs)
+    0x75, 0x03,       //     REPORT_SIZE (3)
+    0x95, 0x01,       //     REPORT_COUNT (1)
+    0x81, 0x01,       //     INPUT (Cnst)
+    0x05, 0x01,       //     USAGE_PAGE (Generic Desktop)
+    0x09, 0x30,       //     USAGE (X)
+    0x09, 0x31,       //     USAGE (Y)
+    0x16, 0x01, 0x80, //     LOGICAL_MINIMUM (-32767)
+    0x26, 0xFF, 0x7F, //     LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,       //     REPORT_SIZE (16)
+    0x95, 0x02,       //     REPORT_COUNT (2)
+    0x81, 0x06,       //     INPUT (Data,Var,Rel)
+    0x09, 0x38,       //     USAGE (Wheel)
+    0x15, 0x81,       //     LOGICAL_MINIMUM (-127)
+    0x25, 0x7F,       //     LOGICAL_MAXIMUM (127)
+    0x75, 0x08,       //     REPORT_SIZE (8)
+    0x95, 0x01,       //     REPORT_COUNT (1)
+    0x81, 0x06,       //     INPUT (Data,Var,Rel)
+    0x05, 0x0C,       //     USAGE_PAGE (Consumer)
+    0x0A, 0x38, 0x02, //     USAGE (AC Pan)
+    0x81, 0x06,       //     INPUT (Data,Var,Rel)
+    0xC0,             //   END_COLLECTION
+    0xC0,             // END_COLLECTION
+};
+
+/* boot protocol keyboard without report ids, 8 byte input report and LEDs */
+inline const uint8_t bootKeyboardReportMap[] = {
+    0x05, 0x01,       // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,       // USAGE (Keyboard)
+    0xA1, 0x01,       // COLLECTION (Application)
+    0x05, 0x07,       //   USAGE_PAGE (Keyboard)
+    0x19, 0xE0,       //   USAGE_MINIMUM (Left Control)
+    0x29, 0xE7,       //   USAGE_MAXIMUM (Right GUI)
+    0x15, 0x00,       //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,       //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,       //   REPORT_SIZE (1)
+    0x95, 0x08,       //   REPORT_COUNT (8)
+    0x81, 0x02,       //   INPUT (Data,Var,Abs)
+    0x95, 0x01,       //   REPORT_COUNT (1)
+    0x75, 0x08,       //   REPORT_SIZE (8)
+    0x81, 0x01,       //   INPUT (Cnst)
+    0x95, 0x05,       //   REPORT_COUNT (5)
+    0x75, 0x01,       //   REPORT_SIZE (1)
+    0x05, 0x08,       //   USAGE_PAGE (LEDs)
+    0x19, 0x01,       //   USAGE_MINIMUM (Num Lock)
+    0x29, 0x05,       //   USAGE_MAXIMUM (Kana)
+    0x91, 0x02,       //   OUTPUT (Data,Var,Abs)
+    0x95, 0x01,       //   REPORT_COUNT (1)
+    0x75, 0x03,       //   REPORT_SIZE (3)
+    0x91, 0x01,       //   OUTPUT (Cnst)
+    0x95, 0x06,       //   REPORT_COUNT (6)
+    0x75, 0x08,       //   REPORT_SIZE (8)
+    0x15, 0x00,       //   LOGICAL_MINIMUM (0)
+    0x25, 0x65,       //   LOGICAL_MAXIMUM (101)
+    0x05, 0x07,       //   USAGE_PAGE (Keyboard)
+    0x19, 0x00,       //   USAGE_MINIMUM (0)
+    0x29, 0x65,       //   USAGE_MAXIMUM (101)
+    0x81, 0x00,       //   INPUT (Data,Ary,Abs)
+    0xC0,             // END_COLLECTION
+};
+
+#define MOCNORDIC_PTP_FINGER \
+    0x09, 0x22,       /*   USAGE (Finger) */ \
+    0xA1, 0x02,       /*   COLLECTION (Logical) */ \
+    0x15, 0x00,       /*     LOGICAL_MINIMUM (0) */ \
+    0x25, 0x01,       /*     LOGICAL_MAXIMUM (1) */ \
+    0x09, 0x47,       /*     USAGE (Confidence) */ \
+    0x09, 0x42,       /*     USAGE (Tip Switch) */ \
+    0x95, 0x02,       /*     REPORT_COUNT (2) */ \
+    0x75, 0x01,       /*     REPORT_SIZE (1) */ \
+    0x81, 0x02,       /*     INPUT (Data,Var,Abs) */ \
+    0x95, 0x01,       /*     REPORT_COUNT (1) */ \
+    0x75, 0x03,       /*     REPORT_SIZE (3) */ \
+    0x25, 0x07,       /*     LOGICAL_MAXIMUM (7) */ \
+    0x09, 0x51,       /*     USAGE (Contact Identifier) */ \
+    0x81, 0x02,       /*     INPUT (Data,Var,Abs) */ \
+    0x75, 0x03,       /*     REPORT_SIZE (3) */ \
+    0x81, 0x03,       /*     INPUT (Cnst,Var,Abs) */ \
+    0x05, 0x01,       /*     USAGE_PAGE (Generic Desktop) */ \
+    0x15, 0x00,       /*     LOGICAL_MINIMUM (0) */ \
+    0x26, 0xFF, 0x0F, /*     LOGICAL_MAXIMUM (4095) */ \
+    0x75, 0x10,       /*     REPORT_SIZE (16) */ \
+    0x55, 0x0E,       /*     UNIT_EXPONENT (-2) */ \
+    0x65, 0x11,       /*     UNIT (cm) */ \
+    0x09, 0x30,       /*     USAGE (X) */ \
+    0x35, 0x00,       /*     PHYSICAL_MINIMUM (0) */ \
+    0x46, 0x90, 0x04, /*     PHYSICAL_MAXIMUM (1168) */ \
+    0x95, 0x01,       /*     REPORT_COUNT (1) */ \
+    0x81, 0x02,       /*     INPUT (Data,Var,Abs) */ \
+    0x46, 0xD0, 0x02, /*     PHYSICAL_MAXIMUM (720) */ \
+    0x09, 0x31,       /*     USAGE (Y) */ \
+    0x81, 0x02,       /*     INPUT (Data,Var,Abs) */ \
+    0x05, 0x0D,       /*     USAGE_PAGE (Digitizers) */ \
+    0xC0              /*   END_COLLECTION */
+
+/* windows precision touchpad, 5 contacts (report 1), caps (2), certification (3), input mode (4), selective reporting (5) */
+inline const uint8_t touchpadReportMap[] = {
+    0x05, 0x0D,       // USAGE_PAGE (Digitizers)
+    0x09, 0x05,       // USAGE (Touch Pad)
+    0xA1, 0x01,       // COLLECTION (Application)
+    0x85, 0x01,       //   REPORT_ID (1)
+    MOCNORDIC_PTP_FINGER,
+    MOCNORDIC_PTP_FINGER,
+    MOCNORDIC_PTP_FINGER,
+    MOCNORDIC_PTP_FINGER,
+    MOCNORDIC_PTP_FINGER,
+    0x55, 0x0C,       //   UNIT_EXPONENT (-4)
+    0x66, 0x01, 0x10, //   UNIT (Seconds)
+    0x47, 0xFF, 0xFF, 0x00, 0x00, // PHYSICAL_MAXIMUM (65535)
+    0x27, 0xFF, 0xFF, 0x00, 0x00, // LOGICAL_MAXIMUM (65535)
+    0x75, 0x10,       //   REPORT_SIZE (16)
+    0x95, 0x01,       //   REPORT_COUNT (1)
+    0x09, 0x56,       //   USAGE (Scan Time)
+    0x81, 0x02,       //   INPUT (Data,Var,Abs)
+    0x09, 0x54,       //   USAGE (Contact Count)
+    0x25, 0x7F,       //   LOGICAL_MAXIMUM (127)
+    0x75, 0x08,       //   REPORT_SIZE (8)
+    0x81, 0x02,       //   INPUT (Data,Var,Abs)
+    0x05, 0x09,       //   USAGE_PAGE (Button)
+    0x09, 0x01,       //   USAGE (Button 1)
+    0x25, 0x01,       //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,       //   REPORT_SIZE (1)
+    0x95, 0x01,       //   REPORT_COUNT (1)
+    0x81, 0x02,       //   INPUT (Data,Var,Abs)
+    0x95, 0x07,       //   REPORT_COUNT (7)
+    0x81, 0x03,       //   INPUT (Cnst,Var,Abs)
+    0x05, 0x0D,       //   USAGE_PAGE (Digitizers)
+    0x85, 0x02,       //   REPORT_ID (2)
+    0x09, 0x55,       //   USAGE (Contact Count Maximum)
+    0x09, 0x59,       //   USAGE (Pad Type)
+    0x75, 0x04,       //   REPORT_SIZE (4)
+    0x95, 0x02,       //   REPORT_COUNT (2)
+    0x25, 0x0F,       //   LOGICAL_MAXIMUM (15)
+    0xB1, 0x02,       //   FEATURE (Data,Var,Abs)
+    0x06, 0x00, 0xFF, //   USAGE_PAGE (Vendor Defined)
+    0x85, 0x03,       //   REPORT_ID (3)
+    0x09, 0xC5,       //   USAGE (Vendor Usage 0xC5)
+    0x15, 0x00,       //   LOGICAL_MINIMUM (0)
+    0x26, 0xFF, 0x00, //   LOGICAL_MAXIMUM (255)
+    0x75, 0x08,       //   REPORT_SIZE (8)
+    0x96, 0x00, 0x01, //   REPORT_COUNT (256)
+    0xB1, 0x02,       //   FEATURE (Data,Var,Abs)
+    0xC0,             // END_COLLECTION
+    0x05, 0x0D,       // USAGE_PAGE (Digitizers)
+    0x09, 0x0E,       // USAGE (Configuration)
+    0xA1, 0x01,       // COLLECTION (Application)
+    0x85, 0x04,       //   REPORT_ID (4)
+    0x09, 0x22,       //   USAGE (Finger)
+    0xA1, 0x02,       //   COLLECTION (Logical)
+    0x09, 0x52,       //     USAGE (Input Mode)
+    0x15, 0x00,       //     LOGICAL_MINIMUM (0)
+    0x25, 0x0A,       //     LOGICAL_MAXIMUM (10)
+    0x75, 0x08,       //     REPORT_SIZE (8)
+    0x95, 0x01,       //     REPORT_COUNT (1)
+    0xB1, 0x02,       //     FEATURE (Data,Var,Abs)
+    0xC0,             //   END_COLLECTION
+    0x09, 0x22,       //   USAGE (Finger)
+    0xA1, 0x00,       //   COLLECTION (Physical)
+    0x85, 0x05,       //     REPORT_ID (5)
+    0x09, 0x57,       //     USAGE (Surface Switch)
+    0x09, 0x58,       //     USAGE (Button Switch)
+    0x75, 0x01,       //     REPORT_SIZE (1)
+    0x95, 0x02,       //     REPORT_COUNT (2)
+    0x25, 0x01,       //     LOGICAL_MAXIMUM (1)
+    0xB1, 0x02,       //     FEATURE (Data,Var,Abs)
+    0x95, 0x06,       //     REPORT_COUNT (6)
+    0xB1, 0x03,       //     FEATURE (Cnst,Var,Abs)
+    0xC0,             //   END_COLLECTION
+    0xC0,             // END_COLLECTION
+};
+
+#undef MOCNORDIC_PTP_FINGER
+
+} /* MOCNordicHost */
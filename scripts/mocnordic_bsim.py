@@ -0,0 +1,118 @@
+"""
+Multi peripheral scaling bench in BabbleSim (CONFIG_MOCNORDIC_BENCH_BSIM).
+
+The dongle (built with bsim.conf) and 1..n simulated HOGP peripherals (bsim/peripheral) share one simulated
+2.4 GHz phy. Every run brings up real links through the unchanged BLE manager, so bring-up time, sustained
+rate and drops are measured with the controller, the connection scheduling and the GATT traffic in the loop.
+Peripherals cycle through --kinds, each kind reports at its own rate.
+
+    west build -b nrf52_bsim -d build-dongle . -- -DCONF_FILE=bsim.conf
+    west build -b nrf52_bsim -d build-sim bsim/peripheral
+    python3 scripts/mocnordic_bsim.py --dongle build-dongle/zephyr/zephyr.exe --peripheral build-sim/zephyr/zephyr.exe \\
+        --max 5 --kinds touchpad,mouse,keyboard -o bsim.json
+
+Prints one "BSIM {json}" line with one run per peripheral count: the dongle's SCALE result, the stats of
+every simulated peripheral and a summary with the slowest bring-up, the delivered rate and the drops.
+"""
+import argparse
+import json
+import os
+import subprocess
+import time
+
+KINDS = ('keyboard', 'mouse', 'touchpad')
+
+
+def last_json(output, prefix):
+    """payload of the last "PREFIX {json}" line"""
+    found = None
+    for line in output.splitlines():
+        index = line.find(prefix + ' {')
+        if index >= 0:
+            try:
+                found = json.loads(line[index + len(prefix) + 1:])
+            except json.JSONDecodeError:
+                pass
+    return found
+
+
+def run(args, count, sim_id):
+    bin_dir = os.path.join(args.bsim_out, 'bin')
+    sim_length_us = (args.ready_ms + args.duration_ms + args.margin_ms) * 1000
+    phy = subprocess.Popen([os.path.join(bin_dir, 'bs_2G4_phy_v1'), f'-s={sim_id}', f'-D={count + 1}',
+                            f'-sim_length={sim_length_us}'], cwd=bin_dir,
+                           stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    env = dict(os.environ, MOCNORDIC_BSIM_PERIPHERALS=str(count))
+    dongle = subprocess.Popen([args.dongle, f'-s={sim_id}', '-d=0'], cwd=bin_dir, env=env,
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    peripherals = []
+    for i in range(count):
+        kind = args.kinds[i % len(args.kinds)]
+        env = dict(os.environ, MOCSIM_KIND=kind, MOCSIM_RATE_HZ=str(args.rates[kind]))
+        peripherals.append(subprocess.Popen([args.peripheral, f'-s={sim_id}', f'-d={i + 1}'], cwd=bin_dir, env=env,
+                                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True))
+
+    dongle_output = dongle.communicate()[0]
+    peripheral_outputs = [p.communicate()[0] for p in peripherals]
+    phy.wait()
+
+    scale = last_json(dongle_output, 'SCALE')
+    sims = [last_json(output, 'SIMPERIPHERAL') for output in peripheral_outputs]
+    result = {'peripherals': count, 'dongle_exit': dongle.returncode, 'scale': scale, 'sim': sims}
+    if scale:
+        ready = [link['ready_ms'] for link in scale['links'] if link['ready_ms'] >= 0]
+        seconds = scale['duration_ms'] / 1000
+        result['summary'] = {
+            'ready': scale['ready'],
+            'bring_up_ms': scale['bring_up_ms'],
+            'max_ready_ms': max(ready) if ready else -1,
+            'notifications_hz': round(scale['notifications'] / seconds),
+            'delivered_hz': round(scale['delivered'] / seconds),
+            'forward_failed': scale['forward_failed'],
+            'age_variance_us2': scale.get('release', {}).get('age_variance_us2'),
+            'sim_failed': sum(sim['failed'] for sim in sims if sim),
+        }
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--dongle', required=True, help='zephyr.exe built with bsim.conf')
+    parser.add_argument('--peripheral', required=True, help='zephyr.exe of bsim/peripheral')
+    parser.add_argument('--bsim-out', default=os.environ.get('BSIM_OUT_PATH', ''), help='BSIM_OUT_PATH')
+    parser.add_argument('--min', type=int, default=1, help='first peripheral count of the sweep')
+    parser.add_argument('--max', type=int, default=5, help='last peripheral count, CONFIG_MOCNORDIC_BENCH_PERIPHERALS at most')
+    parser.add_argument('--kinds', default='touchpad,mouse,keyboard', help='kind of peripheral 0, 1, ... repeated')
+    parser.add_argument('--keyboard-rate', type=int, default=125)
+    parser.add_argument('--mouse-rate', type=int, default=1000)
+    parser.add_argument('--touchpad-rate', type=int, default=133)
+    parser.add_argument('--ready-ms', type=int, default=30000, help='CONFIG_MOCNORDIC_BENCH_BSIM_READY_MS')
+    parser.add_argument('--duration-ms', type=int, default=10000, help='CONFIG_MOCNORDIC_BENCH_DURATION_MS')
+    parser.add_argument('--margin-ms', type=int, default=2000, help='simulated time after the measurement')
+    parser.add_argument('-o', '--output', help='also write the result json here')
+    args = parser.parse_args()
+    if not args.bsim_out:
+        parser.error('set BSIM_OUT_PATH or --bsim-out')
+    args.kinds = args.kinds.split(',')
+    for kind in args.kinds:
+        if kind not in KINDS:
+            parser.error(f'unknown kind {kind}, one of {",".join(KINDS)}')
+    args.rates = {'keyboard': args.keyboard_rate, 'mouse': args.mouse_rate, 'touchpad': args.touchpad_rate}
+
+    result = {'kinds': args.kinds, 'rates_hz': args.rates, 'duration_ms': args.duration_ms, 'runs': []}
+    for count in range(args.min, args.max + 1):
+        start = time.monotonic()
+        outcome = run(args, count, f'mocnordic_{os.getpid()}_{count}')
+        outcome['wall_s'] = round(time.monotonic() - start, 1)
+        result['runs'].append(outcome)
+
+    line = json.dumps(result)
+    print(f'BSIM {line}')
+    if args.output:
+        with open(args.output, 'w') as out:
+            out.write(line + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,150 @@
+"""
+Read and summarize a MOCNordic notification session capture (CONFIG_MOCNORDIC_RECORD).
+
+The capture is either read from a file (native_sim writes one to $MOCNORDIC_RECORD_FILE on exit)
+or pulled from the dongle through the feature report of a vendor (SPP) hidraw interface.
+Reading it from the dongle ends the session, the next one starts with the layouts of the links
+which are up. -o stores the capture for the replay benchmark (CONFIG_MOCNORDIC_BENCH_REPLAY).
+
+    python3 scripts/mocnordic_record.py --hidraw /dev/hidraw3 -o session.mocr
+    python3 scripts/mocnordic_record.py --file session.mocr --json
+"""
+import argparse
+import fcntl
+import json
+import struct
+
+from mocnordic_trace import HIDIOCGFEATURE, SPP_PAYLOAD_SIZE, SPP_REPORT_ID, select_stream
+
+HEADER = struct.Struct('<IHHII')
+RECORD = struct.Struct('<IBBH')
+REPORT_ID = struct.Struct('<HBx')
+MAGIC = 0x52434F4D
+VERSION = 1
+
+RECORDING_STREAM = 2
+
+LINK_UP, REPORT_MAP, REPORT_IDS, NOTIFY, LINK_DOWN = range(1, 6)
+
+
+def read_hidraw(path):
+    data = bytearray()
+    expected = None
+    with open(path, 'rb+', buffering=0) as dev:
+        select_stream(dev, RECORDING_STREAM)
+        while expected is None or len(data) < expected:
+            buf = bytearray(1 + SPP_PAYLOAD_SIZE)
+            buf[0] = SPP_REPORT_ID
+            fcntl.ioctl(dev, HIDIOCGFEATURE(len(buf)), buf, True)
+            data += buf[1:]
+            if expected is None and len(data) >= HEADER.size:
+                expected = HEADER.size + HEADER.unpack_from(data)[3]
+    return bytes(data[:expected])
+
+
+def parse(data):
+    magic, version, record_size, length, dropped = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        raise ValueError(f'not a MOCNordic session capture (magic {magic:#x}, version {version})')
+
+    records = []
+    offset = HEADER.size
+    end = min(len(data), HEADER.size + length)
+    while offset + RECORD.size <= end:
+        timestamp, kind, link, size = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+        records.append((timestamp, kind, link, data[offset:offset + size]))
+        offset += size
+    return records, dropped
+
+
+def percentile(values, p):
+    return values[(len(values) - 1) * p // 100] if values else 0
+
+
+def summarize(records):
+    links = {}
+    # 32 bit us timestamps wrap after ~71 minutes, unwrap against the previous record
+    base = 0
+    previous = None
+    for timestamp, kind, link, payload in records:
+        if previous is not None and timestamp < previous:
+            base += 1 << 32
+        previous = timestamp
+        ts = base + timestamp
+        info = links.setdefault(link, {'interval_us': 0, 'report_map': 0, 'report_ids': {}, 'notifications': 0,
+                                       'handles': {}, 'first_us': None, 'last_us': None, 'gaps': [], 'down': False})
+        if kind == LINK_UP and len(payload) >= 4:
+            info['interval_us'] = struct.unpack_from('<I', payload)[0]
+        elif kind == REPORT_MAP:
+            info['report_map'] = len(payload)
+        elif kind == REPORT_IDS:
+            for offset in range(0, len(payload) - REPORT_ID.size + 1, REPORT_ID.size):
+                handle, report_id = REPORT_ID.unpack_from(payload, offset)
+                info['report_ids'][handle] = report_id
+        elif kind == NOTIFY and len(payload) >= 2:
+            handle = struct.unpack_from('<H', payload)[0]
+            info['handles'][handle] = info['handles'].get(handle, 0) + 1
+            info['notifications'] += 1
+            if info['last_us'] is not None:
+                info['gaps'].append(ts - info['last_us'])
+            if info['first_us'] is None:
+                info['first_us'] = ts
+            info['last_us'] = ts
+        elif kind == LINK_DOWN:
+            info['down'] = True
+
+    summary = {}
+    for link, info in sorted(links.items()):
+        gaps = sorted(info['gaps'])
+        span = (info['last_us'] - info['first_us']) if info['notifications'] > 1 else 0
+        summary[link] = {
+            'interval_us': info['interval_us'],
+            'report_map_bytes': info['report_map'],
+            'report_ids': {f'{handle:#06x}': report_id for handle, report_id in sorted(info['report_ids'].items())},
+            'notifications': info['notifications'],
+            'rate_hz': round((info['notifications'] - 1) * 1e6 / span, 1) if span else 0,
+            'handles': {f'{handle:#06x}': count for handle, count in sorted(info['handles'].items())},
+            'gap_us': {'p50': percentile(gaps, 50), 'p90': percentile(gaps, 90), 'p99': percentile(gaps, 99),
+                       'max': gaps[-1] if gaps else 0},
+            'link_down': info['down'],
+        }
+    return summary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--file', help='capture written by native_sim or a previous -o run')
+    source.add_argument('--hidraw', help='hidraw node of a vendor (SPP) interface of the dongle')
+    parser.add_argument('-o', '--output', help='store the binary capture for replay')
+    parser.add_argument('--json', action='store_true', help='print the summary as json')
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+    else:
+        data = read_hidraw(args.hidraw)
+
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(data)
+
+    records, dropped = parse(data)
+    summary = summarize(records)
+    if args.json:
+        print(json.dumps({'records': len(records), 'dropped': dropped, 'links': summary}, indent=2))
+        return
+
+    print(f'{len(records)} records, {dropped} dropped')
+    print(f'{"link":>4} {"interval":>9} {"map":>5} {"ids":>4} {"notify":>7} {"rate_hz":>8} '
+          f'{"gap_p50":>8} {"gap_p99":>8} {"gap_max":>8}')
+    for link, info in summary.items():
+        gap = info['gap_us']
+        print(f'{link:>4} {info["interval_us"]:>9} {info["report_map_bytes"]:>5} {len(info["report_ids"]):>4} '
+              f'{info["notifications"]:>7} {info["rate_hz"]:>8} {gap["p50"]:>8} {gap["p99"]:>8} {gap["max"]:>8}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,89 @@
+"""
+Turn the "PROFILE {json}" line of CONFIG_MOCNORDIC_PROFILER into a stack sizing report.
+
+    python3 scripts/mocnordic_stack_report.py console.log
+    ./build/zephyr/zephyr.exe | python3 scripts/mocnordic_stack_report.py --conf stacks.conf
+
+Prints cpu share and stack peak of every thread per scenario, the suggested size of every stack and
+a conf fragment for the stacks which have a Kconfig option. Peaks are only as good as the scenarios
+which ran, run bring-up, sustained forwarding and re-enumeration before tightening anything.
+"""
+import argparse
+import json
+import sys
+
+# thread name -> option sizing its stack
+STACK_OPTIONS = {
+    'main': 'CONFIG_MAIN_STACK_SIZE',
+    'sysworkq': 'CONFIG_SYSTEM_WORKQUEUE_STACK_SIZE',
+    'usbworkq': 'CONFIG_USB_WORKQUEUE_STACK_SIZE',
+    'usbd_workq': 'CONFIG_USB_NRFX_WORK_QUEUE_STACK_SIZE',
+    'BT RX WQ': 'CONFIG_BT_RX_STACK_SIZE',
+    'BT TX': 'CONFIG_BT_HCI_TX_STACK_SIZE',
+    'BT LW WQ': 'CONFIG_BT_LONG_WQ_STACK_SIZE',
+    'MOCDeferredLogThread': 'CONFIG_MOCNORDIC_DEFERRED_LOG_STACK_SIZE',
+    'idle': 'CONFIG_IDLE_STACK_SIZE',
+    'logging': 'CONFIG_LOG_PROCESS_THREAD_STACK_SIZE',
+}
+
+# sized in code, not by Kconfig
+STACK_SOURCES = {
+    'ZWorkControl': 'ZWorkControlStackArea in MOCZephyrType.h',
+}
+
+
+def load(stream):
+    profile = None
+    for line in stream:
+        start = line.find('PROFILE {')
+        if start >= 0:
+            profile = json.loads(line[start + len('PROFILE '):])
+    if profile is None:
+        raise SystemExit('no PROFILE line found')
+    return profile
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('log', nargs='?', help='console output, stdin if omitted')
+    parser.add_argument('--conf', help='write the suggested stack options here')
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, errors='replace') as stream:
+            profile = load(stream)
+    else:
+        profile = load(sys.stdin)
+
+    for name, scenario in profile['scenarios'].items():
+        if not scenario['runs']:
+            print(f'{name}: not run')
+            continue
+        state = ', still open' if scenario['active'] else ''
+        print(f'{name}: {scenario["runs"]} run(s), {scenario["wall_ms"]} ms{state}')
+        for thread, usage in sorted(scenario['threads'].items(), key=lambda item: -item[1]['cpu_permille']):
+            print(f'    {thread:<24} cpu {usage["cpu_permille"] / 10:5.1f} %   stack peak since boot {usage["stack_peak_since_boot"]:6}')
+
+    print()
+    print(f'{"thread":<24} {"size":>6} {"peak":>6} {"suggested":>9}  option')
+    fragment = []
+    for thread in profile['threads']:
+        name = thread['name']
+        option = STACK_OPTIONS.get(name) or STACK_SOURCES.get(name, '')
+        print(f'{name:<24} {thread["stack_size"]:6} {thread["stack_peak"]:6} {thread["suggested"]:9}  {option}')
+        if name in STACK_OPTIONS and thread['suggested'] < thread['stack_size']:
+            fragment.append(f'{STACK_OPTIONS[name]}={thread["suggested"]}')
+
+    print()
+    print(f'reclaimable with {profile["margin_percent"]} % headroom: {profile["reclaimable"]} bytes')
+    if profile['untracked']:
+        print(f'{profile["untracked"]} thread(s) not tracked, raise CONFIG_MOCNORDIC_PROFILER_THREADS')
+
+    if args.conf:
+        with open(args.conf, 'w') as out:
+            out.write(f'# suggested by scripts/mocnordic_stack_report.py, {profile["margin_percent"]} % over the measured peak\n')
+            out.write('\n'.join(fragment) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,174 @@
+"""
+Convert a MOCNordic event trace dump to Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+
+The dump is either read from a file (native_sim writes one to $MOCNORDIC_TRACE_FILE on exit)
+or pulled from the dongle through the feature report of a vendor (SPP) hidraw interface.
+
+    python3 scripts/mocnordic_trace.py --file trace.bin -o trace.json
+    python3 scripts/mocnordic_trace.py --hidraw /dev/hidraw3 -o trace.json
+"""
+import argparse
+import fcntl
+import json
+import struct
+
+HEADER = struct.Struct('<IHHII')
+RECORD = struct.Struct('<IBBH')
+MAGIC = 0x54434F4D
+VERSION = 1
+
+SPP_REPORT_ID = 0x0C
+SPP_PAYLOAD_SIZE = 63
+# feature report [SPP_REPORT_ID, stream] picks what the vendor feature reads return
+TRACE_STREAM = 1
+
+NO_LINK = 0xFF
+
+EVENTS = {
+    1: 'ScanMatch',
+    2: 'Connected',
+    3: 'SecurityChanged',
+    4: 'PairingComplete',
+    5: 'DiscoveryStart',
+    6: 'DiscoveryComplete',
+    7: 'Subscribe',
+    8: 'ReportMapStart',
+    9: 'ReportMapDone',
+    10: 'UsbEnumerate',
+    11: 'UsbConfigured',
+    12: 'FirstReport',
+    13: 'NotifyRx',
+    14: 'UsbWrite',
+    15: 'Disconnected',
+    16: 'ScanDuty',
+    17: 'InvalidTransition',
+    18: 'UsbSuspend',
+    19: 'UsbResume',
+    20: 'RemoteWakeup',
+    21: 'OutputWrite',
+    22: 'LinkFast',
+}
+
+# bring-up phases, each one spans from its start event to the next lifecycle event of the same link
+LIFECYCLE = ('Connected', 'SecurityChanged', 'PairingComplete', 'DiscoveryStart', 'DiscoveryComplete',
+             'ReportMapStart', 'ReportMapDone', 'UsbEnumerate', 'FirstReport', 'Disconnected')
+
+
+def HIDIOCGFEATURE(length):
+    # _IOC(_IOC_WRITE | _IOC_READ, 'H', 0x07, length)
+    return (3 << 30) | (length << 16) | (ord('H') << 8) | 0x07
+
+
+def HIDIOCSFEATURE(length):
+    # _IOC(_IOC_WRITE | _IOC_READ, 'H', 0x06, length)
+    return (3 << 30) | (length << 16) | (ord('H') << 8) | 0x06
+
+
+def select_stream(dev, stream):
+    try:
+        fcntl.ioctl(dev, HIDIOCSFEATURE(2), bytes([SPP_REPORT_ID, stream]))
+    except OSError:
+        # firmware without the recorder only streams the trace
+        if stream != TRACE_STREAM:
+            raise
+
+
+def read_hidraw(path):
+    data = bytearray()
+    expected = None
+    with open(path, 'rb+', buffering=0) as dev:
+        select_stream(dev, TRACE_STREAM)
+        while expected is None or len(data) < expected:
+            buf = bytearray(1 + SPP_PAYLOAD_SIZE)
+            buf[0] = SPP_REPORT_ID
+            fcntl.ioctl(dev, HIDIOCGFEATURE(len(buf)), buf, True)
+            data += buf[1:]
+            if expected is None and len(data) >= HEADER.size:
+                _, _, record_size, count, _ = HEADER.unpack_from(data)
+                expected = HEADER.size + record_size * count
+    return bytes(data[:expected])
+
+
+def parse(data):
+    magic, version, record_size, count, lost = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        raise ValueError(f'not a MOCNordic trace dump (magic {magic:#x}, version {version})')
+
+    records = []
+    offset = HEADER.size
+    for _ in range(count):
+        timestamp, event, link, arg = RECORD.unpack_from(data, offset)
+        records.append((timestamp, EVENTS.get(event, f'event{event}'), link, arg))
+        offset += RECORD.size
+    return records, lost
+
+
+def to_chrome(records):
+    events = []
+    # 32 bit us timestamps wrap after ~71 minutes, unwrap against the previous record
+    base = 0
+    previous = None
+    phase_start = {}
+    pending_rx = {}
+    names = {}
+
+    for timestamp, name, link, arg in records:
+        if previous is not None and timestamp < previous:
+            base += 1 << 32
+        previous = timestamp
+        ts = base + timestamp
+        tid = link
+        if tid not in names:
+            names[tid] = 'global' if link == NO_LINK else f'link {link}'
+
+        events.append({'name': name, 'ph': 'i', 's': 't', 'ts': ts, 'pid': 0, 'tid': tid, 'args': {'arg': arg}})
+
+        if name in LIFECYCLE and link != NO_LINK:
+            start = phase_start.get(link)
+            if start:
+                events.append({'name': start[1], 'ph': 'X', 'ts': start[0], 'dur': ts - start[0],
+                               'pid': 0, 'tid': tid, 'cat': 'bring-up'})
+            phase_start[link] = (ts, name)
+
+        if name == 'NotifyRx':
+            pending_rx[link] = ts
+        elif name == 'UsbWrite' and link in pending_rx:
+            start = pending_rx.pop(link)
+            events.append({'name': 'forward', 'ph': 'X', 'ts': start, 'dur': ts - start,
+                           'pid': 1, 'tid': tid, 'cat': 'forward', 'args': {'result': arg}})
+
+    for pid, process in ((0, 'lifecycle'), (1, 'forwarding')):
+        events.append({'name': 'process_name', 'ph': 'M', 'pid': pid, 'args': {'name': process}})
+        for tid, name in names.items():
+            events.append({'name': 'thread_name', 'ph': 'M', 'pid': pid, 'tid': tid, 'args': {'name': name}})
+
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a MOCNordic event trace dump to Chrome trace JSON')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--file', help='binary dump written by native_sim or a previous --raw run')
+    source.add_argument('--hidraw', help='hidraw node of a vendor (SPP) interface of the dongle')
+    parser.add_argument('-o', '--output', default='trace.json', help='Chrome trace JSON output')
+    parser.add_argument('--raw', help='also store the binary dump')
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+    else:
+        data = read_hidraw(args.hidraw)
+
+    if args.raw:
+        with open(args.raw, 'wb') as f:
+            f.write(data)
+
+    records, lost = parse(data)
+    with open(args.output, 'w') as f:
+        json.dump(to_chrome(records), f)
+    print(f'{len(records)} records, {lost} overwritten, written to {args.output}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,274 @@
+"""
+Host side of the USB/IP integration benchmark (CONFIG_MOCNORDIC_BENCH_USBIP).
+
+The native_sim build exports the dongle to the local kernel over USB/IP. Synthetic peripheral reports
+carrying a sequence number and a host timestamp are injected through output reports of the vendor
+interface and read back from the hidraw node of the interface they are routed to, so the numbers
+include the kernel USB/IP, usbhid and hidraw path exactly as an application sees it.
+
+    ./build/zephyr/zephyr.exe &
+    sudo modprobe vhci-hcd
+    sudo python3 scripts/mocnordic_usbip.py --attach --rate 500 --duration 5 --reenumerate 5 -o usbip.json
+
+Prints one "USBIP {json}" line: enumeration time, echo round trip, per interface latency percentiles,
+throughput, losses, re-enumeration times and the dongle's own command counters.
+"""
+import argparse
+import glob
+import json
+import os
+import re
+import select
+import struct
+import subprocess
+import threading
+import time
+
+# must match MOCNordicBench::VendorCommand
+CMD_INJECT = 0x01
+CMD_ECHO = 0x02
+CMD_ENUMERATE = 0x03
+CMD_STATS = 0x04
+
+SPP_REPORT_ID = 0x0C
+SPP_PAYLOAD_SIZE = 63
+BENCH_REPORT_ID = 0x01
+
+# sequence number, host timestamp in us
+STAMP = struct.Struct('<II')
+
+INTERFACE = re.compile(r':1\.(\d+)/0003:([0-9A-F]{4}):([0-9A-F]{4})\.')
+
+
+def now_us():
+    return time.monotonic_ns() // 1000
+
+
+def hidraw_nodes(vid, pid):
+    """interface number -> /dev/hidrawN of the dongle"""
+    nodes = {}
+    for path in glob.glob('/sys/class/hidraw/hidraw*'):
+        match = INTERFACE.search(os.path.realpath(os.path.join(path, 'device')))
+        if match and int(match.group(2), 16) == vid and int(match.group(3), 16) == pid:
+            nodes[int(match.group(1))] = os.path.join('/dev', os.path.basename(path))
+    return nodes
+
+
+def wait_nodes(vid, pid, count, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        nodes = hidraw_nodes(vid, pid)
+        if len(nodes) >= count and all(os.access(node, os.R_OK | os.W_OK) for node in nodes.values()):
+            return nodes
+        time.sleep(0.001)
+    raise TimeoutError(f'{count} hidraw nodes of {vid:04x}:{pid:04x} not up after {timeout} s')
+
+
+def percentiles(values):
+    if not values:
+        return {'count': 0}
+    values = sorted(values)
+    pick = lambda p: values[(len(values) - 1) * p // 100]
+    return {'count': len(values), 'p50': pick(50), 'p90': pick(90), 'p99': pick(99), 'max': values[-1]}
+
+
+class Dongle:
+    def __init__(self, nodes, control):
+        self.nodes = nodes
+        self.control = os.open(nodes[control], os.O_RDWR)
+        self.lock = threading.Lock()
+
+    def close(self):
+        os.close(self.control)
+
+    def command(self, command, payload=b''):
+        report = bytes([SPP_REPORT_ID, command]) + payload
+        report += bytes(1 + SPP_PAYLOAD_SIZE - len(report))
+        with self.lock:
+            os.write(self.control, report)
+
+    def reply(self, command, timeout=1.0):
+        deadline = time.monotonic() + timeout
+        while True:
+            left = deadline - time.monotonic()
+            if left <= 0 or not select.select([self.control], [], [], left)[0]:
+                raise TimeoutError(f'no reply to vendor command {command:#x}')
+            report = os.read(self.control, 1 + SPP_PAYLOAD_SIZE)
+            if len(report) > 1 and report[0] == SPP_REPORT_ID and report[1] == command:
+                return report[2:]
+
+    def inject(self, peripheral, payload):
+        self.command(CMD_INJECT, bytes([peripheral, len(payload)]) + payload)
+
+
+def echo_rtt(dongle, count):
+    rtt = []
+    for seq in range(count):
+        sent = now_us()
+        dongle.command(CMD_ECHO, STAMP.pack(seq, sent & 0xFFFFFFFF))
+        while True:
+            got_seq, _ = STAMP.unpack_from(dongle.reply(CMD_ECHO))
+            if got_seq == seq:
+                break
+        rtt.append(now_us() - sent)
+    return percentiles(rtt)
+
+
+class Reader(threading.Thread):
+    """reads one bench interface, latency from the timestamp the report carries"""
+
+    def __init__(self, node, report_size):
+        super().__init__(daemon=True)
+        self.fd = os.open(node, os.O_RDONLY | os.O_NONBLOCK)
+        self.report_size = report_size
+        self.latency = []
+        self.seen = set()
+        self.reordered = 0
+        self.last_seq = -1
+        self.running = True
+
+    def run(self):
+        while self.running:
+            if not select.select([self.fd], [], [], 0.1)[0]:
+                continue
+            try:
+                report = os.read(self.fd, 1 + self.report_size)
+            except BlockingIOError:
+                continue
+            received = now_us()
+            if len(report) < 1 + STAMP.size or report[0] != BENCH_REPORT_ID:
+                continue
+            seq, stamp = STAMP.unpack_from(report, 1)
+            self.latency.append((received - stamp) & 0xFFFFFFFF)
+            self.seen.add(seq)
+            if seq < self.last_seq:
+                self.reordered += 1
+            self.last_seq = seq
+
+    def stop(self):
+        self.running = False
+        self.join()
+        os.close(self.fd)
+
+
+def inject_run(dongle, interfaces, report_size, rate, duration):
+    readers = {index: Reader(dongle.nodes[index], report_size) for index in interfaces}
+    for reader in readers.values():
+        reader.start()
+
+    period = 1.0 / rate
+    sent = 0
+    padding = bytes(report_size - STAMP.size)
+    start = time.monotonic()
+    while True:
+        deadline = start + sent * period
+        if deadline - start >= duration:
+            break
+        delay = deadline - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+        for index in interfaces:
+            dongle.inject(index, STAMP.pack(sent, now_us() & 0xFFFFFFFF) + padding)
+        sent += 1
+    elapsed = time.monotonic() - start
+
+    # last reports still in flight
+    time.sleep(0.2)
+    result = {}
+    for index, reader in readers.items():
+        reader.stop()
+        result[str(index)] = {
+            'sent': sent,
+            'received': len(reader.seen),
+            'lost': sent - len(reader.seen),
+            'reordered': reader.reordered,
+            'throughput_rps': round(len(reader.seen) / elapsed),
+            'latency_us': percentiles(reader.latency),
+        }
+    return result
+
+
+def reenumerate(dongle, args, interface, expected):
+    """time until every node is back and the re-enumerated interface delivers a report"""
+    old = dongle.nodes[interface]
+    start = now_us()
+    dongle.command(CMD_ENUMERATE, bytes([interface]))
+    dongle.close()
+
+    # the whole composite device goes away, wait for the nodes to drop before waiting for them again
+    deadline = time.monotonic() + args.timeout
+    while hidraw_nodes(args.vid, args.pid).get(interface) == old and time.monotonic() < deadline:
+        time.sleep(0.001)
+    nodes = wait_nodes(args.vid, args.pid, expected, args.timeout)
+    enumerated = now_us() - start
+
+    dongle = Dongle(nodes, args.control)
+    reader = Reader(nodes[interface], args.report_size)
+    reader.start()
+    while not reader.seen and now_us() - start < args.timeout * 1000000:
+        dongle.inject(interface, STAMP.pack(0, now_us() & 0xFFFFFFFF) + bytes(args.report_size - STAMP.size))
+        time.sleep(0.001)
+    first_report = now_us() - start
+    reader.stop()
+    return dongle, {'enumerated_us': enumerated, 'first_report_us': first_report}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--attach', action='store_true', help='run usbip attach and time the enumeration')
+    parser.add_argument('--remote', default='127.0.0.1')
+    parser.add_argument('--busid', default='1-1')
+    parser.add_argument('--vid', type=lambda x: int(x, 0), default=0x1529, help='CONFIG_USB_DEVICE_VID')
+    parser.add_argument('--pid', type=lambda x: int(x, 0), default=0x2061, help='CONFIG_USB_DEVICE_PID')
+    parser.add_argument('--peripherals', type=int, default=3, help='CONFIG_MOCNORDIC_BENCH_PERIPHERALS')
+    parser.add_argument('--control', type=int, default=4, help='vendor interface, CONFIG_USB_HID_DEVICE_COUNT - 1')
+    parser.add_argument('--report-size', type=int, default=8, help='CONFIG_MOCNORDIC_BENCH_REPORT_SIZE')
+    parser.add_argument('--rate', type=float, default=500, help='reports per second per interface')
+    parser.add_argument('--duration', type=float, default=5)
+    parser.add_argument('--echo', type=int, default=200, help='echo round trips for the transport baseline')
+    parser.add_argument('--reenumerate', type=int, default=0, help='deviceUnitInit cycles to time')
+    parser.add_argument('--timeout', type=float, default=10)
+    parser.add_argument('-o', '--output', help='also write the result json here')
+    args = parser.parse_args()
+    if args.report_size < STAMP.size:
+        parser.error(f'report size must hold the {STAMP.size} byte stamp')
+
+    expected = args.control + 1
+    result = {'rate_hz': args.rate, 'duration_s': args.duration, 'report_size': args.report_size}
+
+    if args.attach:
+        start = now_us()
+        subprocess.run(['usbip', 'attach', '-r', args.remote, '-b', args.busid], check=True)
+        nodes = wait_nodes(args.vid, args.pid, expected, args.timeout)
+        result['enumeration_us'] = now_us() - start
+    else:
+        nodes = wait_nodes(args.vid, args.pid, expected, args.timeout)
+
+    dongle = Dongle(nodes, args.control)
+    result['echo_rtt_us'] = echo_rtt(dongle, args.echo)
+    result['interfaces'] = inject_run(dongle, range(args.peripherals), args.report_size, args.rate, args.duration)
+
+    cycles = []
+    for n in range(args.reenumerate):
+        dongle, cycle = reenumerate(dongle, args, n % args.peripherals, expected)
+        cycles.append(cycle)
+    if cycles:
+        result['reenumeration'] = {
+            'enumerated_us': percentiles([cycle['enumerated_us'] for cycle in cycles]),
+            'first_report_us': percentiles([cycle['first_report_us'] for cycle in cycles]),
+        }
+
+    dongle.command(CMD_STATS)
+    injected, forwarded, failed, dropped = struct.unpack_from('<IIII', dongle.reply(CMD_STATS))
+    result['dongle'] = {'injected': injected, 'forwarded': forwarded, 'failed': failed, 'dropped': dropped}
+    dongle.close()
+
+    line = json.dumps(result)
+    print(f'USBIP {line}')
+    if args.output:
+        with open(args.output, 'w') as out:
+            out.write(line + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,95 @@
+"""
+RAM used by every subsystem of the dongle, from the symbols of the linked elf.
+
+    python3 scripts/ram_budget.py build/zephyr/zephyr.elf
+    python3 scripts/ram_budget.py build/zephyr/zephyr.elf --nm arm-zephyr-eabi-nm --output ram_budget.json
+
+Runs after every firmware build (extra_post_build_commands in CMakeLists.txt) and writes the
+table to the console and ram_budget.json to the build directory. Only .data, .bss and .noinit
+symbols count, thread stacks are their own group so the capacities in Kconfig menu "Capacities"
+can be weighed against CONFIG_*_STACK_SIZE.
+"""
+import argparse
+import json
+import re
+import subprocess
+import sys
+
+# first match wins, checked against "source path:symbol"
+GROUPS = [
+    ('stacks', re.compile(r'stack|_k_thread_stack|z_interrupt_stacks|z_main_stack|z_idle_stacks', re.I)),
+    ('ble', re.compile(r'MOCNordicBLE/|MOCNordicBLEMgr|MOCNordicScanMgr|PeripheralUnit')),
+    ('hid', re.compile(r'MOCNordicHID/|MOCNordicHIDevice|MOCNordicUsbLayout|ReportDesc|KeyboardStage|PTPTouchpad')),
+    ('router', re.compile(r'MOCNordicRouter')),
+    ('trace', re.compile(r'MOCNordicTrace')),
+    ('recorder', re.compile(r'MOCNordicRecorder')),
+    ('logger', re.compile(r'MOCNordicLogger|MOCDeferredLog')),
+    ('profiler', re.compile(r'MOCNordicProfiler')),
+    ('bench', re.compile(r'MOCNordicBench')),
+    ('work queues', re.compile(r'ZWorkControl|ZPoolQueue|MOCZephyrType')),
+    ('app', re.compile(r'src/main\.cpp|MOCNordic')),
+    ('bluetooth', re.compile(r'subsys/bluetooth|/bt_|\bbt_|hci|mpsl|sdc_|ll_', re.I)),
+    ('usb', re.compile(r'subsys/usb|usb|nrfx_usbd', re.I)),
+    ('kernel', re.compile(r'zephyr/kernel/|zephyr/arch/|\bz_|_kernel|\bk_', re.I)),
+]
+
+# nm types of data in RAM
+RAM_TYPES = set('bBdDsSvV')
+
+
+def symbols(elf, nm):
+    out = subprocess.run([nm, '-S', '-C', '-l', '--size-sort', elf], check=True, capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        # address size type name[\tfile:line]
+        parts = line.split(None, 3)
+        if len(parts) < 4 or parts[2] not in RAM_TYPES:
+            continue
+        name, _, source = parts[3].partition('\t')
+        yield name, int(parts[1], 16), source
+
+
+def group_of(name, source):
+    key = f'{source}:{name}'
+    for group, pattern in GROUPS:
+        if pattern.search(key):
+            return group
+    return 'other'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf')
+    parser.add_argument('--nm', default='nm', help='nm of the toolchain which linked the elf')
+    parser.add_argument('--output', help='write the budget as json here')
+    parser.add_argument('--top', type=int, default=5, help='largest symbols listed per group')
+    args = parser.parse_args()
+
+    budget = {group: {'bytes': 0, 'symbols': []} for group, _ in GROUPS}
+    budget['other'] = {'bytes': 0, 'symbols': []}
+    for name, size, source in symbols(args.elf, args.nm):
+        entry = budget[group_of(name, source)]
+        entry['bytes'] += size
+        entry['symbols'].append((size, name))
+
+    total = sum(entry['bytes'] for entry in budget.values())
+    print(f'{"group":<12} {"bytes":>8} {"share":>6}  largest')
+    for group, entry in budget.items():
+        entry['symbols'].sort(reverse=True)
+        largest = ', '.join(f'{name} {size}' for size, name in entry['symbols'][:args.top])
+        share = entry['bytes'] * 100 / total if total else 0
+        print(f'{group:<12} {entry["bytes"]:8} {share:5.1f}%  {largest}')
+    print(f'{"total":<12} {total:8}')
+
+    if args.output:
+        report = {
+            'total': total,
+            'groups': {group: {'bytes': entry['bytes'],
+                               'largest': [{'name': name, 'bytes': size} for size, name in entry['symbols'][:args.top]]}
+                       for group, entry in budget.items()},
+        }
+        with open(args.output, 'w') as out:
+            json.dump(report, out, indent=2)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
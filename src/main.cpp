@@ -16,10 +16,29 @@
 #include <MOCNordic/MOCNordicBLEMgr.h>
 #include <MOCNordic/MOCNordicLogger.h>
 #include <MOCNordic/MOCNordicHIDevice.h>
+#include <MOCNordic/MOCNordicRouter.h>
+#include <MOCNordic/MOCNordicProfiler.h>
 #include <dk_buttons_and_leds.h>
+#if defined(CONFIG_MOCNORDIC_BENCH)
+#include <MOCNordic/MOCNordicBench.h>
+#if defined(CONFIG_ARCH_POSIX)
+#include <posix_board_if.h>
+#endif
+#endif
 
 LOG_MODULE_REGISTER(main, CONFIG_LOG_DEFAULT_LEVEL);
 
+/* peripheral index -> usb interfaces, peripherals get their index in connect order below */
+constexpr MOCNordic::Route routes[] = {
+    /* touchpad */
+    {0, MOCNordic::Route::anyReport, BIT(0)},
+    /* mouse */
+    {1, MOCNordic::Route::anyReport, BIT(1)},
+    /* keyboard */
+    {2, MOCNordic::Route::anyReport, BIT(2)},
+};
+static_assert(MOCNordic::MOCNordicRouter::validRoutes(routes), "route outside of the paired peripherals or usb interfaces");
+
 class BLEDevice {
 public:
     explicit BLEDevice(std::string_view deviceName) : name(deviceName)
@@ -42,19 +61,17 @@ public:
             desc.clear();
             desc.insert(data, length, MOCNordic::ReportDescType::UNKNOWN);
             
-            
-            MOCNordic::MOCNordicHIDevice::deviceUnitInit(index, desc);
+            /* every interface the peripheral is routed to enumerates with its report map */
+            uint32_t interfaces = MOCNordic::MOCNordicRouter::interfacesOf(index);
+            if(!interfaces)
+                interfaces = BIT(index);
+            for(uint8_t i = 0; interfaces; i++, interfaces >>= 1) {
+                if(interfaces & 0x01)
+                    MOCNordic::MOCNordicHIDevice::deviceUnitInit(i, desc, index, MOCNordic::MOCNordicBLEMgr::reportMapStream(index));
+            }
             k_sem_give(&connectSem);
             
         });
-
-        MOCNordic::MOCNordicBLEMgr::registerNotifyToIndex(index, [index](uint8_t *data, uint32_t length){
-            if(!length || !data)
-                return;
-
-            MOCNordic::MOCNordicHIDevice::writeToDevice(index, data, length);
-
-        });
     }
 
     void waitForConnect(uint32_t timeoutMs)
@@ -71,6 +88,23 @@ private:
 
 int main(void)
 {
+#if defined(CONFIG_MOCNORDIC_BENCH)
+#if defined(CONFIG_MOCNORDIC_BENCH_USBIP)
+    int benchErr = MOCNordic::MOCNordicBench::serve();
+#elif defined(CONFIG_MOCNORDIC_BENCH_REPLAY)
+    int benchErr = MOCNordic::MOCNordicBench::replay();
+#elif defined(CONFIG_MOCNORDIC_BENCH_BSIM)
+    int benchErr = MOCNordic::MOCNordicBench::scale();
+#elif defined(CONFIG_MOCNORDIC_BENCH_PRIORITY)
+    int benchErr = MOCNordic::MOCNordicBench::priority();
+#else
+    int benchErr = MOCNordic::MOCNordicBench::run();
+#endif
+#if defined(CONFIG_ARCH_POSIX)
+    posix_exit(benchErr);
+#endif
+    return benchErr;
+#endif
     
     /* int err = dk_buttons_init(button_handler);
     
@@ -79,6 +113,12 @@ int main(void)
 		return 0;
     } */
 
+    MOC_PROFILE_BEGIN(BringUp);
+
+    if(MOCNordic::MOCNordicRouter::setRoutes(routes)) {
+        DEBUG_PRINT("route table rejected.");
+    }
+
 	if(!MOCNordic::MOCNordicBLEMgr::BLEStackInit()) {
         DEBUG_PRINT("moc nordic ble stack init successful.");
     }
@@ -103,6 +143,14 @@ int main(void)
     keyboardDevice.waitForConnect(2000000);
 
     DEBUG_PRINT("all device connected.");
+    MOC_PROFILE_END(BringUp);
+
+#if defined(CONFIG_MOCNORDIC_PROFILER)
+    MOC_PROFILE_BEGIN(Forwarding);
+    k_msleep(CONFIG_MOCNORDIC_PROFILER_FORWARD_MS);
+    MOC_PROFILE_END(Forwarding);
+    MOCNordic::MOCNordicProfiler::report();
+#endif
     while(1) {
         
         k_msleep(1000000000);